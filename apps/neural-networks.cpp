@@ -1,19 +1,405 @@
 /**
  * @file neural-networks.cpp
  * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
- * @brief This file is the main file for the neural networks project.
- * @version 0.1
- * @date 2023-07-04
+ * @brief This file is the main file for the neural networks project: an
+ *        inference server for the digits. It trains a network, or loads one,
+ *        then answers requests of 784 pixels, one byte each, with the digit
+ *        they show, one byte too. The requests are read from the standard
+ *        input, or from the connections to a Unix-domain socket, and the
+ *        concurrent ones are coalesced into batches. The network can be
+ *        quantized to 8 bits first, and its accuracy compared to the one of
+ *        the float network.
+ * @version 1.0
+ * @date 2023-08-15
  *
  * @copyright Copyright (c) 2023
  *
  */
 
-#include "math.hpp"
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-int main() {
-  custom_math::Matrix *matrix = custom_math::matrix_create(2, 2);
-  custom_math::matrix_print(matrix);
-  custom_math::matrix_delete(matrix);
-  return 0;
-}
\ No newline at end of file
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "server.hpp"
+#include "trainer.hpp"
+
+namespace {
+
+const size_t PIXELS = 784;
+const size_t SIZES[] = {PIXELS, 128, 10};
+
+typedef struct {
+  const char *model;   // The file of the parameters, nullptr for none.
+  size_t epochs;       // The epochs of training, if no model is loaded.
+  const char *socket;  // The path of the socket, nullptr for stdin.
+  double report;       // The seconds between two reports on a socket.
+  bool quantize;       // Whether the 8-bit network answers.
+  neural::ServerOptions server;
+} Options;
+
+volatile sig_atomic_t running = 1;
+
+void stop(int) { running = 0; }
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --model FILE   load the network from FILE, or train it and save "
+          "it there\n"
+          "  --epochs N     the epochs of training (default 1)\n"
+          "  --batch N      the largest batch (default 64)\n"
+          "  --delay MS     the longest wait of a request for a batch, the "
+          "knob between\n"
+          "                 latency and throughput (default 1)\n"
+          "  --socket PATH  serve on a Unix-domain socket instead of the "
+          "standard input\n"
+          "  --report S     the seconds between two reports on a socket "
+          "(default 10)\n"
+          "  --quantize     answer with the network quantized to 8 bits, "
+          "calibrated on the\n"
+          "                 test images, and report the accuracy it loses\n",
+          program);
+}
+
+bool parse(int argc, char **argv, Options *options) {
+  options->model = nullptr;
+  options->epochs = 1;
+  options->socket = nullptr;
+  options->report = 10;
+  options->quantize = false;
+  options->server = neural::server_default_options();
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quantize") == 0) {
+      options->quantize = true;
+      continue;
+    }
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) return false;
+    if (strcmp(argv[i], "--model") == 0)
+      options->model = value;
+    else if (strcmp(argv[i], "--epochs") == 0)
+      options->epochs = strtoul(value, nullptr, 10);
+    else if (strcmp(argv[i], "--batch") == 0)
+      options->server.max_batch = strtoul(value, nullptr, 10);
+    else if (strcmp(argv[i], "--delay") == 0)
+      options->server.max_delay = strtod(value, nullptr) / 1000;
+    else if (strcmp(argv[i], "--socket") == 0)
+      options->socket = value;
+    else if (strcmp(argv[i], "--report") == 0)
+      options->report = strtod(value, nullptr);
+    else
+      return false;
+    i++;
+  }
+
+  if (options->server.queue < 4 * options->server.max_batch)
+    options->server.queue = 4 * options->server.max_batch;
+  return options->report > 0;
+}
+
+// Reports the requests answered since the previous report.
+void report(neural::ServerF *server) {
+  const neural::ServerStats stats = neural::server_stats(server, true);
+  fprintf(stderr,
+          "%zu requests in %zu batches (%.1f per batch), latency p50 %.3f ms, "
+          "p99 %.3f ms, %.0f requests/s\n",
+          stats.requests, stats.batches,
+          stats.batches > 0 ? (double)stats.requests / (double)stats.batches
+                            : 0.,
+          stats.p50 * 1000, stats.p99 * 1000, stats.throughput);
+}
+
+// Trains the network on the training set, or the test set if the former
+// cannot be read.
+bool train(neural::NetworkF *network, size_t epochs) {
+  images::DatasetF *test = images::read_test_dataset<float>();
+  images::DatasetF *dataset = images::read_train_dataset<float>();
+  if (dataset == nullptr) dataset = test;
+  if (dataset == nullptr) return false;
+
+  const size_t batch_size = 64;
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+  neural::OptimizerF *optimizer =
+      neural::optimizer_create<float>(network->size, &options);
+  neural::TrainerF *trainer = neural::trainer_create(network, batch_size);
+  bool trained = optimizer != nullptr && trainer != nullptr;
+
+  for (size_t epoch = 0; trained && epoch < epochs; epoch++) {
+    for (size_t first = 0; first < dataset->count; first += batch_size) {
+      images::BatchF batch = images::dataset_batch(dataset, first, batch_size);
+      neural::trainer_train_batch(trainer, network, &batch, optimizer);
+    }
+    if (test != nullptr)
+      fprintf(stderr, "Epoch %zu, test accuracy %.4f\n", epoch + 1,
+              neural::network_accuracy(network, trainer->workspaces[0], test));
+  }
+
+  neural::trainer_delete(trainer);
+  neural::optimizer_delete(optimizer);
+  if (dataset != test) images::dataset_delete(dataset);
+  images::dataset_delete(test);
+  return trained;
+}
+
+// The samples of the test set classified per second by a forward pass.
+template <typename Forward>
+double classified_per_second(const images::DatasetF *dataset, size_t batch,
+                             Forward forward) {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  for (size_t first = 0; first < dataset->count; first += batch) {
+    const images::BatchF samples = images::dataset_batch(dataset, first, batch);
+    forward(&samples.samples);
+  }
+  return (double)dataset->count /
+         std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Quantizes the network, calibrated on the first samples of the test set,
+// and compares it to the float network over the whole test set.
+neural::QuantizedNetwork *quantize(const neural::NetworkF *network) {
+  const size_t calibration = 1000, batch = 64;
+  images::DatasetF *test = images::read_test_dataset<float>();
+  if (test == nullptr) return nullptr;
+
+  neural::QuantizedNetwork *quantized =
+      neural::quantize_network(network, test, calibration);
+  neural::WorkspaceF *workspace = neural::workspace_create(network, batch);
+  neural::QuantizedWorkspace *quantized_workspace =
+      neural::quantized_workspace_create(quantized, batch);
+
+  if (quantized != nullptr && workspace != nullptr &&
+      quantized_workspace != nullptr) {
+    const double expected =
+        neural::network_accuracy(network, workspace, test);
+    const double accuracy =
+        neural::quantized_accuracy(quantized, quantized_workspace, test);
+    const double speed = classified_per_second(
+        test, batch, [&](const custom_math::MatrixF *samples) {
+          neural::network_forward(network, workspace, samples);
+        });
+    const double quantized_speed = classified_per_second(
+        test, batch, [&](const custom_math::MatrixF *samples) {
+          neural::quantized_forward(quantized, quantized_workspace, samples);
+        });
+
+    size_t parameters = 0;
+    for (size_t l = 0; l < network->count; l++)
+      parameters += (network->layers[l].inputs + 1) *
+                    network->layers[l].outputs * sizeof(float);
+    fprintf(stderr,
+            "Test accuracy %.4f with floats, %.4f with 8 bits (%+.4f), "
+            "parameters of %zu bytes instead of %zu, %.0f samples/s instead "
+            "of %.0f\n",
+            expected, accuracy, accuracy - expected,
+            neural::quantized_size(quantized), parameters, quantized_speed,
+            speed);
+  } else {
+    neural::quantized_delete(quantized);
+    quantized = nullptr;
+  }
+
+  neural::quantized_workspace_delete(quantized_workspace);
+  neural::workspace_delete(workspace);
+  images::dataset_delete(test);
+  return quantized;
+}
+
+// Reads exactly size bytes, false at the end of the stream.
+bool read_fully(int fd, uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t count = read(fd, data, size);
+    if (count <= 0) return false;
+    data += count;
+    size -= (size_t)count;
+  }
+  return true;
+}
+
+void answer_stream(void *context, int label) { putc(label, (FILE *)context); }
+
+void answer_socket(void *context, int label) {
+  // An answer to a client that is gone is dropped.
+  const uint8_t byte = (uint8_t)label;
+  send(*(int *)context, &byte, 1, MSG_NOSIGNAL);
+}
+
+// Serves the requests of the standard input, answered in the same order on
+// answers.
+void serve_stdin(neural::ServerF *server, FILE *answers) {
+  uint8_t pixels[PIXELS];
+  while (running && read_fully(STDIN_FILENO, pixels, PIXELS))
+    neural::server_submit(server, pixels, answer_stream, answers);
+  neural::server_flush(server);
+  fflush(answers);
+  report(server);
+}
+
+typedef struct {
+  int fd;
+  std::atomic<bool> done;
+  std::thread thread;
+} Connection;
+
+// Serves the requests of a connection. The client can send many of them
+// before it reads the answers.
+void serve_connection(neural::ServerF *server, Connection *connection) {
+  uint8_t pixels[PIXELS];
+  while (read_fully(connection->fd, pixels, PIXELS))
+    neural::server_submit(server, pixels, answer_socket, &connection->fd);
+  neural::server_flush(server);
+  connection->done = true;
+}
+
+void close_connection(Connection *connection) {
+  connection->thread.join();
+  close(connection->fd);
+  delete connection;
+}
+
+bool serve_socket(neural::ServerF *server, const char *path,
+                  double interval) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) return false;
+  strcpy(address.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 64) != 0) {
+    if (listener >= 0) close(listener);
+    return false;
+  }
+  fprintf(stderr, "Serving on %s\n", path);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point reported = Clock::now();
+  std::vector<Connection *> connections;
+
+  while (running) {
+    struct pollfd fd = {listener, POLLIN, 0};
+    if (poll(&fd, 1, 100) == 1) {
+      Connection *connection = new Connection();
+      connection->fd = accept(listener, nullptr, nullptr);
+      connection->done = false;
+      if (connection->fd >= 0) {
+        connection->thread =
+            std::thread(serve_connection, server, connection);
+        connections.push_back(connection);
+      } else {
+        delete connection;
+      }
+    }
+
+    // The connections whose clients left.
+    for (size_t i = 0; i < connections.size();) {
+      if (connections[i]->done) {
+        close_connection(connections[i]);
+        connections[i] = connections.back();
+        connections.pop_back();
+      } else {
+        i++;
+      }
+    }
+
+    if (std::chrono::duration<double>(Clock::now() - reported).count() >=
+        interval) {
+      report(server);
+      reported = Clock::now();
+    }
+  }
+
+  close(listener);
+  unlink(path);
+  for (Connection *connection : connections) {
+    shutdown(connection->fd, SHUT_RD);
+    close_connection(connection);
+  }
+  report(server);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, &options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The standard output only carries the answers: the messages of the
+  // library, e.g. while it reads the datasets, go to the standard error.
+  FILE *answers = fdopen(dup(STDOUT_FILENO), "wb");
+  if (answers == nullptr || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) return 1;
+
+  const custom_math::Activation relu = {custom_math::ACTIVATION_RELU, 0,
+                                        false};
+  neural::NetworkF *network = neural::network_create<float>(SIZES, 3, &relu);
+  if (network == nullptr) return 1;
+
+  if (options.model == nullptr ||
+      !neural::network_load(network, options.model)) {
+    if (!train(network, options.epochs)) {
+      fprintf(stderr, "Cannot read the data to train the network\n");
+      neural::network_delete(network);
+      return 1;
+    }
+    if (options.model != nullptr &&
+        !neural::network_save(network, options.model))
+      fprintf(stderr, "Cannot save the network to %s\n", options.model);
+  }
+
+  neural::QuantizedNetwork *quantized = nullptr;
+  if (options.quantize && (quantized = quantize(network)) == nullptr) {
+    fprintf(stderr, "Cannot quantize the network\n");
+    neural::network_delete(network);
+    return 1;
+  }
+
+  neural::ServerF *server =
+      neural::server_create(network, &options.server, quantized);
+  if (server == nullptr) {
+    usage(argv[0]);
+    neural::quantized_delete(quantized);
+    neural::network_delete(network);
+    return 1;
+  }
+
+  // Without SA_RESTART, so that a signal interrupts the reads.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  int status = 0;
+  if (options.socket == nullptr) {
+    serve_stdin(server, answers);
+  } else if (!serve_socket(server, options.socket, options.report)) {
+    fprintf(stderr, "Cannot listen on %s\n", options.socket);
+    status = 1;
+  }
+
+  neural::server_delete(server);
+  neural::quantized_delete(quantized);
+  neural::network_delete(network);
+  fclose(answers);
+  return status;
+}
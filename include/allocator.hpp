@@ -0,0 +1,226 @@
+/**
+ * @file allocator.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the memory allocators that are used
+ *        to create matrices. There are three of them: the heap allocator, a
+ *        bump arena for temporaries and a size-class pool for long-lived
+ *        buffers. All of them report the memory they hold, its peak and the
+ *        bytes in use, and can be capped.
+ * @version 1.0
+ * @date 2023-07-25
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ALLOCATOR_HPP_
+#define ALLOCATOR_HPP_
+
+#include <stddef.h>
+
+#include <atomic>
+
+namespace custom_math {
+
+/**
+ * @brief Every block returned by an allocator is aligned to this many bytes.
+ */
+#define ALLOCATOR_ALIGNMENT 64
+
+typedef struct Allocator Allocator;
+
+/**
+ * @brief The interface shared by all the allocators. A custom allocator
+ *        provides the two functions and calls allocator_reserve and
+ *        allocator_release for the memory it takes from and gives back to
+ *        the system, the bytes in use are counted by allocator_allocate and
+ *        allocator_deallocate.
+ */
+struct Allocator {
+  void *(*allocate)(Allocator *allocator, size_t size);
+  void (*deallocate)(Allocator *allocator, void *pointer, size_t size);
+
+  std::atomic<size_t> current;  // The number of bytes held.
+  std::atomic<size_t> peak;     // The highest value current has reached.
+  size_t limit;                 // The maximum of current, 0 for no limit.
+  std::atomic<size_t> in_use;   // The number of bytes handed out.
+};
+
+/**
+ * @brief This function allocates a block of memory from an allocator.
+ *
+ * @param allocator The allocator.
+ * @param size      The size of the block in bytes.
+ * @return void*    The block, or nullptr if it could not be allocated or if
+ *                  the memory it needs would take the allocator over its
+ *                  limit.
+ */
+void *allocator_allocate(Allocator *allocator, size_t size);
+
+/**
+ * @brief This function gives a block back to the allocator it came from.
+ *
+ * @param allocator The allocator.
+ * @param pointer   The block.
+ * @param size      The size the block was allocated with.
+ */
+void allocator_deallocate(Allocator *allocator, void *pointer, size_t size);
+
+/**
+ * @brief This function records that an allocator takes memory from the
+ *        system, unless it would take it over its limit.
+ *
+ * @param allocator The allocator.
+ * @param size      The number of bytes.
+ * @return bool     Whether the memory can be taken.
+ */
+bool allocator_reserve(Allocator *allocator, size_t size);
+
+/**
+ * @brief This function records that an allocator gives memory back to the
+ *        system.
+ *
+ * @param allocator The allocator.
+ * @param size      The number of bytes.
+ */
+void allocator_release(Allocator *allocator, size_t size);
+
+/**
+ * @brief This function returns the number of bytes an allocator holds: the
+ *        blocks of an arena, the size classes of a pool, in use or free.
+ *
+ * @param allocator The allocator.
+ * @return size_t   The number of bytes held.
+ */
+size_t allocator_current(const Allocator *allocator);
+
+/**
+ * @brief This function returns the highest number of bytes an allocator has
+ *        held at the same time.
+ *
+ * @param allocator The allocator.
+ * @return size_t   The peak number of bytes held.
+ */
+size_t allocator_peak(const Allocator *allocator);
+
+/**
+ * @brief This function returns the number of bytes of the blocks handed out
+ *        by an allocator and not deallocated yet, as they were requested.
+ *
+ * @param allocator The allocator.
+ * @return size_t   The number of bytes in use.
+ */
+size_t allocator_in_use(const Allocator *allocator);
+
+/**
+ * @brief This function resets the peak of an allocator to the memory it
+ *        currently holds.
+ *
+ * @param allocator The allocator.
+ */
+void allocator_reset_peak(Allocator *allocator);
+
+/**
+ * @brief This function caps the memory an allocator can hold.
+ *
+ * @param allocator The allocator.
+ * @param limit     The maximum number of bytes held, 0 for no limit.
+ */
+void allocator_set_limit(Allocator *allocator, size_t limit);
+
+/**
+ * @brief This function returns the allocator backed by the system heap. It is
+ *        the only thread-safe allocator.
+ *
+ * @return Allocator* The heap allocator.
+ */
+Allocator *allocator_heap();
+
+/**
+ * @brief This function returns the allocator used by the calling thread when
+ *        a matrix is created without an explicit allocator. It is the heap
+ *        allocator unless allocator_set_default was called.
+ *
+ * @return Allocator* The default allocator of the calling thread.
+ */
+Allocator *allocator_get_default();
+
+/**
+ * @brief This function sets the default allocator of the calling thread.
+ *        Giving each OpenMP thread its own arena or pool removes all the
+ *        contention on the heap.
+ *
+ * @param allocator   The new default allocator, nullptr for the heap.
+ * @return Allocator* The previous default allocator.
+ */
+Allocator *allocator_set_default(Allocator *allocator);
+
+// Arena
+
+/**
+ * @brief This function creates a bump arena. Allocations only move a pointer
+ *        forward and deallocations do nothing until the arena is reset, which
+ *        makes it the right place for the temporaries of one training step.
+ *        When the arena runs out of space it chains a new block. An arena
+ *        must only be used by one thread at a time.
+ *
+ * @param capacity    The size of the first block in bytes.
+ * @return Allocator* The arena, or nullptr if it could not be created.
+ */
+Allocator *arena_create(size_t capacity);
+
+/**
+ * @brief This function releases everything allocated from an arena at once.
+ *        If the arena had to chain blocks, they are merged into a single block
+ *        big enough for the next step. The arena keeps holding that block.
+ *
+ * @param arena The arena.
+ */
+void arena_reset(Allocator *arena);
+
+/**
+ * @brief This function returns the number of bytes reserved by an arena.
+ *
+ * @param arena   The arena.
+ * @return size_t The total size of the blocks of the arena.
+ */
+size_t arena_capacity(const Allocator *arena);
+
+/**
+ * @brief This function deletes an arena and all of its blocks.
+ *
+ * @param arena The arena.
+ */
+void arena_delete(Allocator *arena);
+
+// Pool
+
+/**
+ * @brief This function creates a size-class pool. Blocks are rounded up to a
+ *        power of two and freed blocks are kept in a free list per size, so
+ *        buffers that are repeatedly created and deleted with the same shape
+ *        never go back to the heap. A pool must only be used by one thread at
+ *        a time.
+ *
+ * @return Allocator* The pool, or nullptr if it could not be created.
+ */
+Allocator *pool_create();
+
+/**
+ * @brief This function returns the free blocks of a pool to the heap.
+ *
+ * @param pool The pool.
+ */
+void pool_trim(Allocator *pool);
+
+/**
+ * @brief This function deletes a pool. Every block allocated from it must
+ *        have been deallocated first.
+ *
+ * @param pool The pool.
+ */
+void pool_delete(Allocator *pool);
+
+}  // namespace custom_math
+
+#endif  // ALLOCATOR_HPP_
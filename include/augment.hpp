@@ -0,0 +1,119 @@
+/**
+ * @file augment.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the data augmentation: random
+ *        shifts, rotations, elastic distortions and noise applied to the
+ *        images as the batches are gathered, instead of storing augmented
+ *        copies of the dataset.
+ * @version 1.0
+ * @date 2023-08-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef AUGMENT_HPP_
+#define AUGMENT_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace images {
+
+/**
+ * @brief The transforms, each drawn at random for every image.
+ */
+typedef enum {
+  AUGMENT_SHIFT,     // Moves the image by up to amount pixels on each axis.
+  AUGMENT_ROTATION,  // Rotates it around its center by up to amount degrees.
+  AUGMENT_ELASTIC,   // Moves every pixel by up to amount pixels, along a
+                     // field that is smooth over sigma pixels.
+  AUGMENT_NOISE      // Adds noise of standard deviation amount to the pixels,
+                     // which stay in [0, 1].
+} AugmentType;
+
+typedef struct {
+  AugmentType type;
+  double amount;
+  double sigma;
+} AugmentStep;
+
+#define AUGMENT_MAX_STEPS 8
+
+/**
+ * @brief The transforms applied to an image, in order. The shifts, rotations
+ *        and elastic distortions are composed into a single bilinear
+ *        resampling, so the image is interpolated once whatever their
+ *        number; the noise is added afterwards.
+ */
+typedef struct {
+  size_t count;
+  AugmentStep steps[AUGMENT_MAX_STEPS];
+} AugmentChain;
+
+/**
+ * @brief This function returns a chain without any transform.
+ *
+ * @return AugmentChain The chain.
+ */
+AugmentChain augment_chain();
+
+/**
+ * @brief This function appends a transform to a chain.
+ *
+ * @param chain   The chain.
+ * @param type    The transform.
+ * @param amount  How far it goes, see AugmentType.
+ * @param sigma   The smoothness of an elastic distortion, ignored otherwise.
+ * @return bool   Whether the transform was appended. It is not when the chain
+ *                is full, amount is negative, or sigma is not positive for an
+ *                elastic distortion.
+ */
+bool augment_add(AugmentChain *chain, AugmentType type, double amount,
+                 double sigma = 0);
+
+template <typename T>
+struct BasicAugmenter;
+
+typedef BasicAugmenter<double> Augmenter;
+typedef BasicAugmenter<float> AugmenterF;
+
+/**
+ * @brief This function creates an augmenter, which holds the buffers needed
+ *        to transform images of a given size. An augmenter must not be used
+ *        by several threads at once.
+ *
+ * @param chain   The transforms, copied.
+ * @param rows    The number of rows of the images.
+ * @param cols    The number of columns of the images.
+ * @return BasicAugmenter<T>* The augmenter, or nullptr if the chain is empty
+ *                            or the buffers cannot be allocated.
+ */
+template <typename T>
+BasicAugmenter<T> *augmenter_create(const AugmentChain *chain, size_t rows,
+                                    size_t cols);
+
+/**
+ * @brief This function transforms an image. The transforms only depend on the
+ *        seed: an image augmented twice with the same seed is the same.
+ *
+ * @param augmenter The augmenter.
+ * @param dst       The transformed image, possibly src itself.
+ * @param src       The image, rows x cols pixels in [0, 1].
+ * @param seed      The seed of the random transforms.
+ */
+template <typename T>
+void augment(BasicAugmenter<T> *augmenter, T *dst, const T *src,
+             uint64_t seed);
+
+/**
+ * @brief This function deletes an augmenter.
+ *
+ * @param augmenter The augmenter.
+ */
+template <typename T>
+void augmenter_delete(BasicAugmenter<T> *augmenter);
+
+}  // namespace images
+
+#endif  // AUGMENT_HPP_
@@ -0,0 +1,170 @@
+/**
+ * @file dataset.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the datasets: all the images of a
+ *        file stored as the rows of one matrix, with their labels next to
+ *        them. A sample or a mini-batch is a view of the matrix, so that a
+ *        batch can be given to the matrix product without being gathered.
+ * @version 1.0
+ * @date 2023-08-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DATASET_HPP_
+#define DATASET_HPP_
+
+#include "allocator.hpp"
+#include "image.hpp"
+#include "math.hpp"
+
+namespace images {
+
+/**
+ * @brief Consecutive samples of a dataset: one sample per row of the matrix,
+ *        and one label per sample. Both are views of the dataset.
+ */
+template <typename T>
+struct BasicBatch {
+  custom_math::BasicMatrix<T> samples;
+  const int *labels;
+};
+
+typedef BasicBatch<double> Batch;
+typedef BasicBatch<float> BatchF;
+
+/**
+ * @brief The images of a file. Sample i is row i of samples, its rows * cols
+ *        pixels scaled to [0, 1], and labels[i] is its label. The structure,
+ *        the labels and the samples share one block of memory.
+ *
+ * A dataset of bytes, ByteDataset, keeps the pixels as they are in the files,
+ * in [0, 255]. It takes 8 times less memory than a dataset of doubles (47 MB
+ * instead of 376 MB for the training set) and the pixels are turned into
+ * floats or doubles as the batches are gathered, see loader.hpp.
+ */
+template <typename T>
+struct BasicDataset {
+  size_t count;  // The number of samples.
+  size_t rows;   // The size of the images.
+  size_t cols;
+  custom_math::BasicMatrix<T> samples;  // count x (rows * cols), a view.
+  int *labels;
+  custom_math::Allocator *allocator;  // The allocator of the block.
+  size_t size;                        // The size of the block.
+};
+
+typedef BasicDataset<double> Dataset;
+typedef BasicDataset<float> DatasetF;
+typedef BasicDataset<uint8_t> ByteDataset;
+
+/**
+ * @brief This function creates a dataset whose samples and labels are not
+ *        initialized. The samples start on a 64-byte boundary and are stored
+ *        one after the other.
+ *
+ * @param count     The number of samples.
+ * @param rows      The number of rows of the images.
+ * @param cols      The number of columns of the images.
+ * @param allocator The allocator of the dataset, nullptr for the default one.
+ * @return BasicDataset<T>* The dataset, or nullptr if it cannot be allocated.
+ */
+template <typename T = double>
+BasicDataset<T> *dataset_create(size_t count, size_t rows, size_t cols,
+                                custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function creates a dataset from images stored as bytes.
+ *
+ * @param raw       The images.
+ * @param count     The number of images to take, 0 for all of them.
+ * @param allocator The allocator of the dataset, nullptr for the default one.
+ * @return BasicDataset<T>* The dataset, or nullptr if there are not enough
+ *                          images or it cannot be allocated.
+ */
+template <typename T = double>
+BasicDataset<T> *dataset_from_raw(const RawImages *raw, size_t count = 0,
+                                  custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function reads a dataset from a CSV file, possibly compressed,
+ *        through the cache of load_image_cache.
+ *
+ * @param filename  The name of the file.
+ * @param count     The number of images to read, 0 for all of them.
+ * @return BasicDataset<T>* The dataset, or nullptr if the file cannot be read
+ *                          or holds fewer images than requested.
+ */
+template <typename T = double>
+BasicDataset<T> *read_dataset(const char *filename, size_t count = 0);
+
+/**
+ * @brief This function reads the test dataset, from the files
+ *        read_test_images reads.
+ *
+ * @return BasicDataset<T>* The dataset, or nullptr if it cannot be read.
+ */
+template <typename T = double>
+BasicDataset<T> *read_test_dataset();
+
+/**
+ * @brief This function reads the training dataset, from the files
+ *        read_train_images reads.
+ *
+ * @return BasicDataset<T>* The dataset, or nullptr if it cannot be read.
+ */
+template <typename T = double>
+BasicDataset<T> *read_train_dataset();
+
+/**
+ * @brief This function deletes a dataset, with a single deallocation. The
+ *        views of the dataset must not be used afterwards.
+ *
+ * @param dataset The dataset.
+ */
+template <typename T>
+void dataset_delete(BasicDataset<T> *dataset);
+
+/**
+ * @brief This function returns the image of a sample as a rows x cols view.
+ *
+ * @param dataset* The dataset.
+ * @param index    The index of the sample.
+ * @return BasicMatrix<T> The view of the sample.
+ */
+template <typename T>
+inline custom_math::BasicMatrix<T> dataset_sample(
+    const BasicDataset<T> *dataset, size_t index) {
+  custom_math::BasicMatrix<T> sample = {
+      dataset->rows, dataset->cols, dataset->cols,
+      custom_math::matrix_row(&dataset->samples, index), nullptr};
+  return sample;
+}
+
+/**
+ * @brief This function returns consecutive samples as a batch, without
+ *        copying them.
+ *
+ * @param dataset* The dataset.
+ * @param first    The index of the first sample.
+ * @param size     The number of samples, cut at the end of the dataset.
+ * @return BasicBatch<T> The batch.
+ */
+template <typename T>
+inline BasicBatch<T> dataset_batch(const BasicDataset<T> *dataset,
+                                   size_t first, size_t size) {
+  if (first > dataset->count) first = dataset->count;
+  if (size > dataset->count - first) size = dataset->count - first;
+
+  BasicBatch<T> batch;
+  batch.samples = dataset->samples;
+  batch.samples.rows = size;
+  batch.samples.elements = custom_math::matrix_row(&dataset->samples, first);
+  batch.labels = dataset->labels + first;
+  return batch;
+}
+
+}  // namespace images
+
+#endif  // DATASET_HPP_
@@ -0,0 +1,108 @@
+/**
+ * @file distributed.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the distributed training: several
+ *        processes, each with a replica of the network and a shard of the
+ *        data, average their gradients at every step with a ring allreduce
+ *        over a transport, while their backward passes go on.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DISTRIBUTED_HPP_
+#define DISTRIBUTED_HPP_
+
+#include "network.hpp"
+#include "transport.hpp"
+
+namespace neural {
+
+/**
+ * @brief This function sums an array over all the processes of a ring, in
+ *        place. The array is cut into one chunk per process: in size - 1
+ *        exchanges every process reduces one chunk, then in size - 1 more it
+ *        collects the reduced chunks of the others. Every process sends and
+ *        receives 2 * (size - 1) / size of the array, whatever their number.
+ *
+ * @param transport The ring. Every process must call the function with the
+ *                  same count.
+ * @param data      The array, replaced by the sums.
+ * @param count     The number of elements of the array.
+ * @param scratch   Receives the chunks, at least count / size + 1 elements.
+ * @return bool     Whether all the exchanges succeeded. On failure the array
+ *                  is partially reduced.
+ */
+template <typename T>
+bool ring_allreduce(Transport *transport, T *data, size_t count, T *scratch);
+
+/**
+ * @brief A process of a distributed training: its workspace, and a thread
+ *        that averages the gradients of every layer over the ring as soon as
+ *        the backward pass is done with it. The layers are reduced from the
+ *        last to the first, in the order every process finishes them.
+ */
+template <typename T>
+struct BasicDistributed;
+
+typedef BasicDistributed<double> Distributed;
+typedef BasicDistributed<float> DistributedF;
+
+/**
+ * @brief This function creates a process of a distributed training. The
+ *        replicas must start from the same parameters, e.g. networks created
+ *        with the same seed.
+ *
+ * @param network   The replica of this process.
+ * @param capacity  The largest mini-batch of this process.
+ * @param transport The ring, which is not owned and must outlive the
+ *                  process.
+ * @return BasicDistributed<T>* The process, or nullptr if it cannot be
+ *                              allocated.
+ */
+template <typename T>
+BasicDistributed<T> *distributed_create(const BasicNetwork<T> *network,
+                                        size_t capacity,
+                                        Transport *transport);
+
+/**
+ * @brief This function trains the replica on its shard of a mini-batch: it
+ *        runs the forward and backward passes, sends the gradients of every
+ *        layer while it computes the ones of the previous layer, and steps
+ *        the optimizer with the mean of the gradients of all the processes.
+ *        With shards of the same size, it is the step a single process would
+ *        take on the whole batch, and the replicas stay identical.
+ *
+ * Every process must call it for every step. Once an exchange fails, e.g.
+ * because another process died, this one and all the following return NaN.
+ *
+ * @param distributed The process.
+ * @param network     The replica it was created for.
+ * @param batch       The shard of the mini-batch.
+ * @param optimizer   The optimizer, over network->size parameters.
+ * @return T          The mean loss of the shard, or NaN if the shard or the
+ *                    optimizer do not fit, a label is invalid or the
+ *                    gradients could not be exchanged. With an invalid label,
+ *                    the shard adds gradients of 0 to the ones of the other
+ *                    processes, and the step is still taken.
+ */
+template <typename T>
+T distributed_train_batch(BasicDistributed<T> *distributed,
+                          BasicNetwork<T> *network,
+                          const images::BasicBatch<T> *batch,
+                          BasicOptimizer<T> *optimizer);
+
+/**
+ * @brief This function stops the thread of a process and deletes it. The
+ *        transport is left open.
+ *
+ * @param distributed The process.
+ */
+template <typename T>
+void distributed_delete(BasicDistributed<T> *distributed);
+
+}  // namespace neural
+
+#endif  // DISTRIBUTED_HPP_
@@ -0,0 +1,580 @@
+/**
+ * @file expression.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the lazy matrix expressions. A
+ *        chain of element-wise operations is described first and computed
+ *        later in a single loop, without any temporary matrix. The chain can
+ *        also be computed by the GEMM engine on the blocks of a product while
+ *        they are still in cache.
+ * @version 1.0
+ * @date 2023-07-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef EXPRESSION_HPP_
+#define EXPRESSION_HPP_
+
+#include "gemm.hpp"
+#include "math.hpp"
+
+namespace custom_math {
+
+// An expression is a small value describing how to compute element (i, j)
+// of a result. They are built with the lazy_* functions below, which accept
+// matrices and other expressions, e.g. for a layer of a network:
+//
+//   matrix_dot_eval_into(output, weights, input,
+//                        lazy_apply(lazy_add(lazy_product<double>(),
+//                                            lazy_broadcast(bias)),
+//                                   sigmoid));
+//
+// Every expression provides:
+//  - Element, the element type,
+//  - USES_PRODUCT, whether it reads the product of matrix_dot_eval_into,
+//  - rows() and cols(), its shape, 0 when any number fits,
+//  - fits(rows, cols), whether it can be computed with this shape,
+//  - reads(destination, in_place), whether it reads the memory of the
+//    destination, apart from the element being written when in_place is
+//    true,
+//  - at(i, j, product, ldp), the value of element (i, j).
+//
+// The matrices must outlive the expressions that refer to them.
+
+namespace detail {
+
+// Whether the memory spanned by the two matrices (padding and the elements
+// skipped by a view included) overlaps.
+template <typename T>
+inline bool overlap(const BasicMatrix<T> *matrix1,
+                    const BasicMatrix<T> *matrix2) {
+  const T *begin1 = matrix1->elements;
+  const T *end1 =
+      begin1 + (matrix1->rows - 1) * matrix1->stride + matrix1->cols;
+  const T *begin2 = matrix2->elements;
+  const T *end2 =
+      begin2 + (matrix2->rows - 1) * matrix2->stride + matrix2->cols;
+
+  return begin1 < end2 && begin2 < end1;
+}
+
+}  // namespace detail
+
+/**
+ * @brief An expression that reads the elements of a matrix.
+ */
+template <typename T>
+struct LazyMatrix {
+  typedef T Element;
+  static const bool USES_PRODUCT = false;
+
+  const BasicMatrix<T> *matrix;
+
+  size_t rows() const { return matrix == nullptr ? 0 : matrix->rows; }
+  size_t cols() const { return matrix == nullptr ? 0 : matrix->cols; }
+
+  bool fits(size_t rows, size_t cols) const {
+    return matrix != nullptr && matrix->elements != nullptr &&
+           matrix->rows == rows && matrix->cols == cols;
+  }
+
+  bool reads(const BasicMatrix<T> *destination, bool in_place) const {
+    if (!detail::overlap(matrix, destination)) return false;
+    // Reading the element that is about to be written is fine.
+    return !in_place || matrix->elements != destination->elements ||
+           matrix->stride != destination->stride;
+  }
+
+  T at(size_t i, size_t j, const T *, size_t) const {
+    return matrix->elements[i * matrix->stride + j];
+  }
+};
+
+/**
+ * @brief An expression that repeats a row vector (1 x cols), a column vector
+ *        (rows x 1) or a single element over the whole result, e.g. a bias.
+ */
+template <typename T>
+struct LazyBroadcast {
+  typedef T Element;
+  static const bool USES_PRODUCT = false;
+
+  const BasicMatrix<T> *matrix;
+
+  size_t rows() const {
+    return matrix == nullptr || matrix->rows == 1 ? 0 : matrix->rows;
+  }
+  size_t cols() const {
+    return matrix == nullptr || matrix->cols == 1 ? 0 : matrix->cols;
+  }
+
+  bool fits(size_t rows, size_t cols) const {
+    return matrix != nullptr && matrix->elements != nullptr &&
+           (matrix->rows == 1 || matrix->rows == rows) &&
+           (matrix->cols == 1 || matrix->cols == cols);
+  }
+
+  bool reads(const BasicMatrix<T> *destination, bool) const {
+    return detail::overlap(matrix, destination);
+  }
+
+  T at(size_t i, size_t j, const T *, size_t) const {
+    return matrix->elements[(matrix->rows == 1 ? 0 : i) * matrix->stride +
+                            (matrix->cols == 1 ? 0 : j)];
+  }
+};
+
+/**
+ * @brief An expression that reads the product computed by
+ *        matrix_dot_eval_into.
+ */
+template <typename T>
+struct LazyProduct {
+  typedef T Element;
+  static const bool USES_PRODUCT = true;
+
+  size_t rows() const { return 0; }
+  size_t cols() const { return 0; }
+  bool fits(size_t, size_t) const { return true; }
+  bool reads(const BasicMatrix<T> *, bool) const { return false; }
+
+  T at(size_t i, size_t j, const T *product, size_t ldp) const {
+    return product[i * ldp + j];
+  }
+};
+
+/**
+ * @brief An expression that combines two expressions element by element.
+ */
+template <typename Operation, typename Left, typename Right>
+struct LazyBinary {
+  typedef typename Left::Element Element;
+  static const bool USES_PRODUCT =
+      Left::USES_PRODUCT || Right::USES_PRODUCT;
+
+  Left left;
+  Right right;
+
+  size_t rows() const {
+    return left.rows() != 0 ? left.rows() : right.rows();
+  }
+  size_t cols() const {
+    return left.cols() != 0 ? left.cols() : right.cols();
+  }
+
+  bool fits(size_t rows, size_t cols) const {
+    return left.fits(rows, cols) && right.fits(rows, cols);
+  }
+
+  bool reads(const BasicMatrix<Element> *destination, bool in_place) const {
+    return left.reads(destination, in_place) ||
+           right.reads(destination, in_place);
+  }
+
+  Element at(size_t i, size_t j, const Element *product, size_t ldp) const {
+    return Operation::apply(left.at(i, j, product, ldp),
+                            right.at(i, j, product, ldp));
+  }
+};
+
+/**
+ * @brief An expression that multiplies another one with a scalar.
+ */
+template <typename Operand>
+struct LazyScale {
+  typedef typename Operand::Element Element;
+  static const bool USES_PRODUCT = Operand::USES_PRODUCT;
+
+  Operand operand;
+  Element scalar;
+
+  size_t rows() const { return operand.rows(); }
+  size_t cols() const { return operand.cols(); }
+
+  bool fits(size_t rows, size_t cols) const {
+    return operand.fits(rows, cols);
+  }
+
+  bool reads(const BasicMatrix<Element> *destination, bool in_place) const {
+    return operand.reads(destination, in_place);
+  }
+
+  Element at(size_t i, size_t j, const Element *product, size_t ldp) const {
+    return operand.at(i, j, product, ldp) * scalar;
+  }
+};
+
+/**
+ * @brief An expression that applies a function (a function pointer or a
+ *        lambda) to every element of another one.
+ */
+template <typename Operand, typename Function>
+struct LazyApply {
+  typedef typename Operand::Element Element;
+  static const bool USES_PRODUCT = Operand::USES_PRODUCT;
+
+  Operand operand;
+  Function function;
+
+  size_t rows() const { return operand.rows(); }
+  size_t cols() const { return operand.cols(); }
+
+  bool fits(size_t rows, size_t cols) const {
+    return operand.fits(rows, cols);
+  }
+
+  bool reads(const BasicMatrix<Element> *destination, bool in_place) const {
+    return operand.reads(destination, in_place);
+  }
+
+  Element at(size_t i, size_t j, const Element *product, size_t ldp) const {
+    return function(operand.at(i, j, product, ldp));
+  }
+};
+
+struct LazyAddOperation {
+  template <typename T>
+  static T apply(T left, T right) {
+    return left + right;
+  }
+};
+
+struct LazySubOperation {
+  template <typename T>
+  static T apply(T left, T right) {
+    return left - right;
+  }
+};
+
+struct LazyMulOperation {
+  template <typename T>
+  static T apply(T left, T right) {
+    return left * right;
+  }
+};
+
+/**
+ * @brief Turns the operands of the lazy_* functions into expressions, a
+ *        matrix being read element by element.
+ */
+template <typename E>
+struct LazyOperand {
+  typedef E Type;
+  static const E &get(const E &expression) { return expression; }
+};
+
+template <typename T>
+struct LazyOperand<BasicMatrix<T> *> {
+  typedef LazyMatrix<T> Type;
+  static Type get(const BasicMatrix<T> *matrix) { return Type{matrix}; }
+};
+
+template <typename T>
+struct LazyOperand<const BasicMatrix<T> *> {
+  typedef LazyMatrix<T> Type;
+  static Type get(const BasicMatrix<T> *matrix) { return Type{matrix}; }
+};
+
+/**
+ * @brief This function returns an expression that reads a matrix.
+ *
+ * @param matrix* The matrix.
+ * @return LazyMatrix<T> The expression.
+ */
+template <typename T>
+inline LazyMatrix<T> lazy(const BasicMatrix<T> *matrix) {
+  return LazyMatrix<T>{matrix};
+}
+
+/**
+ * @brief This function returns an expression that repeats a row vector, a
+ *        column vector or a single element over the whole result.
+ *
+ * @param matrix* The vector.
+ * @return LazyBroadcast<T> The expression.
+ */
+template <typename T>
+inline LazyBroadcast<T> lazy_broadcast(const BasicMatrix<T> *matrix) {
+  return LazyBroadcast<T>{matrix};
+}
+
+/**
+ * @brief This function returns an expression that reads the product computed
+ *        by matrix_dot_eval_into.
+ *
+ * @return LazyProduct<T> The expression.
+ */
+template <typename T>
+inline LazyProduct<T> lazy_product() {
+  return LazyProduct<T>();
+}
+
+/**
+ * @brief This function returns the expression left + right.
+ *
+ * @param left  The first operand, a matrix or an expression.
+ * @param right The second operand, a matrix or an expression.
+ * @return The expression.
+ */
+template <typename L, typename R>
+inline LazyBinary<LazyAddOperation, typename LazyOperand<L>::Type,
+                  typename LazyOperand<R>::Type>
+lazy_add(const L &left, const R &right) {
+  return {LazyOperand<L>::get(left), LazyOperand<R>::get(right)};
+}
+
+/**
+ * @brief This function returns the expression left - right.
+ *
+ * @param left  The first operand, a matrix or an expression.
+ * @param right The second operand, a matrix or an expression.
+ * @return The expression.
+ */
+template <typename L, typename R>
+inline LazyBinary<LazySubOperation, typename LazyOperand<L>::Type,
+                  typename LazyOperand<R>::Type>
+lazy_sub(const L &left, const R &right) {
+  return {LazyOperand<L>::get(left), LazyOperand<R>::get(right)};
+}
+
+/**
+ * @brief This function returns the element-wise product of two operands.
+ *
+ * @param left  The first operand, a matrix or an expression.
+ * @param right The second operand, a matrix or an expression.
+ * @return The expression.
+ */
+template <typename L, typename R>
+inline LazyBinary<LazyMulOperation, typename LazyOperand<L>::Type,
+                  typename LazyOperand<R>::Type>
+lazy_mul(const L &left, const R &right) {
+  return {LazyOperand<L>::get(left), LazyOperand<R>::get(right)};
+}
+
+/**
+ * @brief This function returns the expression operand * scalar.
+ *
+ * @param operand The operand, a matrix or an expression.
+ * @param scalar  The scalar.
+ * @return The expression.
+ */
+template <typename E>
+inline LazyScale<typename LazyOperand<E>::Type> lazy_scale(
+    const E &operand,
+    typename LazyOperand<E>::Type::Element scalar) {
+  return {LazyOperand<E>::get(operand), scalar};
+}
+
+/**
+ * @brief This function returns the expression function(operand). Unlike a
+ *        function pointer given to matrix_apply, a lambda is inlined in the
+ *        loop.
+ *
+ * @param operand  The operand, a matrix or an expression.
+ * @param function The function applied to every element.
+ * @return The expression.
+ */
+template <typename E, typename F>
+inline LazyApply<typename LazyOperand<E>::Type, F> lazy_apply(
+    const E &operand, F function) {
+  return {LazyOperand<E>::get(operand), function};
+}
+
+namespace detail {
+
+// Computes the rows [row, row + rows) and the columns [col, col + cols) of
+// an expression into a matrix.
+template <typename T, typename E>
+inline void evaluate_block(const E &expression, BasicMatrix<T> *destination,
+                           size_t row, size_t col, size_t rows, size_t cols,
+                           const T *product, size_t ldp) {
+  for (size_t i = row; i < row + rows; i++) {
+    T *output = destination->elements + i * destination->stride;
+    for (size_t j = col; j < col + cols; j++)
+      output[j] = expression.at(i, j, product, ldp);
+  }
+}
+
+template <typename T, typename E>
+inline bool can_evaluate(const E &expression, const BasicMatrix<T> *destination,
+                         bool in_place) {
+  if (destination == nullptr || destination->elements == nullptr)
+    return false;
+  if (!expression.fits(destination->rows, destination->cols)) return false;
+
+  return !expression.reads(destination, in_place);
+}
+
+template <typename T, typename E>
+struct EpilogueContext {
+  const E *expression;
+  BasicMatrix<T> *destination;
+};
+
+template <typename T, typename E>
+void apply_epilogue(void *context, size_t row, size_t col, size_t rows,
+                    size_t cols) {
+  EpilogueContext<T, E> *epilogue = (EpilogueContext<T, E> *)context;
+  BasicMatrix<T> *destination = epilogue->destination;
+
+  evaluate_block(*epilogue->expression, destination, row, col, rows, cols,
+                 (const T *)destination->elements, destination->stride);
+}
+
+}  // namespace detail
+
+/**
+ * @brief This function computes an expression into a matrix, in one pass
+ *        over the memory.
+ *
+ * @param destination* The matrix that receives the result. It may be one of
+ *                     the matrices the expression reads, but not a
+ *                     broadcast one.
+ * @param expression   The expression, which cannot read a product.
+ * @return BasicMatrix<T>* The destination, or nullptr if the shapes do not
+ *                         match.
+ */
+template <typename T, typename E>
+BasicMatrix<T> *matrix_eval_into(BasicMatrix<T> *destination,
+                                 const E &expression) {
+  static_assert(!E::USES_PRODUCT,
+                "lazy_product() can only be used by matrix_dot_eval_into");
+
+  // The destination may be an operand, but nothing may read it elsewhere.
+  if (!detail::can_evaluate(expression, destination, true)) return nullptr;
+
+  const long rows = (long)destination->rows;
+  const size_t cols = destination->cols;
+  long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i) if (rows * cols >= 1 << 16)
+#endif
+  for (i = 0; i < rows; i++)
+    detail::evaluate_block(expression, destination, (size_t)i, 0, 1, cols,
+                           (const T *)nullptr, 0);
+
+  return destination;
+}
+
+/**
+ * @brief This function computes an expression into a new matrix.
+ *
+ * @param expression The expression, which must have a shape (at least one
+ *                   of the matrices it reads is not broadcast).
+ * @param allocator  The allocator of the result, nullptr for the default
+ *                   one.
+ * @return BasicMatrix<T>* The result.
+ */
+template <typename E>
+BasicMatrix<typename E::Element> *matrix_eval(const E &expression,
+                                              Allocator *allocator = nullptr) {
+  typedef typename E::Element T;
+
+  if (expression.rows() == 0 || expression.cols() == 0) return nullptr;
+  if (!expression.fits(expression.rows(), expression.cols())) return nullptr;
+
+  BasicMatrix<T> *matrix = matrix_create<T>(expression.rows(),
+                                            expression.cols(), 0, allocator);
+  if (matrix == nullptr) return nullptr;
+
+  return matrix_eval_into(matrix, expression);
+}
+
+/**
+ * @brief This function multiplies two matrices and computes an expression of
+ *        the product (read with lazy_product()) in the epilogue of the GEMM,
+ *        block by block while the product is in cache.
+ *
+ * @param destination* The matrix that receives the result.
+ * @param matrix1*     The first matrix.
+ * @param matrix2*     The second matrix.
+ * @param expression   The expression of the product.
+ * @return BasicMatrix<T>* The destination, or nullptr if the shapes do not
+ *                         match or the destination overlaps an operand.
+ */
+template <typename T, typename E>
+BasicMatrix<T> *matrix_dot_eval_into(BasicMatrix<T> *destination,
+                                     const BasicMatrix<T> *matrix1,
+                                     const BasicMatrix<T> *matrix2,
+                                     const E &expression) {
+  if (matrix1 == nullptr || matrix1->elements == nullptr ||
+      matrix2 == nullptr || matrix2->elements == nullptr)
+    return nullptr;
+  // The destination holds the product by the time the expression runs, so
+  // the expression cannot read it at all.
+  if (!detail::can_evaluate(expression, destination, false)) return nullptr;
+  if (matrix1->cols != matrix2->rows || destination->rows != matrix1->rows ||
+      destination->cols != matrix2->cols)
+    return nullptr;
+  // The product is written into the destination while the operands are read.
+  if (detail::overlap(matrix1, (const BasicMatrix<T> *)destination) ||
+      detail::overlap(matrix2, (const BasicMatrix<T> *)destination))
+    return nullptr;
+
+  detail::EpilogueContext<T, E> context = {&expression, destination};
+  GemmEpilogue epilogue = {detail::apply_epilogue<T, E>, &context};
+
+  gemm(NO_TRANS, NO_TRANS, matrix1->rows, matrix2->cols, matrix1->cols, (T)1,
+       matrix1->elements, matrix1->stride, matrix2->elements, matrix2->stride,
+       (T)0, destination->elements, destination->stride, &epilogue);
+
+  return destination;
+}
+
+// Functor-based versions of matrix_apply. The function (a lambda or a functor
+// such as ActivationFunction) is inlined in the loop, which the compiler can
+// then vectorize.
+
+/**
+ * @brief This function applies a function to every element of a matrix and
+ *        stores the results into another matrix.
+ *
+ * @param destination* The matrix that receives the results, which may be the
+ *                     input itself.
+ * @param matrix*      The matrix.
+ * @param function     The function that will be applied to the matrix.
+ * @return BasicMatrix<T>* The destination, or nullptr if the shapes do not
+ *                         match or the matrices partially overlap.
+ */
+template <typename T, typename F>
+BasicMatrix<T> *matrix_map_into(BasicMatrix<T> *destination,
+                                const BasicMatrix<T> *matrix, F function) {
+  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+
+  return matrix_eval_into(destination, lazy_apply(matrix, function));
+}
+
+/**
+ * @brief This function applies a function to every element of a matrix.
+ *
+ * @param matrix*   The matrix.
+ * @param function  The function that will be applied to the matrix.
+ * @param allocator The allocator of the result, nullptr for the default one.
+ * @return BasicMatrix<T>* The results.
+ */
+template <typename T, typename F>
+BasicMatrix<T> *matrix_map(const BasicMatrix<T> *matrix, F function,
+                           Allocator *allocator = nullptr) {
+  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+
+  return matrix_eval(lazy_apply(matrix, function), allocator);
+}
+
+/**
+ * @brief This function applies a function to every element of a matrix in
+ *        place.
+ *
+ * @param matrix*  The matrix that is modified.
+ * @param function The function that will be applied to the matrix.
+ * @return BasicMatrix<T>* The modified matrix.
+ */
+template <typename T, typename F>
+BasicMatrix<T> *matrix_map_inplace(BasicMatrix<T> *matrix, F function) {
+  return matrix_map_into(matrix, (const BasicMatrix<T> *)matrix, function);
+}
+
+}  // namespace custom_math
+
+#endif  // EXPRESSION_HPP_
@@ -0,0 +1,78 @@
+/**
+ * @file gemm.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the general matrix multiplication
+ *        (GEMM) engine that is used by the math library.
+ * @version 1.0
+ * @date 2023-07-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef GEMM_HPP_
+#define GEMM_HPP_
+
+#include <stddef.h>
+
+namespace custom_math {
+
+/**
+ * @brief Describes how an operand of the GEMM is read from memory.
+ */
+typedef enum { NO_TRANS = 0, TRANS = 1 } Transpose;
+
+/**
+ * @brief A function that the GEMM calls on every block of C once the block
+ *        holds its final value, while it is still in cache. It is called
+ *        from the OpenMP threads, on disjoint blocks.
+ */
+typedef struct {
+  // Called with the first row and column of the block and its size.
+  void (*apply)(void *context, size_t row, size_t col, size_t rows,
+                size_t cols);
+  void *context;
+} GemmEpilogue;
+
+/**
+ * @brief This function computes C = alpha * op(A) * op(B) + beta * C, where
+ *        op(X) is either X or its transpose. All the matrices are stored in
+ *        row-major order.
+ *
+ * The operands are packed into panels that fit the L1/L2 caches and the
+ * product is computed by a register-tiled micro-kernel. The macro-tiles of C
+ * are distributed over the OpenMP threads. When beta is 0, C does not have to
+ * be initialized.
+ *
+ * @param trans_a Whether A is transposed.
+ * @param trans_b Whether B is transposed.
+ * @param m       The number of rows of op(A) and C.
+ * @param n       The number of columns of op(B) and C.
+ * @param k       The number of columns of op(A) and rows of op(B).
+ * @param alpha   The scalar that multiplies the product.
+ * @param a       The elements of A.
+ * @param lda     The distance between two consecutive rows of A.
+ * @param b       The elements of B.
+ * @param ldb     The distance between two consecutive rows of B.
+ * @param beta    The scalar that multiplies C.
+ * @param c       The elements of C.
+ * @param ldc     The distance between two consecutive rows of C.
+ * @param epilogue The function applied to the blocks of C, nullptr for none.
+ */
+void gemm(Transpose trans_a, Transpose trans_b, size_t m, size_t n, size_t k,
+          double alpha, const double *a, size_t lda, const double *b,
+          size_t ldb, double beta, double *c, size_t ldc,
+          const GemmEpilogue *epilogue = nullptr);
+
+/**
+ * @brief The same as above, for matrices of floats. The micro-kernel tile is
+ *        6x16, so a vector holds twice as many elements.
+ */
+void gemm(Transpose trans_a, Transpose trans_b, size_t m, size_t n, size_t k,
+          float alpha, const float *a, size_t lda, const float *b, size_t ldb,
+          float beta, float *c, size_t ldc,
+          const GemmEpilogue *epilogue = nullptr);
+
+}  // namespace custom_math
+
+#endif  // GEMM_HPP_
@@ -0,0 +1,75 @@
+/**
+ * @file gzip.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the streaming decompression of the
+ *        gzip files of the data directory. The file is inflated in blocks by
+ *        a thread of its own while the blocks already inflated are parsed.
+ * @version 1.0
+ * @date 2023-08-07
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef GZIP_HPP_
+#define GZIP_HPP_
+
+#include <stddef.h>
+
+namespace images {
+
+// The size of the blocks that are inflated at once, and how many of them can
+// be waiting to be parsed. A block grows when a line does not fit in it.
+#define GZIP_BLOCK_SIZE (1 << 20)
+#define GZIP_BLOCKS 4
+
+typedef struct GzipReader GzipReader;
+
+/**
+ * @brief This function tells whether data is compressed with gzip.
+ *
+ * @param data    The content of a file.
+ * @param size    The size of the content.
+ * @return bool   Whether it starts like a gzip file.
+ */
+bool gzip_is_compressed(const void *data, size_t size);
+
+/**
+ * @brief This function starts inflating the content of a gzip file, possibly
+ *        made of several concatenated members. The content must stay valid
+ *        until gzip_close.
+ *
+ * @param data    The compressed content, usually a mapped file.
+ * @param size    The size of the content.
+ * @return GzipReader* The reader, or nullptr if the library is built without
+ *                     zlib or the reader cannot be created.
+ */
+GzipReader *gzip_open(const void *data, size_t size);
+
+/**
+ * @brief This function returns the next block of inflated text. A block ends
+ *        after a '\n', except the last one which ends with the file, so that
+ *        no line is split between two blocks. The block is valid until the
+ *        next call or gzip_close.
+ *
+ * @param reader  The reader.
+ * @param begin   Receives the start of the block.
+ * @param end     Receives the end of the block.
+ * @return bool   Whether there was a block, false at the end of the content
+ *                or when it is corrupted.
+ */
+bool gzip_next_lines(GzipReader *reader, const char **begin,
+                     const char **end);
+
+/**
+ * @brief This function stops the reader, even if not all the content was
+ *        read, and deletes it.
+ *
+ * @param reader  The reader.
+ * @return bool   Whether everything that was inflated was valid.
+ */
+bool gzip_close(GzipReader *reader);
+
+}  // namespace images
+
+#endif  // GZIP_HPP_
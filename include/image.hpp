@@ -13,6 +13,7 @@
 #ifndef IMAGE_HPP_
 #define IMAGE_HPP_
 
+#include <stdint.h>
 #include <string.h>
 
 #include <fstream>
@@ -21,41 +22,292 @@
 
 namespace images {
 
-#define MAX_LINE_LENGTH 1000000
+// The size of the MNIST images.
+#define IMAGE_ROWS 28
+#define IMAGE_COLS 28
 
-typedef struct {
+/**
+ * @brief An image and its label. The pixels are scaled to [0, 1] and stored
+ *        as floats or doubles.
+ */
+template <typename T>
+struct BasicImage {
   int label;
-  custom_math::Matrix *pixels;
-} Image;
+  custom_math::BasicMatrix<T> *pixels;
+};
+
+typedef BasicImage<double> Image;
+typedef BasicImage<float> ImageF;
+
+/**
+ * @brief What was found while reading a file of images.
+ */
+typedef struct {
+  size_t rows;       // The number of rows holding an image in the file, or
+                     // in the part that was read of a compressed file.
+  size_t malformed;  // The number of malformed rows among the ones read.
+  size_t first_malformed_line;  // The line of the first one, from 1, or 0.
+} ReadReport;
 
 /**
  * @brief This function reads the images from the file and returns them as an
  *        array of Image structures.
+ *
+ * The file is a CSV file with one image per row: the label, then the
+ * IMAGE_ROWS * IMAGE_COLS pixels as integers in [0, 255]. A first line that
+ * does not start with a digit is a header and is skipped. The file is mapped
+ * in memory, split in chunks at line boundaries and the chunks are parsed by
+ * all the OpenMP threads.
+ *
+ * A file compressed with gzip is decompressed in blocks by another thread
+ * while the blocks already decompressed are parsed, see gzip.hpp, and it is
+ * only read until the images that are asked for are found.
 
  * It is the responsibility of the caller to free the memory allocated for the
  * images.
  *
  * @param  filename The name of the file from which the images are read.
  * @param  count    The number of images that are read.
- * @return Image*  The array of images that are read.
+ * @param  report   If not nullptr, receives what was found in the file.
+ * @return BasicImage<T>**  The array of images that are read, or nullptr if
+ *                          the file cannot be read, holds fewer images than
+ *                          requested or a malformed row. The malformed rows
+ *                          are also reported on the standard error.
  */
-Image **read_images(const char *filename, const int *count = nullptr);
+template <typename T = double>
+BasicImage<T> **read_images(const char *filename, const int *count = nullptr,
+                            ReadReport *report = nullptr);
+
+/**
+ * @brief This function reads images from a CSV file like read_images, through
+ *        the cache of load_image_cache.
+ *
+ * @param  filename The name of the file from which the images are read.
+ * @param  count    The number of images that are read.
+ * @return BasicImage<T>**  The array of images that are read, or nullptr if
+ *                          the file cannot be read or holds fewer images than
+ *                          requested.
+ */
+template <typename T = double>
+BasicImage<T> **read_cached_images(const char *filename, const int *count);
 
 /**
  * @brief This function reads the test images from the file and returns them as
- *        an array of Image structures.
+ *        an array of Image structures. The IDX files of the MNIST distribution
+ *        are read when they are in the data directory, the CSV file, or the
+ *        CSV file compressed with gzip, otherwise. The CSV file is cached,
+ *        see load_image_cache.
  *
- * @return Image**  The array of images that are read.
+ * @return BasicImage<T>**  The array of images that are read.
  */
-Image **read_test_images();
+template <typename T = double>
+BasicImage<T> **read_test_images();
 
 /**
  * @brief This function reads the training images from the file and returns
- * them as an array of Image structures.
+ * them as an array of Image structures. The IDX files of the MNIST
+ * distribution are read when they are in the data directory, the CSV file, or
+ * the CSV file compressed with gzip, otherwise. The CSV file is cached, see
+ * load_image_cache.
+ *
+ * @return BasicImage<T>**  The array of images that are read.
+ */
+template <typename T = double>
+BasicImage<T> **read_train_images();
+
+// Images as they are stored in the files, one byte per pixel. Parsing a CSV
+// file takes much longer than converting the bytes, so the bytes are cached
+// in a binary file next to it.
+
+/**
+ * @brief Images stored as bytes: count labels, then count * rows * cols
+ *        pixels in [0, 255], one image after the other. The images of the
+ *        CSV files are IMAGE_ROWS * IMAGE_COLS, the ones of the IDX files
+ *        have the size given in the file.
+ */
+typedef struct {
+  size_t count;
+  size_t rows;
+  size_t cols;
+  uint8_t *labels;
+  uint8_t *pixels;
+  void *mapping;        // The mapped file the pixels are read from, if any.
+  size_t mapping_size;  // The size of the mapping.
+  void *labels_mapping;        // The mapped file of the labels, if it is not
+  size_t labels_mapping_size;  // the one of the pixels.
+} RawImages;
+
+#define IMAGE_CACHE_MAGIC "CMIMAGES"
+#define IMAGE_CACHE_VERSION 1
+#define IMAGE_CACHE_ALIGNMENT 64
+
+/**
+ * @brief The header of an image cache file. It is followed by the labels and
+ *        the pixels, each starting at a multiple of IMAGE_CACHE_ALIGNMENT.
+ *        The cache is valid as long as the size and the modification time of
+ *        the source file do not change.
+ */
+typedef struct {
+  char magic[8];               // IMAGE_CACHE_MAGIC, without the '\0'.
+  uint32_t version;            // IMAGE_CACHE_VERSION.
+  uint32_t reserved;
+  uint64_t count;              // The number of images.
+  uint64_t rows;               // The size of the images.
+  uint64_t cols;
+  uint64_t source_size;        // The size of the source file.
+  int64_t source_seconds;      // The modification time of the source file.
+  int64_t source_nanoseconds;
+  uint64_t labels_offset;      // The position of the labels in the file.
+  uint64_t pixels_offset;      // The position of the pixels in the file.
+} ImageCacheHeader;
+
+/**
+ * @brief This function reads images from a CSV file as bytes. The format and
+ *        the way it is parsed are described at read_images.
+ *
+ * @param filename The name of the file.
+ * @param count    The number of images to read, 0 for all of them.
+ * @param report   If not nullptr, receives what was found in the file.
+ * @return RawImages* The images, or nullptr if the file cannot be read, holds
+ *                    fewer images than requested or a malformed row.
+ */
+RawImages *read_raw_images(const char *filename, size_t count,
+                           ReadReport *report = nullptr);
+
+/**
+ * @brief This function reads all the images of a CSV file from its cache.
+ *        The first time, and every time the file changes, the file is parsed
+ *        and the cache is written. The other times the cache is mapped in
+ *        memory and nothing is parsed or copied.
+ *
+ * @param filename       The name of the CSV file.
+ * @param cache_filename The name of the cache, nullptr for the name of the
+ *                       CSV file followed by ".cache".
+ * @return RawImages* The images, or nullptr if the file cannot be read or is
+ *                    malformed. A cache that cannot be written is reported
+ *                    but the images are still returned.
+ */
+RawImages *load_image_cache(const char *filename,
+                            const char *cache_filename = nullptr);
+
+// The IDX files of the MNIST distribution hold the pixels and the labels as
+// big-endian arrays, which are used as they are once the files are mapped.
+
+/**
+ * @brief The type of the elements of an IDX file, the third byte of the file.
+ */
+typedef enum {
+  IDX_UINT8 = 0x08,
+  IDX_INT8 = 0x09,
+  IDX_INT16 = 0x0B,
+  IDX_INT32 = 0x0C,
+  IDX_FLOAT32 = 0x0D,
+  IDX_FLOAT64 = 0x0E
+} IdxType;
+
+#define IDX_MAX_DIMENSIONS 8
+
+/**
+ * @brief An IDX file. The file starts with two zero bytes, the type, the
+ *        number of dimensions and the size of every dimension as a big-endian
+ *        32-bit integer. The elements follow, in row-major order and in
+ *        big-endian byte order when they are larger than a byte.
+ */
+typedef struct {
+  IdxType type;
+  uint32_t dimensions;
+  uint32_t sizes[IDX_MAX_DIMENSIONS];
+  size_t count;      // The number of elements, the product of the sizes.
+  const void *data;  // The elements, read-only.
+  const char *content;  // The whole file, mapped when possible.
+  size_t content_size;
+  bool mapped;
+} IdxFile;
+
+/**
+ * @brief This function returns the size of an element of an IDX file.
+ *
+ * @param type      The type of the elements.
+ * @return size_t   The size in bytes, or 0 if the type is unknown.
+ */
+size_t idx_type_size(IdxType type);
+
+/**
+ * @brief This function opens an IDX file and reads its header. The elements
+ *        are not read: the file is mapped in memory and they are read from
+ *        the disk when they are used.
+ *
+ * It is the responsibility of the caller to close the file with idx_close.
+ *
+ * @param filename  The name of the file.
+ * @return IdxFile* The file, or nullptr if it cannot be read, is not an IDX
+ *                  file or does not hold as many elements as its header says.
+ */
+IdxFile *idx_open(const char *filename);
+
+/**
+ * @brief This function closes an IDX file.
+ *
+ * @param file The file.
+ */
+void idx_close(IdxFile *file);
+
+/**
+ * @brief This function reads images from the IDX files of the MNIST
+ *        distribution: a file of count * rows * cols bytes and a file of
+ *        count bytes. The images are views of the mapped files, nothing is
+ *        parsed or copied.
+ *
+ * @param images_filename The name of the file of the pixels, like
+ *                        "train-images-idx3-ubyte".
+ * @param labels_filename The name of the file of the labels, like
+ *                        "train-labels-idx1-ubyte".
+ * @return RawImages* The images, or nullptr if the files cannot be read, are
+ *                    not IDX files of bytes of the right shape or do not hold
+ *                    the same number of images.
+ */
+RawImages *load_idx_images(const char *images_filename,
+                           const char *labels_filename);
+
+/**
+ * @brief This function reads images from the IDX files of the MNIST
+ *        distribution, see load_idx_images, and returns them as an array of
+ *        Image structures.
+ *
+ * @param images_filename The name of the file of the pixels.
+ * @param labels_filename The name of the file of the labels.
+ * @param count           The number of images that are read.
+ * @return BasicImage<T>**  The array of images that are read, or nullptr if
+ *                          the files cannot be read or hold fewer images than
+ *                          requested.
+ */
+template <typename T = double>
+BasicImage<T> **read_idx_images(const char *images_filename,
+                                const char *labels_filename,
+                                const int *count);
+
+/**
+ * @brief This function reads all the test images as bytes, from the files
+ *        read_test_images reads.
+ *
+ * @return RawImages* The images, or nullptr if no file can be read.
+ */
+RawImages *load_raw_test_images();
+
+/**
+ * @brief This function reads all the training images as bytes, from the files
+ *        read_train_images reads.
+ *
+ * @return RawImages* The images, or nullptr if no file can be read.
+ */
+RawImages *load_raw_train_images();
+
+/**
+ * @brief This function deletes images stored as bytes.
  *
- * @return Image**  The array of images that are read.
+ * @param raw The images.
  */
-Image **read_train_images();
+void delete_raw_images(RawImages *raw);
 
 /**
  * @brief This function deletes the images that are passed as a parameter.
@@ -63,21 +315,24 @@ Image **read_train_images();
  * @param images The images that are to be deleted.
  * @param count  The number of images that are to be deleted.
  */
-void delete_images(Image **images, const size_t count = 0);
+template <typename T>
+void delete_images(BasicImage<T> **images, const size_t count = 0);
 
 /**
  * @brief This function deletes the image that is passed as a parameter.
  *
  * @param image The image that is to be deleted.
  */
-void delete_image(Image *image);
+template <typename T>
+void delete_image(BasicImage<T> *image);
 
 /**
  * @brief This function prints the image that is passed as a parameter.
  *
  * @param image The image that is to be printed.
  */
-void print_image(const Image *image);
+template <typename T>
+void print_image(const BasicImage<T> *image);
 
 }  // namespace images
 
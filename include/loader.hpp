@@ -0,0 +1,123 @@
+/**
+ * @file loader.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the mini-batch loader. Worker
+ *        threads gather the samples of the next batches of a dataset, in an
+ *        order shuffled at every epoch, into a ring of buffers allocated once,
+ *        so that the training never waits for its data.
+ * @version 1.0
+ * @date 2023-08-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef LOADER_HPP_
+#define LOADER_HPP_
+
+#include <stdint.h>
+
+#include "augment.hpp"
+#include "dataset.hpp"
+
+namespace images {
+
+/**
+ * @brief How the batches are made.
+ */
+typedef struct {
+  size_t batch_size;
+  size_t prefetch;  // The number of batches prepared ahead, at least 2.
+  size_t workers;   // The number of threads gathering the batches.
+  uint64_t seed;    // The seed of the order of the samples.
+  bool shuffle;     // Whether the order changes at every epoch.
+  bool drop_last;   // Whether the last batch of an epoch is dropped when it
+                    // is smaller than the others.
+  double mean;      // Every element x is given as (x - mean) / std, x being
+  double std;       // in [0, 1] for the pixels of a ByteDataset.
+  AugmentChain augment;  // The transforms of the samples, before mean and
+                         // std. They depend on the seed, the epoch and the
+                         // sample, not on the threads.
+} LoaderOptions;
+
+/**
+ * @brief This function returns the default options: batches of 64 samples,
+ *        4 of them prepared ahead by 2 threads, shuffled with seed 0, and
+ *        the samples as they are in the dataset, without augmentation.
+ *
+ * @return LoaderOptions The options.
+ */
+LoaderOptions loader_default_options();
+
+template <typename T>
+struct BasicLoader;
+
+typedef BasicLoader<double> Loader;
+typedef BasicLoader<float> LoaderF;
+
+/**
+ * @brief This function creates a loader and starts preparing the batches of
+ *        the first epoch. The dataset must outlive the loader.
+ *
+ * The order of the samples of an epoch only depends on the seed and on the
+ * index of the epoch, not on the number of threads or on their timing.
+ *
+ * @param dataset  The dataset.
+ * @param options  The options, nullptr for the default ones.
+ * @return BasicLoader<T>* The loader, or nullptr if the options are invalid
+ *                         or the buffers cannot be allocated.
+ */
+template <typename T>
+BasicLoader<T> *loader_create(const BasicDataset<T> *dataset,
+                              const LoaderOptions *options = nullptr);
+
+/**
+ * @brief This function creates a loader over a dataset of bytes. The pixels
+ *        are turned into T, scaled to [0, 1] and normalized by a SIMD kernel
+ *        as the batches are gathered, so that the dataset stays 4 or 8 times
+ *        smaller than the batches it gives. The element type of the batches
+ *        is given explicitly, e.g. loader_create<float>(dataset).
+ *
+ * @param dataset  The dataset, which must outlive the loader.
+ * @param options  The options, nullptr for the default ones.
+ * @return BasicLoader<T>* The loader, or nullptr if the options are invalid
+ *                         or the buffers cannot be allocated.
+ */
+template <typename T>
+BasicLoader<T> *loader_create(const ByteDataset *dataset,
+                              const LoaderOptions *options = nullptr);
+
+/**
+ * @brief This function returns the next batch of the current epoch. The
+ *        batch is a view of a buffer of the loader: it is valid until the
+ *        next call and must not be deleted.
+ *
+ * @param loader   The loader.
+ * @param batch    Receives the batch.
+ * @return bool    Whether there was a batch. At the end of every epoch it
+ *                 returns false once, then the next call starts the next
+ *                 epoch.
+ */
+template <typename T>
+bool loader_next(BasicLoader<T> *loader, BasicBatch<T> *batch);
+
+/**
+ * @brief This function returns the number of batches of an epoch.
+ *
+ * @param loader   The loader.
+ * @return size_t  The number of batches.
+ */
+template <typename T>
+size_t loader_batches(const BasicLoader<T> *loader);
+
+/**
+ * @brief This function stops the threads of a loader and deletes it.
+ *
+ * @param loader   The loader.
+ */
+template <typename T>
+void loader_delete(BasicLoader<T> *loader);
+
+}  // namespace images
+
+#endif  // LOADER_HPP_
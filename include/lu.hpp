@@ -0,0 +1,85 @@
+/**
+ * @file lu.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the LU factorization that the
+ *        determinant, the linear solver and the inverse of the math library
+ *        are built on.
+ * @version 1.0
+ * @date 2023-07-28
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef LU_HPP_
+#define LU_HPP_
+
+#include "math.hpp"
+
+namespace custom_math {
+
+/**
+ * @brief The factorization P * A = L * U of a square matrix, computed with
+ *        partial pivoting. L and U share one matrix: L is below the diagonal
+ *        (its diagonal is made of ones and is not stored) and U is on and
+ *        above it.
+ */
+template <typename T>
+struct BasicLU {
+  BasicMatrix<T> *lu;
+  size_t *pivots;  // Row i was swapped with row pivots[i], in order.
+  int sign;        // The sign of the permutation, 1 or -1.
+  bool singular;   // Whether a pivot was exactly 0.
+};
+
+typedef BasicLU<double> LU;
+typedef BasicLU<float> LUF;
+
+/**
+ * @brief This function computes the LU factorization of a square matrix. The
+ *        factorization is blocked, so most of the work is done by the GEMM
+ *        engine, and the panels are updated by all the OpenMP threads.
+ *
+ * It is the responsibility of the caller to free the factorization with
+ * lu_delete.
+ *
+ * @param matrix*   The matrix, which is not modified.
+ * @param allocator The allocator of the factors, nullptr for the default one.
+ * @return BasicLU<T>* The factorization, or nullptr if the matrix is missing
+ *                     or not square.
+ */
+template <typename T>
+BasicLU<T> *matrix_lu(const BasicMatrix<T> *matrix,
+                      Allocator *allocator = nullptr);
+
+/**
+ * @brief This function deletes an LU factorization.
+ *
+ * @param lu* The factorization.
+ */
+template <typename T>
+void lu_delete(BasicLU<T> *lu);
+
+/**
+ * @brief This function computes the determinant of the factorized matrix.
+ *
+ * @param lu* The factorization.
+ * @return T   The determinant.
+ */
+template <typename T>
+T lu_determinant(const BasicLU<T> *lu);
+
+/**
+ * @brief This function solves A * X = B in place, B being replaced by X.
+ *
+ * @param lu*      The factorization of A.
+ * @param b*       The right-hand sides, one per column.
+ * @return BasicMatrix<T>* b, or nullptr if the shapes do not match or A is
+ *                         singular.
+ */
+template <typename T>
+BasicMatrix<T> *lu_solve_inplace(const BasicLU<T> *lu, BasicMatrix<T> *b);
+
+}  // namespace custom_math
+
+#endif  // LU_HPP_
@@ -22,12 +22,58 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "allocator.hpp"
+
 namespace custom_math {
 
-typedef struct {
+/**
+ * @brief A row-major matrix. Element (i, j) is elements[i * stride + j], the
+ *        stride being at least the number of columns. Matrices without an
+ *        allocator are views over memory owned by someone else.
+ *
+ * The operations are implemented for float and double elements.
+ */
+template <typename T>
+struct BasicMatrix {
   size_t rows, cols;
-  double *elements;
-} Matrix;
+  size_t stride;         // The distance between two consecutive rows.
+  T *elements;
+  Allocator *allocator;  // The allocator the matrix was created with.
+};
+
+typedef BasicMatrix<double> Matrix;
+typedef BasicMatrix<float> MatrixF;
+
+/**
+ * @brief Keeps a parameter out of template argument deduction, so that the
+ *        element type is only deduced from the matrices (e.g. a lambda or an
+ *        int scalar can still be passed).
+ */
+template <typename T>
+struct NonDeduced {
+  typedef T type;
+};
+
+// Every function that creates a matrix without taking an allocator uses the
+// default allocator of the calling thread (see allocator_set_default). The
+// elements of a created matrix always start on a 64-byte boundary.
+//
+// The functions that create a matrix from nothing need the element type to
+// be given explicitly, e.g. matrix_create<float>(rows, cols). The double
+// versions of the original functions are also available without it, see the
+// end of this file.
+
+/**
+ * @brief This function returns the first element of a row of a matrix.
+ *
+ * @param matrix*  The matrix.
+ * @param row      The index of the row.
+ * @return T*      The first element of the row.
+ */
+template <typename T>
+inline T *matrix_row(const BasicMatrix<T> *matrix, size_t row) {
+  return matrix->elements + row * matrix->stride;
+}
 
 /**
  * @brief This function is used to create a matrix.
@@ -35,44 +81,134 @@ typedef struct {
  * @param rows The number of rows of the matrix.
  * @param cols The number of columns of the matrix.
  * @param value The value of each element of the matrix.
+ * @param allocator The allocator of the matrix, nullptr for the default one.
+ *
+ * @return BasicMatrix<T>* The matrix that was created.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_create(const int rows, const int cols,
+                              const typename NonDeduced<T>::type value = 0,
+                              Allocator *allocator = nullptr);
+
+/**
+ * @brief This function is used to create a matrix whose rows all start on a
+ *        64-byte boundary. The stride is the number of columns rounded up to
+ *        a whole cache line, so element (i, j) is not elements[i * cols + j].
+ *
+ * @param rows The number of rows of the matrix.
+ * @param cols The number of columns of the matrix.
+ * @param value The value of each element of the matrix.
+ * @param allocator The allocator of the matrix, nullptr for the default one.
  *
- * @return Matrix* The matrix that was created.
+ * @return BasicMatrix<T>* The matrix that was created.
  */
-Matrix *matrix_create(const int rows, const int cols, const double value = 0.0);
+template <typename T = double>
+BasicMatrix<T> *matrix_create_aligned(
+    const int rows, const int cols,
+    const typename NonDeduced<T>::type value = 0,
+    Allocator *allocator = nullptr);
 
 /**
  * @brief This function is used to create an identity matrix.
  *
- * @param size     The size of the matrix.
- * @return Matrix* The identity matrix.
+ * @param size      The size of the matrix.
+ * @param allocator The allocator of the matrix, nullptr for the default one.
+ * @return BasicMatrix<T>* The identity matrix.
  */
-Matrix *matrix_I(const int size);
+template <typename T>
+BasicMatrix<T> *matrix_I(const int size, Allocator *allocator = nullptr);
 
 /**
- * @brief This function is used to delete a matrix.
+ * @brief This function is used to delete a matrix. Views are left untouched.
  *
  * @param matrix* The matrix that will be deleted.
  */
-void matrix_delete(Matrix *matrix);
+template <typename T>
+void matrix_delete(BasicMatrix<T> *matrix);
 
 /**
  * @brief This function is used to print a matrix.
  *
  * @param matrix* The matrix that will be printed.
  */
-void matrix_print(const Matrix *matrix);
+template <typename T>
+void matrix_print(const BasicMatrix<T> *matrix);
 
 /**
  * @brief This function is used to copy a matrix.
  *
  * @param matrix*   The matrix that will be copied.
- * @return Matrix* The copy of the matrix.
+ * @param allocator The allocator of the copy, nullptr for the default one.
+ * @return BasicMatrix<T>* The copy of the matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_copy(const BasicMatrix<T> *matrix,
+                            Allocator *allocator = nullptr);
+
+/**
+ * @brief This function is used to convert a matrix to another element type.
+ *
+ * @param matrix*   The matrix that will be converted.
+ * @param allocator The allocator of the result, nullptr for the default one.
+ * @return BasicMatrix<U>* The converted matrix.
+ */
+template <typename U, typename T>
+BasicMatrix<U> *matrix_convert(const BasicMatrix<T> *matrix,
+                               Allocator *allocator = nullptr);
+
+// Matrices are saved in the binary format described in matrix_file.hpp,
+// which keeps every bit of the elements and can be mapped in memory. The text
+// format is kept to export matrices to other tools.
+
+/**
+ * @brief This function is used to save a matrix to a binary file.
+ *
+ * @param matrix*  The matrix that will be saved.
+ * @param filename The name of the file.
+ * @return true    If the file was written.
+ * @return false   If the matrix is missing or the file could not be written.
  */
-Matrix *matrix_copy(const Matrix *matrix);
+template <typename T>
+bool matrix_save(const BasicMatrix<T> *matrix, const char *filename);
 
-void matrix_save(Matrix *matrix, const char *filename);
+/**
+ * @brief This function is used to load a matrix from a binary file. A file
+ *        of floats can be loaded as doubles and the other way around.
+ *
+ * @param filename  The name of the file.
+ * @param allocator The allocator of the matrix, nullptr for the default one.
+ * @return BasicMatrix<T>* The matrix, or nullptr if the file cannot be read,
+ *                         is not a matrix file or is corrupted.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_load(const char *filename,
+                            Allocator *allocator = nullptr);
+
+/**
+ * @brief This function is used to save a matrix to a text file: the number
+ *        of rows and columns, then one line per row. The elements are
+ *        written with enough digits to be read back exactly.
+ *
+ * @param matrix*  The matrix that will be saved.
+ * @param filename The name of the file.
+ * @return true    If the file was written.
+ * @return false   If the matrix is missing or the file could not be written.
+ */
+template <typename T>
+bool matrix_save_text(const BasicMatrix<T> *matrix, const char *filename);
 
-Matrix *matrix_load(const char *filename);
+/**
+ * @brief This function is used to load a matrix from a text file written by
+ *        matrix_save_text.
+ *
+ * @param filename  The name of the file.
+ * @param allocator The allocator of the matrix, nullptr for the default one.
+ * @return BasicMatrix<T>* The matrix, or nullptr if the file cannot be read
+ *                         or is malformed.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_load_text(const char *filename,
+                                 Allocator *allocator = nullptr);
 
 // Operations on matrices
 
@@ -81,64 +217,416 @@ Matrix *matrix_load(const char *filename);
  *
  * @param matrix1*   The first matrix.
  * @param matrix2*   The second matrix.
- * @return Matrix*  The sum of the two matrices.
+ * @return BasicMatrix<T>*  The sum of the two matrices.
  */
-Matrix *matrix_add(Matrix *matrix1, Matrix *matrix2);
+template <typename T>
+BasicMatrix<T> *matrix_add(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2);
 
 /**
  * @brief This function is used to subtract two matrices.
  *
  * @param matrix1*   The first matrix.
  * @param matrix2*   The second matrix.
- * @return Matrix*  The difference of the two matrices.
+ * @return BasicMatrix<T>*  The difference of the two matrices.
  */
-Matrix *matrix_sub(Matrix *matrix1, Matrix *matrix2);
+template <typename T>
+BasicMatrix<T> *matrix_sub(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2);
 
 /**
  * @brief This function is used to multiply two matrices.
  *
  * @param matrix1*   The first matrix.
  * @param matrix2*   The second matrix.
- * @return Matrix*  The product of the two matrices.
+ * @return BasicMatrix<T>*  The product of the two matrices.
  */
-Matrix *matrix_dot(Matrix *matrix1, Matrix *matrix2);
+template <typename T>
+BasicMatrix<T> *matrix_dot(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2);
 
 /**
  * @brief This function is used to multiply a matrix with a scalar.
  *
  * @param matrix*    The matrix.
  * @param scalar    The scalar.
- * @return Matrix*  The product of the matrix and the scalar.
+ * @return BasicMatrix<T>*  The product of the matrix and the scalar.
  */
-Matrix *matrix_mul_scalar(Matrix *matrix, double scalar);
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar(BasicMatrix<T> *matrix,
+                                  const typename NonDeduced<T>::type scalar);
 
 /**
  * @brief  This is used to transpose a matrix.
  *
  * @param matrix*  The matrix.
- * @return Matrix* The transpose of the matrix.
+ * @return BasicMatrix<T>* The transpose of the matrix.
  */
-Matrix *matrix_transpose(Matrix *matrix);
+template <typename T>
+BasicMatrix<T> *matrix_transpose(BasicMatrix<T> *matrix);
 
-Matrix *matrix_minor(Matrix *matrix, int row, int col);
+/**
+ * @brief This function is used to get the minor of a matrix, i.e. a copy of
+ *        the matrix without one of its rows and one of its columns.
+ *
+ * @param matrix*  The matrix.
+ * @param row      The row that is removed.
+ * @param col      The column that is removed.
+ * @return BasicMatrix<T>* The minor of the matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_minor(BasicMatrix<T> *matrix, int row, int col);
 
 /**
- * @brief This function is used to calculate the determinant of a matrix.
+ * @brief This function is used to calculate the determinant of a matrix. It
+ *        is computed from the LU factorization of the matrix (see lu.hpp).
  *
  * @param matrix*  The matrix.
- * @return Matrix* The determinant of the matrix.
+ * @return T       The determinant of the matrix, 0 if it is not square.
  */
-double matrix_determinant(Matrix *matrix);
+template <typename T>
+T matrix_determinant(BasicMatrix<T> *matrix);
+
+/**
+ * @brief This function is used to solve the linear system matrix * x = b.
+ *
+ * @param matrix*  The square matrix of the system.
+ * @param b*       The right-hand sides, one per column.
+ * @return BasicMatrix<T>* The solutions, one per column, or nullptr if the
+ *                         matrix is singular or the shapes do not match.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_solve(BasicMatrix<T> *matrix, BasicMatrix<T> *b);
 
 /**
  * @brief This function is used to calculate the inverse of a matrix.
  *
  * @param matrix*  The matrix.
+ * @return BasicMatrix<T>* The inverse of the matrix, or nullptr if it is
+ *                         singular or not square.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_inverse(BasicMatrix<T> *matrix);
+
+/**
+ * @brief This function is used to apply a function to every element of a
+ *        matrix.
+ *
+ * @param matrix*  The matrix.
+ * @param function The function that will be applied to the matrix.
+ * @return BasicMatrix<T>* The resulted of the matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_apply(BasicMatrix<T> *matrix,
+                             typename NonDeduced<T (*)(T)>::type function);
+
+// Operations into caller-owned matrices
+//
+// These functions write their result into a destination matrix that already
+// has the right shape, so they do not allocate anything. They return the
+// destination, or nullptr if a matrix is missing, the shapes do not match or
+// the destination aliases an operand in a way that is not allowed.
+//
+// The element-wise operations (copy excepted) allow the destination to be
+// one of their operands, but not to partially overlap one. The product and
+// the transpose need a destination that shares no memory with the operands.
+
+/**
+ * @brief This function is used to copy a matrix into another one.
+ *
+ * @param destination* The matrix that receives the copy.
+ * @param matrix*      The matrix that will be copied.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_copy_into(BasicMatrix<T> *destination,
+                                 const BasicMatrix<T> *matrix);
+
+/**
+ * @brief This function is used to add two matrices into a third one.
+ *
+ * @param destination* The matrix that receives the sum.
+ * @param matrix1*     The first matrix.
+ * @param matrix2*     The second matrix.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_add_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2);
+
+/**
+ * @brief This function is used to subtract two matrices into a third one.
+ *
+ * @param destination* The matrix that receives the difference.
+ * @param matrix1*     The first matrix.
+ * @param matrix2*     The second matrix.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_sub_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2);
+
+/**
+ * @brief This function is used to multiply two matrices into a third one.
+ *
+ * @param destination* The matrix that receives the product.
+ * @param matrix1*     The first matrix.
+ * @param matrix2*     The second matrix.
+ * @param accumulate   Whether the product is added to the destination
+ *                     (destination += matrix1 * matrix2) instead of
+ *                     overwriting it.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_dot_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2,
+                                const bool accumulate = false);
+
+/**
+ * @brief This function is used to multiply a matrix with a scalar into
+ *        another matrix.
+ *
+ * @param destination* The matrix that receives the product.
+ * @param matrix*      The matrix.
+ * @param scalar       The scalar.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar_into(
+    BasicMatrix<T> *destination, BasicMatrix<T> *matrix,
+    const typename NonDeduced<T>::type scalar);
+
+/**
+ * @brief This function is used to transpose a matrix into another one.
+ *
+ * @param destination* The matrix that receives the transpose.
+ * @param matrix*      The matrix.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_transpose_into(BasicMatrix<T> *destination,
+                                      BasicMatrix<T> *matrix);
+
+/**
+ * @brief This function is used to apply a function to every element of a
+ *        matrix and store the results into another matrix.
+ *
+ * @param destination* The matrix that receives the results.
+ * @param matrix*      The matrix.
+ * @param function     The function that will be applied to the matrix.
+ * @return BasicMatrix<T>* The destination.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_apply_into(
+    BasicMatrix<T> *destination, BasicMatrix<T> *matrix,
+    typename NonDeduced<T (*)(T)>::type function);
+
+// In-place operations
+
+/**
+ * @brief This function adds a matrix to another one (matrix += other).
+ *
+ * @param matrix*  The matrix that is modified.
+ * @param other*   The matrix that is added.
+ * @return BasicMatrix<T>* The modified matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_add_inplace(BasicMatrix<T> *matrix,
+                                   BasicMatrix<T> *other);
+
+/**
+ * @brief This function subtracts a matrix from another one (matrix -= other).
+ *
+ * @param matrix*  The matrix that is modified.
+ * @param other*   The matrix that is subtracted.
+ * @return BasicMatrix<T>* The modified matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_sub_inplace(BasicMatrix<T> *matrix,
+                                   BasicMatrix<T> *other);
+
+/**
+ * @brief This function multiplies a matrix with a scalar (matrix *= scalar).
+ *
+ * @param matrix*  The matrix that is modified.
+ * @param scalar   The scalar.
+ * @return BasicMatrix<T>* The modified matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar_inplace(
+    BasicMatrix<T> *matrix, const typename NonDeduced<T>::type scalar);
+
+/**
+ * @brief This function transposes a square matrix in place.
+ *
+ * @param matrix*  The matrix that is modified.
+ * @return BasicMatrix<T>* The modified matrix, or nullptr if it is not
+ *                         square.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_transpose_inplace(BasicMatrix<T> *matrix);
+
+/**
+ * @brief This function applies a function to every element of a matrix in
+ *        place.
+ *
+ * @param matrix*  The matrix that is modified.
  * @param function The function that will be applied to the matrix.
- * @return Matrix* The resulted of the matrix.
+ * @return BasicMatrix<T>* The modified matrix.
+ */
+template <typename T>
+BasicMatrix<T> *matrix_apply_inplace(
+    BasicMatrix<T> *matrix, typename NonDeduced<T (*)(T)>::type function);
+
+// Views
+//
+// A view is a matrix that points into the elements of another one, so
+// creating it costs nothing. It is returned by value, does not need to be
+// deleted and must not outlive the matrix it points into. Every operation
+// accepts views. When the requested view does not fit, the returned view has
+// no elements and every operation rejects it.
+
+/**
+ * @brief This function is used to get a view of a block of a matrix.
+ *
+ * @param matrix* The matrix.
+ * @param row     The first row of the block.
+ * @param col     The first column of the block.
+ * @param rows    The number of rows of the block.
+ * @param cols    The number of columns of the block.
+ * @return BasicMatrix<T> The view of the block.
+ */
+template <typename T>
+BasicMatrix<T> matrix_view(const BasicMatrix<T> *matrix, size_t row,
+                           size_t col, size_t rows, size_t cols);
+
+/**
+ * @brief This function is used to get a view of consecutive rows of a matrix,
+ *        e.g. a mini-batch of a dataset.
+ *
+ * @param matrix* The matrix.
+ * @param row     The first row.
+ * @param rows    The number of rows.
+ * @return BasicMatrix<T> The view of the rows.
+ */
+template <typename T>
+BasicMatrix<T> matrix_view_rows(const BasicMatrix<T> *matrix, size_t row,
+                                size_t rows);
+
+/**
+ * @brief This function is used to get a view of consecutive columns of a
+ *        matrix.
+ *
+ * @param matrix* The matrix.
+ * @param col     The first column.
+ * @param cols    The number of columns.
+ * @return BasicMatrix<T> The view of the columns.
+ */
+template <typename T>
+BasicMatrix<T> matrix_view_cols(const BasicMatrix<T> *matrix, size_t col,
+                                size_t cols);
+
+/**
+ * @brief This function is used to see the elements of a contiguous matrix
+ *        with another shape that has the same number of elements.
+ *
+ * @param matrix* The matrix, whose stride must be its number of columns.
+ * @param rows    The number of rows of the view.
+ * @param cols    The number of columns of the view.
+ * @return BasicMatrix<T> The reshaped view.
+ */
+template <typename T>
+BasicMatrix<T> matrix_reshape(const BasicMatrix<T> *matrix, size_t rows,
+                              size_t cols);
+
+/**
+ * @brief This function is used to see external memory as a matrix.
+ *
+ * @param elements The first element.
+ * @param rows     The number of rows.
+ * @param cols     The number of columns.
+ * @param stride   The distance between two consecutive rows.
+ * @return BasicMatrix<T> The view of the memory.
  */
-Matrix *matrix_apply(Matrix *matrix, double (*function)(double));
+template <typename T>
+BasicMatrix<T> matrix_wrap(T *elements, size_t rows, size_t cols,
+                           size_t stride);
+
+// The original double API, kept for compatibility. These functions also
+// accept a null pointer literal, which the templates above cannot deduce an
+// element type from.
+
+inline Matrix *matrix_create(const int rows, const int cols,
+                             const double value = 0.0,
+                             Allocator *allocator = nullptr) {
+  return matrix_create<double>(rows, cols, value, allocator);
+}
+
+inline Matrix *matrix_I(const int size, Allocator *allocator = nullptr) {
+  return matrix_I<double>(size, allocator);
+}
+
+inline void matrix_delete(Matrix *matrix) { matrix_delete<double>(matrix); }
+
+inline void matrix_print(const Matrix *matrix) {
+  matrix_print<double>(matrix);
+}
+
+inline Matrix *matrix_copy(const Matrix *matrix,
+                           Allocator *allocator = nullptr) {
+  return matrix_copy<double>(matrix, allocator);
+}
+
+inline bool matrix_save(const Matrix *matrix, const char *filename) {
+  return matrix_save<double>(matrix, filename);
+}
+
+inline Matrix *matrix_load(const char *filename,
+                           Allocator *allocator = nullptr) {
+  return matrix_load<double>(filename, allocator);
+}
+
+inline bool matrix_save_text(const Matrix *matrix, const char *filename) {
+  return matrix_save_text<double>(matrix, filename);
+}
+
+inline Matrix *matrix_load_text(const char *filename,
+                                Allocator *allocator = nullptr) {
+  return matrix_load_text<double>(filename, allocator);
+}
+
+inline Matrix *matrix_add(Matrix *matrix1, Matrix *matrix2) {
+  return matrix_add<double>(matrix1, matrix2);
+}
+
+inline Matrix *matrix_sub(Matrix *matrix1, Matrix *matrix2) {
+  return matrix_sub<double>(matrix1, matrix2);
+}
+
+inline Matrix *matrix_dot(Matrix *matrix1, Matrix *matrix2) {
+  return matrix_dot<double>(matrix1, matrix2);
+}
+
+inline Matrix *matrix_mul_scalar(Matrix *matrix, double scalar) {
+  return matrix_mul_scalar<double>(matrix, scalar);
+}
+
+inline Matrix *matrix_transpose(Matrix *matrix) {
+  return matrix_transpose<double>(matrix);
+}
+
+inline Matrix *matrix_minor(Matrix *matrix, int row, int col) {
+  return matrix_minor<double>(matrix, row, col);
+}
+
+inline double matrix_determinant(Matrix *matrix) {
+  return matrix_determinant<double>(matrix);
+}
+
+inline Matrix *matrix_apply(Matrix *matrix, double (*function)(double)) {
+  return matrix_apply<double>(matrix, function);
+}
 
 };  // namespace custom_math
 
-#endif  // MATH_HPP_
\ No newline at end of file
+#endif  // MATH_HPP_
@@ -0,0 +1,105 @@
+/**
+ * @file matrix_file.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the binary matrix files written by
+ *        matrix_save. A file can be mapped in memory and used as a read-only
+ *        matrix without copying or parsing anything.
+ * @version 1.0
+ * @date 2023-08-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MATRIX_FILE_HPP_
+#define MATRIX_FILE_HPP_
+
+#include <stdint.h>
+
+#include "math.hpp"
+
+namespace custom_math {
+
+#define MATRIX_FILE_MAGIC "CMMATRIX"
+#define MATRIX_FILE_VERSION 1
+
+// The elements start at a multiple of this offset in the file, so that they
+// are aligned like the rows of matrix_create_aligned once mapped.
+#define MATRIX_FILE_ALIGNMENT 64
+
+typedef enum { MATRIX_DTYPE_FLOAT64 = 1, MATRIX_DTYPE_FLOAT32 = 2 } MatrixDtype;
+
+/**
+ * @brief The header at the start of a matrix file. It is followed by the
+ *        elements, rows * stride of them starting at offset, in row-major
+ *        order. Every field is in the byte order of the machine that wrote
+ *        the file (little-endian on every supported target).
+ */
+typedef struct {
+  char magic[8];        // MATRIX_FILE_MAGIC, without the terminating '\0'.
+  uint32_t version;     // MATRIX_FILE_VERSION.
+  uint32_t dtype;       // A MatrixDtype.
+  uint64_t rows;        // The number of rows.
+  uint64_t cols;        // The number of columns.
+  uint64_t stride;      // The distance between two consecutive rows.
+  uint64_t alignment;   // The alignment of offset, MATRIX_FILE_ALIGNMENT.
+  uint64_t offset;      // The position of the first element in the file.
+  uint64_t checksum;    // The checksum of the elements, see matrix_checksum.
+} MatrixFileHeader;
+
+/**
+ * @brief A matrix file mapped in memory. The matrix is a view of the file:
+ *        its elements must not be written and it must not be used after
+ *        matrix_unmap.
+ */
+template <typename T>
+struct BasicMappedMatrix {
+  BasicMatrix<T> matrix;
+  void *address;  // The start of the mapping.
+  size_t size;    // The size of the mapping in bytes.
+};
+
+typedef BasicMappedMatrix<double> MappedMatrix;
+typedef BasicMappedMatrix<float> MappedMatrixF;
+
+/**
+ * @brief This function computes the checksum stored in the matrix files. It
+ *        is a 64-bit FNV-1a hash run over 8-byte words in 4 interleaved
+ *        lanes, so that it is limited by the memory bandwidth.
+ *
+ * @param data      The bytes.
+ * @param size      The number of bytes.
+ * @return uint64_t The checksum.
+ */
+uint64_t matrix_checksum(const void *data, size_t size);
+
+/**
+ * @brief This function maps a matrix file in memory. The header is always
+ *        checked, the checksum only when asked for since it reads the whole
+ *        file: without it the elements are only read from the disk when they
+ *        are used.
+ *
+ * It is the responsibility of the caller to unmap the file with
+ * matrix_unmap.
+ *
+ * @param filename  The name of the file.
+ * @param verify    Whether to check the checksum of the elements.
+ * @return BasicMappedMatrix<T>* The mapped matrix, or nullptr if the file
+ *                               cannot be mapped, is not a matrix file of
+ *                               this element type or is corrupted.
+ */
+template <typename T = double>
+BasicMappedMatrix<T> *matrix_map_file(const char *filename,
+                                      bool verify = false);
+
+/**
+ * @brief This function unmaps a matrix file.
+ *
+ * @param mapped* The mapped matrix.
+ */
+template <typename T>
+void matrix_unmap(BasicMappedMatrix<T> *mapped);
+
+}  // namespace custom_math
+
+#endif  // MATRIX_FILE_HPP_
@@ -0,0 +1,290 @@
+/**
+ * @file network.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the feed-forward networks: dense
+ *        layers trained on whole mini-batches, one GEMM per layer and per
+ *        pass, with all the intermediate results in buffers allocated once.
+ * @version 1.0
+ * @date 2023-08-11
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef NETWORK_HPP_
+#define NETWORK_HPP_
+
+#include <stdint.h>
+
+#include "activation.hpp"
+#include "allocator.hpp"
+#include "dataset.hpp"
+#include "math.hpp"
+#include "optimizer.hpp"
+
+namespace neural {
+
+#define NETWORK_MAX_LAYERS 16
+
+/**
+ * @brief A dense layer: outputs = f(inputs * weights + bias), one sample per
+ *        row. The weights and the bias are views of the parameters of the
+ *        network.
+ */
+template <typename T>
+struct BasicDense {
+  size_t inputs;
+  size_t outputs;
+  custom_math::Activation activation;
+  bool activated;  // Whether activation is applied, it is not for the output
+                   // layer, whose outputs are the logits.
+  size_t offset;   // The index of the first weight in the parameters, the
+                   // bias follows the weights.
+  custom_math::BasicMatrix<T> weights;  // inputs x outputs.
+  T *bias;
+};
+
+/**
+ * @brief A feed-forward network. All the parameters are stored in one array,
+ *        layer after layer, each layer on a 64-byte boundary, so that they
+ *        can be updated, reduced or sent as a whole. The gradients of a
+ *        workspace have the same layout.
+ */
+template <typename T>
+struct BasicNetwork {
+  size_t count;  // The number of layers.
+  BasicDense<T> layers[NETWORK_MAX_LAYERS];
+  T *parameters;
+  size_t size;  // The size of parameters, padding included.
+  custom_math::Allocator *allocator;  // The allocator of the block.
+  size_t block;                       // The size of the block.
+};
+
+typedef BasicNetwork<double> Network;
+typedef BasicNetwork<float> NetworkF;
+
+/**
+ * @brief The buffers of the passes over a mini-batch: for every layer, the
+ *        products z and the outputs a, which are z itself for the output
+ *        layer, and the gradients of the loss with respect to z. The backward
+ *        pass replaces z by the derivative of the activation at z.
+ */
+template <typename T>
+struct BasicWorkspace {
+  size_t capacity;  // The largest number of samples of a pass.
+  size_t rows;      // The number of samples of the last forward pass.
+  custom_math::BasicMatrix<T> z[NETWORK_MAX_LAYERS];
+  custom_math::BasicMatrix<T> a[NETWORK_MAX_LAYERS];
+  custom_math::BasicMatrix<T> delta[NETWORK_MAX_LAYERS];
+  T *gradients;  // The gradients of the parameters, laid out like them.
+  size_t size;   // The size of gradients.
+  custom_math::Allocator *allocator;
+  size_t block;
+};
+
+typedef BasicWorkspace<double> Workspace;
+typedef BasicWorkspace<float> WorkspaceF;
+
+/**
+ * @brief This function creates a network of dense layers. The weights are
+ *        drawn uniformly, scaled for the activation (He for the ReLUs and
+ *        GELU, Glorot otherwise), and the biases are 0.
+ *
+ * @param sizes      The sizes of the layers, inputs first, e.g. {784, 128,
+ *                   10} for one hidden layer.
+ * @param count      The number of sizes, at least 2.
+ * @param activation The activation of the hidden layers.
+ * @param seed       The seed of the weights.
+ * @param allocator  The allocator of the network, nullptr for the default.
+ * @return BasicNetwork<T>* The network, or nullptr if the sizes are invalid
+ *                          or it cannot be allocated.
+ */
+template <typename T>
+BasicNetwork<T> *network_create(const size_t *sizes, size_t count,
+                                const custom_math::Activation *activation,
+                                uint64_t seed = 0,
+                                custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function deletes a network.
+ *
+ * @param network The network.
+ */
+template <typename T>
+void network_delete(BasicNetwork<T> *network);
+
+/**
+ * @brief This function creates the buffers of the passes of a network over
+ *        up to capacity samples.
+ *
+ * @param network   The network.
+ * @param capacity  The largest number of samples of a pass.
+ * @param allocator The allocator of the workspace, nullptr for the default.
+ * @return BasicWorkspace<T>* The workspace, or nullptr if it cannot be
+ *                            allocated.
+ */
+template <typename T>
+BasicWorkspace<T> *workspace_create(
+    const BasicNetwork<T> *network, size_t capacity,
+    custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function deletes a workspace.
+ *
+ * @param workspace The workspace.
+ */
+template <typename T>
+void workspace_delete(BasicWorkspace<T> *workspace);
+
+/**
+ * @brief This function computes the logits of samples. The bias and the
+ *        activation of a layer are applied in the epilogue of its GEMM.
+ *
+ * @param network   The network.
+ * @param workspace The workspace.
+ * @param inputs    The samples, one per row.
+ * @return const BasicMatrix<T>* The logits, one row per sample, a view of
+ *                               the workspace valid until the next pass, or
+ *                               nullptr if the samples do not fit.
+ */
+template <typename T>
+const custom_math::BasicMatrix<T> *network_forward(
+    const BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+    const custom_math::BasicMatrix<T> *inputs);
+
+/**
+ * @brief This function checks that labels are classes of a network, in
+ *        [0, outputs of the last layer).
+ *
+ * @param network The network.
+ * @param labels  The labels.
+ * @param count   The number of labels.
+ * @return bool   Whether all the labels are valid.
+ */
+template <typename T>
+bool network_check_labels(const BasicNetwork<T> *network, const int *labels,
+                          size_t count);
+
+/**
+ * @brief Called by the backward pass as soon as the gradients of a layer are
+ *        final, from the last layer to the first, e.g. to send them while
+ *        the pass goes on with the previous layers.
+ */
+typedef struct {
+  void (*layer_done)(void *context, size_t layer);
+  void *context;
+} BackwardHook;
+
+/**
+ * @brief This function computes the gradients of the mean softmax
+ *        cross-entropy of the samples of the last forward pass.
+ *
+ * @param network   The network.
+ * @param workspace The workspace, whose gradients are overwritten.
+ * @param inputs    The samples given to the forward pass.
+ * @param labels    The labels of the samples.
+ * @param count     The number of samples the loss is averaged over, when
+ *                  the pass is a shard of a larger batch, so that the
+ *                  gradients of the shards add up; 0 for the samples of the
+ *                  pass.
+ * @param hook      Told about every layer whose gradients are final, nullptr
+ *                  for none. The pass never writes them again.
+ * @return T        The loss of the samples divided by count, or NaN if a
+ *                  label is invalid: the gradients are then 0, and the hook
+ *                  is still told about every layer.
+ */
+template <typename T>
+T network_backward(const BasicNetwork<T> *network,
+                   BasicWorkspace<T> *workspace,
+                   const custom_math::BasicMatrix<T> *inputs,
+                   const int *labels, size_t count = 0,
+                   const BackwardHook *hook = nullptr);
+
+/**
+ * @brief This function takes a step of gradient descent: parameters -=
+ *        learning_rate * gradients.
+ *
+ * @param network       The network.
+ * @param workspace     The workspace holding the gradients.
+ * @param learning_rate The learning rate.
+ */
+template <typename T>
+void network_sgd(BasicNetwork<T> *network, const BasicWorkspace<T> *workspace,
+                 T learning_rate);
+
+/**
+ * @brief This function trains a network on a mini-batch: forward pass,
+ *        backward pass and a step of gradient descent.
+ *
+ * @param network       The network.
+ * @param workspace     The workspace, of a capacity of at least the batch.
+ * @param batch         The mini-batch.
+ * @param learning_rate The learning rate.
+ * @return T            The mean loss of the batch before the step, or NaN
+ *                      if the batch does not fit or has an invalid label, in
+ *                      which case no step is taken.
+ */
+template <typename T>
+T network_train_batch(BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+                      const images::BasicBatch<T> *batch, T learning_rate);
+
+/**
+ * @brief This function trains a network on a mini-batch with an optimizer:
+ *        forward pass, backward pass and a step of the optimizer.
+ *
+ * @param network   The network.
+ * @param workspace The workspace, of a capacity of at least the batch.
+ * @param batch     The mini-batch.
+ * @param optimizer The optimizer, over network->size parameters.
+ * @return T        The mean loss of the batch before the step, or NaN if the
+ *                  batch or the optimizer do not fit or a label is invalid,
+ *                  in which case no step is taken.
+ */
+template <typename T>
+T network_train_batch(BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+                      const images::BasicBatch<T> *batch,
+                      BasicOptimizer<T> *optimizer);
+
+/**
+ * @brief This function returns the fraction of the samples of a dataset whose
+ *        largest logit is the one of their label. They are evaluated by
+ *        batches of the capacity of the workspace.
+ *
+ * @param network   The network.
+ * @param workspace The workspace.
+ * @param dataset   The dataset.
+ * @return double   The accuracy, in [0, 1].
+ */
+template <typename T>
+double network_accuracy(const BasicNetwork<T> *network,
+                        BasicWorkspace<T> *workspace,
+                        const images::BasicDataset<T> *dataset);
+
+/**
+ * @brief This function saves the parameters of a network to a matrix file,
+ *        as a single row: the weights then the bias of every layer, without
+ *        the padding. The sizes of the layers are not saved: the file can
+ *        only be loaded into a network of the same sizes.
+ *
+ * @param network  The network.
+ * @param filename The name of the file.
+ * @return bool    Whether the file was written.
+ */
+template <typename T>
+bool network_save(const BasicNetwork<T> *network, const char *filename);
+
+/**
+ * @brief This function loads the parameters of a network saved by
+ *        network_save, possibly with the other element type.
+ *
+ * @param network  The network, of the sizes of the saved one.
+ * @param filename The name of the file.
+ * @return bool    Whether the parameters were loaded, they are left as they
+ *                 were if the file cannot be read or has another size.
+ */
+template <typename T>
+bool network_load(BasicNetwork<T> *network, const char *filename);
+
+}  // namespace neural
+
+#endif  // NETWORK_HPP_
@@ -0,0 +1,124 @@
+/**
+ * @file optimizer.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the optimizers: gradient descent,
+ *        with momentum or Nesterov momentum, Adam and AdamW, each applied to
+ *        a flat array of parameters in a single pass that updates the
+ *        parameters and the state of the optimizer together.
+ * @version 1.0
+ * @date 2023-08-13
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef OPTIMIZER_HPP_
+#define OPTIMIZER_HPP_
+
+#include "allocator.hpp"
+
+namespace neural {
+
+typedef enum {
+  OPTIMIZER_SGD,       // p -= lr * g.
+  OPTIMIZER_MOMENTUM,  // v = momentum * v + g, p -= lr * v.
+  OPTIMIZER_NESTEROV,  // v = momentum * v + g, p -= lr * (g + momentum * v).
+  OPTIMIZER_ADAM,      // The moments of g, corrected for their bias.
+  OPTIMIZER_ADAMW      // Adam, with the weight decay decoupled from g.
+} OptimizerType;
+
+/**
+ * @brief An optimizer and its hyperparameters. The weight decay is added to
+ *        the gradients, weight_decay * p, except for AdamW, which shrinks the
+ *        parameters by lr * weight_decay * p at every step instead.
+ */
+typedef struct {
+  OptimizerType type;
+  double learning_rate;
+  double momentum;  // For OPTIMIZER_MOMENTUM and OPTIMIZER_NESTEROV.
+  double beta1;     // The decays of the moments of Adam and AdamW.
+  double beta2;
+  double epsilon;
+  double weight_decay;
+} OptimizerOptions;
+
+/**
+ * @brief This function returns the usual hyperparameters of an optimizer: a
+ *        learning rate of 0.01, or 0.001 for Adam and AdamW, a momentum of
+ *        0.9, betas of 0.9 and 0.999, an epsilon of 1e-8 and no weight decay,
+ *        or 0.01 for AdamW.
+ *
+ * @param type The optimizer.
+ * @return OptimizerOptions The options.
+ */
+OptimizerOptions optimizer_default_options(OptimizerType type);
+
+/**
+ * @brief The state of an optimizer over size parameters: one block holding
+ *        its moments, each laid out like the parameters on 64-byte
+ *        boundaries. Created from the same arena as the network and its
+ *        workspace, the parameters, the gradients and the state are all in
+ *        one contiguous region.
+ */
+template <typename T>
+struct BasicOptimizer {
+  OptimizerOptions options;
+  size_t size;   // The number of parameters.
+  size_t steps;  // The number of steps taken.
+  T *first;      // The velocity, or the first moment of Adam, nullptr for
+                 // OPTIMIZER_SGD.
+  T *second;     // The second moment of Adam, nullptr otherwise.
+  custom_math::Allocator *allocator;
+  size_t block;
+};
+
+typedef BasicOptimizer<double> Optimizer;
+typedef BasicOptimizer<float> OptimizerF;
+
+/**
+ * @brief This function creates an optimizer, whose state starts at 0.
+ *
+ * @param size      The number of parameters, e.g. network->size.
+ * @param options   The optimizer, copied.
+ * @param allocator The allocator of the state, nullptr for the default.
+ * @return BasicOptimizer<T>* The optimizer, or nullptr if the options are
+ *                            invalid or it cannot be allocated.
+ */
+template <typename T>
+BasicOptimizer<T> *optimizer_create(
+    size_t size, const OptimizerOptions *options,
+    custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function takes a step: it updates the parameters and the state
+ *        in one pass over the arrays, vectorized and split over the OpenMP
+ *        threads.
+ *
+ * @param optimizer  The optimizer.
+ * @param parameters The parameters, optimizer->size of them.
+ * @param gradients  Their gradients, laid out like them.
+ */
+template <typename T>
+void optimizer_step(BasicOptimizer<T> *optimizer, T *parameters,
+                    const T *gradients);
+
+/**
+ * @brief This function sets the state of an optimizer back to 0, as it was
+ *        when it was created.
+ *
+ * @param optimizer The optimizer.
+ */
+template <typename T>
+void optimizer_reset(BasicOptimizer<T> *optimizer);
+
+/**
+ * @brief This function deletes an optimizer.
+ *
+ * @param optimizer The optimizer.
+ */
+template <typename T>
+void optimizer_delete(BasicOptimizer<T> *optimizer);
+
+}  // namespace neural
+
+#endif  // OPTIMIZER_HPP_
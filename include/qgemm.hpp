@@ -0,0 +1,80 @@
+/**
+ * @file qgemm.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the 8-bit integer matrix
+ *        multiplication of the quantized networks: unsigned 8-bit activations
+ *        times signed 8-bit weights, summed exactly in 32 bits.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef QGEMM_HPP_
+#define QGEMM_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gemm.hpp"
+
+namespace custom_math {
+
+/**
+ * @brief The largest element of A. The AVX2 kernel multiplies the bytes with
+ *        vpmaddubsw, which adds the products two by two into 16 bits with
+ *        saturation: with 7-bit activations, 2 * 127 * 128 always fits, so
+ *        all the kernels give the same exact sums.
+ */
+#define QGEMM_MAX_ACTIVATION 127
+
+/**
+ * @brief The number of elements of B once packed: its rows are grouped by 4
+ *        and its columns padded to a multiple of 16.
+ *
+ * @param k The number of rows of B.
+ * @param n The number of columns of B.
+ * @return size_t The number of bytes of the packed matrix.
+ */
+size_t qgemm_packed_size(size_t k, size_t n);
+
+/**
+ * @brief This function packs B for qgemm: the 4 elements of a column in 4
+ *        consecutive rows are stored next to each other, the layout that
+ *        vpmaddubsw and the VNNI instruction vpdpbusd multiply with 4 bytes
+ *        of a row of A. The padding is filled with zeros.
+ *
+ * @param k      The number of rows of B.
+ * @param n      The number of columns of B.
+ * @param b      The elements of B, in row-major order.
+ * @param ldb    The distance between two consecutive rows of B.
+ * @param packed Receives qgemm_packed_size(k, n) bytes.
+ */
+void qgemm_pack(size_t k, size_t n, const int8_t *b, size_t ldb,
+                int8_t *packed);
+
+/**
+ * @brief This function computes C = A * B in 32-bit integers, where A holds
+ *        bytes in [0, QGEMM_MAX_ACTIVATION] and B was packed by qgemm_pack.
+ *        The kernel uses VNNI with AVX-512, vpmaddubsw with AVX2. The blocks
+ *        of rows of C are distributed over the OpenMP threads.
+ *
+ * @param m        The number of rows of A and C.
+ * @param n        The number of columns of B and C.
+ * @param k        The number of columns of A and rows of B.
+ * @param a        The elements of A.
+ * @param lda      The distance between two consecutive rows of A.
+ * @param packed   B, packed.
+ * @param c        The elements of C.
+ * @param ldc      The distance between two consecutive rows of C.
+ * @param epilogue The function applied to the blocks of C, e.g. to turn the
+ *                 sums back into real numbers, nullptr for none.
+ */
+void qgemm(size_t m, size_t n, size_t k, const uint8_t *a, size_t lda,
+           const int8_t *packed, int32_t *c, size_t ldc,
+           const GemmEpilogue *epilogue = nullptr);
+
+}  // namespace custom_math
+
+#endif  // QGEMM_HPP_
@@ -0,0 +1,166 @@
+/**
+ * @file quantize.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the quantized networks: the
+ *        post-training quantization of a trained network to 8-bit weights,
+ *        one scale per output, and 8-bit activations, whose ranges are
+ *        calibrated on samples. The inference runs on the integer GEMM of
+ *        qgemm.hpp, which requantizes the outputs of a layer for the next
+ *        one in its epilogue.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef QUANTIZE_HPP_
+#define QUANTIZE_HPP_
+
+#include <stdint.h>
+
+#include "network.hpp"
+
+namespace neural {
+
+/**
+ * @brief A quantized dense layer. Its input x is stored as bytes q in
+ *        [0, QGEMM_MAX_ACTIVATION], x = input_scale * (q - input_zero), and
+ *        its weights as signed bytes w, in [-127, 127], weights[i][j] =
+ *        weight_scale[j] * w[i][j], so that output j is
+ *
+ *          f(scales[j] * (sum_i q[i] * w[i][j] - offsets[j]) + bias[j])
+ *
+ *        with scales[j] = input_scale * weight_scale[j] and offsets[j] =
+ *        input_zero * sum_i w[i][j].
+ */
+typedef struct {
+  size_t inputs;
+  size_t outputs;
+  custom_math::Activation activation;
+  bool activated;
+  float input_scale;
+  int32_t input_zero;
+  int8_t *weights;   // Packed by qgemm_pack.
+  float *scales;     // One per output.
+  int32_t *offsets;  // One per output.
+  float *bias;       // One per output.
+} QuantizedDense;
+
+/**
+ * @brief A quantized network. The structure and the arrays of the layers
+ *        share one block of memory.
+ */
+typedef struct {
+  size_t count;  // The number of layers.
+  QuantizedDense layers[NETWORK_MAX_LAYERS];
+  custom_math::Allocator *allocator;  // The allocator of the block.
+  size_t block;                       // The size of the block.
+} QuantizedNetwork;
+
+/**
+ * @brief The buffers of the inference over up to capacity samples: the
+ *        quantized inputs of every layer, the sums of the integer GEMM and
+ *        the real outputs of the layers, the logits at the end.
+ */
+typedef struct {
+  size_t capacity;
+  uint8_t *inputs[NETWORK_MAX_LAYERS];  // capacity x layer inputs.
+  int32_t *sums;                        // capacity x the widest layer.
+  custom_math::MatrixF outputs;         // capacity x the widest layer.
+  custom_math::MatrixF logits;          // The view of the last pass.
+  custom_math::Allocator *allocator;
+  size_t block;
+} QuantizedWorkspace;
+
+/**
+ * @brief This function quantizes a trained network. The range of the input
+ *        of every layer is the range of its values over a forward pass of
+ *        the calibration samples, widened to hold 0. The ranges of the
+ *        weights are taken per output, so that a single large weight only
+ *        coarsens the quantization of its own output.
+ *
+ * @param network     The network.
+ * @param calibration The samples the ranges are measured on, e.g. the ones of
+ *                    read_test_dataset.
+ * @param count       The number of samples to use, 0 for all of them.
+ * @return QuantizedNetwork* The quantized network, or nullptr if there are no
+ *                           samples, they do not fit the network or it
+ *                           cannot be allocated.
+ */
+template <typename T>
+QuantizedNetwork *quantize_network(const BasicNetwork<T> *network,
+                                   const images::BasicDataset<T> *calibration,
+                                   size_t count = 0);
+
+/**
+ * @brief This function deletes a quantized network.
+ *
+ * @param network The network.
+ */
+void quantized_delete(QuantizedNetwork *network);
+
+/**
+ * @brief This function creates the buffers of the inference of a quantized
+ *        network over up to capacity samples.
+ *
+ * @param network  The network.
+ * @param capacity The largest number of samples of a pass.
+ * @return QuantizedWorkspace* The workspace, or nullptr if it cannot be
+ *                             allocated.
+ */
+QuantizedWorkspace *quantized_workspace_create(
+    const QuantizedNetwork *network, size_t capacity);
+
+/**
+ * @brief This function deletes the workspace of a quantized network.
+ *
+ * @param workspace The workspace.
+ */
+void quantized_workspace_delete(QuantizedWorkspace *workspace);
+
+/**
+ * @brief This function computes the logits of samples with a quantized
+ *        network: the samples are quantized, then every layer is one integer
+ *        GEMM whose epilogue applies the scales, the bias, the activation
+ *        and quantizes the result for the next layer.
+ *
+ * @param network   The network.
+ * @param workspace The workspace.
+ * @param inputs    The samples, one per row.
+ * @return const MatrixF* The logits, one row per sample, a view of the
+ *                        workspace valid until the next pass, or nullptr if
+ *                        the samples do not fit.
+ */
+template <typename T>
+const custom_math::MatrixF *quantized_forward(
+    const QuantizedNetwork *network, QuantizedWorkspace *workspace,
+    const custom_math::BasicMatrix<T> *inputs);
+
+/**
+ * @brief This function returns the fraction of the samples of a dataset whose
+ *        largest logit of the quantized network is the one of their label.
+ *
+ * @param network   The network.
+ * @param workspace The workspace.
+ * @param dataset   The dataset.
+ * @return double   The accuracy, in [0, 1].
+ */
+template <typename T>
+double quantized_accuracy(const QuantizedNetwork *network,
+                          QuantizedWorkspace *workspace,
+                          const images::BasicDataset<T> *dataset);
+
+/**
+ * @brief This function returns the number of bytes of the parameters of a
+ *        quantized network: the weights, the scales, the offsets and the
+ *        biases, without the padding.
+ *
+ * @param network The network.
+ * @return size_t The number of bytes.
+ */
+size_t quantized_size(const QuantizedNetwork *network);
+
+}  // namespace neural
+
+#endif  // QUANTIZE_HPP_
@@ -0,0 +1,92 @@
+/**
+ * @file random.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the random number generator used
+ *        to shuffle and augment the data. It is a SplitMix64 generator: it is
+ *        fast, its state is a single integer and, unlike rand and the
+ *        distributions of the standard library, it gives the same numbers on
+ *        every platform for a given seed.
+ * @version 1.0
+ * @date 2023-08-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef RANDOM_HPP_
+#define RANDOM_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace custom_math {
+
+typedef struct {
+  uint64_t state;
+} Random;
+
+/**
+ * @brief This function seeds a generator. Two generators seeded with the same
+ *        value give the same numbers.
+ *
+ * @param random  The generator.
+ * @param seed    The seed.
+ */
+inline void random_seed(Random *random, uint64_t seed) {
+  random->state = seed;
+}
+
+/**
+ * @brief This function returns the next number of a generator.
+ *
+ * @param random    The generator.
+ * @return uint64_t A number, uniform over the 64-bit integers.
+ */
+inline uint64_t random_next(Random *random) {
+  uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+/**
+ * @brief This function returns a number in [0, bound). The bias of the modulo
+ *        is below bound / 2^64, negligible for the sizes of the datasets.
+ *
+ * @param random    The generator.
+ * @param bound     The bound, greater than 0.
+ * @return uint64_t A number in [0, bound).
+ */
+inline uint64_t random_below(Random *random, uint64_t bound) {
+  return random_next(random) % bound;
+}
+
+/**
+ * @brief This function returns a number in [0, 1).
+ *
+ * @param random  The generator.
+ * @return double A number in [0, 1), a multiple of 2^-53.
+ */
+inline double random_uniform(Random *random) {
+  return (double)(random_next(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief This function shuffles an array with the Fisher-Yates algorithm.
+ *
+ * @param random  The generator.
+ * @param values  The array.
+ * @param count   The number of values.
+ */
+inline void random_shuffle(Random *random, size_t *values, size_t count) {
+  for (size_t i = count; i > 1; i--) {
+    size_t j = (size_t)random_below(random, i);
+    size_t value = values[i - 1];
+    values[i - 1] = values[j];
+    values[j] = value;
+  }
+}
+
+}  // namespace custom_math
+
+#endif  // RANDOM_HPP_
@@ -0,0 +1,149 @@
+/**
+ * @file server.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the inference server. The requests,
+ *        one sample each, are queued and coalesced into batches, so that a
+ *        forward pass runs one GEMM per layer for many requests instead of
+ *        one per request.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SERVER_HPP_
+#define SERVER_HPP_
+
+#include <stdint.h>
+
+#include "network.hpp"
+#include "quantize.hpp"
+
+namespace neural {
+
+/**
+ * @brief When a batch runs: as soon as max_batch requests are queued, or when
+ *        the oldest one has waited max_delay. The delay trades latency for
+ *        throughput: 0 runs whatever is queued at once, a longer one fills
+ *        larger batches under a light load.
+ */
+typedef struct {
+  size_t max_batch;  // The largest batch.
+  double max_delay;  // The longest wait of a request for others, in seconds.
+  size_t queue;      // The most requests queued, submitting more waits.
+} ServerOptions;
+
+/**
+ * @brief This function returns the default options: batches of up to 64
+ *        requests, a delay of 1 ms and up to 1024 requests queued.
+ *
+ * @return ServerOptions The options.
+ */
+ServerOptions server_default_options();
+
+/**
+ * @brief Called with the label predicted for a request, on the thread of the
+ *        server, in the order the requests were submitted. It must not submit
+ *        requests itself.
+ */
+typedef void (*ServerCallback)(void *context, int label);
+
+/**
+ * @brief The number of latencies the percentiles are taken over: the ones of
+ *        the last requests answered, so that a server that runs for long
+ *        keeps a bounded memory.
+ */
+#define SERVER_LATENCY_WINDOW 4096
+
+/**
+ * @brief The statistics of the requests answered in an interval, which
+ *        starts at the first submission and again at every reset of the
+ *        statistics. The latency of a request goes from its submission to
+ *        its answer, queueing included.
+ */
+typedef struct {
+  size_t requests;
+  size_t batches;
+  double p50;         // The median latency, in seconds, of the last
+                      // SERVER_LATENCY_WINDOW requests.
+  double p99;         // The 99th percentile of the same latencies.
+  double throughput;  // The requests answered per second, from the start of
+                      // the interval to the last answer.
+} ServerStats;
+
+/**
+ * @brief A server: the queue of requests, the workspace of the network and
+ *        the thread that runs the batches.
+ */
+template <typename T>
+struct BasicServer;
+
+typedef BasicServer<double> Server;
+typedef BasicServer<float> ServerF;
+
+/**
+ * @brief This function creates a server and starts its thread.
+ *
+ * @param network   The network, which must not change while the server
+ *                  runs.
+ * @param options   The options, nullptr for the default ones.
+ * @param quantized The network quantized by quantize_network, which answers
+ *                  the requests instead of network, nullptr for none.
+ * @return BasicServer<T>* The server, or nullptr if the options are invalid
+ *                         or it cannot be allocated.
+ */
+template <typename T>
+BasicServer<T> *server_create(const BasicNetwork<T> *network,
+                              const ServerOptions *options = nullptr,
+                              const QuantizedNetwork *quantized = nullptr);
+
+/**
+ * @brief This function queues a request. It can be called from any thread,
+ *        and waits while the queue is full.
+ *
+ * @param server  The server.
+ * @param pixels  The sample, one byte per input of the network, scaled to
+ *                [0, 1] like the datasets. It is copied.
+ * @param done    Called with the predicted label.
+ * @param context Given to done.
+ * @return bool   Whether the request was queued, it is not once the server
+ *                is being deleted.
+ */
+template <typename T>
+bool server_submit(BasicServer<T> *server, const uint8_t *pixels,
+                   ServerCallback done, void *context);
+
+/**
+ * @brief This function waits until all the requests submitted so far are
+ *        answered.
+ *
+ * @param server The server.
+ */
+template <typename T>
+void server_flush(BasicServer<T> *server);
+
+/**
+ * @brief This function returns the statistics of the requests answered in
+ *        the current interval.
+ *
+ * @param server The server.
+ * @param reset  Whether to start a new interval, e.g. at every report.
+ * @return ServerStats The statistics, all 0 before the first answer of the
+ *                     interval.
+ */
+template <typename T>
+ServerStats server_stats(BasicServer<T> *server, bool reset = false);
+
+/**
+ * @brief This function answers the queued requests, stops the thread and
+ *        deletes a server.
+ *
+ * @param server The server.
+ */
+template <typename T>
+void server_delete(BasicServer<T> *server);
+
+}  // namespace neural
+
+#endif  // SERVER_HPP_
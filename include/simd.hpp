@@ -0,0 +1,165 @@
+/**
+ * @file simd.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the vectorized element-wise kernels
+ *        that are used by the math library. The best instruction set is
+ *        picked once at runtime, so the same binary runs on every machine.
+ * @version 1.0
+ * @date 2023-07-22
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace custom_math {
+
+/**
+ * @brief The instruction sets the kernels are compiled for, from the slowest
+ *        to the fastest. ISA_AVX2 also requires FMA.
+ */
+typedef enum {
+  ISA_SCALAR = 0,
+  ISA_SSE2 = 1,
+  ISA_AVX2 = 2,
+  ISA_AVX512 = 3
+} Isa;
+
+/**
+ * @brief This function returns the best instruction set supported by the CPU.
+ *        The CPUID query is only made the first time it is called.
+ *
+ * @return Isa The best supported instruction set.
+ */
+Isa simd_detect();
+
+/**
+ * @brief This function returns the instruction set used by the kernels.
+ *
+ * @return Isa The active instruction set.
+ */
+Isa simd_get_isa();
+
+/**
+ * @brief This function forces the kernels to use the given instruction set.
+ *        It is meant for tests and benchmarks and must not be called while
+ *        other threads run kernels.
+ *
+ * @param isa  The requested instruction set.
+ * @return Isa The instruction set that is used, which is lower than the
+ *             requested one when the CPU does not support it.
+ */
+Isa simd_set_isa(Isa isa);
+
+/**
+ * @brief This function returns a printable name for an instruction set.
+ *
+ * @param isa           The instruction set.
+ * @return const char*  The name of the instruction set.
+ */
+const char *simd_isa_name(Isa isa);
+
+// Kernels over contiguous arrays of doubles or floats. The arrays do not need
+// to be aligned and dst may be the same array as one of the inputs. Large
+// arrays are split over the OpenMP threads.
+
+/**
+ * @brief This function computes dst[i] = a[i] + b[i].
+ *
+ * @param dst  The destination array.
+ * @param a    The first operand.
+ * @param b    The second operand.
+ * @param size The number of elements.
+ */
+void simd_add(double *dst, const double *a, const double *b, size_t size);
+void simd_add(float *dst, const float *a, const float *b, size_t size);
+
+/**
+ * @brief This function computes dst[i] = a[i] - b[i].
+ *
+ * @param dst  The destination array.
+ * @param a    The first operand.
+ * @param b    The second operand.
+ * @param size The number of elements.
+ */
+void simd_sub(double *dst, const double *a, const double *b, size_t size);
+void simd_sub(float *dst, const float *a, const float *b, size_t size);
+
+/**
+ * @brief This function computes dst[i] = a[i] * scalar.
+ *
+ * @param dst    The destination array.
+ * @param a      The operand.
+ * @param scalar The scalar.
+ * @param size   The number of elements.
+ */
+void simd_scale(double *dst, const double *a, double scalar, size_t size);
+void simd_scale(float *dst, const float *a, float scalar, size_t size);
+
+/**
+ * @brief This function copies src into dst. The arrays must not overlap.
+ *
+ * @param dst  The destination array.
+ * @param src  The source array.
+ * @param size The number of elements.
+ */
+void simd_copy(double *dst, const double *src, size_t size);
+void simd_copy(float *dst, const float *src, size_t size);
+
+/**
+ * @brief This function sets every element of dst to value.
+ *
+ * @param dst   The destination array.
+ * @param value The value.
+ * @param size  The number of elements.
+ */
+void simd_fill(double *dst, double value, size_t size);
+void simd_fill(float *dst, float value, size_t size);
+
+/**
+ * @brief This function computes dst[i] = src[i] * scale + shift, turning
+ *        bytes such as pixels into normalized doubles or floats. ISA_AVX512
+ *        fuses the product and the sum, so its values may differ from the
+ *        others in the last bit.
+ *
+ * @param dst   The destination array.
+ * @param src   The bytes.
+ * @param scale The scale.
+ * @param shift The shift.
+ * @param size  The number of elements.
+ */
+void simd_convert_bytes(double *dst, const uint8_t *src, double scale,
+                        double shift, size_t size);
+void simd_convert_bytes(float *dst, const uint8_t *src, float scale,
+                        float shift, size_t size);
+
+/**
+ * @brief This function samples an image at real coordinates with bilinear
+ *        interpolation: dst[i] is the value of src at (x[i], y[i]). The AVX2
+ *        and AVX-512 kernels gather the four neighbours of 4 to 16 pixels at
+ *        once.
+ *
+ * The coordinates must be non-negative and the neighbours must be in the
+ * image: floor(x[i]) + 1 < stride and floor(y[i]) + 1 < the number of rows.
+ * Images are usually padded with a border to ensure it.
+ *
+ * @param dst     The destination array.
+ * @param src     The image, its rows stride elements apart.
+ * @param stride  The distance between two rows of the image.
+ * @param x       The columns to sample at.
+ * @param y       The rows to sample at.
+ * @param size    The number of elements of dst, x and y.
+ */
+void simd_resample(double *dst, const double *src, size_t stride,
+                   const double *x, const double *y, size_t size);
+void simd_resample(float *dst, const float *src, size_t stride,
+                   const float *x, const float *y, size_t size);
+
+}  // namespace custom_math
+
+#endif  // SIMD_HPP_
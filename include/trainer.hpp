@@ -0,0 +1,116 @@
+/**
+ * @file trainer.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the data-parallel trainer. Every
+ *        thread runs the forward and backward passes of the network on its
+ *        own shard of the mini-batch, into gradients of its own, instead of
+ *        splitting every small product of the passes over all the threads.
+ * @version 1.0
+ * @date 2023-08-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef TRAINER_HPP_
+#define TRAINER_HPP_
+
+#include "network.hpp"
+
+namespace neural {
+
+/**
+ * @brief How the shards are combined.
+ */
+typedef struct {
+  size_t threads;  // The number of threads, 0 for as many as OpenMP uses.
+  bool hogwild;    // Whether every thread updates the parameters with the
+                   // gradients of its shard as soon as they are computed,
+                   // without any synchronization, instead of reducing the
+                   // gradients of all the shards into a single step.
+} TrainerOptions;
+
+/**
+ * @brief This function returns the default options: all the threads, and
+ *        the gradients reduced into a single step.
+ *
+ * @return TrainerOptions The options.
+ */
+TrainerOptions trainer_default_options();
+
+/**
+ * @brief A workspace, and so a replica of the gradients, per thread, each in
+ *        a block of its own so that the threads never share a cache line.
+ */
+template <typename T>
+struct BasicTrainer {
+  size_t threads;
+  bool hogwild;
+  size_t capacity;  // The largest mini-batch.
+  size_t size;      // The number of parameters of the network.
+  BasicWorkspace<T> **workspaces;  // One per thread.
+  double *losses;                  // The loss of every shard.
+  custom_math::Allocator *allocator;
+  size_t block;
+};
+
+typedef BasicTrainer<double> Trainer;
+typedef BasicTrainer<float> TrainerF;
+
+/**
+ * @brief This function creates a trainer for a network.
+ *
+ * @param network   The network.
+ * @param capacity  The largest mini-batch.
+ * @param options   The options, nullptr for the default ones.
+ * @param allocator The allocator of the trainer, nullptr for the default.
+ * @return BasicTrainer<T>* The trainer, or nullptr if the options are invalid
+ *                          or it cannot be allocated.
+ */
+template <typename T>
+BasicTrainer<T> *trainer_create(const BasicNetwork<T> *network,
+                                size_t capacity,
+                                const TrainerOptions *options = nullptr,
+                                custom_math::Allocator *allocator = nullptr);
+
+/**
+ * @brief This function trains a network on a mini-batch. The batch is split
+ *        into one contiguous shard per thread.
+ *
+ * Without Hogwild, the gradients of the shards are summed by a tree over the
+ * replicas, every thread summing its own slice of the parameters, and the
+ * optimizer takes one step, as network_train_batch would over the whole
+ * batch. The result only depends on the number of threads, not on their
+ * timing.
+ *
+ * With Hogwild, every thread takes a step of gradient descent of its own on
+ * the shared parameters, with the learning rate and the weight decay of the
+ * optimizer, which must be OPTIMIZER_SGD, and counts in its steps. The
+ * threads read and write the parameters while the others update them,
+ * without any lock: the races are accepted, at the cost of an update being
+ * lost now and then.
+ *
+ * @param trainer   The trainer.
+ * @param network   The network the trainer was created for.
+ * @param batch     The mini-batch.
+ * @param optimizer The optimizer, over network->size parameters.
+ * @return T        The mean loss of the batch, or NaN if the batch or the
+ *                  optimizer do not fit or a label is invalid, in which case
+ *                  no step is taken.
+ */
+template <typename T>
+T trainer_train_batch(BasicTrainer<T> *trainer, BasicNetwork<T> *network,
+                      const images::BasicBatch<T> *batch,
+                      BasicOptimizer<T> *optimizer);
+
+/**
+ * @brief This function deletes a trainer.
+ *
+ * @param trainer The trainer.
+ */
+template <typename T>
+void trainer_delete(BasicTrainer<T> *trainer);
+
+}  // namespace neural
+
+#endif  // TRAINER_HPP_
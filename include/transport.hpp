@@ -0,0 +1,102 @@
+/**
+ * @file transport.hpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file is the header file for the transports between the
+ *        processes of a distributed training. The processes form a ring:
+ *        each of them only ever sends to the next one and receives from the
+ *        previous one, which is all a ring allreduce needs.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef TRANSPORT_HPP_
+#define TRANSPORT_HPP_
+
+#include <stddef.h>
+
+namespace neural {
+
+typedef struct Transport Transport;
+
+/**
+ * @brief The interface shared by all the transports. A custom transport,
+ *        e.g. over TCP, only has to provide the two functions.
+ */
+struct Transport {
+  size_t rank;  // The position of the process in the ring.
+  size_t size;  // The number of processes.
+
+  // Sends send_bytes to the next process and receives receive_bytes from the
+  // previous one, at the same time, so that a ring of exchanges cannot
+  // deadlock whatever the sizes.
+  bool (*exchange)(Transport *transport, const void *send, size_t send_bytes,
+                   void *receive, size_t receive_bytes);
+  void (*close)(Transport *transport);
+};
+
+/**
+ * @brief How long a transport waits for the other processes, to connect or
+ *        to make progress, before it gives up.
+ */
+#define TRANSPORT_TIMEOUT_SECONDS 60
+
+/**
+ * @brief This function joins a ring of processes on the same host through
+ *        POSIX shared memory. Every process maps one segment holding a
+ *        channel per process to the next one, a circular buffer in which the
+ *        data is copied once on each side.
+ *
+ * @param name  The name of the segment, e.g. "/neural-1234", shared by the
+ *              processes and unique to the ring. Rank 0 creates it, in place
+ *              of a segment a crashed run may have left, and unlinks it once
+ *              they are all attached.
+ * @param rank  The position of the process, in [0, size).
+ * @param size  The number of processes.
+ * @return Transport* The transport, or nullptr if the segment cannot be
+ *                    mapped or the other processes do not attach in time.
+ */
+Transport *transport_create_shm(const char *name, size_t rank, size_t size);
+
+/**
+ * @brief This function joins a ring of processes through Unix-domain
+ *        sockets. Every process listens on path.rank, connects to the next
+ *        one and accepts the previous one.
+ *
+ * @param path  The prefix of the paths of the sockets, e.g. "/tmp/neural",
+ *              shared by the processes.
+ * @param rank  The position of the process, in [0, size).
+ * @param size  The number of processes.
+ * @return Transport* The transport, or nullptr if the sockets cannot be
+ *                    created or the other processes do not connect in time.
+ */
+Transport *transport_create_socket(const char *path, size_t rank,
+                                   size_t size);
+
+/**
+ * @brief This function sends data to the next process of the ring while it
+ *        receives data from the previous one.
+ *
+ * @param transport     The transport.
+ * @param send          The data to send.
+ * @param send_bytes    The number of bytes to send.
+ * @param receive       Receives the data of the previous process.
+ * @param receive_bytes The number of bytes to receive.
+ * @return bool         Whether all the bytes were exchanged.
+ */
+bool transport_exchange(Transport *transport, const void *send,
+                        size_t send_bytes, void *receive,
+                        size_t receive_bytes);
+
+/**
+ * @brief This function leaves the ring and deletes a transport.
+ *
+ * @param transport The transport.
+ */
+void transport_delete(Transport *transport);
+
+}  // namespace neural
+
+#endif  // TRANSPORT_HPP_
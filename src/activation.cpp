@@ -0,0 +1,239 @@
+/**
+ * @file activation.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the activation kernels
+ *        declared in activation.hpp.
+ * @version 1.0
+ * @date 2023-08-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "activation.hpp"
+
+#include "expression.hpp"
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#endif
+
+namespace custom_math {
+
+namespace {
+
+template <typename T>
+struct ActivationKernel {
+  typedef void (*Function)(ActivationType type, T slope, T *dst, const T *src,
+                           size_t size);
+};
+
+// The loops are written once and compiled for every instruction set by the
+// wrappers below. The switch is outside of the loops so that every loop is
+// a straight sequence of arithmetic the compiler vectorizes.
+template <typename T, bool FAST, bool DERIVATIVE>
+inline __attribute__((always_inline)) void activation_loop(
+    ActivationType type, T slope, T *dst, const T *src, size_t size) {
+#define ACTIVATION_CASE(TYPE)                                               \
+  case TYPE:                                                                \
+    for (size_t i = 0; i < size; i++)                                       \
+      dst[i] = DERIVATIVE                                                   \
+                   ? activation_derivative_value<T, FAST>(TYPE, src[i],     \
+                                                          slope)            \
+                   : activation_value<T, FAST>(TYPE, src[i], slope);        \
+    break;
+
+  switch (type) {
+    ACTIVATION_CASE(ACTIVATION_SIGMOID)
+    ACTIVATION_CASE(ACTIVATION_TANH)
+    ACTIVATION_CASE(ACTIVATION_RELU)
+    ACTIVATION_CASE(ACTIVATION_LEAKY_RELU)
+    ACTIVATION_CASE(ACTIVATION_GELU)
+    ACTIVATION_CASE(ACTIVATION_EXP)
+  }
+
+#undef ACTIVATION_CASE
+}
+
+template <typename T, bool FAST, bool DERIVATIVE>
+void activation_generic(ActivationType type, T slope, T *dst, const T *src,
+                        size_t size) {
+  activation_loop<T, FAST, DERIVATIVE>(type, slope, dst, src, size);
+}
+
+#ifdef SIMD_X86
+
+template <typename T, bool FAST, bool DERIVATIVE>
+__attribute__((target("avx2,fma"))) void activation_avx2(ActivationType type,
+                                                         T slope, T *dst,
+                                                         const T *src,
+                                                         size_t size) {
+  activation_loop<T, FAST, DERIVATIVE>(type, slope, dst, src, size);
+}
+
+template <typename T, bool FAST, bool DERIVATIVE>
+__attribute__((target("avx512f"))) void activation_avx512(ActivationType type,
+                                                          T slope, T *dst,
+                                                          const T *src,
+                                                          size_t size) {
+  activation_loop<T, FAST, DERIVATIVE>(type, slope, dst, src, size);
+}
+
+#endif  // SIMD_X86
+
+// The kernel for the active instruction set. SSE2 is part of x86-64, so the
+// generic kernel already uses it.
+template <typename T, bool FAST, bool DERIVATIVE>
+typename ActivationKernel<T>::Function select_kernel() {
+#ifdef SIMD_X86
+  switch (simd_get_isa()) {
+    case ISA_AVX512:
+      return activation_avx512<T, FAST, DERIVATIVE>;
+    case ISA_AVX2:
+      return activation_avx2<T, FAST, DERIVATIVE>;
+    default:
+      break;
+  }
+#endif
+  return activation_generic<T, FAST, DERIVATIVE>;
+}
+
+// Arrays smaller than this are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = 1 << 14;
+
+template <typename T, bool DERIVATIVE>
+void run(const Activation *activation, T *dst, const T *src, size_t size) {
+  if (activation == nullptr || size == 0) return;
+
+  typename ActivationKernel<T>::Function kernel =
+      activation->fast ? select_kernel<T, true, DERIVATIVE>()
+                       : select_kernel<T, false, DERIVATIVE>();
+  const ActivationType type = activation->type;
+  const T slope = (T)activation->slope;
+
+#ifdef USE_OPENMP
+  if (size >= PARALLEL_THRESHOLD && omp_get_max_threads() > 1 &&
+      !omp_in_parallel()) {
+#pragma omp parallel
+    {
+      size_t threads = (size_t)omp_get_num_threads();
+      size_t id = (size_t)omp_get_thread_num();
+      size_t chunk = ((size + threads - 1) / threads + 15) & ~(size_t)15;
+      size_t begin = id * chunk < size ? id * chunk : size;
+      size_t end = begin + chunk < size ? begin + chunk : size;
+
+      if (begin < end)
+        kernel(type, slope, dst + begin, src + begin, end - begin);
+    }
+    return;
+  }
+#endif
+  kernel(type, slope, dst, src, size);
+}
+
+template <typename T, bool DERIVATIVE>
+BasicMatrix<T> *activate_into(BasicMatrix<T> *destination,
+                              const BasicMatrix<T> *matrix,
+                              const Activation *activation) {
+  if (destination == nullptr || destination->elements == nullptr ||
+      matrix == nullptr || matrix->elements == nullptr || activation == nullptr)
+    return nullptr;
+  if (destination->rows != matrix->rows || destination->cols != matrix->cols)
+    return nullptr;
+
+  // Writing into the input itself is fine, into a part of it is not.
+  if (detail::overlap((const BasicMatrix<T> *)destination, matrix) &&
+      (destination->elements != matrix->elements ||
+       destination->stride != matrix->stride))
+    return nullptr;
+
+  if (destination->stride == destination->cols &&
+      matrix->stride == matrix->cols) {
+    run<T, DERIVATIVE>(activation, destination->elements, matrix->elements,
+                       matrix->rows * matrix->cols);
+    return destination;
+  }
+
+  long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i) if (matrix->rows * matrix->cols >= \
+                                        PARALLEL_THRESHOLD)
+#endif
+  for (i = 0; i < (long)matrix->rows; i++)
+    run<T, DERIVATIVE>(activation, matrix_row(destination, (size_t)i),
+                       matrix_row(matrix, (size_t)i), matrix->cols);
+
+  return destination;
+}
+
+}  // namespace
+
+void activation_forward(const Activation *activation, double *dst,
+                        const double *src, size_t size) {
+  run<double, false>(activation, dst, src, size);
+}
+
+void activation_forward(const Activation *activation, float *dst,
+                        const float *src, size_t size) {
+  run<float, false>(activation, dst, src, size);
+}
+
+void activation_derivative(const Activation *activation, double *dst,
+                           const double *src, size_t size) {
+  run<double, true>(activation, dst, src, size);
+}
+
+void activation_derivative(const Activation *activation, float *dst,
+                           const float *src, size_t size) {
+  run<float, true>(activation, dst, src, size);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_activate_into(BasicMatrix<T> *destination,
+                                     const BasicMatrix<T> *matrix,
+                                     const Activation *activation) {
+  return activate_into<T, false>(destination, matrix, activation);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_activate(const BasicMatrix<T> *matrix,
+                                const Activation *activation) {
+  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+
+  BasicMatrix<T> *new_matrix =
+      matrix_create<T>((int)matrix->rows, (int)matrix->cols);
+  if (new_matrix == nullptr) return nullptr;
+
+  if (matrix_activate_into(new_matrix, matrix, activation) == nullptr) {
+    matrix_delete(new_matrix);
+    return nullptr;
+  }
+
+  return new_matrix;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_activate_derivative_into(BasicMatrix<T> *destination,
+                                                const BasicMatrix<T> *matrix,
+                                                const Activation *activation) {
+  return activate_into<T, true>(destination, matrix, activation);
+}
+
+#define INSTANTIATE_ACTIVATION(T)                                       \
+  template BasicMatrix<T> *matrix_activate_into<T>(                     \
+      BasicMatrix<T> *, const BasicMatrix<T> *, const Activation *);    \
+  template BasicMatrix<T> *matrix_activate<T>(const BasicMatrix<T> *,   \
+                                              const Activation *);      \
+  template BasicMatrix<T> *matrix_activate_derivative_into<T>(          \
+      BasicMatrix<T> *, const BasicMatrix<T> *, const Activation *);
+
+INSTANTIATE_ACTIVATION(double)
+INSTANTIATE_ACTIVATION(float)
+
+}  // namespace custom_math
@@ -0,0 +1,339 @@
+/**
+ * @file allocator.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the allocators declared in
+ *        allocator.hpp.
+ * @version 1.0
+ * @date 2023-07-25
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "allocator.hpp"
+
+#include <stdlib.h>
+
+namespace custom_math {
+
+namespace {
+
+inline size_t align_up(size_t size) {
+  return (size + ALLOCATOR_ALIGNMENT - 1) & ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+void *aligned_block(size_t size) {
+  void *pointer = nullptr;
+  if (posix_memalign(&pointer, ALLOCATOR_ALIGNMENT, size == 0 ? 1 : size) != 0)
+    return nullptr;
+  return pointer;
+}
+
+// Heap
+
+void *heap_allocate(Allocator *allocator, size_t size) {
+  if (!allocator_reserve(allocator, size)) return nullptr;
+
+  void *pointer = aligned_block(size);
+  if (pointer == nullptr) allocator_release(allocator, size);
+  return pointer;
+}
+
+void heap_deallocate(Allocator *allocator, void *pointer, size_t size) {
+  free(pointer);
+  allocator_release(allocator, size);
+}
+
+Allocator heap_allocator = {heap_allocate, heap_deallocate, {0}, {0}, 0, {0}};
+
+thread_local Allocator *default_allocator = nullptr;
+
+// Arena
+
+// The header of every arena block, the memory handed out follows it.
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size;
+  size_t used;
+} ArenaBlock;
+
+const size_t ARENA_HEADER_SIZE = align_up(sizeof(ArenaBlock));
+
+typedef struct {
+  Allocator base;
+  ArenaBlock *blocks;  // The block in use, followed by the full ones.
+} Arena;
+
+ArenaBlock *arena_block_create(Arena *arena, size_t size, ArenaBlock *next) {
+  if (!allocator_reserve(&arena->base, ARENA_HEADER_SIZE + size))
+    return nullptr;
+
+  ArenaBlock *block = (ArenaBlock *)aligned_block(ARENA_HEADER_SIZE + size);
+  if (block == nullptr) {
+    allocator_release(&arena->base, ARENA_HEADER_SIZE + size);
+    return nullptr;
+  }
+
+  block->next = next;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+void arena_block_delete(Arena *arena, ArenaBlock *block) {
+  allocator_release(&arena->base, ARENA_HEADER_SIZE + block->size);
+  free(block);
+}
+
+void *arena_allocate(Allocator *allocator, size_t size) {
+  Arena *arena = (Arena *)allocator;
+  ArenaBlock *block = arena->blocks;
+  size = align_up(size);
+
+  if (block->used + size > block->size) {
+    size_t block_size = block->size * 2;
+    if (block_size < size) block_size = size;
+
+    block = arena_block_create(arena, block_size, arena->blocks);
+    if (block == nullptr) return nullptr;
+    arena->blocks = block;
+  }
+
+  void *pointer = (char *)block + ARENA_HEADER_SIZE + block->used;
+  block->used += size;
+
+  return pointer;
+}
+
+void arena_deallocate(Allocator *, void *, size_t) {
+  // Nothing is given back before the arena is reset.
+}
+
+// Pool
+
+// Size classes are the powers of two from 64 bytes to 512 MB. Larger blocks
+// go straight to the heap.
+const size_t POOL_MIN_SHIFT = 6;
+const size_t POOL_CLASSES = 24;
+
+typedef struct PoolNode {
+  struct PoolNode *next;
+} PoolNode;
+
+typedef struct {
+  Allocator base;
+  PoolNode *free_lists[POOL_CLASSES];
+} Pool;
+
+size_t pool_class(size_t size) {
+  size_t size_class = 0;
+  while (size_class < POOL_CLASSES &&
+         ((size_t)1 << (size_class + POOL_MIN_SHIFT)) < size)
+    size_class++;
+  return size_class;
+}
+
+void *pool_allocate(Allocator *allocator, size_t size) {
+  Pool *pool = (Pool *)allocator;
+  size_t size_class = pool_class(size);
+
+  PoolNode *node =
+      size_class < POOL_CLASSES ? pool->free_lists[size_class] : nullptr;
+  if (node != nullptr) {
+    pool->free_lists[size_class] = node->next;
+    return node;
+  }
+
+  // Only a new block takes memory, the class size of it.
+  size_t reserved = size_class < POOL_CLASSES
+                        ? (size_t)1 << (size_class + POOL_MIN_SHIFT)
+                        : size;
+  if (!allocator_reserve(allocator, reserved)) return nullptr;
+
+  void *pointer = aligned_block(reserved);
+  if (pointer == nullptr) allocator_release(allocator, reserved);
+  return pointer;
+}
+
+void pool_deallocate(Allocator *allocator, void *pointer, size_t size) {
+  Pool *pool = (Pool *)allocator;
+  size_t size_class = pool_class(size);
+
+  if (size_class == POOL_CLASSES) {
+    free(pointer);
+    allocator_release(allocator, size);
+    return;
+  }
+
+  PoolNode *node = (PoolNode *)pointer;
+  node->next = pool->free_lists[size_class];
+  pool->free_lists[size_class] = node;
+}
+
+}  // namespace
+
+void *allocator_allocate(Allocator *allocator, size_t size) {
+  if (allocator == nullptr) allocator = allocator_get_default();
+
+  void *pointer = allocator->allocate(allocator, size);
+  if (pointer != nullptr) allocator->in_use.fetch_add(size);
+
+  return pointer;
+}
+
+void allocator_deallocate(Allocator *allocator, void *pointer, size_t size) {
+  if (pointer == nullptr) return;
+  if (allocator == nullptr) allocator = allocator_get_default();
+
+  allocator->deallocate(allocator, pointer, size);
+  allocator->in_use.fetch_sub(size);
+}
+
+bool allocator_reserve(Allocator *allocator, size_t size) {
+  size_t current = allocator->current.fetch_add(size) + size;
+  if (allocator->limit != 0 && current > allocator->limit) {
+    allocator->current.fetch_sub(size);
+    return false;
+  }
+
+  size_t peak = allocator->peak.load(std::memory_order_relaxed);
+  while (current > peak &&
+         !allocator->peak.compare_exchange_weak(peak, current,
+                                                std::memory_order_relaxed)) {
+  }
+
+  return true;
+}
+
+void allocator_release(Allocator *allocator, size_t size) {
+  allocator->current.fetch_sub(size);
+}
+
+size_t allocator_current(const Allocator *allocator) {
+  return allocator->current.load();
+}
+
+size_t allocator_peak(const Allocator *allocator) {
+  return allocator->peak.load();
+}
+
+size_t allocator_in_use(const Allocator *allocator) {
+  return allocator->in_use.load();
+}
+
+void allocator_reset_peak(Allocator *allocator) {
+  allocator->peak.store(allocator->current.load());
+}
+
+void allocator_set_limit(Allocator *allocator, size_t limit) {
+  allocator->limit = limit;
+}
+
+Allocator *allocator_heap() { return &heap_allocator; }
+
+Allocator *allocator_get_default() {
+  return default_allocator != nullptr ? default_allocator : &heap_allocator;
+}
+
+Allocator *allocator_set_default(Allocator *allocator) {
+  Allocator *previous = allocator_get_default();
+  default_allocator = allocator;
+  return previous;
+}
+
+Allocator *arena_create(size_t capacity) {
+  Arena *arena = new Arena();
+
+  arena->blocks = arena_block_create(arena, align_up(capacity), nullptr);
+  if (arena->blocks == nullptr) {
+    delete arena;
+    return nullptr;
+  }
+
+  arena->base.allocate = arena_allocate;
+  arena->base.deallocate = arena_deallocate;
+
+  return &arena->base;
+}
+
+void arena_reset(Allocator *allocator) {
+  Arena *arena = (Arena *)allocator;
+
+  if (arena->blocks->next != nullptr) {
+    // Replace the chain with one block that fits everything the step used.
+    size_t capacity = arena_capacity(allocator);
+    ArenaBlock *block = arena_block_create(arena, capacity, nullptr);
+
+    if (block != nullptr) {
+      while (arena->blocks != nullptr) {
+        ArenaBlock *next = arena->blocks->next;
+        arena_block_delete(arena, arena->blocks);
+        arena->blocks = next;
+      }
+      arena->blocks = block;
+    }
+  }
+
+  for (ArenaBlock *block = arena->blocks; block != nullptr; block = block->next)
+    block->used = 0;
+
+  arena->base.in_use.store(0);
+}
+
+size_t arena_capacity(const Allocator *allocator) {
+  const Arena *arena = (const Arena *)allocator;
+  size_t capacity = 0;
+
+  for (ArenaBlock *block = arena->blocks; block != nullptr; block = block->next)
+    capacity += block->size;
+
+  return capacity;
+}
+
+void arena_delete(Allocator *allocator) {
+  if (allocator == nullptr) return;
+
+  Arena *arena = (Arena *)allocator;
+  while (arena->blocks != nullptr) {
+    ArenaBlock *next = arena->blocks->next;
+    arena_block_delete(arena, arena->blocks);
+    arena->blocks = next;
+  }
+
+  if (default_allocator == allocator) default_allocator = nullptr;
+  delete arena;
+}
+
+Allocator *pool_create() {
+  Pool *pool = new Pool();
+
+  pool->base.allocate = pool_allocate;
+  pool->base.deallocate = pool_deallocate;
+
+  return &pool->base;
+}
+
+void pool_trim(Allocator *allocator) {
+  Pool *pool = (Pool *)allocator;
+
+  for (size_t i = 0; i < POOL_CLASSES; i++) {
+    while (pool->free_lists[i] != nullptr) {
+      PoolNode *next = pool->free_lists[i]->next;
+      free(pool->free_lists[i]);
+      allocator_release(allocator, (size_t)1 << (i + POOL_MIN_SHIFT));
+      pool->free_lists[i] = next;
+    }
+  }
+}
+
+void pool_delete(Allocator *allocator) {
+  if (allocator == nullptr) return;
+
+  pool_trim(allocator);
+
+  if (default_allocator == allocator) default_allocator = nullptr;
+  delete (Pool *)allocator;
+}
+
+}  // namespace custom_math
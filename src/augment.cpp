@@ -0,0 +1,341 @@
+/**
+ * @file augment.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief  This file contains the implementation of the functions declared in
+ *         augment.hpp.
+ * @version 1.0
+ * @date 2023-08-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "augment.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "random.hpp"
+#include "simd.hpp"
+
+namespace images {
+
+// The image is copied into padded with 1 row and column of zeros before it
+// and 2 after, so that the neighbours of every coordinate clamped to
+// [-1, cols] x [-1, rows] are in the padded image, and that the pixels
+// outside of the image are black.
+template <typename T>
+struct BasicAugmenter {
+  AugmentChain chain;
+  size_t rows;
+  size_t cols;
+  bool moves;  // Whether the chain moves the pixels.
+  T *padded;   // (rows + 3) x (cols + 3) pixels.
+  T *x;        // Where each pixel of the result is taken from in the image.
+  T *y;
+  T *field;  // The displacements of the nodes of an elastic distortion,
+             // then their interpolation along the rows of nodes.
+  int *first_x;  // The nodes and the weights of the pixels along each axis.
+  int *first_y;
+  T *weight_x;
+  T *weight_y;
+};
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// An affine map of the coordinates, (x, y) -> (a x + b y + c, d x + e y + f).
+typedef struct {
+  double a, b, c;
+  double d, e, f;
+} Affine;
+
+const Affine IDENTITY = {1, 0, 0, 0, 1, 0};
+
+// Returns the map p -> second(first(p)).
+Affine compose(const Affine &second, const Affine &first) {
+  Affine map;
+  map.a = second.a * first.a + second.b * first.d;
+  map.b = second.a * first.b + second.b * first.e;
+  map.c = second.a * first.c + second.b * first.f + second.c;
+  map.d = second.d * first.a + second.e * first.d;
+  map.e = second.d * first.b + second.e * first.e;
+  map.f = second.d * first.c + second.e * first.f + second.f;
+  return map;
+}
+
+// Returns a number in [-amount, amount).
+double uniform(custom_math::Random *random, double amount) {
+  return (2 * custom_math::random_uniform(random) - 1) * amount;
+}
+
+// The number of nodes of an elastic distortion along a side of n pixels.
+size_t nodes(size_t n, double sigma) {
+  const size_t count = (size_t)ceil((double)(n - 1) / sigma) + 1;
+  return count < 2 ? 2 : count;
+}
+
+template <typename T>
+T clamp(T value, T low, T high) {
+  value = value < low ? low : value;
+  return value > high ? high : value;
+}
+
+// Maps the coordinates of the pixels, or the ones of the pixels of the image
+// when from_grid is set. The loops are written to be vectorized.
+template <typename T>
+void apply(BasicAugmenter<T> *augmenter, const Affine &map, bool from_grid) {
+  T *x = augmenter->x, *y = augmenter->y;
+  const T a = (T)map.a, b = (T)map.b, c = (T)map.c;
+  const T d = (T)map.d, e = (T)map.e, f = (T)map.f;
+  const int rows = (int)augmenter->rows, cols = (int)augmenter->cols;
+
+  if (from_grid) {
+    for (int i = 0; i < rows; i++) {
+      const T x0 = b * (T)i + c, y0 = e * (T)i + f;
+      T *row_x = x + i * cols, *row_y = y + i * cols;
+      for (int j = 0; j < cols; j++) {
+        row_x[j] = a * (T)j + x0;
+        row_y[j] = d * (T)j + y0;
+      }
+    }
+  } else {
+    for (int k = 0; k < rows * cols; k++) {
+      const T px = x[k], py = y[k];
+      x[k] = a * px + b * py + c;
+      y[k] = d * px + e * py + f;
+    }
+  }
+}
+
+// Returns the smoothstep weights of the nodes sigma pixels apart around n
+// pixels: pixel i is between node first[i] and the next one, at weight[i].
+template <typename T>
+void weights(size_t n, size_t count, double sigma, int *first, T *weight) {
+  for (size_t i = 0; i < n; i++) {
+    const double position = (double)i / sigma;
+    const size_t node = (size_t)position < count - 2 ? (size_t)position
+                                                      : count - 2;
+    const T t = (T)(position - (double)node);
+    first[i] = (int)node;
+    weight[i] = t * t * (3 - 2 * t);
+  }
+}
+
+// Moves the coordinates along a field drawn at random on nodes sigma pixels
+// apart, interpolated between the nodes with smoothstep weights: it is smooth
+// and costs a few operations per pixel, instead of the Gaussian filter of a
+// field drawn for every pixel. The field is evaluated at the pixels of the
+// result, so that it is separable: it is interpolated along the rows of
+// nodes, then between these rows.
+template <typename T>
+void distort(BasicAugmenter<T> *augmenter, const AugmentStep &step,
+             custom_math::Random *random) {
+  const size_t rows = augmenter->rows, cols = augmenter->cols;
+  const size_t width = nodes(cols, step.sigma);
+  const size_t height = nodes(rows, step.sigma);
+
+  // The displacements of the nodes, then the field along their rows.
+  T *field = augmenter->field;
+  T *along = field + 2 * width * height;
+  for (size_t i = 0; i < 2 * width * height; i++)
+    field[i] = (T)uniform(random, step.amount);
+
+  weights(cols, width, step.sigma, augmenter->first_x, augmenter->weight_x);
+  weights(rows, height, step.sigma, augmenter->first_y, augmenter->weight_y);
+
+  for (size_t r = 0; r < 2 * height; r++) {
+    const T *nodes_row = field + r * width;
+    T *row = along + r * cols;
+    for (size_t j = 0; j < cols; j++) {
+      const T *p = nodes_row + augmenter->first_x[j];
+      row[j] = p[0] + (p[1] - p[0]) * augmenter->weight_x[j];
+    }
+  }
+
+  for (size_t i = 0; i < rows; i++) {
+    const T fy = augmenter->weight_y[i];
+    for (int axis = 0; axis < 2; axis++) {
+      const T *top = along + (axis * height + augmenter->first_y[i]) * cols;
+      const T *bottom = top + cols;
+      T *values = (axis == 0 ? augmenter->x : augmenter->y) + i * cols;
+      for (size_t j = 0; j < cols; j++)
+        values[j] += top[j] + (bottom[j] - top[j]) * fy;
+    }
+  }
+}
+
+// Adds noise to the pixels. Each pixel takes a single draw: the sum of its
+// four 16-bit parts is close to normal, of variance 1/3 once centered.
+template <typename T>
+void add_noise(T *values, size_t size, double amount,
+               custom_math::Random *random) {
+  const T scale = (T)(amount * sqrt(3.0) / 65536);
+
+  for (size_t i = 0; i < size; i++) {
+    const uint64_t bits = custom_math::random_next(random);
+    const int sum = (int)((bits & 0xFFFF) + (bits >> 16 & 0xFFFF) +
+                          (bits >> 32 & 0xFFFF) + (bits >> 48));
+    values[i] = clamp(values[i] + (T)(sum - 131070) * scale, (T)0, (T)1);
+  }
+}
+
+}  // namespace
+
+AugmentChain augment_chain() {
+  AugmentChain chain;
+  memset(&chain, 0, sizeof(chain));
+  return chain;
+}
+
+bool augment_add(AugmentChain *chain, AugmentType type, double amount,
+                 double sigma) {
+  if (chain->count == AUGMENT_MAX_STEPS || !(amount >= 0)) return false;
+  if (type == AUGMENT_ELASTIC && !(sigma > 0)) return false;
+
+  AugmentStep *step = &chain->steps[chain->count++];
+  step->type = type;
+  step->amount = amount;
+  step->sigma = sigma;
+  return true;
+}
+
+template <typename T>
+BasicAugmenter<T> *augmenter_create(const AugmentChain *chain, size_t rows,
+                                    size_t cols) {
+  if (chain == nullptr || chain->count == 0 || rows == 0 || cols == 0)
+    return nullptr;
+
+  BasicAugmenter<T> *augmenter = new (std::nothrow) BasicAugmenter<T>();
+  if (augmenter == nullptr) return nullptr;
+
+  augmenter->chain = *chain;
+  augmenter->rows = rows;
+  augmenter->cols = cols;
+  augmenter->moves = false;
+
+  size_t field = 0;
+  for (size_t k = 0; k < chain->count; k++) {
+    const AugmentStep &step = chain->steps[k];
+    if (step.type == AUGMENT_NOISE) continue;
+
+    augmenter->moves = true;
+    if (step.type == AUGMENT_ELASTIC) {
+      const size_t height = nodes(rows, step.sigma);
+      const size_t size = 2 * height * (nodes(cols, step.sigma) + cols);
+      if (size > field) field = size;
+    }
+  }
+
+  const size_t size = rows * cols;
+  augmenter->padded = (T *)calloc((rows + 3) * (cols + 3), sizeof(T));
+  augmenter->x = (T *)malloc(size * sizeof(T));
+  augmenter->y = (T *)malloc(size * sizeof(T));
+  augmenter->field = (T *)malloc((field > 0 ? field : 1) * sizeof(T));
+  augmenter->first_x = (int *)malloc(cols * sizeof(int));
+  augmenter->first_y = (int *)malloc(rows * sizeof(int));
+  augmenter->weight_x = (T *)malloc(cols * sizeof(T));
+  augmenter->weight_y = (T *)malloc(rows * sizeof(T));
+
+  if (augmenter->padded == nullptr || augmenter->x == nullptr ||
+      augmenter->y == nullptr || augmenter->field == nullptr ||
+      augmenter->first_x == nullptr || augmenter->first_y == nullptr ||
+      augmenter->weight_x == nullptr || augmenter->weight_y == nullptr) {
+    augmenter_delete(augmenter);
+    return nullptr;
+  }
+
+  return augmenter;
+}
+
+template <typename T>
+void augment(BasicAugmenter<T> *augmenter, T *dst, const T *src,
+             uint64_t seed) {
+  const AugmentChain &chain = augmenter->chain;
+  const size_t rows = augmenter->rows, cols = augmenter->cols;
+  const size_t size = rows * cols;
+
+  custom_math::Random random;
+  custom_math::random_seed(&random, seed);
+
+  if (augmenter->moves) {
+    // Pixel p of the result is taken from step_1(step_2(... step_n(p))) in
+    // the image, so the coordinates go through the steps from the last one.
+    // Consecutive shifts and rotations are composed into one affine map.
+    Affine map = IDENTITY;
+    bool from_grid = true;
+
+    for (size_t k = chain.count; k-- > 0;) {
+      const AugmentStep &step = chain.steps[k];
+
+      if (step.type == AUGMENT_SHIFT) {
+        const double dx = uniform(&random, step.amount);
+        const double dy = uniform(&random, step.amount);
+        const Affine shift = {1, 0, -dx, 0, 1, -dy};
+        map = compose(shift, map);
+      } else if (step.type == AUGMENT_ROTATION) {
+        const double angle = uniform(&random, step.amount) * PI / 180;
+        const double c = cos(angle), s = sin(angle);
+        const double cx = (double)(cols - 1) / 2, cy = (double)(rows - 1) / 2;
+        const Affine rotation = {c, -s, cx - c * cx + s * cy,
+                                 s, c,  cy - s * cx - c * cy};
+        map = compose(rotation, map);
+      } else if (step.type == AUGMENT_ELASTIC) {
+        apply(augmenter, map, from_grid);
+        map = IDENTITY;
+        from_grid = false;
+        distort(augmenter, step, &random);
+      }
+    }
+    apply(augmenter, map, from_grid);
+
+    T *x = augmenter->x, *y = augmenter->y;
+    const T right = (T)cols, bottom = (T)rows;
+    for (size_t k = 0; k < size; k++) {
+      x[k] = clamp(x[k], (T)-1, right) + 1;
+      y[k] = clamp(y[k], (T)-1, bottom) + 1;
+    }
+
+    for (size_t i = 0; i < rows; i++)
+      memcpy(augmenter->padded + (i + 1) * (cols + 3) + 1, src + i * cols,
+             cols * sizeof(T));
+    custom_math::simd_resample(dst, augmenter->padded, cols + 3, x, y, size);
+  } else if (dst != src) {
+    memcpy(dst, src, size * sizeof(T));
+  }
+
+  for (size_t k = 0; k < chain.count; k++)
+    if (chain.steps[k].type == AUGMENT_NOISE)
+      add_noise(dst, size, chain.steps[k].amount, &random);
+}
+
+template <typename T>
+void augmenter_delete(BasicAugmenter<T> *augmenter) {
+  if (augmenter == nullptr) return;
+  free(augmenter->padded);
+  free(augmenter->x);
+  free(augmenter->y);
+  free(augmenter->field);
+  free(augmenter->first_x);
+  free(augmenter->first_y);
+  free(augmenter->weight_x);
+  free(augmenter->weight_y);
+  delete augmenter;
+}
+
+#define INSTANTIATE_AUGMENTER(T)                                             \
+  template BasicAugmenter<T> *augmenter_create<T>(const AugmentChain *,      \
+                                                  size_t, size_t);           \
+  template void augment<T>(BasicAugmenter<T> *, T *, const T *, uint64_t);   \
+  template void augmenter_delete<T>(BasicAugmenter<T> *);
+
+INSTANTIATE_AUGMENTER(float)
+INSTANTIATE_AUGMENTER(double)
+
+#undef INSTANTIATE_AUGMENTER
+
+}  // namespace images
@@ -0,0 +1,155 @@
+/**
+ * @file dataset.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief  This file contains the implementation of the functions declared in
+ *         dataset.hpp.
+ * @version 1.0
+ * @date 2023-08-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "dataset.hpp"
+
+namespace images {
+
+namespace {
+
+inline size_t align(size_t offset) {
+  return (offset + ALLOCATOR_ALIGNMENT - 1) &
+         ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+// Turns the pixels into T, scaled to [0, 1] exactly like (T)(pixel / 255.0).
+// The bytes are kept as they are.
+template <typename T>
+void convert(T *dst, const uint8_t *src, size_t size, const T *scale) {
+  for (size_t j = 0; j < size; j++) dst[j] = scale[src[j]];
+}
+
+inline void convert(uint8_t *dst, const uint8_t *src, size_t size,
+                    const uint8_t *) {
+  memcpy(dst, src, size);
+}
+
+// Takes all the images of raw, or nullptr when they cannot be read.
+template <typename T>
+BasicDataset<T> *take_all(RawImages *raw) {
+  if (raw == nullptr) return nullptr;
+  BasicDataset<T> *dataset = dataset_from_raw<T>(raw);
+  delete_raw_images(raw);
+  return dataset;
+}
+
+}  // namespace
+
+template <typename T>
+BasicDataset<T> *dataset_create(size_t count, size_t rows, size_t cols,
+                                custom_math::Allocator *allocator) {
+  if (count == 0 || rows == 0 || cols == 0) return nullptr;
+
+  if (allocator == nullptr) allocator = custom_math::allocator_get_default();
+
+  // The structure, then the labels, then the samples, each on a cache line
+  // of its own.
+  const size_t labels_offset = align(sizeof(BasicDataset<T>));
+  const size_t samples_offset = align(labels_offset + count * sizeof(int));
+  const size_t size = samples_offset + count * rows * cols * sizeof(T);
+
+  BasicDataset<T> *dataset =
+      (BasicDataset<T> *)custom_math::allocator_allocate(allocator, size);
+  if (dataset == nullptr) return nullptr;
+
+  dataset->count = count;
+  dataset->rows = rows;
+  dataset->cols = cols;
+  dataset->samples.rows = count;
+  dataset->samples.cols = rows * cols;
+  dataset->samples.stride = rows * cols;
+  dataset->samples.elements = (T *)((char *)dataset + samples_offset);
+  dataset->samples.allocator = nullptr;
+  dataset->labels = (int *)((char *)dataset + labels_offset);
+  dataset->allocator = allocator;
+  dataset->size = size;
+
+  return dataset;
+}
+
+template <typename T>
+BasicDataset<T> *dataset_from_raw(const RawImages *raw, size_t count,
+                                  custom_math::Allocator *allocator) {
+  if (raw == nullptr) return nullptr;
+  if (count == 0) count = raw->count;
+  if (count > raw->count) {
+    fprintf(stderr, "found %zu image(s) instead of %zu\n", raw->count, count);
+    return nullptr;
+  }
+
+  BasicDataset<T> *dataset =
+      dataset_create<T>(count, raw->rows, raw->cols, allocator);
+  if (dataset == nullptr) return nullptr;
+
+  T scale[256];
+  for (int i = 0; i < 256; i++) scale[i] = (T)(i / 255.0);
+
+  const size_t size = raw->rows * raw->cols;
+  long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i)
+#endif
+  for (i = 0; i < (long)count; i++) {
+    const uint8_t *pixels = raw->pixels + i * size;
+    T *sample = custom_math::matrix_row(&dataset->samples, i);
+    convert(sample, pixels, size, scale);
+    dataset->labels[i] = raw->labels[i];
+  }
+
+  return dataset;
+}
+
+template <typename T>
+BasicDataset<T> *read_dataset(const char *filename, size_t count) {
+  RawImages *raw = load_image_cache(filename);
+  if (raw == nullptr) return nullptr;
+
+  BasicDataset<T> *dataset = dataset_from_raw<T>(raw, count);
+  delete_raw_images(raw);
+  return dataset;
+}
+
+template <typename T>
+BasicDataset<T> *read_test_dataset() {
+  return take_all<T>(load_raw_test_images());
+}
+
+template <typename T>
+BasicDataset<T> *read_train_dataset() {
+  return take_all<T>(load_raw_train_images());
+}
+
+template <typename T>
+void dataset_delete(BasicDataset<T> *dataset) {
+  if (dataset == nullptr) return;
+  custom_math::allocator_deallocate(dataset->allocator, dataset,
+                                    dataset->size);
+}
+
+#define INSTANTIATE_DATASET(T)                                               \
+  template BasicDataset<T> *dataset_create<T>(size_t, size_t, size_t,        \
+                                              custom_math::Allocator *);     \
+  template BasicDataset<T> *dataset_from_raw<T>(const RawImages *, size_t,   \
+                                                custom_math::Allocator *);   \
+  template BasicDataset<T> *read_dataset<T>(const char *, size_t);           \
+  template BasicDataset<T> *read_test_dataset<T>();                          \
+  template BasicDataset<T> *read_train_dataset<T>();                         \
+  template void dataset_delete<T>(BasicDataset<T> *);
+
+INSTANTIATE_DATASET(float)
+INSTANTIATE_DATASET(double)
+INSTANTIATE_DATASET(uint8_t)
+
+#undef INSTANTIATE_DATASET
+
+}  // namespace images
@@ -0,0 +1,266 @@
+/**
+ * @file distributed.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the distributed training
+ *        declared in distributed.hpp.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "distributed.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "simd.hpp"
+
+namespace neural {
+
+// The backward pass counts the layers whose gradients are final in ready,
+// the thread counts the ones it reduced in reduced. Both go from the last
+// layer to the first, so layer count - 1 - reduced is the next to reduce.
+template <typename T>
+struct BasicDistributed {
+  Transport *transport;
+  BasicWorkspace<T> *workspace;
+  size_t size;    // The number of parameters of the network.
+  size_t layers;  // The number of layers of the network.
+  size_t bounds[NETWORK_MAX_LAYERS + 1];  // The gradients of layer l are
+                                          // [bounds[l], bounds[l + 1]).
+  T *scratch;
+
+  size_t ready;
+  size_t reduced;
+  bool failed;  // Whether an exchange failed, the following are skipped.
+  bool stopped;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+};
+
+namespace {
+
+// The first element of a chunk of an array cut into parts.
+inline size_t chunk_begin(size_t count, size_t parts, size_t chunk) {
+  return count * chunk / parts;
+}
+
+// Averages the gradients of a layer over the ring.
+template <typename T>
+bool reduce_layer(BasicDistributed<T> *distributed, size_t layer) {
+  const size_t begin = distributed->bounds[layer];
+  const size_t count = distributed->bounds[layer + 1] - begin;
+  T *gradients = distributed->workspace->gradients + begin;
+
+  if (!ring_allreduce(distributed->transport, gradients, count,
+                      distributed->scratch))
+    return false;
+  custom_math::simd_scale(gradients, gradients,
+                          (T)1 / (T)distributed->transport->size, count);
+  return true;
+}
+
+template <typename T>
+void communicate(BasicDistributed<T> *distributed) {
+  std::unique_lock<std::mutex> lock(distributed->mutex);
+
+  for (;;) {
+    distributed->changed.wait(lock, [distributed] {
+      return distributed->stopped ||
+             distributed->reduced < distributed->ready;
+    });
+    if (distributed->stopped) return;
+
+    const size_t layer = distributed->layers - 1 - distributed->reduced;
+    bool failed = distributed->failed;
+    lock.unlock();
+    if (!failed) failed = !reduce_layer(distributed, layer);
+    lock.lock();
+
+    distributed->failed = failed;
+    distributed->reduced++;
+    distributed->changed.notify_all();
+  }
+}
+
+template <typename T>
+void layer_done(void *context, size_t) {
+  BasicDistributed<T> *distributed = (BasicDistributed<T> *)context;
+  std::lock_guard<std::mutex> lock(distributed->mutex);
+  distributed->ready++;
+  distributed->changed.notify_all();
+}
+
+}  // namespace
+
+template <typename T>
+bool ring_allreduce(Transport *transport, T *data, size_t count, T *scratch) {
+  if (transport == nullptr) return false;
+  const size_t size = transport->size;
+  const size_t rank = transport->rank;
+
+  // Step s sends the chunk received at step s - 1, which starts with the
+  // chunk of the rank itself.
+  for (size_t step = 0; step + 1 < size; step++) {
+    const size_t send = (rank + size - step) % size;
+    const size_t receive = (rank + 2 * size - step - 1) % size;
+    const size_t send_begin = chunk_begin(count, size, send);
+    const size_t send_count = chunk_begin(count, size, send + 1) - send_begin;
+    const size_t begin = chunk_begin(count, size, receive);
+    const size_t elements = chunk_begin(count, size, receive + 1) - begin;
+
+    if (!transport_exchange(transport, data + send_begin,
+                            send_count * sizeof(T), scratch,
+                            elements * sizeof(T)))
+      return false;
+    custom_math::simd_add(data + begin, data + begin, scratch, elements);
+  }
+
+  // Chunk rank + 1 is now reduced: it goes around the ring, and the reduced
+  // chunks of the others are received in place.
+  for (size_t step = 0; step + 1 < size; step++) {
+    const size_t send = (rank + 1 + size - step) % size;
+    const size_t receive = (rank + size - step) % size;
+    const size_t send_begin = chunk_begin(count, size, send);
+    const size_t send_count = chunk_begin(count, size, send + 1) - send_begin;
+    const size_t begin = chunk_begin(count, size, receive);
+    const size_t elements = chunk_begin(count, size, receive + 1) - begin;
+
+    if (!transport_exchange(transport, data + send_begin,
+                            send_count * sizeof(T), data + begin,
+                            elements * sizeof(T)))
+      return false;
+  }
+
+  return true;
+}
+
+template <typename T>
+BasicDistributed<T> *distributed_create(const BasicNetwork<T> *network,
+                                        size_t capacity,
+                                        Transport *transport) {
+  if (network == nullptr || transport == nullptr || capacity == 0)
+    return nullptr;
+
+  BasicDistributed<T> *distributed = new (std::nothrow) BasicDistributed<T>();
+  if (distributed == nullptr) return nullptr;
+
+  distributed->transport = transport;
+  distributed->size = network->size;
+  distributed->layers = network->count;
+  size_t largest = 0;
+  for (size_t l = 0; l < network->count; l++) {
+    distributed->bounds[l] = network->layers[l].offset;
+    distributed->bounds[l + 1] = l + 1 < network->count
+                                     ? network->layers[l + 1].offset
+                                     : network->size;
+    const size_t count = distributed->bounds[l + 1] - distributed->bounds[l];
+    if (count > largest) largest = count;
+  }
+  distributed->ready = 0;
+  distributed->reduced = 0;
+  distributed->failed = false;
+  distributed->stopped = false;
+
+  distributed->workspace = workspace_create(network, capacity);
+  distributed->scratch =
+      (T *)malloc((largest / transport->size + 1) * sizeof(T));
+  if (distributed->workspace == nullptr || distributed->scratch == nullptr) {
+    workspace_delete(distributed->workspace);
+    free(distributed->scratch);
+    delete distributed;
+    return nullptr;
+  }
+
+  distributed->thread = std::thread(communicate<T>, distributed);
+  return distributed;
+}
+
+template <typename T>
+T distributed_train_batch(BasicDistributed<T> *distributed,
+                          BasicNetwork<T> *network,
+                          const images::BasicBatch<T> *batch,
+                          BasicOptimizer<T> *optimizer) {
+  if (batch->samples.rows == 0 ||
+      batch->samples.rows > distributed->workspace->capacity ||
+      batch->samples.cols != network->layers[0].inputs ||
+      distributed->size != network->size || optimizer->size != network->size)
+    return (T)NAN;
+
+  {
+    std::lock_guard<std::mutex> lock(distributed->mutex);
+    if (distributed->failed) return (T)NAN;
+    distributed->ready = 0;
+    distributed->reduced = 0;
+  }
+
+  // A rank with an invalid label still takes part in the allreduce, with
+  // gradients of 0, so that its peers do not wait for it, and takes the step
+  // of their gradients, so that the replicas stay the same.
+  T loss = (T)NAN;
+  if (network_check_labels(network, batch->labels, batch->samples.rows)) {
+    network_forward(network, distributed->workspace, &batch->samples);
+    const BackwardHook hook = {layer_done<T>, distributed};
+    loss = network_backward(network, distributed->workspace, &batch->samples,
+                            batch->labels, 0, &hook);
+  } else {
+    memset(distributed->workspace->gradients, 0,
+           distributed->workspace->size * sizeof(T));
+    for (size_t l = network->count; l-- > 0;) layer_done<T>(distributed, l);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(distributed->mutex);
+    distributed->changed.wait(lock, [distributed] {
+      return distributed->reduced == distributed->layers;
+    });
+    if (distributed->failed) return (T)NAN;
+  }
+
+  optimizer_step(optimizer, network->parameters,
+                 distributed->workspace->gradients);
+  return loss;
+}
+
+template <typename T>
+void distributed_delete(BasicDistributed<T> *distributed) {
+  if (distributed == nullptr) return;
+
+  {
+    std::lock_guard<std::mutex> lock(distributed->mutex);
+    distributed->stopped = true;
+    distributed->changed.notify_all();
+  }
+  distributed->thread.join();
+
+  workspace_delete(distributed->workspace);
+  free(distributed->scratch);
+  delete distributed;
+}
+
+#define INSTANTIATE_DISTRIBUTED(T)                                           \
+  template bool ring_allreduce<T>(Transport *, T *, size_t, T *);            \
+  template BasicDistributed<T> *distributed_create<T>(                       \
+      const BasicNetwork<T> *, size_t, Transport *);                         \
+  template T distributed_train_batch<T>(BasicDistributed<T> *,               \
+                                        BasicNetwork<T> *,                   \
+                                        const images::BasicBatch<T> *,       \
+                                        BasicOptimizer<T> *);                \
+  template void distributed_delete<T>(BasicDistributed<T> *);
+
+INSTANTIATE_DISTRIBUTED(float)
+INSTANTIATE_DISTRIBUTED(double)
+
+#undef INSTANTIATE_DISTRIBUTED
+
+}  // namespace neural
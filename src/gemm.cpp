@@ -0,0 +1,455 @@
+/**
+ * @file gemm.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the cache-blocked GEMM
+ *        engine declared in gemm.hpp.
+ * @version 1.0
+ * @date 2023-07-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "gemm.hpp"
+
+#include "simd.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace custom_math {
+
+namespace {
+
+// Register tile of the micro-kernel (MR x NR) and the cache blocking sizes.
+// A KC x NR panel of B stays in L1, a MC x KC block of A stays in L2 and a
+// KC x NC panel of B stays in L3. A row of the tile is one cache line, so NR
+// depends on the element type (8 doubles or 16 floats).
+const size_t MR = 6;
+const size_t MC = 96;
+const size_t KC = 256;
+const size_t NC = 2048;
+
+// Products smaller than this (m * n * k) are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = 64 * 64 * 64;
+
+template <typename T>
+struct Tile {
+  static const size_t NR = 64 / sizeof(T);
+};
+
+typedef struct {
+  void *data;
+  size_t size;  // In bytes.
+} Buffer;
+
+// Every thread keeps its own packing buffers, so they are only allocated
+// the first time a thread needs them (or when they have to grow). They are
+// freed when the thread exits.
+struct Buffers {
+  Buffer a = {nullptr, 0};
+  Buffer b = {nullptr, 0};
+
+  ~Buffers() {
+    free(a.data);
+    free(b.data);
+  }
+};
+
+thread_local Buffers buffers;
+
+template <typename T>
+T *buffer_reserve(Buffer *buffer, size_t count) {
+  size_t size = count * sizeof(T);
+  if (buffer->size >= size) return (T *)buffer->data;
+
+  void *data = nullptr;
+  if (posix_memalign(&data, 64, size) != 0) return nullptr;
+
+  free(buffer->data);
+  buffer->data = data;
+  buffer->size = size;
+
+  return (T *)buffer->data;
+}
+
+inline size_t min_size(size_t a, size_t b) { return a < b ? a : b; }
+
+template <typename T>
+inline T element(const T *x, size_t ld, Transpose trans, size_t i, size_t j) {
+  return trans == TRANS ? x[j * ld + i] : x[i * ld + j];
+}
+
+// Packs alpha * op(A)[ic:ic+mc, pc:pc+kc] into micro-panels of MR rows. The
+// last panel is padded with zeros.
+template <typename T>
+void pack_a(Transpose trans, const T *a, size_t lda, size_t ic, size_t pc,
+            size_t mc, size_t kc, T alpha, T *packed) {
+  for (size_t ir = 0; ir < mc; ir += MR) {
+    size_t mr = min_size(MR, mc - ir);
+    T *panel = packed + ir * kc;
+
+    for (size_t p = 0; p < kc; p++) {
+      size_t i;
+      for (i = 0; i < mr; i++)
+        panel[p * MR + i] =
+            alpha * element(a, lda, trans, ic + ir + i, pc + p);
+      for (; i < MR; i++) panel[p * MR + i] = 0.;
+    }
+  }
+}
+
+// Packs op(B)[pc:pc+kc, jc+jr:jc+jr+NR] into one micro-panel of NR columns.
+template <typename T>
+void pack_b_panel(Transpose trans, const T *b, size_t ldb, size_t pc,
+                  size_t jc, size_t kc, size_t nr, T *panel) {
+  const size_t NR = Tile<T>::NR;
+
+  for (size_t p = 0; p < kc; p++) {
+    size_t j;
+    if (trans == NO_TRANS && nr == NR) {
+      memcpy(panel + p * NR, b + (pc + p) * ldb + jc, NR * sizeof(T));
+      continue;
+    }
+    for (j = 0; j < nr; j++)
+      panel[p * NR + j] = element(b, ldb, trans, pc + p, jc + j);
+    for (; j < NR; j++) panel[p * NR + j] = 0.;
+  }
+}
+
+template <typename T>
+struct MicroKernel {
+  typedef void (*Function)(size_t kc, const T *a, const T *b, T *c,
+                           size_t ldc, T beta);
+};
+
+// Writes the accumulated tile back to C, reading C only when beta != 0.
+template <typename T>
+inline void store_tile(const T *ab, T *c, size_t ldc, T beta) {
+  const size_t NR = Tile<T>::NR;
+
+  if (beta == 0.) {
+    for (size_t i = 0; i < MR; i++)
+      for (size_t j = 0; j < NR; j++) c[i * ldc + j] = ab[i * NR + j];
+  } else {
+    for (size_t i = 0; i < MR; i++)
+      for (size_t j = 0; j < NR; j++)
+        c[i * ldc + j] = beta * c[i * ldc + j] + ab[i * NR + j];
+  }
+}
+
+template <typename T>
+void micro_kernel_generic(size_t kc, const T *a, const T *b, T *c, size_t ldc,
+                          T beta) {
+  const size_t NR = Tile<T>::NR;
+  T ab[MR * NR] = {0};
+
+  for (size_t p = 0; p < kc; p++) {
+    for (size_t i = 0; i < MR; i++) {
+      const T ai = a[p * MR + i];
+      for (size_t j = 0; j < NR; j++) ab[i * NR + j] += ai * b[p * NR + j];
+    }
+  }
+
+  store_tile(ab, c, ldc, beta);
+}
+
+#ifdef GEMM_X86
+// 6x8 tile held in 12 ymm accumulators, one FMA per loaded B vector.
+__attribute__((target("avx2,fma"))) void micro_kernel_avx2(
+    size_t kc, const double *a, const double *b, double *c, size_t ldc,
+    double beta) {
+  __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+  __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+  __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+  __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+  __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+  __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+  for (size_t p = 0; p < kc; p++) {
+    const __m256d b0 = _mm256_load_pd(b);
+    const __m256d b1 = _mm256_load_pd(b + 4);
+    __m256d ai;
+
+    ai = _mm256_broadcast_sd(a + 0);
+    c00 = _mm256_fmadd_pd(ai, b0, c00);
+    c01 = _mm256_fmadd_pd(ai, b1, c01);
+    ai = _mm256_broadcast_sd(a + 1);
+    c10 = _mm256_fmadd_pd(ai, b0, c10);
+    c11 = _mm256_fmadd_pd(ai, b1, c11);
+    ai = _mm256_broadcast_sd(a + 2);
+    c20 = _mm256_fmadd_pd(ai, b0, c20);
+    c21 = _mm256_fmadd_pd(ai, b1, c21);
+    ai = _mm256_broadcast_sd(a + 3);
+    c30 = _mm256_fmadd_pd(ai, b0, c30);
+    c31 = _mm256_fmadd_pd(ai, b1, c31);
+    ai = _mm256_broadcast_sd(a + 4);
+    c40 = _mm256_fmadd_pd(ai, b0, c40);
+    c41 = _mm256_fmadd_pd(ai, b1, c41);
+    ai = _mm256_broadcast_sd(a + 5);
+    c50 = _mm256_fmadd_pd(ai, b0, c50);
+    c51 = _mm256_fmadd_pd(ai, b1, c51);
+
+    a += MR;
+    b += Tile<double>::NR;
+  }
+
+  __m256d rows[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                         {c30, c31}, {c40, c41}, {c50, c51}};
+
+  if (beta == 0.) {
+    for (size_t i = 0; i < MR; i++) {
+      _mm256_storeu_pd(c + i * ldc, rows[i][0]);
+      _mm256_storeu_pd(c + i * ldc + 4, rows[i][1]);
+    }
+  } else {
+    const __m256d vbeta = _mm256_set1_pd(beta);
+    for (size_t i = 0; i < MR; i++) {
+      double *row = c + i * ldc;
+      _mm256_storeu_pd(
+          row, _mm256_fmadd_pd(vbeta, _mm256_loadu_pd(row), rows[i][0]));
+      _mm256_storeu_pd(row + 4, _mm256_fmadd_pd(vbeta,
+                                                _mm256_loadu_pd(row + 4),
+                                                rows[i][1]));
+    }
+  }
+}
+
+// 6x16 tile held in 12 ymm accumulators, one FMA per loaded B vector.
+__attribute__((target("avx2,fma"))) void micro_kernel_avx2(
+    size_t kc, const float *a, const float *b, float *c, size_t ldc,
+    float beta) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+  for (size_t p = 0; p < kc; p++) {
+    const __m256 b0 = _mm256_load_ps(b);
+    const __m256 b1 = _mm256_load_ps(b + 8);
+    __m256 ai;
+
+    ai = _mm256_broadcast_ss(a + 0);
+    c00 = _mm256_fmadd_ps(ai, b0, c00);
+    c01 = _mm256_fmadd_ps(ai, b1, c01);
+    ai = _mm256_broadcast_ss(a + 1);
+    c10 = _mm256_fmadd_ps(ai, b0, c10);
+    c11 = _mm256_fmadd_ps(ai, b1, c11);
+    ai = _mm256_broadcast_ss(a + 2);
+    c20 = _mm256_fmadd_ps(ai, b0, c20);
+    c21 = _mm256_fmadd_ps(ai, b1, c21);
+    ai = _mm256_broadcast_ss(a + 3);
+    c30 = _mm256_fmadd_ps(ai, b0, c30);
+    c31 = _mm256_fmadd_ps(ai, b1, c31);
+    ai = _mm256_broadcast_ss(a + 4);
+    c40 = _mm256_fmadd_ps(ai, b0, c40);
+    c41 = _mm256_fmadd_ps(ai, b1, c41);
+    ai = _mm256_broadcast_ss(a + 5);
+    c50 = _mm256_fmadd_ps(ai, b0, c50);
+    c51 = _mm256_fmadd_ps(ai, b1, c51);
+
+    a += MR;
+    b += Tile<float>::NR;
+  }
+
+  __m256 rows[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                        {c30, c31}, {c40, c41}, {c50, c51}};
+
+  if (beta == 0.) {
+    for (size_t i = 0; i < MR; i++) {
+      _mm256_storeu_ps(c + i * ldc, rows[i][0]);
+      _mm256_storeu_ps(c + i * ldc + 8, rows[i][1]);
+    }
+  } else {
+    const __m256 vbeta = _mm256_set1_ps(beta);
+    for (size_t i = 0; i < MR; i++) {
+      float *row = c + i * ldc;
+      _mm256_storeu_ps(
+          row, _mm256_fmadd_ps(vbeta, _mm256_loadu_ps(row), rows[i][0]));
+      _mm256_storeu_ps(row + 8, _mm256_fmadd_ps(vbeta,
+                                                _mm256_loadu_ps(row + 8),
+                                                rows[i][1]));
+    }
+  }
+}
+#endif
+
+// Follows the instruction set picked by the SIMD dispatcher.
+template <typename T>
+typename MicroKernel<T>::Function select_micro_kernel() {
+#ifdef GEMM_X86
+  if (simd_get_isa() >= ISA_AVX2) return micro_kernel_avx2;
+#endif
+  return micro_kernel_generic<T>;
+}
+
+// Multiplies a packed mc x kc block of A with a packed kc x nc panel of B.
+template <typename T>
+void macro_kernel(typename MicroKernel<T>::Function micro_kernel, size_t mc,
+                  size_t nc, size_t kc, const T *a, const T *b, T beta, T *c,
+                  size_t ldc) {
+  const size_t NR = Tile<T>::NR;
+
+  for (size_t jr = 0; jr < nc; jr += NR) {
+    size_t nr = min_size(NR, nc - jr);
+
+    for (size_t ir = 0; ir < mc; ir += MR) {
+      size_t mr = min_size(MR, mc - ir);
+      T *tile = c + ir * ldc + jr;
+
+      if (mr == MR && nr == NR) {
+        micro_kernel(kc, a + ir * kc, b + jr * kc, tile, ldc, beta);
+        continue;
+      }
+
+      // Edge tile: compute the full register tile and copy what fits.
+      T ab[MR * NR];
+      micro_kernel(kc, a + ir * kc, b + jr * kc, ab, NR, 0.);
+      for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < nr; j++)
+          tile[i * ldc + j] = beta == 0. ? ab[i * NR + j]
+                                         : beta * tile[i * ldc + j] +
+                                               ab[i * NR + j];
+    }
+  }
+}
+
+template <typename T>
+void scale_c(size_t m, size_t n, T beta, T *c, size_t ldc) {
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++)
+      c[i * ldc + j] = beta == 0. ? 0. : beta * c[i * ldc + j];
+}
+
+// Computes C[ic:ic+mc, jc:jc+nc] = alpha * op(A)[ic:ic+mc, pc:pc+kc] *
+// op(B)[pc:pc+kc, jc:jc+nc] + beta * C without packing, for the blocks whose
+// buffers could not be allocated.
+template <typename T>
+void reference_block(Transpose trans_a, Transpose trans_b, size_t ic,
+                     size_t jc, size_t pc, size_t mc, size_t nc, size_t kc,
+                     T alpha, const T *a, size_t lda, const T *b, size_t ldb,
+                     T beta, T *c, size_t ldc) {
+  for (size_t i = ic; i < ic + mc; i++)
+    for (size_t j = jc; j < jc + nc; j++) {
+      T sum = 0;
+      for (size_t p = pc; p < pc + kc; p++)
+        sum += element(a, lda, trans_a, i, p) * element(b, ldb, trans_b, p, j);
+      c[i * ldc + j] = beta == 0. ? alpha * sum
+                                  : alpha * sum + beta * c[i * ldc + j];
+    }
+}
+
+template <typename T>
+void run(Transpose trans_a, Transpose trans_b, size_t m, size_t n, size_t k,
+         T alpha, const T *a, size_t lda, const T *b, size_t ldb, T beta, T *c,
+         size_t ldc, const GemmEpilogue *epilogue) {
+  const size_t NR = Tile<T>::NR;
+
+  if (m == 0 || n == 0) return;
+
+  if (k == 0 || alpha == 0.) {
+    scale_c(m, n, beta, c, ldc);
+    if (epilogue != nullptr) epilogue->apply(epilogue->context, 0, 0, m, n);
+    return;
+  }
+
+  typename MicroKernel<T>::Function micro_kernel = select_micro_kernel<T>();
+  bool parallel = m * n * k >= PARALLEL_THRESHOLD;
+  size_t mc_block = MC;
+
+#ifdef USE_OPENMP
+  // Inside a parallel region, e.g. a shard of a data-parallel step, the
+  // product runs on the calling thread.
+  if (omp_in_parallel()) parallel = false;
+
+  // Shrink the row blocks when there are fewer of them than threads, so that
+  // skinny products (e.g. a small batch) still use every core.
+  if (parallel) {
+    size_t threads = (size_t)omp_get_max_threads();
+    size_t rows_per_thread = (m + threads - 1) / threads;
+    rows_per_thread = (rows_per_thread + MR - 1) / MR * MR;
+    if (rows_per_thread < mc_block) mc_block = rows_per_thread;
+  }
+#endif
+
+  size_t kc_max = min_size(KC, k);
+  T *b_packed = buffer_reserve<T>(
+      &buffers.b, kc_max * ((min_size(NC, n) + NR - 1) / NR * NR));
+  if (b_packed == nullptr) {
+    reference_block(trans_a, trans_b, 0, 0, 0, m, n, k, alpha, a, lda, b, ldb,
+                    beta, c, ldc);
+    if (epilogue != nullptr) epilogue->apply(epilogue->context, 0, 0, m, n);
+    return;
+  }
+
+  for (size_t jc = 0; jc < n; jc += NC) {
+    size_t nc = min_size(NC, n - jc);
+    long panels = (long)((nc + NR - 1) / NR);
+
+    for (size_t pc = 0; pc < k; pc += KC) {
+      size_t kc = min_size(KC, k - pc);
+      T beta_block = pc == 0 ? beta : 1;
+      long blocks = (long)((m + mc_block - 1) / mc_block);
+      long jr, ic;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(jr) if (parallel)
+#endif
+      for (jr = 0; jr < panels; jr++)
+        pack_b_panel(trans_b, b, ldb, pc, jc + jr * NR, kc,
+                     min_size(NR, nc - jr * NR), b_packed + jr * NR * kc);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(ic) if (parallel) schedule(dynamic)
+#endif
+      for (ic = 0; ic < blocks; ic++) {
+        size_t row = ic * mc_block;
+        size_t mc = min_size(mc_block, m - row);
+        T *a_packed =
+            buffer_reserve<T>(&buffers.a, (mc_block + MR - 1) / MR * MR * KC);
+        if (a_packed != nullptr) {
+          pack_a(trans_a, a, lda, row, pc, mc, kc, alpha, a_packed);
+          macro_kernel<T>(micro_kernel, mc, nc, kc, a_packed, b_packed,
+                          beta_block, c + row * ldc + jc, ldc);
+        } else {
+          reference_block(trans_a, trans_b, row, jc, pc, mc, nc, kc, alpha, a,
+                          lda, b, ldb, beta_block, c, ldc);
+        }
+
+        // The block is final after the last panel of K.
+        if (epilogue != nullptr && pc + kc == k)
+          epilogue->apply(epilogue->context, row, jc, mc, nc);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void gemm(Transpose trans_a, Transpose trans_b, size_t m, size_t n, size_t k,
+          double alpha, const double *a, size_t lda, const double *b,
+          size_t ldb, double beta, double *c, size_t ldc,
+          const GemmEpilogue *epilogue) {
+  run(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+      epilogue);
+}
+
+void gemm(Transpose trans_a, Transpose trans_b, size_t m, size_t n, size_t k,
+          float alpha, const float *a, size_t lda, const float *b, size_t ldb,
+          float beta, float *c, size_t ldc, const GemmEpilogue *epilogue) {
+  run(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+      epilogue);
+}
+
+}  // namespace custom_math
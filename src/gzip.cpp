@@ -0,0 +1,279 @@
+/**
+ * @file gzip.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief  This file contains the implementation of the functions declared in
+ *         gzip.hpp.
+ * @version 1.0
+ * @date 2023-08-07
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "gzip.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#endif
+
+namespace images {
+
+bool gzip_is_compressed(const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  return size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b;
+}
+
+#ifdef USE_ZLIB
+
+namespace {
+
+// The compressed content is given to zlib in parts of this size, since its
+// sizes are 32-bit.
+#define GZIP_INPUT_SIZE (1 << 20)
+
+typedef struct {
+  char *data;
+  size_t size;      // The size of the block, up to the end of its last line.
+  size_t extra;     // The size of the partial line that follows it.
+  size_t capacity;
+} Block;
+
+}  // namespace
+
+// The blocks are a ring: the thread fills block produced % GZIP_BLOCKS while
+// the blocks from consumed to produced are waiting to be parsed.
+struct GzipReader {
+  z_stream stream;
+  const unsigned char *input;  // The content that is not given to zlib yet.
+  size_t input_size;
+
+  Block blocks[GZIP_BLOCKS];
+  size_t produced;
+  size_t consumed;
+  bool holding;   // Whether block consumed is being parsed.
+  bool finished;  // Whether the thread has inflated everything.
+  bool failed;    // Whether the content is corrupted.
+  bool stopped;   // Whether gzip_close was called.
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+};
+
+namespace {
+
+// Inflates into out until it is full or the content ends.
+bool inflate_into(GzipReader *reader, char *out, size_t size,
+                  size_t *written, bool *end) {
+  z_stream *stream = &reader->stream;
+  stream->next_out = (Bytef *)out;
+  stream->avail_out = (uInt)size;
+  *end = false;
+
+  while (stream->avail_out > 0) {
+    if (stream->avail_in == 0 && reader->input_size > 0) {
+      size_t part = reader->input_size < GZIP_INPUT_SIZE ? reader->input_size
+                                                         : GZIP_INPUT_SIZE;
+      stream->next_in = (Bytef *)reader->input;
+      stream->avail_in = (uInt)part;
+      reader->input += part;
+      reader->input_size -= part;
+    }
+
+    int status = inflate(stream, Z_NO_FLUSH);
+    if (status == Z_STREAM_END) {
+      // Another member may follow, as in concatenated gzip files. The parts
+      // are contiguous, so the rest of the content starts at next_in.
+      if (!gzip_is_compressed(stream->next_in,
+                              stream->avail_in + reader->input_size)) {
+        *end = true;
+        break;
+      }
+      if (inflateReset(stream) != Z_OK) return false;
+    } else if (status != Z_OK) {
+      // Z_BUF_ERROR when the content ends in the middle of a member.
+      return false;
+    }
+  }
+
+  *written = size - stream->avail_out;
+  return true;
+}
+
+// Returns the position after the last '\n' of [begin, end), or begin.
+const char *after_last_line(const char *begin, const char *end) {
+  for (const char *p = end; p > begin; p--)
+    if (p[-1] == '\n') return p;
+  return begin;
+}
+
+bool reserve(Block *block, size_t capacity) {
+  if (block->capacity >= capacity) return true;
+  char *data = (char *)realloc(block->data, capacity);
+  if (data == nullptr) return false;
+  block->data = data;
+  block->capacity = capacity;
+  return true;
+}
+
+void produce(GzipReader *reader) {
+  bool end = false;
+  bool failed = false;
+
+  while (!end && !failed) {
+    {
+      std::unique_lock<std::mutex> lock(reader->mutex);
+      reader->changed.wait(lock, [reader] {
+        return reader->stopped ||
+               reader->produced - reader->consumed < GZIP_BLOCKS;
+      });
+      if (reader->stopped) break;
+    }
+
+    // The partial line at the end of the previous block starts this one. The
+    // previous block may be parsed at the same time, but it is only read.
+    Block *block = &reader->blocks[reader->produced % GZIP_BLOCKS];
+    const Block *previous =
+        reader->produced > 0
+            ? &reader->blocks[(reader->produced - 1) % GZIP_BLOCKS]
+            : nullptr;
+    size_t filled = previous != nullptr ? previous->extra : 0;
+
+    if (!reserve(block, filled + GZIP_BLOCK_SIZE)) {
+      failed = true;
+      break;
+    }
+    if (filled > 0)
+      memcpy(block->data, previous->data + previous->size, filled);
+
+    const char *last_line = block->data;
+    while (!end) {
+      size_t written;
+      if (!inflate_into(reader, block->data + filled,
+                        block->capacity - filled, &written, &end)) {
+        failed = true;
+        break;
+      }
+      filled += written;
+      if (end) break;
+
+      // A line longer than the block makes it grow.
+      last_line = after_last_line(block->data, block->data + filled);
+      if (last_line > block->data) break;
+      if (!reserve(block, 2 * block->capacity)) {
+        failed = true;
+        break;
+      }
+    }
+    if (failed) break;
+
+    block->size = end ? filled : (size_t)(last_line - block->data);
+    block->extra = filled - block->size;
+
+    std::lock_guard<std::mutex> lock(reader->mutex);
+    reader->produced++;
+    reader->changed.notify_all();
+  }
+
+  std::lock_guard<std::mutex> lock(reader->mutex);
+  reader->finished = true;
+  reader->failed = failed;
+  reader->changed.notify_all();
+}
+
+}  // namespace
+
+GzipReader *gzip_open(const void *data, size_t size) {
+  if (!gzip_is_compressed(data, size)) return nullptr;
+
+  GzipReader *reader = new (std::nothrow) GzipReader();
+  if (reader == nullptr) return nullptr;
+
+  // 16 + MAX_WBITS reads the gzip header and trailer, not only the deflate
+  // stream.
+  memset(&reader->stream, 0, sizeof(reader->stream));
+  if (inflateInit2(&reader->stream, 16 + MAX_WBITS) != Z_OK) {
+    delete reader;
+    return nullptr;
+  }
+
+  reader->input = (const unsigned char *)data;
+  reader->input_size = size;
+  memset(reader->blocks, 0, sizeof(reader->blocks));
+  reader->produced = 0;
+  reader->consumed = 0;
+  reader->holding = false;
+  reader->finished = false;
+  reader->failed = false;
+  reader->stopped = false;
+  reader->thread = std::thread(produce, reader);
+
+  return reader;
+}
+
+bool gzip_next_lines(GzipReader *reader, const char **begin,
+                     const char **end) {
+  std::unique_lock<std::mutex> lock(reader->mutex);
+
+  if (reader->holding) {
+    reader->consumed++;
+    reader->holding = false;
+    reader->changed.notify_all();
+  }
+
+  reader->changed.wait(lock, [reader] {
+    return reader->finished || reader->produced > reader->consumed;
+  });
+  if (reader->produced == reader->consumed) return false;
+
+  const Block *block = &reader->blocks[reader->consumed % GZIP_BLOCKS];
+  *begin = block->data;
+  *end = block->data + block->size;
+  reader->holding = true;
+  return true;
+}
+
+bool gzip_close(GzipReader *reader) {
+  if (reader == nullptr) return false;
+
+  {
+    std::lock_guard<std::mutex> lock(reader->mutex);
+    reader->stopped = true;
+    reader->changed.notify_all();
+  }
+  reader->thread.join();
+
+  const bool ok = !reader->failed;
+  inflateEnd(&reader->stream);
+  for (size_t i = 0; i < GZIP_BLOCKS; i++) free(reader->blocks[i].data);
+  delete reader;
+
+  return ok;
+}
+
+#else
+
+// Without zlib the compressed files cannot be read.
+
+struct GzipReader {};
+
+GzipReader *gzip_open(const void *, size_t) { return nullptr; }
+
+bool gzip_next_lines(GzipReader *, const char **, const char **) {
+  return false;
+}
+
+bool gzip_close(GzipReader *) { return false; }
+
+#endif  // USE_ZLIB
+
+}  // namespace images
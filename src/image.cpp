@@ -12,90 +12,878 @@
 
 #include "image.hpp"
 
+#include "gzip.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IMAGE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace images {
 
-Image **read_images(const char *filename, const int *count) {
-  Image **images = nullptr;
+namespace {
 
-  FILE *file = fopen(filename, "r");
+// The content of a file, mapped in memory when possible and read into a
+// buffer otherwise.
+typedef struct {
+  const char *data;
+  size_t size;
+  bool mapped;
+} FileContent;
 
-  if (file == nullptr || count == nullptr) {
-    return nullptr;
+// A file that is read from the start to the end once is mapped for a
+// sequential access, the other ones are read where they are used.
+bool file_open(const char *filename, FileContent *content,
+               bool sequential = true) {
+  content->data = nullptr;
+  content->size = 0;
+  content->mapped = false;
+
+#ifdef IMAGE_MMAP
+  int descriptor = open(filename, O_RDONLY);
+  if (descriptor < 0) return false;
+
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return false;
   }
 
-  printf("Reading %d image(s) from %s...\n", *count, filename);
+  content->size = (size_t)status.st_size;
+  if (content->size > 0) {
+    void *address =
+        mmap(nullptr, content->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address != MAP_FAILED) {
+      if (sequential) madvise(address, content->size, MADV_SEQUENTIAL);
+      content->data = (const char *)address;
+      content->mapped = true;
+    }
+  }
+  close(descriptor);
 
-  images = (Image **)malloc((*count) * sizeof(Image *));
+  if (content->mapped || content->size == 0) return true;
+#endif
 
-  if (images == nullptr) {
+  FILE *file = fopen(filename, "rb");
+  if (file == nullptr) return false;
+
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+  char *buffer = size >= 0 ? (char *)malloc((size_t)size + 1) : nullptr;
+
+  if (buffer == nullptr || fseek(file, 0, SEEK_SET) != 0 ||
+      fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+    free(buffer);
     fclose(file);
+    return false;
+  }
+  fclose(file);
+
+  content->data = buffer;
+  content->size = (size_t)size;
+  return true;
+}
+
+void file_close(FileContent *content) {
+#ifdef IMAGE_MMAP
+  if (content->mapped) {
+    munmap((void *)content->data, content->size);
+    return;
+  }
+#endif
+  free((void *)content->data);
+}
+
+bool file_exists(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (file == nullptr) return false;
+  fclose(file);
+  return true;
+}
+
+// A part of the file that starts and ends at line boundaries.
+typedef struct {
+  const char *begin;
+  const char *end;
+  size_t lines;       // The number of lines, empty ones included.
+  size_t rows;        // The number of lines that are not empty.
+  size_t first_line;  // The index of its first line in the file.
+  size_t first_row;   // The index of its first row in the file.
+  size_t malformed;
+  size_t first_malformed_line;
+} Chunk;
+
+// Returns the end of the line that starts at begin, without the '\n' and the
+// '\r' before it.
+inline const char *line_end(const char *begin, const char *end,
+                            const char **next) {
+  const char *newline = (const char *)memchr(begin, '\n', end - begin);
+  *next = newline == nullptr ? end : newline + 1;
+  if (newline == nullptr) newline = end;
+  if (newline > begin && newline[-1] == '\r') newline--;
+  return newline;
+}
+
+// Parses an integer of at most 9 digits. A longer one makes the row
+// malformed, since the character that follows is not a separator.
+inline bool parse_integer(const char **cursor, const char *end,
+                          unsigned int *value) {
+  const char *begin = *cursor;
+  const char *limit = end - begin > 9 ? begin + 9 : end;
+  const char *p = begin;
+  unsigned int result = 0;
+
+  while (p < limit && (unsigned int)(*p - '0') < 10)
+    result = result * 10 + (unsigned int)(*p++ - '0');
+
+  *cursor = p;
+  *value = result;
+  return p != begin;
+}
+
+// Parses one row, "label,pixel,...,pixel".
+bool parse_row(const char *begin, const char *end, uint8_t *label,
+               uint8_t *pixels) {
+  const char *p = begin;
+  unsigned int value;
+
+  if (!parse_integer(&p, end, &value) || value > 255) return false;
+  *label = (uint8_t)value;
+
+  for (size_t i = 0; i < IMAGE_ROWS * IMAGE_COLS; i++) {
+    if (p == end || *p++ != ',') return false;
+    if (!parse_integer(&p, end, &value) || value > 255) return false;
+    pixels[i] = (uint8_t)value;
+  }
+
+  return p == end;
+}
+
+// Counts the lines and the rows of a chunk.
+void count_rows(Chunk *chunk) {
+  chunk->lines = 0;
+  chunk->rows = 0;
+
+  for (const char *p = chunk->begin, *next; p < chunk->end; p = next) {
+    const char *end = line_end(p, chunk->end, &next);
+    chunk->lines++;
+    if (end > p) chunk->rows++;
+  }
+}
+
+// The parsing of a file, which is given in one part when it is mapped and in
+// several when it is decompressed.
+typedef struct {
+  size_t limit;     // The number of images to read, 0 for all of them.
+  size_t capacity;  // The number of images labels and pixels can hold.
+  uint8_t *labels;
+  uint8_t *pixels;
+  size_t lines;     // The number of lines so far, the header included.
+  size_t rows;      // The number of rows so far, read or not.
+  size_t malformed;
+  size_t first_malformed_line;
+  bool failed;      // Whether the memory could not be allocated.
+} Parser;
+
+// Parses the rows of a chunk whose index is lower than the number of images
+// the parser can hold.
+void parse_rows(Chunk *chunk, Parser *parser) {
+  const size_t size = IMAGE_ROWS * IMAGE_COLS;
+  size_t line = chunk->first_line;
+  size_t row = chunk->first_row;
+
+  for (const char *p = chunk->begin, *next;
+       p < chunk->end && row < parser->capacity; p = next, line++) {
+    const char *end = line_end(p, chunk->end, &next);
+    if (end == p) continue;
+
+    if (!parse_row(p, end, &parser->labels[row],
+                   &parser->pixels[row * size])) {
+      if (chunk->malformed++ == 0) chunk->first_malformed_line = line + 1;
+    }
+    row++;
+  }
+}
+
+// Makes room for count images, more when the number of images is not known
+// so that the memory is not reallocated for every part.
+bool parser_reserve(Parser *parser, size_t count) {
+  if (count <= parser->capacity) return true;
+
+  size_t capacity = count;
+  if (parser->limit == 0 && capacity < 2 * parser->capacity)
+    capacity = 2 * parser->capacity;
+  if (parser->limit > 0 && capacity > parser->limit) capacity = parser->limit;
+
+  uint8_t *labels = (uint8_t *)realloc(parser->labels, capacity);
+  if (labels != nullptr) parser->labels = labels;
+  uint8_t *pixels = (uint8_t *)realloc(parser->pixels,
+                                       capacity * IMAGE_ROWS * IMAGE_COLS);
+  if (pixels != nullptr) parser->pixels = pixels;
+  if (labels == nullptr || pixels == nullptr) return false;
+
+  parser->capacity = capacity;
+  return true;
+}
+
+// Parses a part of the file that ends at a line boundary. It is split in
+// chunks at line boundaries, the rows of every chunk are counted, then the
+// chunks are parsed by all the OpenMP threads.
+void parse_text(Parser *parser, const char *begin, const char *end) {
+  // A few chunks per thread, so that they finish at about the same time.
+  size_t chunk_count = 1;
+#ifdef USE_OPENMP
+  chunk_count = 4 * (size_t)omp_get_max_threads();
+#endif
+  if (chunk_count > (size_t)(end - begin) / 4096 + 1)
+    chunk_count = (size_t)(end - begin) / 4096 + 1;
+
+  Chunk *chunks = (Chunk *)calloc(chunk_count, sizeof(Chunk));
+  if (chunks == nullptr) {
+    parser->failed = true;
+    return;
+  }
+
+  // Every chunk but the first starts after a newline.
+  const char *previous = begin;
+  for (size_t i = 0; i < chunk_count; i++) {
+    const char *start = begin + (size_t)(end - begin) * i / chunk_count;
+    if (i > 0 && start[-1] != '\n') line_end(start, end, &start);
+    if (start < previous) start = previous;
+    chunks[i].begin = previous = start;
+  }
+  for (size_t i = 0; i < chunk_count; i++)
+    chunks[i].end = i + 1 < chunk_count ? chunks[i + 1].begin : end;
+
+  long c;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(c)
+#endif
+  for (c = 0; c < (long)chunk_count; c++) count_rows(&chunks[c]);
+
+  for (size_t i = 0; i < chunk_count; i++) {
+    chunks[i].first_line = parser->lines;
+    chunks[i].first_row = parser->rows;
+    parser->lines += chunks[i].lines;
+    parser->rows += chunks[i].rows;
+  }
+
+  if (!parser_reserve(parser, parser->rows)) parser->failed = true;
+
+  if (!parser->failed) {
+#ifdef USE_OPENMP
+#pragma omp parallel for private(c) schedule(dynamic)
+#endif
+    for (c = 0; c < (long)chunk_count; c++) parse_rows(&chunks[c], parser);
+  }
+
+  for (size_t i = 0; i < chunk_count; i++) {
+    if (chunks[i].malformed > 0 && parser->malformed == 0)
+      parser->first_malformed_line = chunks[i].first_malformed_line;
+    parser->malformed += chunks[i].malformed;
+  }
+
+  free(chunks);
+}
+
+// Skips the header of the file, if there is one.
+const char *skip_header(Parser *parser, const char *begin, const char *end) {
+  if (begin < end && (unsigned int)(*begin - '0') >= 10) {
+    line_end(begin, end, &begin);
+    parser->lines = 1;
+  }
+  return begin;
+}
+
+// Parses a gzip file as it is decompressed. The reading stops once the
+// images that are asked for are found.
+bool parse_compressed(Parser *parser, const FileContent *content) {
+  GzipReader *reader = gzip_open(content->data, content->size);
+  if (reader == nullptr) return false;
+
+  const char *begin, *end;
+  bool first = true;
+  while ((parser->limit == 0 || parser->rows < parser->limit) &&
+         !parser->failed && gzip_next_lines(reader, &begin, &end)) {
+    if (first) begin = skip_header(parser, begin, end);
+    first = false;
+    parse_text(parser, begin, end);
+  }
+
+  return gzip_close(reader);
+}
+
+RawImages *raw_images_create(size_t count, size_t rows, size_t cols) {
+  RawImages *raw = (RawImages *)malloc(sizeof(RawImages));
+  if (raw == nullptr) return nullptr;
+
+  raw->count = count;
+  raw->rows = rows;
+  raw->cols = cols;
+  raw->labels = (uint8_t *)malloc(count);
+  raw->pixels = (uint8_t *)malloc(count * rows * cols);
+  raw->mapping = nullptr;
+  raw->mapping_size = 0;
+  raw->labels_mapping = nullptr;
+  raw->labels_mapping_size = 0;
+
+  if (raw->labels == nullptr || raw->pixels == nullptr) {
+    delete_raw_images(raw);
     return nullptr;
   }
 
-  char line[MAX_LINE_LENGTH];
-  int i = 0;
+  return raw;
+}
 
-  fgets(line, MAX_LINE_LENGTH, file);
+// Turns the raw images into images of T, with the pixels scaled to [0, 1].
+template <typename T>
+BasicImage<T> **to_images(const RawImages *raw, size_t count) {
+  BasicImage<T> **images =
+      (BasicImage<T> **)calloc(count, sizeof(BasicImage<T> *));
+  if (images == nullptr) return nullptr;
 
-  while (feof(file) != 1 && i < *count) {
-    // Allocate memory for the image
-    images[i] = (Image *)malloc(sizeof(Image));
+  // The pixels are turned into T exactly like (T)(pixel / 255.0).
+  T scale[256];
+  for (int i = 0; i < 256; i++) scale[i] = (T)(i / 255.0);
 
-    if (images[i] == nullptr) {
-      fclose(file);
-      return nullptr;
+  bool failed = false;
+  long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i) reduction(|| : failed)
+#endif
+  for (i = 0; i < (long)count; i++) {
+    BasicImage<T> *image = (BasicImage<T> *)malloc(sizeof(BasicImage<T>));
+    if (image == nullptr) {
+      failed = true;
+      continue;
+    }
+    images[i] = image;
+    image->label = raw->labels[i];
+    image->pixels = custom_math::matrix_create<T>(raw->rows, raw->cols);
+    if (image->pixels == nullptr) {
+      failed = true;
+      continue;
     }
 
-    // Allocate memory for the pixels
-    images[i]->pixels = custom_math::matrix_create(28, 28);
+    const uint8_t *pixels = raw->pixels + i * raw->rows * raw->cols;
+    for (size_t r = 0; r < raw->rows; r++) {
+      T *row = custom_math::matrix_row(image->pixels, r);
+      for (size_t c = 0; c < raw->cols; c++)
+        row[c] = scale[pixels[r * raw->cols + c]];
+    }
+  }
 
-    if (images[i]->pixels == nullptr) {
-      // Delete the current image and all the previous ones
-      while (i >= 0) {
-        delete_image(images[i]);
-        i--;
-      }
-      fclose(file);
-      return nullptr;
+  if (failed) {
+    delete_images(images, count);
+    return nullptr;
+  }
+
+  return images;
+}
+
+#ifdef IMAGE_MMAP
+
+// The size and the modification time of a file, which identify its content
+// for the cache.
+bool file_status(const char *filename, uint64_t *size, int64_t *seconds,
+                 int64_t *nanoseconds) {
+  struct stat status;
+  if (stat(filename, &status) != 0) return false;
+
+  *size = (uint64_t)status.st_size;
+  *seconds = (int64_t)status.st_mtime;
+#ifdef __APPLE__
+  *nanoseconds = (int64_t)status.st_mtimespec.tv_nsec;
+#else
+  *nanoseconds = (int64_t)status.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+inline uint64_t align(uint64_t offset) {
+  return (offset + IMAGE_CACHE_ALIGNMENT - 1) &
+         ~(uint64_t)(IMAGE_CACHE_ALIGNMENT - 1);
+}
+
+// Maps a cache file and checks that it was made from the given source.
+RawImages *open_cache(const char *filename, const ImageCacheHeader *source) {
+  FileContent content;
+  if (!file_open(filename, &content)) return nullptr;
+
+  // A truncated or corrupt cache is stale: the header is only read once it
+  // is known to be there, and its count bounded by the size of the file.
+  if (!content.mapped || content.size < sizeof(ImageCacheHeader)) {
+    file_close(&content);
+    return nullptr;
+  }
+
+  const ImageCacheHeader *header = (const ImageCacheHeader *)content.data;
+  if (header->count > content.size / (IMAGE_ROWS * IMAGE_COLS)) {
+    file_close(&content);
+    return nullptr;
+  }
+  const uint64_t pixels_size = header->count * IMAGE_ROWS * IMAGE_COLS;
+
+  if (memcmp(header->magic, IMAGE_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != IMAGE_CACHE_VERSION ||
+      header->rows != IMAGE_ROWS || header->cols != IMAGE_COLS ||
+      header->source_size != source->source_size ||
+      header->source_seconds != source->source_seconds ||
+      header->source_nanoseconds != source->source_nanoseconds ||
+      header->labels_offset != align(sizeof(ImageCacheHeader)) ||
+      header->pixels_offset != align(header->labels_offset + header->count) ||
+      content.size != header->pixels_offset + pixels_size) {
+    file_close(&content);
+    return nullptr;
+  }
+
+  RawImages *raw = (RawImages *)malloc(sizeof(RawImages));
+  if (raw == nullptr) {
+    file_close(&content);
+    return nullptr;
+  }
+
+  raw->count = header->count;
+  raw->rows = IMAGE_ROWS;
+  raw->cols = IMAGE_COLS;
+  raw->labels = (uint8_t *)content.data + header->labels_offset;
+  raw->pixels = (uint8_t *)content.data + header->pixels_offset;
+  raw->mapping = (void *)content.data;
+  raw->mapping_size = content.size;
+  raw->labels_mapping = nullptr;
+  raw->labels_mapping_size = 0;
+
+  return raw;
+}
+
+// Writes a cache file. It is written under another name first and renamed,
+// so that a process never sees a partial cache.
+bool write_cache(const char *filename, ImageCacheHeader header,
+                 const RawImages *raw) {
+  const uint64_t pixels_size = raw->count * IMAGE_ROWS * IMAGE_COLS;
+  static const char padding[IMAGE_CACHE_ALIGNMENT] = {0};
+
+  header.count = raw->count;
+  header.labels_offset = align(sizeof(ImageCacheHeader));
+  header.pixels_offset = align(header.labels_offset + raw->count);
+
+  char temporary[4096];
+  if (snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", filename,
+               (long)getpid()) >= (int)sizeof(temporary))
+    return false;
+
+  FILE *file = fopen(temporary, "wb");
+  if (file == nullptr) return false;
+
+  bool ok =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(padding, 1, header.labels_offset - sizeof(header), file) ==
+          header.labels_offset - sizeof(header) &&
+      fwrite(raw->labels, 1, raw->count, file) == raw->count &&
+      fwrite(padding, 1, header.pixels_offset - header.labels_offset -
+                             raw->count, file) ==
+          header.pixels_offset - header.labels_offset - raw->count &&
+      fwrite(raw->pixels, 1, pixels_size, file) == pixels_size;
+  ok = fclose(file) == 0 && ok;
+  ok = ok && rename(temporary, filename) == 0;
+
+  if (!ok) remove(temporary);
+  return ok;
+}
+
+#endif  // IMAGE_MMAP
+
+inline uint32_t read_big_endian(const unsigned char *bytes) {
+  return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+         (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+}
+
+// Reads the header of an IDX file and checks that the elements fill the rest
+// of the file.
+bool idx_parse(IdxFile *file) {
+  const unsigned char *bytes = (const unsigned char *)file->content;
+  if (file->content_size < 4 || bytes[0] != 0 || bytes[1] != 0) return false;
+
+  file->type = (IdxType)bytes[2];
+  file->dimensions = bytes[3];
+  const size_t element_size = idx_type_size(file->type);
+  const size_t offset = 4 + 4 * (size_t)file->dimensions;
+  if (element_size == 0 || file->dimensions > IDX_MAX_DIMENSIONS ||
+      file->content_size < offset)
+    return false;
+
+  // The product of the sizes is checked against the size of the file as it
+  // is computed, so that it cannot overflow.
+  const size_t available = (file->content_size - offset) / element_size;
+  size_t count = 1;
+  for (uint32_t i = 0; i < file->dimensions; i++) {
+    file->sizes[i] = read_big_endian(bytes + 4 + 4 * i);
+    if (file->sizes[i] != 0 && count > available / file->sizes[i])
+      return false;
+    count *= file->sizes[i];
+  }
+  if (offset + count * element_size != file->content_size) return false;
+
+  file->count = count;
+  file->data = file->content + offset;
+  return true;
+}
+
+}  // namespace
+
+RawImages *read_raw_images(const char *filename, size_t count,
+                           ReadReport *report) {
+  if (filename == nullptr) return nullptr;
+
+  FileContent content;
+  if (!file_open(filename, &content)) return nullptr;
+
+  Parser parser;
+  memset(&parser, 0, sizeof(parser));
+  parser.limit = count;
+
+  if (gzip_is_compressed(content.data, content.size)) {
+    if (!parse_compressed(&parser, &content)) {
+      fprintf(stderr, "%s: cannot be decompressed\n", filename);
+      parser.failed = true;
     }
+  } else {
+    const char *end = content.data + content.size;
+    parse_text(&parser, skip_header(&parser, content.data, end), end);
+  }
+  file_close(&content);
+
+  const size_t rows = parser.rows;
+  if (report != nullptr) {
+    report->rows = rows;
+    report->malformed = parser.malformed;
+    report->first_malformed_line = parser.first_malformed_line;
+  }
+
+  if (count == 0) count = rows;
+  if (rows < count)
+    fprintf(stderr, "%s: found %zu image(s) instead of %zu\n", filename, rows,
+            count);
+  if (parser.malformed > 0)
+    fprintf(stderr, "%s: %zu malformed row(s), the first one on line %zu\n",
+            filename, parser.malformed, parser.first_malformed_line);
+
+  RawImages *raw = nullptr;
+  if (!parser.failed && parser.malformed == 0 && rows >= count && count > 0)
+    raw = (RawImages *)malloc(sizeof(RawImages));
+
+  if (raw == nullptr) {
+    free(parser.labels);
+    free(parser.pixels);
+    return nullptr;
+  }
+
+  raw->count = count;
+  raw->rows = IMAGE_ROWS;
+  raw->cols = IMAGE_COLS;
+  raw->labels = parser.labels;
+  raw->pixels = parser.pixels;
+  raw->mapping = nullptr;
+  raw->mapping_size = 0;
+  raw->labels_mapping = nullptr;
+  raw->labels_mapping_size = 0;
+
+  return raw;
+}
+
+RawImages *load_image_cache(const char *filename, const char *cache_filename) {
+  if (filename == nullptr) return nullptr;
+
+  char default_cache[4096];
+  if (cache_filename == nullptr) {
+    if (snprintf(default_cache, sizeof(default_cache), "%s.cache", filename) >=
+        (int)sizeof(default_cache))
+      return nullptr;
+    cache_filename = default_cache;
+  }
+
+#ifdef IMAGE_MMAP
+  ImageCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMAGE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = IMAGE_CACHE_VERSION;
+  header.rows = IMAGE_ROWS;
+  header.cols = IMAGE_COLS;
+  if (!file_status(filename, &header.source_size, &header.source_seconds,
+                   &header.source_nanoseconds))
+    return nullptr;
+
+  RawImages *raw = open_cache(cache_filename, &header);
+  if (raw != nullptr) return raw;
+
+  // The cache is missing or stale.
+  raw = read_raw_images(filename, 0);
+  if (raw == nullptr) return nullptr;
+
+  if (!write_cache(cache_filename, header, raw))
+    fprintf(stderr, "%s: cannot write the cache\n", cache_filename);
+
+  return raw;
+#else
+  // The cache is only worth it when it can be mapped.
+  return read_raw_images(filename, 0);
+#endif
+}
+
+size_t idx_type_size(IdxType type) {
+  switch (type) {
+    case IDX_UINT8:
+    case IDX_INT8:
+      return 1;
+    case IDX_INT16:
+      return 2;
+    case IDX_INT32:
+    case IDX_FLOAT32:
+      return 4;
+    case IDX_FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+IdxFile *idx_open(const char *filename) {
+  if (filename == nullptr) return nullptr;
+
+  FileContent content;
+  if (!file_open(filename, &content, false)) return nullptr;
+
+  IdxFile *file = (IdxFile *)malloc(sizeof(IdxFile));
+  if (file == nullptr) {
+    file_close(&content);
+    return nullptr;
+  }
+
+  file->content = content.data;
+  file->content_size = content.size;
+  file->mapped = content.mapped;
+
+  if (!idx_parse(file)) {
+    fprintf(stderr, "%s: not an IDX file\n", filename);
+    idx_close(file);
+    return nullptr;
+  }
+
+  return file;
+}
+
+void idx_close(IdxFile *file) {
+  if (file == nullptr) return;
 
-    // Process the line
-    int j = 0;
-    fgets(line, MAX_LINE_LENGTH, file);
-    char *token = strtok(line, ",");
-    images[i]->label = atoi(token);
-
-    // Read the pixels
-    while (token != nullptr) {
-      token = strtok(nullptr, ",");
-      if (token != nullptr) {
-        images[i]->pixels->elements[j - 1] = atof(token) / 255.0;
-        j++;
-      }
+  FileContent content = {file->content, file->content_size, file->mapped};
+  file_close(&content);
+  free(file);
+}
+
+RawImages *load_idx_images(const char *images_filename,
+                           const char *labels_filename) {
+  IdxFile *images = idx_open(images_filename);
+  if (images == nullptr) return nullptr;
+
+  IdxFile *labels = idx_open(labels_filename);
+  if (labels == nullptr) {
+    idx_close(images);
+    return nullptr;
+  }
+
+  if (images->type != IDX_UINT8 || images->dimensions != 3 ||
+      labels->type != IDX_UINT8 || labels->dimensions != 1 ||
+      labels->sizes[0] != images->sizes[0]) {
+    fprintf(stderr, "%s, %s: not the images and the labels of a dataset\n",
+            images_filename, labels_filename);
+    idx_close(images);
+    idx_close(labels);
+    return nullptr;
+  }
+
+  const size_t count = images->sizes[0];
+  const size_t rows = images->sizes[1];
+  const size_t cols = images->sizes[2];
+  RawImages *raw = nullptr;
+
+  if (images->mapped && labels->mapped) {
+    // The mappings are handed over to the images.
+    raw = (RawImages *)malloc(sizeof(RawImages));
+    if (raw != nullptr) {
+      raw->count = count;
+      raw->rows = rows;
+      raw->cols = cols;
+      raw->labels = (uint8_t *)labels->data;
+      raw->pixels = (uint8_t *)images->data;
+      raw->mapping = (void *)images->content;
+      raw->mapping_size = images->content_size;
+      raw->labels_mapping = (void *)labels->content;
+      raw->labels_mapping_size = labels->content_size;
+      free(images);
+      free(labels);
+      return raw;
+    }
+  } else {
+    raw = raw_images_create(count, rows, cols);
+    if (raw != nullptr) {
+      memcpy(raw->labels, labels->data, count);
+      memcpy(raw->pixels, images->data, count * rows * cols);
     }
+  }
 
-    // Go to the next line
-    i++;
+  idx_close(images);
+  idx_close(labels);
+  return raw;
+}
+
+RawImages *load_raw_test_images() {
+  const char *images_filename = "data/t10k-images-idx3-ubyte";
+  const char *labels_filename = "data/t10k-labels-idx1-ubyte";
+  const char *filename = file_exists("data/mnist_test.csv")
+                             ? "data/mnist_test.csv"
+                             : "data/mnist_test.csv.gz";
+
+  printf("Reading the test images...\n");
+
+  if (file_exists(images_filename) && file_exists(labels_filename))
+    return load_idx_images(images_filename, labels_filename);
+  return load_image_cache(filename);
+}
+
+RawImages *load_raw_train_images() {
+  const char *images_filename = "data/train-images-idx3-ubyte";
+  const char *labels_filename = "data/train-labels-idx1-ubyte";
+  const char *filename = file_exists("data/mnist_train.csv")
+                             ? "data/mnist_train.csv"
+                             : "data/mnist_train.csv.gz";
+
+  printf("Reading the training images...\n");
+
+  if (file_exists(images_filename) && file_exists(labels_filename))
+    return load_idx_images(images_filename, labels_filename);
+  return load_image_cache(filename);
+}
+
+void delete_raw_images(RawImages *raw) {
+  if (raw == nullptr) return;
+
+  if (raw->mapping != nullptr) {
+#ifdef IMAGE_MMAP
+    munmap(raw->mapping, raw->mapping_size);
+    if (raw->labels_mapping != nullptr)
+      munmap(raw->labels_mapping, raw->labels_mapping_size);
+#endif
+  } else {
+    free(raw->labels);
+    free(raw->pixels);
   }
 
+  free(raw);
+}
+
+template <typename T>
+BasicImage<T> **read_images(const char *filename, const int *count,
+                            ReadReport *report) {
+  if (filename == nullptr || count == nullptr || *count <= 0) return nullptr;
+
+  printf("Reading %d image(s) from %s...\n", *count, filename);
+
+  RawImages *raw = read_raw_images(filename, (size_t)*count, report);
+  if (raw == nullptr) return nullptr;
+
+  BasicImage<T> **images = to_images<T>(raw, raw->count);
+  delete_raw_images(raw);
+
+  return images;
+}
+
+template <typename T>
+BasicImage<T> **read_cached_images(const char *filename, const int *count) {
+  if (filename == nullptr || count == nullptr || *count <= 0) return nullptr;
+
+  printf("Reading %d image(s) from %s...\n", *count, filename);
+
+  RawImages *raw = load_image_cache(filename);
+  if (raw == nullptr) return nullptr;
+
+  BasicImage<T> **images = nullptr;
+  if (raw->count >= (size_t)*count)
+    images = to_images<T>(raw, (size_t)*count);
+  else
+    fprintf(stderr, "%s: found %zu image(s) instead of %d\n", filename,
+            raw->count, *count);
+  delete_raw_images(raw);
+
+  return images;
+}
+
+template <typename T>
+BasicImage<T> **read_idx_images(const char *images_filename,
+                                const char *labels_filename,
+                                const int *count) {
+  if (images_filename == nullptr || labels_filename == nullptr ||
+      count == nullptr || *count <= 0)
+    return nullptr;
+
+  printf("Reading %d image(s) from %s...\n", *count, images_filename);
+
+  RawImages *raw = load_idx_images(images_filename, labels_filename);
+  if (raw == nullptr) return nullptr;
+
+  BasicImage<T> **images = nullptr;
+  if (raw->count >= (size_t)*count)
+    images = to_images<T>(raw, (size_t)*count);
+  else
+    fprintf(stderr, "%s: found %zu image(s) instead of %d\n",
+            images_filename, raw->count, *count);
+  delete_raw_images(raw);
+
   return images;
 }
 
-Image **read_test_images() {
-  const char *filename = "data/mnist_test.csv";
+template <typename T>
+BasicImage<T> **read_test_images() {
   int count = 10000;
 
-  return read_images(filename, &count);
+  RawImages *raw = load_raw_test_images();
+  if (raw == nullptr) return nullptr;
+
+  BasicImage<T> **images = nullptr;
+  if (raw->count >= (size_t)count)
+    images = to_images<T>(raw, (size_t)count);
+  else
+    fprintf(stderr, "found %zu test image(s) instead of %d\n", raw->count,
+            count);
+  delete_raw_images(raw);
+
+  return images;
 }
 
-Image **read_train_images() {
-  const char *filename = "data/mnist_train.csv";
+template <typename T>
+BasicImage<T> **read_train_images() {
   int count = 60000;
 
-  return read_images(filename, &count);
+  RawImages *raw = load_raw_train_images();
+  if (raw == nullptr) return nullptr;
+
+  BasicImage<T> **images = nullptr;
+  if (raw->count >= (size_t)count)
+    images = to_images<T>(raw, (size_t)count);
+  else
+    fprintf(stderr, "found %zu training image(s) instead of %d\n",
+            raw->count, count);
+  delete_raw_images(raw);
+
+  return images;
 }
 
-void delete_images(Image **images, const size_t count) {
+template <typename T>
+void delete_images(BasicImage<T> **images, const size_t count) {
   if (images == nullptr) {
     return;
   }
@@ -109,7 +897,8 @@ void delete_images(Image **images, const size_t count) {
   free(images);
 }
 
-void delete_image(Image *image) {
+template <typename T>
+void delete_image(BasicImage<T> *image) {
   if (image == nullptr) {
     return;
   }
@@ -118,7 +907,8 @@ void delete_image(Image *image) {
   free(image);
 }
 
-void print_image(const Image *image) {
+template <typename T>
+void print_image(const BasicImage<T> *image) {
   if (image == nullptr) {
     printf("Image is null.\n");
     return;
@@ -130,4 +920,21 @@ void print_image(const Image *image) {
   custom_math::matrix_print(image->pixels);
 }
 
+#define INSTANTIATE_IMAGES(T)                                              \
+  template BasicImage<T> **read_images<T>(const char *, const int *,       \
+                                          ReadReport *);                   \
+  template BasicImage<T> **read_cached_images<T>(const char *, const int *); \
+  template BasicImage<T> **read_idx_images<T>(const char *, const char *,  \
+                                              const int *);                \
+  template BasicImage<T> **read_test_images<T>();                          \
+  template BasicImage<T> **read_train_images<T>();                         \
+  template void delete_images<T>(BasicImage<T> **, const size_t);          \
+  template void delete_image<T>(BasicImage<T> *);                          \
+  template void print_image<T>(const BasicImage<T> *);
+
+INSTANTIATE_IMAGES(float)
+INSTANTIATE_IMAGES(double)
+
+#undef INSTANTIATE_IMAGES
+
 }  // namespace images
\ No newline at end of file
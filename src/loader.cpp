@@ -0,0 +1,394 @@
+/**
+ * @file loader.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief  This file contains the implementation of the functions declared in
+ *         loader.hpp.
+ * @version 1.0
+ * @date 2023-08-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "loader.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "random.hpp"
+#include "simd.hpp"
+
+namespace images {
+
+// The batches are numbered from the start, across the epochs. Batch s is
+// gathered into buffer s % prefetch, which is free once batch s - prefetch
+// was handed out and released, and is ready once ready[s % prefetch] is s.
+template <typename T>
+struct BasicLoader {
+  const BasicDataset<T> *dataset;  // The dataset, unless it is made of bytes.
+  const ByteDataset *bytes;
+  size_t count;     // The number of samples of the dataset.
+  size_t features;  // The number of elements of a sample.
+  LoaderOptions options;
+  size_t batches;  // The number of batches of an epoch.
+
+  // The order of the samples of two consecutive epochs. The order of an epoch
+  // is made when its first batch is claimed. The batches that are gathered
+  // then are at most prefetch <= batches behind, so they are all from the
+  // same epoch or the previous one.
+  size_t *orders[2];
+
+  custom_math::BasicMatrix<T> **buffers;
+  BasicAugmenter<T> **augmenters;  // One per thread, nullptr without any.
+  int *labels;
+  size_t *ready;
+
+  size_t claimed;     // The next batch to gather.
+  size_t consumed;    // The next batch to hand out.
+  bool holding;       // Whether batch consumed was handed out.
+  bool epoch_ended;   // Whether the end of the epoch was reported.
+  bool stopped;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread *threads;
+};
+
+namespace {
+
+template <typename T>
+void make_order(BasicLoader<T> *loader, size_t epoch) {
+  const size_t count = loader->count;
+  size_t *order = loader->orders[epoch % 2];
+
+  for (size_t i = 0; i < count; i++) order[i] = i;
+  if (!loader->options.shuffle) return;
+
+  custom_math::Random random;
+  custom_math::random_seed(
+      &random, loader->options.seed ^ (epoch * 0xD1B54A32D192ED03ull));
+  custom_math::random_shuffle(&random, order, count);
+}
+
+template <typename T>
+size_t batch_size(const BasicLoader<T> *loader, size_t sequence) {
+  const size_t first = sequence % loader->batches * loader->options.batch_size;
+  const size_t left = loader->count - first;
+  return left < loader->options.batch_size ? left
+                                           : loader->options.batch_size;
+}
+
+// Normalizes the elements of a sample, from source into destination.
+template <typename T>
+void normalize(const BasicLoader<T> *loader, T *destination, const T *source) {
+  const T scale = (T)(1 / loader->options.std);
+  const T shift = (T)(-loader->options.mean / loader->options.std);
+
+  if (loader->options.mean == 0 && loader->options.std == 1) {
+    if (destination != source)
+      memcpy(destination, source, loader->features * sizeof(T));
+  } else {
+    for (size_t j = 0; j < loader->features; j++)
+      destination[j] = source[j] * scale + shift;
+  }
+}
+
+// Copies a sample of a dataset of T into a batch, normalizing it.
+template <typename T>
+void gather_sample(const BasicLoader<T> *loader, size_t index,
+                   T *destination) {
+  normalize(loader, destination,
+            custom_math::matrix_row(&loader->dataset->samples, index));
+}
+
+// Turns a sample of a dataset of bytes into T, scaling it to [0, 1] and
+// normalizing it in a single pass.
+template <typename T>
+void gather_bytes(const BasicLoader<T> *loader, size_t index,
+                  T *destination) {
+  const uint8_t *source =
+      custom_math::matrix_row(&loader->bytes->samples, index);
+  const T scale = (T)(1 / (255 * loader->options.std));
+  const T shift = (T)(-loader->options.mean / loader->options.std);
+
+  custom_math::simd_convert_bytes(destination, source, scale, shift,
+                                  loader->features);
+}
+
+// Augments a sample into a batch, then normalizes it in place. The seed of the
+// transforms is drawn from the seed of the loader, the epoch and the sample.
+template <typename T>
+void gather_augmented(const BasicLoader<T> *loader, size_t index,
+                      size_t epoch, BasicAugmenter<T> *augmenter,
+                      T *destination) {
+  custom_math::Random random;
+  custom_math::random_seed(&random, loader->options.seed ^
+                                        (epoch * 0xD1B54A32D192ED03ull) ^
+                                        (index * 0x8CB92BA72F3D8DD7ull));
+  const uint64_t seed = custom_math::random_next(&random);
+
+  if (loader->bytes != nullptr) {
+    custom_math::simd_convert_bytes(
+        destination, custom_math::matrix_row(&loader->bytes->samples, index),
+        (T)(1 / 255.), (T)0, loader->features);
+    augment(augmenter, destination, destination, seed);
+  } else {
+    augment(augmenter, destination,
+            custom_math::matrix_row(&loader->dataset->samples, index), seed);
+  }
+  normalize(loader, destination, destination);
+}
+
+template <typename T>
+void gather(BasicLoader<T> *loader, size_t sequence,
+            BasicAugmenter<T> *augmenter) {
+  const size_t *order = loader->orders[sequence / loader->batches % 2];
+  const size_t first = sequence % loader->batches * loader->options.batch_size;
+  const size_t size = batch_size(loader, sequence);
+  const size_t slot = sequence % loader->options.prefetch;
+  const int *dataset_labels = loader->bytes != nullptr
+                                  ? loader->bytes->labels
+                                  : loader->dataset->labels;
+
+  custom_math::BasicMatrix<T> *buffer = loader->buffers[slot];
+  int *labels = loader->labels + slot * loader->options.batch_size;
+
+  for (size_t i = 0; i < size; i++) {
+    const size_t index = order[first + i];
+    T *destination = custom_math::matrix_row(buffer, i);
+
+    if (augmenter != nullptr)
+      gather_augmented(loader, index, sequence / loader->batches, augmenter,
+                       destination);
+    else if (loader->bytes != nullptr)
+      gather_bytes(loader, index, destination);
+    else
+      gather_sample(loader, index, destination);
+    labels[i] = dataset_labels[index];
+  }
+}
+
+template <typename T>
+void work(BasicLoader<T> *loader, size_t worker) {
+  BasicAugmenter<T> *augmenter =
+      loader->augmenters != nullptr ? loader->augmenters[worker] : nullptr;
+
+  for (;;) {
+    size_t sequence;
+    {
+      std::unique_lock<std::mutex> lock(loader->mutex);
+      loader->changed.wait(lock, [loader] {
+        return loader->stopped ||
+               loader->claimed < loader->consumed + loader->options.prefetch;
+      });
+      if (loader->stopped) return;
+
+      sequence = loader->claimed++;
+      if (sequence % loader->batches == 0)
+        make_order(loader, sequence / loader->batches);
+    }
+
+    gather(loader, sequence, augmenter);
+
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    loader->ready[sequence % loader->options.prefetch] = sequence;
+    loader->changed.notify_all();
+  }
+}
+
+// Creates a loader over the samples of dataset, or of bytes when it is not
+// nullptr.
+template <typename T>
+BasicLoader<T> *create(const BasicDataset<T> *dataset,
+                       const ByteDataset *bytes, size_t count,
+                       size_t features, const LoaderOptions *options) {
+  LoaderOptions defaults = loader_default_options();
+  if (options == nullptr) options = &defaults;
+
+  if (options->batch_size == 0 || options->prefetch == 0 ||
+      options->workers == 0 || !(options->std > 0))
+    return nullptr;
+
+  const size_t batches =
+      options->drop_last
+          ? count / options->batch_size
+          : (count + options->batch_size - 1) / options->batch_size;
+  if (batches == 0) return nullptr;
+
+  BasicLoader<T> *loader = new (std::nothrow) BasicLoader<T>();
+  if (loader == nullptr) return nullptr;
+
+  loader->dataset = dataset;
+  loader->bytes = bytes;
+  loader->count = count;
+  loader->features = features;
+  loader->options = *options;
+  loader->batches = batches;
+  if (loader->options.prefetch > batches) loader->options.prefetch = batches;
+
+  const size_t prefetch = loader->options.prefetch;
+  loader->orders[0] = (size_t *)malloc(count * sizeof(size_t));
+  loader->orders[1] = (size_t *)malloc(count * sizeof(size_t));
+  loader->buffers = (custom_math::BasicMatrix<T> **)calloc(
+      prefetch, sizeof(custom_math::BasicMatrix<T> *));
+  loader->labels = (int *)malloc(prefetch * options->batch_size * sizeof(int));
+  loader->ready = (size_t *)malloc(prefetch * sizeof(size_t));
+  loader->augmenters = nullptr;
+  loader->claimed = 0;
+  loader->consumed = 0;
+  loader->holding = false;
+  loader->epoch_ended = false;
+  loader->stopped = false;
+  loader->threads = nullptr;
+
+  bool failed = loader->orders[0] == nullptr || loader->orders[1] == nullptr ||
+                loader->buffers == nullptr || loader->labels == nullptr ||
+                loader->ready == nullptr;
+  for (size_t i = 0; !failed && i < prefetch; i++) {
+    loader->buffers[i] = custom_math::matrix_create<T>(
+        (int)options->batch_size, (int)features);
+    loader->ready[i] = SIZE_MAX;
+    failed = loader->buffers[i] == nullptr;
+  }
+
+  if (!failed && options->augment.count > 0) {
+    const size_t rows = bytes != nullptr ? bytes->rows : dataset->rows;
+    const size_t cols = bytes != nullptr ? bytes->cols : dataset->cols;
+    loader->augmenters = (BasicAugmenter<T> **)calloc(
+        options->workers, sizeof(BasicAugmenter<T> *));
+    failed = loader->augmenters == nullptr;
+    for (size_t i = 0; !failed && i < options->workers; i++) {
+      loader->augmenters[i] =
+          augmenter_create<T>(&options->augment, rows, cols);
+      failed = loader->augmenters[i] == nullptr;
+    }
+  }
+  if (failed) {
+    loader_delete(loader);
+    return nullptr;
+  }
+
+  loader->threads = new std::thread[options->workers];
+  for (size_t i = 0; i < options->workers; i++)
+    loader->threads[i] = std::thread(work<T>, loader, i);
+
+  return loader;
+}
+
+}  // namespace
+
+LoaderOptions loader_default_options() {
+  LoaderOptions options;
+  options.batch_size = 64;
+  options.prefetch = 4;
+  options.workers = 2;
+  options.seed = 0;
+  options.shuffle = true;
+  options.drop_last = false;
+  options.mean = 0;
+  options.std = 1;
+  options.augment = augment_chain();
+  return options;
+}
+
+template <typename T>
+BasicLoader<T> *loader_create(const BasicDataset<T> *dataset,
+                              const LoaderOptions *options) {
+  if (dataset == nullptr) return nullptr;
+  return create<T>(dataset, nullptr, dataset->count, dataset->samples.cols,
+                   options);
+}
+
+template <typename T>
+BasicLoader<T> *loader_create(const ByteDataset *dataset,
+                              const LoaderOptions *options) {
+  if (dataset == nullptr) return nullptr;
+  return create<T>(nullptr, dataset, dataset->count, dataset->samples.cols,
+                   options);
+}
+
+template <typename T>
+bool loader_next(BasicLoader<T> *loader, BasicBatch<T> *batch) {
+  std::unique_lock<std::mutex> lock(loader->mutex);
+
+  if (loader->holding) {
+    loader->consumed++;
+    loader->holding = false;
+    loader->changed.notify_all();
+  }
+
+  if (loader->consumed % loader->batches == 0 && loader->consumed > 0 &&
+      !loader->epoch_ended) {
+    loader->epoch_ended = true;
+    return false;
+  }
+  loader->epoch_ended = false;
+
+  const size_t sequence = loader->consumed;
+  const size_t slot = sequence % loader->options.prefetch;
+  loader->changed.wait(lock, [loader, slot, sequence] {
+    return loader->ready[slot] == sequence;
+  });
+
+  batch->samples = custom_math::matrix_view_rows(
+      loader->buffers[slot], 0, batch_size(loader, sequence));
+  batch->labels = loader->labels + slot * loader->options.batch_size;
+  loader->holding = true;
+  return true;
+}
+
+template <typename T>
+size_t loader_batches(const BasicLoader<T> *loader) {
+  return loader->batches;
+}
+
+template <typename T>
+void loader_delete(BasicLoader<T> *loader) {
+  if (loader == nullptr) return;
+
+  if (loader->threads != nullptr) {
+    {
+      std::lock_guard<std::mutex> lock(loader->mutex);
+      loader->stopped = true;
+      loader->changed.notify_all();
+    }
+    for (size_t i = 0; i < loader->options.workers; i++)
+      loader->threads[i].join();
+    delete[] loader->threads;
+  }
+
+  if (loader->buffers != nullptr)
+    for (size_t i = 0; i < loader->options.prefetch; i++)
+      custom_math::matrix_delete(loader->buffers[i]);
+  free(loader->buffers);
+  if (loader->augmenters != nullptr)
+    for (size_t i = 0; i < loader->options.workers; i++)
+      augmenter_delete(loader->augmenters[i]);
+  free(loader->augmenters);
+  free(loader->orders[0]);
+  free(loader->orders[1]);
+  free(loader->labels);
+  free(loader->ready);
+  delete loader;
+}
+
+#define INSTANTIATE_LOADER(T)                                                \
+  template BasicLoader<T> *loader_create<T>(const BasicDataset<T> *,         \
+                                            const LoaderOptions *);          \
+  template BasicLoader<T> *loader_create<T>(const ByteDataset *,             \
+                                            const LoaderOptions *);          \
+  template bool loader_next<T>(BasicLoader<T> *, BasicBatch<T> *);          \
+  template size_t loader_batches<T>(const BasicLoader<T> *);                 \
+  template void loader_delete<T>(BasicLoader<T> *);
+
+INSTANTIATE_LOADER(float)
+INSTANTIATE_LOADER(double)
+
+#undef INSTANTIATE_LOADER
+
+}  // namespace images
@@ -0,0 +1,248 @@
+/**
+ * @file lu.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the LU factorization
+ *        declared in lu.hpp.
+ * @version 1.0
+ * @date 2023-07-28
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "lu.hpp"
+
+#include <math.h>
+
+#include "gemm.hpp"
+
+namespace custom_math {
+
+namespace {
+
+// The number of columns factorized at once. The panel is factorized with
+// vector operations and the rest of the matrix is updated with one GEMM.
+const size_t BLOCK = 64;
+
+// Below this many rows (or columns), a loop is not worth waking up the
+// threads.
+const long PARALLEL_SIZE = 256;
+
+template <typename T>
+void swap_rows(BasicMatrix<T> *matrix, size_t row1, size_t row2) {
+  T *elements1 = matrix_row(matrix, row1);
+  T *elements2 = matrix_row(matrix, row2);
+
+  for (size_t j = 0; j < matrix->cols; j++) {
+    T value = elements1[j];
+    elements1[j] = elements2[j];
+    elements2[j] = value;
+  }
+}
+
+// Factorizes the columns [start, start + width) of the rows [start, n). The
+// row swaps are applied to the whole rows, so the L columns on the left and
+// the columns on the right are permuted as well.
+template <typename T>
+void factorize_panel(BasicLU<T> *lu, size_t start, size_t width) {
+  BasicMatrix<T> *a = lu->lu;
+  const size_t n = a->rows;
+  const size_t end = start + width;
+
+  for (size_t j = start; j < end; j++) {
+    size_t pivot_row = j;
+    T max = fabs(a->elements[j * a->stride + j]);
+
+    for (size_t i = j + 1; i < n; i++) {
+      T value = fabs(a->elements[i * a->stride + j]);
+      if (value > max) {
+        max = value;
+        pivot_row = i;
+      }
+    }
+
+    lu->pivots[j] = pivot_row;
+    if (pivot_row != j) {
+      swap_rows(a, j, pivot_row);
+      lu->sign = -lu->sign;
+    }
+
+    const T *pivot = matrix_row(a, j);
+    if (pivot[j] == 0) {
+      lu->singular = true;
+      continue;
+    }
+
+    long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i) shared(a, pivot) \
+    if ((long)(n - j) > PARALLEL_SIZE)
+#endif
+    for (i = (long)j + 1; i < (long)n; i++) {
+      T *row = matrix_row(a, i);
+      T factor = row[j] / pivot[j];
+
+      row[j] = factor;
+      for (size_t c = j + 1; c < end; c++) row[c] -= factor * pivot[c];
+    }
+  }
+}
+
+// Computes U12 = L11^-1 * A12, L11 being the unit lower triangle of the
+// panel that was just factorized.
+template <typename T>
+void solve_block_row(BasicMatrix<T> *a, size_t start, size_t width) {
+  const size_t n = a->rows;
+  const size_t end = start + width;
+  const long CHUNK = 128;
+  long chunk, chunks = (long)((n - end + CHUNK - 1) / CHUNK);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(chunk) shared(a) \
+    if ((long)(n - end) > PARALLEL_SIZE)
+#endif
+  for (chunk = 0; chunk < chunks; chunk++) {
+    size_t first = end + chunk * CHUNK;
+    size_t last = first + CHUNK < n ? first + CHUNK : n;
+
+    for (size_t j = start; j < end; j++) {
+      const T *row_j = matrix_row(a, j);
+      for (size_t i = j + 1; i < end; i++) {
+        T *row_i = matrix_row(a, i);
+        T factor = row_i[j];
+        for (size_t c = first; c < last; c++) row_i[c] -= factor * row_j[c];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename T>
+BasicLU<T> *matrix_lu(const BasicMatrix<T> *matrix, Allocator *allocator) {
+  if (matrix == nullptr || matrix->elements == nullptr ||
+      matrix->rows != matrix->cols)
+    return nullptr;
+
+  const size_t n = matrix->rows;
+
+  BasicLU<T> *lu = (BasicLU<T> *)malloc(sizeof(BasicLU<T>));
+  if (lu == nullptr) return nullptr;
+
+  lu->lu = matrix_copy(matrix, allocator);
+  lu->pivots = lu->lu == nullptr ? nullptr
+                                 : (size_t *)allocator_allocate(
+                                       lu->lu->allocator, n * sizeof(size_t));
+  lu->sign = 1;
+  lu->singular = false;
+
+  if (lu->pivots == nullptr) {
+    lu_delete(lu);
+    return nullptr;
+  }
+
+  BasicMatrix<T> *a = lu->lu;
+
+  for (size_t start = 0; start < n; start += BLOCK) {
+    size_t width = n - start < BLOCK ? n - start : BLOCK;
+    size_t end = start + width;
+
+    factorize_panel(lu, start, width);
+    if (end == n) break;
+
+    solve_block_row(a, start, width);
+
+    // A22 -= L21 * U12
+    gemm(NO_TRANS, NO_TRANS, n - end, n - end, width, (T)-1,
+         matrix_row(a, end) + start, a->stride, matrix_row(a, start) + end,
+         a->stride, (T)1, matrix_row(a, end) + end, a->stride);
+  }
+
+  return lu;
+}
+
+template <typename T>
+void lu_delete(BasicLU<T> *lu) {
+  if (lu == nullptr) return;
+
+  if (lu->pivots != nullptr)
+    allocator_deallocate(lu->lu->allocator, lu->pivots,
+                         lu->lu->rows * sizeof(size_t));
+  matrix_delete(lu->lu);
+  free(lu);
+}
+
+template <typename T>
+T lu_determinant(const BasicLU<T> *lu) {
+  if (lu == nullptr || lu->singular) return 0;
+
+  T determinant = lu->sign;
+  for (size_t i = 0; i < lu->lu->rows; i++)
+    determinant *= lu->lu->elements[i * lu->lu->stride + i];
+
+  return determinant;
+}
+
+template <typename T>
+BasicMatrix<T> *lu_solve_inplace(const BasicLU<T> *lu, BasicMatrix<T> *b) {
+  if (lu == nullptr || b == nullptr || b->elements == nullptr) return nullptr;
+  if (lu->singular || b->rows != lu->lu->rows) return nullptr;
+
+  const BasicMatrix<T> *a = lu->lu;
+  const size_t n = a->rows;
+
+  for (size_t i = 0; i < n; i++)
+    if (lu->pivots[i] != i) swap_rows(b, i, lu->pivots[i]);
+
+  // The right-hand sides are independent, so the columns of B are split
+  // between the threads and every row operation is a vectorizable loop.
+  const long CHUNK = 64;
+  long chunk, chunks = (long)((b->cols + CHUNK - 1) / CHUNK);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(chunk) shared(a, b) \
+    if (chunks > 1 && (long)n > PARALLEL_SIZE / 4)
+#endif
+  for (chunk = 0; chunk < chunks; chunk++) {
+    size_t first = chunk * CHUNK;
+    size_t last = first + CHUNK < b->cols ? first + CHUNK : b->cols;
+
+    // L * Y = P * B
+    for (size_t i = 1; i < n; i++) {
+      const T *l = matrix_row(a, i);
+      T *row_i = matrix_row(b, i);
+      for (size_t j = 0; j < i; j++) {
+        const T *row_j = matrix_row(b, j);
+        for (size_t c = first; c < last; c++) row_i[c] -= l[j] * row_j[c];
+      }
+    }
+
+    // U * X = Y
+    for (size_t i = n; i-- > 0;) {
+      const T *u = matrix_row(a, i);
+      T *row_i = matrix_row(b, i);
+      for (size_t j = i + 1; j < n; j++) {
+        const T *row_j = matrix_row(b, j);
+        for (size_t c = first; c < last; c++) row_i[c] -= u[j] * row_j[c];
+      }
+      for (size_t c = first; c < last; c++) row_i[c] /= u[i];
+    }
+  }
+
+  return b;
+}
+
+#define INSTANTIATE_LU(T)                                                   \
+  template BasicLU<T> *matrix_lu<T>(const BasicMatrix<T> *, Allocator *);   \
+  template void lu_delete<T>(BasicLU<T> *);                                 \
+  template T lu_determinant<T>(const BasicLU<T> *);                         \
+  template BasicMatrix<T> *lu_solve_inplace<T>(const BasicLU<T> *,          \
+                                               BasicMatrix<T> *);
+
+INSTANTIATE_LU(float)
+INSTANTIATE_LU(double)
+
+#undef INSTANTIATE_LU
+
+}  // namespace custom_math
@@ -12,39 +12,157 @@
 
 #include "math.hpp"
 
+#include "expression.hpp"
+#include "gemm.hpp"
+#include "lu.hpp"
+#include "simd.hpp"
+
 namespace custom_math {
 
-Matrix *matrix_create(const int rows, const int cols, const double value) {
+namespace {
+
+// The header of a matrix rounded up to a whole number of cache lines. It has
+// the same size whatever the element type is.
+const size_t MATRIX_HEADER_SIZE = (sizeof(Matrix) + ALLOCATOR_ALIGNMENT - 1) &
+                                  ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+
+template <typename T>
+bool is_valid(const BasicMatrix<T> *matrix) {
+  return matrix != nullptr && matrix->elements != nullptr;
+}
+
+template <typename T, typename U>
+bool same_shape(const BasicMatrix<T> *matrix1, const BasicMatrix<U> *matrix2) {
+  return matrix1->rows == matrix2->rows && matrix1->cols == matrix2->cols;
+}
+
+template <typename T>
+bool is_contiguous(const BasicMatrix<T> *matrix) {
+  return matrix->stride == matrix->cols;
+}
+
+// Element-wise operations can write into one of their operands, as long as
+// the two are exactly the same matrix and not two overlapping ones.
+template <typename T>
+bool partial_overlap(const BasicMatrix<T> *matrix1,
+                     const BasicMatrix<T> *matrix2) {
+  return detail::overlap(matrix1, matrix2) &&
+         (matrix1->elements != matrix2->elements ||
+          matrix1->stride != matrix2->stride);
+}
+
+// The size of the block holding the header and the elements of a matrix.
+template <typename T>
+size_t matrix_block_size(size_t rows, size_t stride) {
+  return MATRIX_HEADER_SIZE + rows * stride * sizeof(T);
+}
+
+// Calls kernel(row, count) so that it covers every element of a rows x cols
+// matrix: once from the first row when all the operands are contiguous,
+// once per row otherwise.
+template <typename RowKernel>
+void for_each_row(size_t rows, size_t cols, bool contiguous,
+                  RowKernel kernel) {
+  if (contiguous) {
+    kernel(0, rows * cols);
+    return;
+  }
+
+  long i;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(i) if (rows * cols >= 1 << 16)
+#endif
+  for (i = 0; i < (long)rows; i++) kernel((size_t)i, cols);
+}
+
+template <typename T>
+BasicMatrix<T> *create(const int rows, const int cols, const size_t stride,
+                       const T value, Allocator *allocator) {
   if (rows <= 0 || cols <= 0) return nullptr;
 
-  Matrix *matrix = (Matrix *)malloc(sizeof(Matrix));
+  if (allocator == nullptr) allocator = allocator_get_default();
+
+  // The header and the elements share one block, the elements start on the
+  // cache line that follows the header.
+  BasicMatrix<T> *matrix = (BasicMatrix<T> *)allocator_allocate(
+      allocator, matrix_block_size<T>(rows, stride));
 
   if (matrix == nullptr) return nullptr;
 
   matrix->rows = rows;
   matrix->cols = cols;
-  matrix->elements = (double *)malloc(rows * cols * sizeof(double));
-
-  if (matrix->elements == nullptr) {
-    free(matrix);
-    matrix = nullptr;
-  }
+  matrix->stride = stride;
+  matrix->elements = (T *)((char *)matrix + MATRIX_HEADER_SIZE);
+  matrix->allocator = allocator;
 
 // Initialize the matrix with the given value.
 #ifndef __APPLE__ AND value == \
     0  // Apparently, Apple M1 will initialize the matrix with 0.
-  int i;
-#ifdef USE_OPENMP
-#pragma omp parallel for private(i)
-#endif
-  for (i = 0; i < rows * cols; i++) matrix->elements[i] = value;
+  // The padding is filled as well, so it never holds garbage.
+  simd_fill(matrix->elements, value, rows * stride);
 #endif
 
   return matrix;
 }
 
-Matrix *matrix_I(const int size) {
-  Matrix *matrix = matrix_create(size, size);
+// Closed-form determinant of matrices up to 4x4, cheaper than factorizing
+// them and exact for integer elements.
+template <typename T>
+T small_determinant(const BasicMatrix<T> *matrix) {
+  const T *r0 = matrix_row(matrix, 0);
+  if (matrix->rows == 1) return r0[0];
+
+  const T *r1 = matrix_row(matrix, 1);
+  if (matrix->rows == 2) return r0[0] * r1[1] - r0[1] * r1[0];
+
+  const T *r2 = matrix_row(matrix, 2);
+  if (matrix->rows == 3)
+    return r0[0] * (r1[1] * r2[2] - r1[2] * r2[1]) -
+           r0[1] * (r1[0] * r2[2] - r1[2] * r2[0]) +
+           r0[2] * (r1[0] * r2[1] - r1[1] * r2[0]);
+
+  // Laplace expansion along the first two rows.
+  const T *r3 = matrix_row(matrix, 3);
+  T s0 = r0[0] * r1[1] - r1[0] * r0[1];
+  T s1 = r0[0] * r1[2] - r1[0] * r0[2];
+  T s2 = r0[0] * r1[3] - r1[0] * r0[3];
+  T s3 = r0[1] * r1[2] - r1[1] * r0[2];
+  T s4 = r0[1] * r1[3] - r1[1] * r0[3];
+  T s5 = r0[2] * r1[3] - r1[2] * r0[3];
+  T c5 = r2[2] * r3[3] - r3[2] * r2[3];
+  T c4 = r2[1] * r3[3] - r3[1] * r2[3];
+  T c3 = r2[1] * r3[2] - r3[1] * r2[2];
+  T c2 = r2[0] * r3[3] - r3[0] * r2[3];
+  T c1 = r2[0] * r3[2] - r3[0] * r2[2];
+  T c0 = r2[0] * r3[1] - r3[0] * r2[1];
+
+  return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+}  // namespace
+
+template <typename T>
+BasicMatrix<T> *matrix_create(const int rows, const int cols,
+                              const typename NonDeduced<T>::type value,
+                              Allocator *allocator) {
+  return create<T>(rows, cols, cols, value, allocator);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_create_aligned(
+    const int rows, const int cols,
+    const typename NonDeduced<T>::type value, Allocator *allocator) {
+  const size_t per_line = ALLOCATOR_ALIGNMENT / sizeof(T);
+  size_t stride = (cols + per_line - 1) / per_line * per_line;
+
+  return create<T>(rows, cols, stride, value, allocator);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_I(const int size, Allocator *allocator) {
+  BasicMatrix<T> *matrix = matrix_create<T>(size, size, 0, allocator);
+  if (matrix == nullptr) return nullptr;
   int i, j;
 
 #ifdef USE_OPENMP
@@ -52,253 +170,538 @@ Matrix *matrix_I(const int size) {
 #endif
   for (i = 0; i < size; i++)
     for (j = 0; j < size; j++)
-      matrix->elements[i * size + j] = (i == j) ? 1. : 0.;
+      matrix->elements[i * matrix->stride + j] = (i == j) ? 1 : 0;
 
   return matrix;
 }
 
-void matrix_delete(Matrix *matrix) {
-  if (matrix == nullptr) return;
+template <typename T>
+void matrix_delete(BasicMatrix<T> *matrix) {
+  // Views do not own their elements.
+  if (matrix == nullptr || matrix->allocator == nullptr) return;
 
-  if (matrix->elements != nullptr) free(matrix->elements);
+  size_t size = matrix_block_size<T>(matrix->rows, matrix->stride);
   matrix->elements = nullptr;
-  if (matrix != nullptr) free(matrix);
+  allocator_deallocate(matrix->allocator, matrix, size);
   matrix = nullptr;
 }
 
-void matrix_print(const Matrix *matrix) {
+template <typename T>
+void matrix_print(const BasicMatrix<T> *matrix) {
   if (matrix == nullptr || matrix->elements == nullptr) return;
 
   for (int i = 0; i < matrix->rows; i++) {
     for (int j = 0; j < matrix->cols; j++) {
       // Print the number with 3 decimals.
-      printf("%.3f ", matrix->elements[i * matrix->cols + j]);
+      printf("%.3f ", (double)matrix->elements[i * matrix->stride + j]);
     }
     printf("\n");
   }
 }
 
-Matrix *matrix_copy(const Matrix *matrix) {
-  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+template <typename T>
+BasicMatrix<T> *matrix_copy(const BasicMatrix<T> *matrix,
+                            Allocator *allocator) {
+  if (!is_valid(matrix)) return nullptr;
+
+  BasicMatrix<T> *new_matrix =
+      matrix_create<T>(matrix->rows, matrix->cols, 0, allocator);
+  if (new_matrix == nullptr) return nullptr;
+
+  return matrix_copy_into(new_matrix, matrix);
+}
+
+template <typename U, typename T>
+BasicMatrix<U> *matrix_convert(const BasicMatrix<T> *matrix,
+                               Allocator *allocator) {
+  if (!is_valid(matrix)) return nullptr;
+
+  BasicMatrix<U> *new_matrix =
+      matrix_create<U>(matrix->rows, matrix->cols, 0, allocator);
+  if (new_matrix == nullptr) return nullptr;
+
+  for_each_row(matrix->rows, matrix->cols, is_contiguous(matrix),
+               [=](size_t row, size_t count) {
+                 U *output = matrix_row(new_matrix, row);
+                 const T *input = matrix_row(matrix, row);
+                 for (size_t i = 0; i < count; i++) output[i] = (U)input[i];
+               });
+
+  return new_matrix;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_add(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2) {
+  if (!is_valid(matrix1) || !is_valid(matrix2)) return nullptr;
+
+  if (!same_shape(matrix1, matrix2)) return nullptr;
+
+  BasicMatrix<T> *matrix = matrix_create<T>(matrix1->rows, matrix1->cols);
+  if (matrix == nullptr) return nullptr;
+
+  return matrix_add_into(matrix, matrix1, matrix2);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_sub(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2) {
+  if (!is_valid(matrix1) || !is_valid(matrix2)) return nullptr;
+
+  if (!same_shape(matrix1, matrix2)) return nullptr;
+
+  BasicMatrix<T> *matrix = matrix_create<T>(matrix1->rows, matrix1->cols);
+  if (matrix == nullptr) return nullptr;
+
+  return matrix_sub_into(matrix, matrix1, matrix2);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_dot(BasicMatrix<T> *matrix1, BasicMatrix<T> *matrix2) {
+  if (!is_valid(matrix1) || !is_valid(matrix2)) return nullptr;
+
+  if (matrix1->cols != matrix2->rows) return nullptr;
+
+  BasicMatrix<T> *matrix = matrix_create<T>(matrix1->rows, matrix2->cols);
+  if (matrix == nullptr) return nullptr;
+
+  return matrix_dot_into(matrix, matrix1, matrix2);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar(BasicMatrix<T> *matrix,
+                                  const typename NonDeduced<T>::type scalar) {
+  if (!is_valid(matrix)) return nullptr;
+
+  BasicMatrix<T> *new_matrix = matrix_create<T>(matrix->rows, matrix->cols);
+  if (new_matrix == nullptr) return nullptr;
+
+  return matrix_mul_scalar_into(new_matrix, matrix, scalar);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_transpose(BasicMatrix<T> *matrix) {
+  if (!is_valid(matrix)) return nullptr;
+
+  BasicMatrix<T> *new_matrix = matrix_create<T>(matrix->cols, matrix->rows);
+  if (new_matrix == nullptr) return nullptr;
+
+  return matrix_transpose_into(new_matrix, matrix);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_minor(BasicMatrix<T> *matrix, int row, int col) {
+  if (!is_valid(matrix) || matrix->rows < 2 || matrix->cols < 2) return nullptr;
+
+  BasicMatrix<T> *new_matrix =
+      matrix_create<T>(matrix->rows - 1, matrix->cols - 1);
+  if (new_matrix == nullptr) return nullptr;
 
-  Matrix *new_matrix = matrix_create(matrix->rows, matrix->cols);
   int i, j;
 
 #ifdef USE_OPENMP
 #pragma omp parallel for private(i, j) shared(matrix, new_matrix)
 #endif
-  for (i = 0; i < matrix->rows; i++)
-    for (j = 0; j < matrix->cols; j++)
-      new_matrix->elements[i * matrix->cols + j] =
-          matrix->elements[i * matrix->cols + j];
+  for (i = 0; i < (int)matrix->rows; i++) {
+    if (i == row) continue;
+    T *new_row = matrix_row(new_matrix, i < row ? i : i - 1);
+    const T *old_row = matrix_row(matrix, i);
+    for (j = 0; j < (int)matrix->cols; j++) {
+      if (j == col) continue;
+      new_row[j < col ? j : j - 1] = old_row[j];
+    }
+  }
 
   return new_matrix;
 }
 
-void matrix_save(Matrix *matrix, const char *filename) {
-  FILE *file = fopen(filename, "w");
+template <typename T>
+T matrix_determinant(BasicMatrix<T> *matrix) {
+  if (!is_valid(matrix) || matrix->rows != matrix->cols) return 0;
+  if (matrix->rows <= 4) return small_determinant(matrix);
 
-  fprintf(file, "%ld %ld\n", matrix->rows, matrix->cols);
+  BasicLU<T> *lu = matrix_lu(matrix);
+  if (lu == nullptr) return 0;
 
-  for (int i = 0; i < matrix->rows; i++) {
-    for (int j = 0; j < matrix->cols; j++) {
-      fprintf(file, "%f ", matrix->elements[i * matrix->cols + j]);
-    }
-    fprintf(file, "\n");
-  }
+  T determinant = lu_determinant(lu);
+  lu_delete(lu);
 
-  fclose(file);
+  return determinant;
 }
 
-Matrix *matrix_load(const char *filename) {
-  FILE *file = fopen(filename, "r");
+template <typename T>
+BasicMatrix<T> *matrix_solve(BasicMatrix<T> *matrix, BasicMatrix<T> *b) {
+  if (!is_valid(b)) return nullptr;
 
-  size_t rows, cols;
-  fscanf(file, "%ld %ld", &rows, &cols);
+  BasicLU<T> *lu = matrix_lu(matrix);
+  if (lu == nullptr) return nullptr;
 
-  Matrix *matrix = matrix_create(rows, cols);
+  BasicMatrix<T> *x = matrix_copy<T>(b);
+  if (lu_solve_inplace(lu, x) == nullptr) {
+    matrix_delete<T>(x);
+    x = nullptr;
+  }
 
-  for (int i = 0; i < matrix->rows; i++) {
-    for (int j = 0; j < matrix->cols; j++) {
-      fscanf(file, "%lf", &matrix->elements[i * matrix->cols + j]);
-    }
+  lu_delete(lu);
+
+  return x;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_inverse(BasicMatrix<T> *matrix) {
+  BasicLU<T> *lu = matrix_lu(matrix);
+  if (lu == nullptr) return nullptr;
+
+  BasicMatrix<T> *inverse = matrix_I<T>(matrix->rows);
+  if (lu_solve_inplace(lu, inverse) == nullptr) {
+    matrix_delete<T>(inverse);
+    inverse = nullptr;
   }
 
-  fclose(file);
+  lu_delete(lu);
 
-  return matrix;
+  return inverse;
 }
 
-Matrix *matrix_add(Matrix *matrix1, Matrix *matrix2) {
-  if (matrix1 == nullptr || matrix1->elements == nullptr ||
-      matrix2 == nullptr || matrix2->elements == nullptr)
-    return nullptr;
+template <typename T>
+BasicMatrix<T> *matrix_apply(BasicMatrix<T> *matrix,
+                             typename NonDeduced<T (*)(T)>::type function) {
+  if (!is_valid(matrix)) return nullptr;
 
-  if (matrix1->rows != matrix2->rows || matrix1->cols != matrix2->cols)
-    return nullptr;
+  BasicMatrix<T> *new_matrix = matrix_create<T>(matrix->rows, matrix->cols);
+  if (new_matrix == nullptr) return nullptr;
 
-  Matrix *matrix = matrix_create(matrix1->rows, matrix1->cols);
-  int i, j;
+  return matrix_apply_into(new_matrix, matrix, function);
+}
 
-#if HAVE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix1, matrix2, matrix)
-#endif
-  for (i = 0; i < matrix1->rows; i++)
-    for (j = 0; j < matrix1->cols; j++)
-      matrix->elements[i * matrix1->cols + j] =
-          matrix1->elements[i * matrix1->cols + j] +
-          matrix2->elements[i * matrix1->cols + j];
+// Operations into caller-owned matrices
 
-  return matrix;
+template <typename T>
+BasicMatrix<T> *matrix_copy_into(BasicMatrix<T> *destination,
+                                 const BasicMatrix<T> *matrix) {
+  if (!is_valid(destination) || !is_valid(matrix)) return nullptr;
+  if (!same_shape(destination, matrix) ||
+      detail::overlap(destination, matrix))
+    return nullptr;
+
+  for_each_row(matrix->rows, matrix->cols,
+               is_contiguous(destination) && is_contiguous(matrix),
+               [=](size_t row, size_t count) {
+                 simd_copy(matrix_row(destination, row),
+                           matrix_row(matrix, row), count);
+               });
+
+  return destination;
 }
 
-Matrix *matrix_sub(Matrix *matrix1, Matrix *matrix2) {
-  if (matrix1 == nullptr || matrix1->elements == nullptr ||
-      matrix2 == nullptr || matrix2->elements == nullptr)
+template <typename T>
+BasicMatrix<T> *matrix_add_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2) {
+  if (!is_valid(destination) || !is_valid(matrix1) || !is_valid(matrix2))
     return nullptr;
-  if (matrix1->rows != matrix2->rows || matrix1->cols != matrix2->cols)
+  if (!same_shape(matrix1, matrix2) || !same_shape(destination, matrix1))
+    return nullptr;
+  if (partial_overlap(destination, matrix1) ||
+      partial_overlap(destination, matrix2))
     return nullptr;
 
-  Matrix *matrix = matrix_create(matrix1->rows, matrix1->cols);
-  int i, j;
-
-#if HAVE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix1, matrix2, matrix)
-#endif
-  for (i = 0; i < matrix1->rows; i++)
-    for (j = 0; j < matrix1->cols; j++)
-      matrix->elements[i * matrix1->cols + j] =
-          matrix1->elements[i * matrix1->cols + j] -
-          matrix2->elements[i * matrix1->cols + j];
+  for_each_row(matrix1->rows, matrix1->cols,
+               is_contiguous(destination) && is_contiguous(matrix1) &&
+                   is_contiguous(matrix2),
+               [=](size_t row, size_t count) {
+                 simd_add(matrix_row(destination, row),
+                          matrix_row(matrix1, row), matrix_row(matrix2, row),
+                          count);
+               });
 
-  return matrix;
+  return destination;
 }
 
-Matrix *matrix_dot(Matrix *matrix1, Matrix *matrix2) {
-  if (matrix1 == nullptr || matrix1->elements == nullptr ||
-      matrix2 == nullptr || matrix2->elements == nullptr)
+template <typename T>
+BasicMatrix<T> *matrix_sub_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2) {
+  if (!is_valid(destination) || !is_valid(matrix1) || !is_valid(matrix2))
+    return nullptr;
+  if (!same_shape(matrix1, matrix2) || !same_shape(destination, matrix1))
+    return nullptr;
+  if (partial_overlap(destination, matrix1) ||
+      partial_overlap(destination, matrix2))
     return nullptr;
 
-  if (matrix1->cols != matrix2->rows) return nullptr;
+  for_each_row(matrix1->rows, matrix1->cols,
+               is_contiguous(destination) && is_contiguous(matrix1) &&
+                   is_contiguous(matrix2),
+               [=](size_t row, size_t count) {
+                 simd_sub(matrix_row(destination, row),
+                          matrix_row(matrix1, row), matrix_row(matrix2, row),
+                          count);
+               });
+
+  return destination;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_dot_into(BasicMatrix<T> *destination,
+                                BasicMatrix<T> *matrix1,
+                                BasicMatrix<T> *matrix2,
+                                const bool accumulate) {
+  if (!is_valid(destination) || !is_valid(matrix1) || !is_valid(matrix2))
+    return nullptr;
+  if (matrix1->cols != matrix2->rows || destination->rows != matrix1->rows ||
+      destination->cols != matrix2->cols)
+    return nullptr;
+  // The product is accumulated in the destination while the operands are
+  // still being read, so they cannot share any memory.
+  if (detail::overlap(destination, matrix1) ||
+      detail::overlap(destination, matrix2))
+    return nullptr;
 
-  Matrix *matrix = matrix_create(matrix1->rows, matrix2->cols);
-  Matrix *matrix2_t = matrix_transpose(matrix2);
+  gemm(NO_TRANS, NO_TRANS, matrix1->rows, matrix2->cols, matrix1->cols, (T)1,
+       matrix1->elements, matrix1->stride, matrix2->elements, matrix2->stride,
+       accumulate ? (T)1 : (T)0, destination->elements, destination->stride);
 
-  int i, j, k, dot;
+  return destination;
+}
 
-#if HAVE_OPENMP
-#pragma omp parallel for private(i, j, k, dot) \
-    shared(matrix1, matrix2_t, matrix)
-#endif
-  for (i = 0; i < matrix1->rows; i++)
-    for (j = 0; j < matrix2_t->rows; j++) {
-      dot = 0;
-      for (k = 0; k < matrix1->cols; k++)
-        dot += matrix1->elements[i * matrix1->cols + k] *
-               matrix2_t->elements[j * matrix2_t->cols + k];
-      matrix->elements[i * matrix->cols + j] = dot;
-    }
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar_into(
+    BasicMatrix<T> *destination, BasicMatrix<T> *matrix,
+    const typename NonDeduced<T>::type scalar) {
+  if (!is_valid(destination) || !is_valid(matrix)) return nullptr;
+  if (!same_shape(destination, matrix) || partial_overlap(destination, matrix))
+    return nullptr;
 
-  matrix_delete(matrix2_t);
+  for_each_row(matrix->rows, matrix->cols,
+               is_contiguous(destination) && is_contiguous(matrix),
+               [=](size_t row, size_t count) {
+                 simd_scale(matrix_row(destination, row),
+                            matrix_row(matrix, row), scalar, count);
+               });
 
-  return matrix;
+  return destination;
 }
 
-Matrix *matrix_mul_scalar(Matrix *matrix, double scalar) {
-  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+template <typename T>
+BasicMatrix<T> *matrix_transpose_into(BasicMatrix<T> *destination,
+                                      BasicMatrix<T> *matrix) {
+  if (!is_valid(destination) || !is_valid(matrix)) return nullptr;
+  if (destination->rows != matrix->cols || destination->cols != matrix->rows)
+    return nullptr;
+  if (detail::overlap(destination, matrix)) return nullptr;
 
-  Matrix *new_matrix = matrix_create(matrix->rows, matrix->cols);
-  int i, j;
+  const long rows = (long)matrix->rows, cols = (long)matrix->cols;
+  const size_t stride = matrix->stride, destination_stride = destination->stride;
+  const long BLOCK = 32;
+  long bi, bj, i, j;
 
+  // Go through the matrix in square blocks, so that both the reads and the
+  // writes stay in cache.
 #ifdef USE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix, new_matrix)
+#pragma omp parallel for private(bi, bj, i, j) shared(matrix, destination) \
+    if (rows * cols > 1 << 16)
 #endif
-  for (i = 0; i < matrix->rows; i++)
-    for (j = 0; j < matrix->cols; j++)
-      new_matrix->elements[i * matrix->cols + j] =
-          matrix->elements[i * matrix->cols + j] * scalar;
-
-  return new_matrix;
+  for (bi = 0; bi < rows; bi += BLOCK)
+    for (bj = 0; bj < cols; bj += BLOCK)
+      for (i = bi; i < bi + BLOCK && i < rows; i++)
+        for (j = bj; j < bj + BLOCK && j < cols; j++)
+          destination->elements[j * destination_stride + i] =
+              matrix->elements[i * stride + j];
+
+  return destination;
 }
 
-Matrix *matrix_transpose(Matrix *matrix) {
-  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+template <typename T>
+BasicMatrix<T> *matrix_apply_into(
+    BasicMatrix<T> *destination, BasicMatrix<T> *matrix,
+    typename NonDeduced<T (*)(T)>::type function) {
+  if (!is_valid(destination) || !is_valid(matrix) || function == nullptr)
+    return nullptr;
+  if (!same_shape(destination, matrix) || partial_overlap(destination, matrix))
+    return nullptr;
 
-  Matrix *new_matrix = matrix_create(matrix->cols, matrix->rows);
+  // The function is opaque, so this loop cannot be vectorized. It is kept
+  // flat so that at least the indexing is free.
+  for_each_row(matrix->rows, matrix->cols,
+               is_contiguous(destination) && is_contiguous(matrix),
+               [=](size_t row, size_t count) {
+                 T *output = matrix_row(destination, row);
+                 const T *input = matrix_row(matrix, row);
+                 for (size_t i = 0; i < count; i++)
+                   output[i] = function(input[i]);
+               });
+
+  return destination;
+}
 
-  int i, j;
+// In-place operations
 
-#ifdef USE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix, new_matrix)
-#endif
-  for (i = 0; i < matrix->rows; i++)
-    for (j = 0; j < matrix->cols; j++)
-      new_matrix->elements[j * matrix->rows + i] =
-          matrix->elements[i * matrix->cols + j];
+template <typename T>
+BasicMatrix<T> *matrix_add_inplace(BasicMatrix<T> *matrix,
+                                   BasicMatrix<T> *other) {
+  return matrix_add_into(matrix, matrix, other);
+}
 
-  return new_matrix;
+template <typename T>
+BasicMatrix<T> *matrix_sub_inplace(BasicMatrix<T> *matrix,
+                                   BasicMatrix<T> *other) {
+  return matrix_sub_into(matrix, matrix, other);
 }
 
-Matrix *matrix_minor(Matrix *matrix, int row, int col) {
-  Matrix *new_matrix = matrix_create(matrix->rows - 1, matrix->cols - 1);
+template <typename T>
+BasicMatrix<T> *matrix_mul_scalar_inplace(
+    BasicMatrix<T> *matrix, const typename NonDeduced<T>::type scalar) {
+  return matrix_mul_scalar_into(matrix, matrix, scalar);
+}
 
-  int new_row = 0, new_col = 0;
-  int i, j;
+template <typename T>
+BasicMatrix<T> *matrix_transpose_inplace(BasicMatrix<T> *matrix) {
+  if (!is_valid(matrix) || matrix->rows != matrix->cols) return nullptr;
+
+  const long size = (long)matrix->rows;
+  const size_t stride = matrix->stride;
+  long i, j;
 
 #ifdef USE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix, new_matrix)
+#pragma omp parallel for private(i, j) shared(matrix) schedule(dynamic) \
+    if (size * size > 1 << 16)
 #endif
-  for (i = 0; i < matrix->rows; i++) {
-    if (i == row) continue;
-    for (j = 0; j < matrix->cols; j++) {
-      if (j == col) continue;
-      new_matrix->elements[new_row * new_matrix->cols + new_col] =
-          matrix->elements[i * matrix->cols + j];
-      new_col++;
+  for (i = 0; i < size; i++)
+    for (j = i + 1; j < size; j++) {
+      T value = matrix->elements[i * stride + j];
+      matrix->elements[i * stride + j] = matrix->elements[j * stride + i];
+      matrix->elements[j * stride + i] = value;
     }
-    new_row++;
-    new_col = 0;
-  }
 
-  return new_matrix;
+  return matrix;
 }
 
-double matrix_determinant(Matrix *matrix) {
-  if (matrix->rows == 1) return matrix->elements[0];
+template <typename T>
+BasicMatrix<T> *matrix_apply_inplace(
+    BasicMatrix<T> *matrix, typename NonDeduced<T (*)(T)>::type function) {
+  return matrix_apply_into(matrix, matrix, function);
+}
 
-  double determinant = 0;
-  int i;
-  Matrix *minor;
+// Views
 
-#ifdef USE_OPENMP
-#pragma omp parallel for private(i, minor) shared(matrix, determinant)
-#endif
-  for (i = 0; i < matrix->rows; i++) {
-    minor = matrix_minor(matrix, 0, i);
-    determinant +=
-        matrix->elements[i] * matrix_determinant(minor) * (i % 2 == 0 ? 1 : -1);
-    matrix_delete(minor);
-  }
+template <typename T>
+BasicMatrix<T> matrix_view(const BasicMatrix<T> *matrix, size_t row,
+                           size_t col, size_t rows, size_t cols) {
+  BasicMatrix<T> view = {0, 0, 0, nullptr, nullptr};
 
-  return determinant;
+  if (!is_valid(matrix) || rows == 0 || cols == 0 ||
+      row + rows > matrix->rows || col + cols > matrix->cols)
+    return view;
+
+  view.rows = rows;
+  view.cols = cols;
+  view.stride = matrix->stride;
+  view.elements = matrix->elements + row * matrix->stride + col;
+
+  return view;
+}
+
+template <typename T>
+BasicMatrix<T> matrix_view_rows(const BasicMatrix<T> *matrix, size_t row,
+                                size_t rows) {
+  if (!is_valid(matrix)) return matrix_view(matrix, 0, 0, 0, 0);
+  return matrix_view(matrix, row, 0, rows, matrix->cols);
 }
 
-Matrix *matrix_apply(Matrix *matrix, double (*function)(double)) {
-  if (matrix == nullptr || matrix->elements == nullptr) return nullptr;
+template <typename T>
+BasicMatrix<T> matrix_view_cols(const BasicMatrix<T> *matrix, size_t col,
+                                size_t cols) {
+  if (!is_valid(matrix)) return matrix_view(matrix, 0, 0, 0, 0);
+  return matrix_view(matrix, 0, col, matrix->rows, cols);
+}
 
-  Matrix *new_matrix = matrix_create(matrix->rows, matrix->cols);
+template <typename T>
+BasicMatrix<T> matrix_reshape(const BasicMatrix<T> *matrix, size_t rows,
+                              size_t cols) {
+  BasicMatrix<T> view = {0, 0, 0, nullptr, nullptr};
 
-  int i, j;
+  if (!is_valid(matrix) || !is_contiguous(matrix) || rows == 0 ||
+      rows * cols != matrix->rows * matrix->cols)
+    return view;
 
-#ifdef USE_OPENMP
-#pragma omp parallel for private(i, j) shared(matrix, new_matrix)
-#endif
-  for (i = 0; i < matrix->rows; i++)
-    for (j = 0; j < matrix->cols; j++)
-      new_matrix->elements[i * matrix->cols + j] =
-          function(matrix->elements[i * matrix->cols + j]);
+  return matrix_wrap(matrix->elements, rows, cols, cols);
+}
 
-  return new_matrix;
+template <typename T>
+BasicMatrix<T> matrix_wrap(T *elements, size_t rows, size_t cols,
+                           size_t stride) {
+  BasicMatrix<T> view = {0, 0, 0, nullptr, nullptr};
+
+  if (elements == nullptr || rows == 0 || cols == 0 || stride < cols)
+    return view;
+
+  view.rows = rows;
+  view.cols = cols;
+  view.stride = stride;
+  view.elements = elements;
+
+  return view;
 }
 
-}  // namespace custom_math
\ No newline at end of file
+// The library is built for float and double elements.
+
+#define INSTANTIATE_MATRIX(T)                                                 \
+  template BasicMatrix<T> *matrix_create<T>(int, int, T, Allocator *);        \
+  template BasicMatrix<T> *matrix_create_aligned<T>(int, int, T, Allocator *); \
+  template BasicMatrix<T> *matrix_I<T>(int, Allocator *);                     \
+  template void matrix_delete<T>(BasicMatrix<T> *);                           \
+  template void matrix_print<T>(const BasicMatrix<T> *);                      \
+  template BasicMatrix<T> *matrix_copy<T>(const BasicMatrix<T> *,             \
+                                          Allocator *);                       \
+  template BasicMatrix<float> *matrix_convert<float, T>(                      \
+      const BasicMatrix<T> *, Allocator *);                                   \
+  template BasicMatrix<double> *matrix_convert<double, T>(                    \
+      const BasicMatrix<T> *, Allocator *);                                   \
+  template BasicMatrix<T> *matrix_add<T>(BasicMatrix<T> *, BasicMatrix<T> *); \
+  template BasicMatrix<T> *matrix_sub<T>(BasicMatrix<T> *, BasicMatrix<T> *); \
+  template BasicMatrix<T> *matrix_dot<T>(BasicMatrix<T> *, BasicMatrix<T> *); \
+  template BasicMatrix<T> *matrix_mul_scalar<T>(BasicMatrix<T> *, T);         \
+  template BasicMatrix<T> *matrix_transpose<T>(BasicMatrix<T> *);             \
+  template BasicMatrix<T> *matrix_minor<T>(BasicMatrix<T> *, int, int);       \
+  template T matrix_determinant<T>(BasicMatrix<T> *);                         \
+  template BasicMatrix<T> *matrix_solve<T>(BasicMatrix<T> *,                  \
+                                           BasicMatrix<T> *);                 \
+  template BasicMatrix<T> *matrix_inverse<T>(BasicMatrix<T> *);               \
+  template BasicMatrix<T> *matrix_apply<T>(BasicMatrix<T> *, T (*)(T));       \
+  template BasicMatrix<T> *matrix_copy_into<T>(BasicMatrix<T> *,              \
+                                               const BasicMatrix<T> *);       \
+  template BasicMatrix<T> *matrix_add_into<T>(                                \
+      BasicMatrix<T> *, BasicMatrix<T> *, BasicMatrix<T> *);                  \
+  template BasicMatrix<T> *matrix_sub_into<T>(                                \
+      BasicMatrix<T> *, BasicMatrix<T> *, BasicMatrix<T> *);                  \
+  template BasicMatrix<T> *matrix_dot_into<T>(                                \
+      BasicMatrix<T> *, BasicMatrix<T> *, BasicMatrix<T> *, bool);            \
+  template BasicMatrix<T> *matrix_mul_scalar_into<T>(BasicMatrix<T> *,        \
+                                                     BasicMatrix<T> *, T);    \
+  template BasicMatrix<T> *matrix_transpose_into<T>(BasicMatrix<T> *,         \
+                                                    BasicMatrix<T> *);        \
+  template BasicMatrix<T> *matrix_apply_into<T>(                              \
+      BasicMatrix<T> *, BasicMatrix<T> *, T (*)(T));                          \
+  template BasicMatrix<T> *matrix_add_inplace<T>(BasicMatrix<T> *,            \
+                                                 BasicMatrix<T> *);           \
+  template BasicMatrix<T> *matrix_sub_inplace<T>(BasicMatrix<T> *,            \
+                                                 BasicMatrix<T> *);           \
+  template BasicMatrix<T> *matrix_mul_scalar_inplace<T>(BasicMatrix<T> *, T); \
+  template BasicMatrix<T> *matrix_transpose_inplace<T>(BasicMatrix<T> *);     \
+  template BasicMatrix<T> *matrix_apply_inplace<T>(BasicMatrix<T> *,          \
+                                                   T (*)(T));                 \
+  template BasicMatrix<T> matrix_view<T>(const BasicMatrix<T> *, size_t,      \
+                                         size_t, size_t, size_t);             \
+  template BasicMatrix<T> matrix_view_rows<T>(const BasicMatrix<T> *, size_t, \
+                                              size_t);                        \
+  template BasicMatrix<T> matrix_view_cols<T>(const BasicMatrix<T> *, size_t, \
+                                              size_t);                        \
+  template BasicMatrix<T> matrix_reshape<T>(const BasicMatrix<T> *, size_t,   \
+                                            size_t);                          \
+  template BasicMatrix<T> matrix_wrap<T>(T *, size_t, size_t, size_t);
+
+INSTANTIATE_MATRIX(float)
+INSTANTIATE_MATRIX(double)
+
+#undef INSTANTIATE_MATRIX
+
+}  // namespace custom_math
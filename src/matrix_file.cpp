@@ -0,0 +1,402 @@
+/**
+ * @file matrix_file.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the functions that save and load matrices, in
+ *        the binary format of matrix_file.hpp and as text.
+ * @version 1.0
+ * @date 2023-08-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "matrix_file.hpp"
+
+#include <limits.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace custom_math {
+
+namespace {
+
+const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+// The checksum is computed in blocks of 4 words, one per lane. The bytes
+// that do not fill a block yet are kept in pending.
+typedef struct {
+  uint64_t lanes[4];
+  unsigned char pending[32];
+  size_t pending_size;
+  uint64_t size;
+} Checksum;
+
+void checksum_init(Checksum *checksum) {
+  for (int i = 0; i < 4; i++) checksum->lanes[i] = FNV_OFFSET + i;
+  checksum->pending_size = 0;
+  checksum->size = 0;
+}
+
+inline void checksum_block(uint64_t *lanes, const unsigned char *block) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t word;
+    memcpy(&word, block + 8 * i, sizeof(word));
+    lanes[i] = (lanes[i] ^ word) * FNV_PRIME;
+  }
+}
+
+void checksum_update(Checksum *checksum, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  checksum->size += size;
+
+  if (checksum->pending_size > 0) {
+    size_t count = 32 - checksum->pending_size;
+    if (count > size) count = size;
+    memcpy(checksum->pending + checksum->pending_size, bytes, count);
+    checksum->pending_size += count;
+    bytes += count;
+    size -= count;
+
+    if (checksum->pending_size < 32) return;
+    checksum_block(checksum->lanes, checksum->pending);
+    checksum->pending_size = 0;
+  }
+
+  for (; size >= 32; bytes += 32, size -= 32)
+    checksum_block(checksum->lanes, bytes);
+
+  memcpy(checksum->pending, bytes, size);
+  checksum->pending_size = size;
+}
+
+uint64_t checksum_final(Checksum *checksum) {
+  // The last block is padded with zeros.
+  if (checksum->pending_size > 0) {
+    memset(checksum->pending + checksum->pending_size, 0,
+           32 - checksum->pending_size);
+    checksum_block(checksum->lanes, checksum->pending);
+  }
+
+  uint64_t hash = FNV_OFFSET;
+  for (int i = 0; i < 4; i++) hash = (hash ^ checksum->lanes[i]) * FNV_PRIME;
+  return (hash ^ checksum->size) * FNV_PRIME;
+}
+
+template <typename T>
+MatrixDtype dtype_of();
+
+template <>
+MatrixDtype dtype_of<double>() {
+  return MATRIX_DTYPE_FLOAT64;
+}
+
+template <>
+MatrixDtype dtype_of<float>() {
+  return MATRIX_DTYPE_FLOAT32;
+}
+
+size_t dtype_size(uint32_t dtype) {
+  switch (dtype) {
+    case MATRIX_DTYPE_FLOAT64:
+      return sizeof(double);
+    case MATRIX_DTYPE_FLOAT32:
+      return sizeof(float);
+    default:
+      return 0;
+  }
+}
+
+// Whether a header is valid and the elements it describes fit in a file of
+// the given size.
+bool check_header(const MatrixFileHeader *header, uint64_t file_size) {
+  if (memcmp(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MATRIX_FILE_VERSION)
+    return false;
+
+  size_t element_size = dtype_size(header->dtype);
+  if (element_size == 0) return false;
+
+  if (header->rows == 0 || header->cols == 0 ||
+      header->stride < header->cols)
+    return false;
+  if (header->alignment == 0 || header->offset % header->alignment != 0 ||
+      header->offset < sizeof(MatrixFileHeader) || header->offset > file_size)
+    return false;
+
+  // Written so that none of the products can overflow.
+  if (header->stride > (file_size - header->offset) / element_size)
+    return false;
+  return header->rows <=
+         (file_size - header->offset) / (header->stride * element_size);
+}
+
+template <typename T>
+bool is_valid(const BasicMatrix<T> *matrix) {
+  return matrix != nullptr && matrix->elements != nullptr;
+}
+
+// Reads rows of elements of type U into a matrix of T, computing their
+// checksum on the way.
+template <typename T, typename U>
+bool read_rows(FILE *file, BasicMatrix<T> *matrix, size_t stride,
+               Checksum *checksum) {
+  U *row = (U *)malloc(stride * sizeof(U));
+  if (row == nullptr) return false;
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < matrix->rows; i++) {
+    ok = fread(row, sizeof(U), stride, file) == stride;
+    checksum_update(checksum, row, stride * sizeof(U));
+
+    T *output = matrix_row(matrix, i);
+    for (size_t j = 0; j < matrix->cols; j++) output[j] = (T)row[j];
+  }
+
+  free(row);
+  return ok;
+}
+
+}  // namespace
+
+uint64_t matrix_checksum(const void *data, size_t size) {
+  Checksum checksum;
+  checksum_init(&checksum);
+  checksum_update(&checksum, data, size);
+  return checksum_final(&checksum);
+}
+
+template <typename T>
+bool matrix_save(const BasicMatrix<T> *matrix, const char *filename) {
+  if (!is_valid(matrix) || filename == nullptr) return false;
+
+  FILE *file = fopen(filename, "wb");
+  if (file == nullptr) return false;
+
+  // The rows are saved without their padding.
+  MatrixFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+  header.version = MATRIX_FILE_VERSION;
+  header.dtype = dtype_of<T>();
+  header.rows = matrix->rows;
+  header.cols = matrix->cols;
+  header.stride = matrix->cols;
+  header.alignment = MATRIX_FILE_ALIGNMENT;
+  header.offset = (sizeof(header) + MATRIX_FILE_ALIGNMENT - 1) &
+                  ~(uint64_t)(MATRIX_FILE_ALIGNMENT - 1);
+
+  // The header is written again once the checksum is known.
+  static const char padding[MATRIX_FILE_ALIGNMENT] = {0};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(padding, 1, header.offset - sizeof(header), file) ==
+                header.offset - sizeof(header);
+
+  Checksum checksum;
+  checksum_init(&checksum);
+  for (size_t i = 0; ok && i < matrix->rows; i++) {
+    const T *row = matrix_row(matrix, i);
+    ok = fwrite(row, sizeof(T), matrix->cols, file) == matrix->cols;
+    checksum_update(&checksum, row, matrix->cols * sizeof(T));
+  }
+  header.checksum = checksum_final(&checksum);
+
+  ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok) remove(filename);
+  return ok;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_load(const char *filename, Allocator *allocator) {
+  if (filename == nullptr) return nullptr;
+
+  FILE *file = fopen(filename, "rb");
+  if (file == nullptr) return nullptr;
+
+  MatrixFileHeader header;
+  long file_size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) file_size = ftell(file);
+
+  if (file_size < 0 || fseek(file, 0, SEEK_SET) != 0 ||
+      fread(&header, sizeof(header), 1, file) != 1 ||
+      !check_header(&header, (uint64_t)file_size) || header.rows > INT_MAX ||
+      header.cols > INT_MAX ||
+      fseek(file, (long)header.offset, SEEK_SET) != 0) {
+    fclose(file);
+    return nullptr;
+  }
+
+  BasicMatrix<T> *matrix =
+      matrix_create<T>((int)header.rows, (int)header.cols, 0, allocator);
+  if (matrix == nullptr) {
+    fclose(file);
+    return nullptr;
+  }
+
+  Checksum checksum;
+  checksum_init(&checksum);
+  bool ok = header.dtype == MATRIX_DTYPE_FLOAT64
+                ? read_rows<T, double>(file, matrix, header.stride, &checksum)
+                : read_rows<T, float>(file, matrix, header.stride, &checksum);
+  fclose(file);
+
+  if (!ok || checksum_final(&checksum) != header.checksum) {
+    matrix_delete(matrix);
+    return nullptr;
+  }
+
+  return matrix;
+}
+
+template <typename T>
+bool matrix_save_text(const BasicMatrix<T> *matrix, const char *filename) {
+  if (!is_valid(matrix) || filename == nullptr) return false;
+
+  FILE *file = fopen(filename, "w");
+  if (file == nullptr) return false;
+
+  // 17 and 9 significant digits are enough to get a double and a float back.
+  const int digits = sizeof(T) == sizeof(double) ? 17 : 9;
+  bool ok = fprintf(file, "%zu %zu\n", matrix->rows, matrix->cols) > 0;
+
+  for (size_t i = 0; ok && i < matrix->rows; i++) {
+    const T *row = matrix_row(matrix, i);
+    for (size_t j = 0; ok && j < matrix->cols; j++)
+      ok = fprintf(file, "%.*g ", digits, (double)row[j]) > 0;
+    ok = ok && fprintf(file, "\n") > 0;
+  }
+
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok) remove(filename);
+  return ok;
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_load_text(const char *filename, Allocator *allocator) {
+  if (filename == nullptr) return nullptr;
+
+  FILE *file = fopen(filename, "r");
+  if (file == nullptr) return nullptr;
+
+  size_t rows, cols;
+  if (fscanf(file, "%zu %zu", &rows, &cols) != 2 || rows == 0 || cols == 0 ||
+      rows > INT_MAX || cols > INT_MAX) {
+    fclose(file);
+    return nullptr;
+  }
+
+  BasicMatrix<T> *matrix = matrix_create<T>((int)rows, (int)cols, 0, allocator);
+  if (matrix == nullptr) {
+    fclose(file);
+    return nullptr;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < rows; i++) {
+    T *row = matrix_row(matrix, i);
+    for (size_t j = 0; ok && j < cols; j++) {
+      double value;
+      ok = fscanf(file, "%lf", &value) == 1;
+      row[j] = (T)value;
+    }
+  }
+
+  fclose(file);
+
+  if (!ok) {
+    matrix_delete(matrix);
+    return nullptr;
+  }
+
+  return matrix;
+}
+
+template <typename T>
+BasicMappedMatrix<T> *matrix_map_file(const char *filename, bool verify) {
+#ifdef MATRIX_FILE_MMAP
+  if (filename == nullptr) return nullptr;
+
+  int descriptor = open(filename, O_RDONLY);
+  if (descriptor < 0) return nullptr;
+
+  struct stat status;
+  if (fstat(descriptor, &status) != 0 ||
+      status.st_size < (off_t)sizeof(MatrixFileHeader)) {
+    close(descriptor);
+    return nullptr;
+  }
+
+  // The mapping stays valid once the descriptor is closed.
+  size_t size = (size_t)status.st_size;
+  void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (address == MAP_FAILED) return nullptr;
+
+  const MatrixFileHeader *header = (const MatrixFileHeader *)address;
+  if (!check_header(header, size) || header->dtype != dtype_of<T>()) {
+    munmap(address, size);
+    return nullptr;
+  }
+
+  T *elements = (T *)((char *)address + header->offset);
+  if (verify && matrix_checksum(elements, header->rows * header->stride *
+                                              sizeof(T)) != header->checksum) {
+    munmap(address, size);
+    return nullptr;
+  }
+
+  BasicMappedMatrix<T> *mapped =
+      (BasicMappedMatrix<T> *)malloc(sizeof(BasicMappedMatrix<T>));
+  if (mapped == nullptr) {
+    munmap(address, size);
+    return nullptr;
+  }
+
+  mapped->matrix =
+      matrix_wrap(elements, header->rows, header->cols, header->stride);
+  mapped->address = address;
+  mapped->size = size;
+
+  return mapped;
+#else
+  (void)filename;
+  (void)verify;
+  return nullptr;
+#endif
+}
+
+template <typename T>
+void matrix_unmap(BasicMappedMatrix<T> *mapped) {
+  if (mapped == nullptr) return;
+
+#ifdef MATRIX_FILE_MMAP
+  munmap(mapped->address, mapped->size);
+#endif
+  free(mapped);
+}
+
+#define INSTANTIATE_MATRIX_FILE(T)                                          \
+  template bool matrix_save<T>(const BasicMatrix<T> *, const char *);       \
+  template BasicMatrix<T> *matrix_load<T>(const char *, Allocator *);       \
+  template bool matrix_save_text<T>(const BasicMatrix<T> *, const char *);  \
+  template BasicMatrix<T> *matrix_load_text<T>(const char *, Allocator *);  \
+  template BasicMappedMatrix<T> *matrix_map_file<T>(const char *, bool);    \
+  template void matrix_unmap<T>(BasicMappedMatrix<T> *);
+
+INSTANTIATE_MATRIX_FILE(float)
+INSTANTIATE_MATRIX_FILE(double)
+
+#undef INSTANTIATE_MATRIX_FILE
+
+}  // namespace custom_math
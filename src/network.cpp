@@ -0,0 +1,479 @@
+/**
+ * @file network.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief  This file contains the implementation of the functions declared in
+ *         network.hpp.
+ * @version 1.0
+ * @date 2023-08-11
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "network.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "gemm.hpp"
+#include "random.hpp"
+#include "simd.hpp"
+#include "softmax.hpp"
+
+namespace neural {
+
+namespace {
+
+inline size_t align(size_t offset) {
+  return (offset + ALLOCATOR_ALIGNMENT - 1) &
+         ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+// Rounds a number of elements up to a multiple of 64 bytes.
+template <typename T>
+inline size_t pad(size_t count) {
+  return align(count * sizeof(T)) / sizeof(T);
+}
+
+// Adds the bias to a block of z and applies the activation into a.
+template <typename T>
+struct ForwardContext {
+  const BasicDense<T> *layer;
+  const custom_math::BasicMatrix<T> *z;
+  const custom_math::BasicMatrix<T> *a;
+};
+
+template <typename T>
+void forward_epilogue(void *context, size_t row, size_t col, size_t rows,
+                      size_t cols) {
+  const ForwardContext<T> *forward = (const ForwardContext<T> *)context;
+  const BasicDense<T> *layer = forward->layer;
+
+  for (size_t i = row; i < row + rows; i++) {
+    T *z = custom_math::matrix_row(forward->z, i) + col;
+    custom_math::simd_add(z, z, layer->bias + col, cols);
+    if (layer->activated)
+      custom_math::activation_forward(
+          &layer->activation, custom_math::matrix_row(forward->a, i) + col, z,
+          cols);
+  }
+}
+
+// Multiplies a block of the gradients with respect to the outputs of a layer
+// by the derivative of its activation, computed over z.
+template <typename T>
+struct BackwardContext {
+  const custom_math::Activation *activation;
+  const custom_math::BasicMatrix<T> *z;
+  const custom_math::BasicMatrix<T> *delta;
+};
+
+template <typename T>
+void backward_epilogue(void *context, size_t row, size_t col, size_t rows,
+                       size_t cols) {
+  const BackwardContext<T> *backward = (const BackwardContext<T> *)context;
+
+  for (size_t i = row; i < row + rows; i++) {
+    T *z = custom_math::matrix_row(backward->z, i) + col;
+    T *delta = custom_math::matrix_row(backward->delta, i) + col;
+    custom_math::activation_derivative(backward->activation, z, z, cols);
+    for (size_t j = 0; j < cols; j++) delta[j] *= z[j];
+  }
+}
+
+}  // namespace
+
+template <typename T>
+BasicNetwork<T> *network_create(const size_t *sizes, size_t count,
+                                const custom_math::Activation *activation,
+                                uint64_t seed,
+                                custom_math::Allocator *allocator) {
+  if (sizes == nullptr || activation == nullptr || count < 2 ||
+      count > NETWORK_MAX_LAYERS + 1)
+    return nullptr;
+  for (size_t l = 0; l < count; l++)
+    if (sizes[l] == 0) return nullptr;
+
+  // The weights of every layer, then its bias, each on a cache line of its
+  // own.
+  size_t size = 0;
+  for (size_t l = 0; l + 1 < count; l++)
+    size = pad<T>(pad<T>(size + sizes[l] * sizes[l + 1]) + sizes[l + 1]);
+
+  if (allocator == nullptr) allocator = custom_math::allocator_get_default();
+  const size_t header = align(sizeof(BasicNetwork<T>));
+  const size_t block = header + size * sizeof(T);
+
+  BasicNetwork<T> *network =
+      (BasicNetwork<T> *)custom_math::allocator_allocate(allocator, block);
+  if (network == nullptr) return nullptr;
+
+  memset(network, 0, header);
+  network->count = count - 1;
+  network->parameters = (T *)((char *)network + header);
+  network->size = size;
+  network->allocator = allocator;
+  network->block = block;
+  memset(network->parameters, 0, size * sizeof(T));
+
+  custom_math::Random random;
+  custom_math::random_seed(&random, seed);
+  size_t offset = 0;
+
+  for (size_t l = 0; l + 1 < count; l++) {
+    BasicDense<T> *layer = &network->layers[l];
+    layer->inputs = sizes[l];
+    layer->outputs = sizes[l + 1];
+    layer->activation = *activation;
+    layer->activated = l + 2 < count;
+    layer->offset = offset;
+    layer->weights.rows = layer->inputs;
+    layer->weights.cols = layer->outputs;
+    layer->weights.stride = layer->outputs;
+    layer->weights.elements = network->parameters + offset;
+    layer->weights.allocator = nullptr;
+    layer->bias = network->parameters +
+                  pad<T>(offset + layer->inputs * layer->outputs);
+    offset = pad<T>((size_t)(layer->bias - network->parameters) +
+                    layer->outputs);
+
+    // The ReLUs and GELU keep about half of their inputs.
+    const bool rectified =
+        layer->activated &&
+        (activation->type == custom_math::ACTIVATION_RELU ||
+         activation->type == custom_math::ACTIVATION_LEAKY_RELU ||
+         activation->type == custom_math::ACTIVATION_GELU);
+    const double limit =
+        rectified ? sqrt(6. / (double)layer->inputs)
+                  : sqrt(6. / (double)(layer->inputs + layer->outputs));
+    for (size_t i = 0; i < layer->inputs * layer->outputs; i++)
+      layer->weights.elements[i] =
+          (T)((2 * custom_math::random_uniform(&random) - 1) * limit);
+  }
+
+  return network;
+}
+
+template <typename T>
+void network_delete(BasicNetwork<T> *network) {
+  if (network == nullptr) return;
+  custom_math::allocator_deallocate(network->allocator, network,
+                                    network->block);
+}
+
+template <typename T>
+BasicWorkspace<T> *workspace_create(const BasicNetwork<T> *network,
+                                    size_t capacity,
+                                    custom_math::Allocator *allocator) {
+  if (network == nullptr || capacity == 0) return nullptr;
+
+  // z, a unless it is z, and delta for every layer, then the gradients.
+  size_t elements = 0;
+  for (size_t l = 0; l < network->count; l++) {
+    const BasicDense<T> *layer = &network->layers[l];
+    elements += (layer->activated ? 3 : 2) * capacity * pad<T>(layer->outputs);
+  }
+  elements += network->size;
+
+  if (allocator == nullptr) allocator = custom_math::allocator_get_default();
+  const size_t header = align(sizeof(BasicWorkspace<T>));
+  const size_t block = header + elements * sizeof(T);
+
+  BasicWorkspace<T> *workspace =
+      (BasicWorkspace<T> *)custom_math::allocator_allocate(allocator, block);
+  if (workspace == nullptr) return nullptr;
+
+  memset(workspace, 0, header);
+  workspace->capacity = capacity;
+  workspace->allocator = allocator;
+  workspace->block = block;
+
+  T *next = (T *)((char *)workspace + header);
+  for (size_t l = 0; l < network->count; l++) {
+    const BasicDense<T> *layer = &network->layers[l];
+    const size_t stride = pad<T>(layer->outputs);
+    custom_math::BasicMatrix<T> *buffers[] = {
+        &workspace->z[l], &workspace->delta[l], &workspace->a[l]};
+
+    for (size_t k = 0; k < (layer->activated ? 3u : 2u); k++) {
+      custom_math::BasicMatrix<T> buffer = {capacity, layer->outputs, stride,
+                                            next, nullptr};
+      *buffers[k] = buffer;
+      next += capacity * stride;
+    }
+    if (!layer->activated) workspace->a[l] = workspace->z[l];
+  }
+
+  workspace->gradients = next;
+  workspace->size = network->size;
+  memset(workspace->gradients, 0, network->size * sizeof(T));
+
+  return workspace;
+}
+
+template <typename T>
+void workspace_delete(BasicWorkspace<T> *workspace) {
+  if (workspace == nullptr) return;
+  custom_math::allocator_deallocate(workspace->allocator, workspace,
+                                    workspace->block);
+}
+
+template <typename T>
+const custom_math::BasicMatrix<T> *network_forward(
+    const BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+    const custom_math::BasicMatrix<T> *inputs) {
+  if (inputs == nullptr || inputs->rows == 0 ||
+      inputs->rows > workspace->capacity ||
+      inputs->cols != network->layers[0].inputs)
+    return nullptr;
+
+  const size_t rows = inputs->rows;
+  workspace->rows = rows;
+  const custom_math::BasicMatrix<T> *input = inputs;
+
+  for (size_t l = 0; l < network->count; l++) {
+    const BasicDense<T> *layer = &network->layers[l];
+    workspace->z[l].rows = rows;
+    workspace->a[l].rows = rows;
+    workspace->delta[l].rows = rows;
+
+    ForwardContext<T> context = {layer, &workspace->z[l], &workspace->a[l]};
+    custom_math::GemmEpilogue epilogue = {forward_epilogue<T>, &context};
+    custom_math::gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, rows,
+                      layer->outputs, layer->inputs, (T)1, input->elements,
+                      input->stride, layer->weights.elements,
+                      layer->weights.stride, (T)0, workspace->z[l].elements,
+                      workspace->z[l].stride, &epilogue);
+
+    input = &workspace->a[l];
+  }
+
+  return &workspace->z[network->count - 1];
+}
+
+template <typename T>
+bool network_check_labels(const BasicNetwork<T> *network, const int *labels,
+                          size_t count) {
+  const int classes = (int)network->layers[network->count - 1].outputs;
+  for (size_t i = 0; i < count; i++)
+    if (labels[i] < 0 || labels[i] >= classes) return false;
+  return true;
+}
+
+template <typename T>
+T network_backward(const BasicNetwork<T> *network,
+                   BasicWorkspace<T> *workspace,
+                   const custom_math::BasicMatrix<T> *inputs,
+                   const int *labels, size_t count,
+                   const BackwardHook *hook) {
+  const size_t rows = workspace->rows;
+  const size_t last = network->count - 1;
+  if (count == 0) count = rows;
+
+  // Without a loss, the deltas are not written: the gradients would be the
+  // ones of the previous pass.
+  if (!network_check_labels(network, labels, rows)) {
+    memset(workspace->gradients, 0, workspace->size * sizeof(T));
+    if (hook != nullptr)
+      for (size_t l = network->count; l-- > 0;)
+        hook->layer_done(hook->context, l);
+    return (T)NAN;
+  }
+
+  const custom_math::SoftmaxLoss loss = custom_math::softmax_cross_entropy(
+      &workspace->z[last], labels, &workspace->delta[last], (T)1 / (T)count);
+
+  for (size_t l = network->count; l-- > 0;) {
+    const BasicDense<T> *layer = &network->layers[l];
+    const custom_math::BasicMatrix<T> *input =
+        l == 0 ? inputs : &workspace->a[l - 1];
+    const custom_math::BasicMatrix<T> *delta = &workspace->delta[l];
+    T *weights = workspace->gradients + layer->offset;
+    T *bias = workspace->gradients +
+              (size_t)(layer->bias - network->parameters);
+
+    // The gradients of the weights are input^T * delta, the ones of the bias
+    // the sums of the columns of delta.
+    custom_math::gemm(custom_math::TRANS, custom_math::NO_TRANS,
+                      layer->inputs, layer->outputs, rows, (T)1,
+                      input->elements, input->stride, delta->elements,
+                      delta->stride, (T)0, weights, layer->outputs);
+    custom_math::simd_copy(bias, delta->elements, layer->outputs);
+    for (size_t i = 1; i < rows; i++)
+      custom_math::simd_add(bias, bias, custom_math::matrix_row(delta, i),
+                            layer->outputs);
+    if (hook != nullptr) hook->layer_done(hook->context, l);
+
+    if (l == 0) break;
+
+    // The gradients with respect to the outputs of the previous layer are
+    // delta * weights^T, times the derivative of its activation.
+    const BasicDense<T> *previous = &network->layers[l - 1];
+    BackwardContext<T> context = {&previous->activation, &workspace->z[l - 1],
+                                  &workspace->delta[l - 1]};
+    custom_math::GemmEpilogue epilogue = {backward_epilogue<T>, &context};
+    custom_math::gemm(custom_math::NO_TRANS, custom_math::TRANS, rows,
+                      layer->inputs, layer->outputs, (T)1, delta->elements,
+                      delta->stride, layer->weights.elements,
+                      layer->weights.stride, (T)0,
+                      workspace->delta[l - 1].elements,
+                      workspace->delta[l - 1].stride, &epilogue);
+  }
+
+  return (T)(loss.loss / (double)count);
+}
+
+template <typename T>
+void network_sgd(BasicNetwork<T> *network, const BasicWorkspace<T> *workspace,
+                 T learning_rate) {
+  T *parameters = network->parameters;
+  const T *gradients = workspace->gradients;
+  for (size_t i = 0; i < network->size; i++)
+    parameters[i] -= learning_rate * gradients[i];
+}
+
+template <typename T>
+T network_train_batch(BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+                      const images::BasicBatch<T> *batch, T learning_rate) {
+  if (!network_check_labels(network, batch->labels, batch->samples.rows) ||
+      network_forward(network, workspace, &batch->samples) == nullptr)
+    return (T)NAN;
+
+  const T loss =
+      network_backward(network, workspace, &batch->samples, batch->labels);
+  network_sgd(network, workspace, learning_rate);
+  return loss;
+}
+
+template <typename T>
+T network_train_batch(BasicNetwork<T> *network, BasicWorkspace<T> *workspace,
+                      const images::BasicBatch<T> *batch,
+                      BasicOptimizer<T> *optimizer) {
+  if (optimizer->size != network->size ||
+      !network_check_labels(network, batch->labels, batch->samples.rows) ||
+      network_forward(network, workspace, &batch->samples) == nullptr)
+    return (T)NAN;
+
+  const T loss =
+      network_backward(network, workspace, &batch->samples, batch->labels);
+  optimizer_step(optimizer, network->parameters, workspace->gradients);
+  return loss;
+}
+
+template <typename T>
+double network_accuracy(const BasicNetwork<T> *network,
+                        BasicWorkspace<T> *workspace,
+                        const images::BasicDataset<T> *dataset) {
+  size_t correct = 0;
+
+  for (size_t first = 0; first < dataset->count;
+       first += workspace->capacity) {
+    images::BasicBatch<T> batch =
+        images::dataset_batch(dataset, first, workspace->capacity);
+    const custom_math::BasicMatrix<T> *logits =
+        network_forward(network, workspace, &batch.samples);
+    if (logits == nullptr) return 0;
+
+    correct +=
+        custom_math::softmax_cross_entropy(logits, batch.labels).correct;
+  }
+
+  return dataset->count > 0 ? (double)correct / (double)dataset->count : 0;
+}
+
+namespace {
+
+// The number of weights and biases of a network, without the padding.
+template <typename T>
+size_t parameter_count(const BasicNetwork<T> *network) {
+  size_t count = 0;
+  for (size_t l = 0; l < network->count; l++)
+    count += (network->layers[l].inputs + 1) * network->layers[l].outputs;
+  return count;
+}
+
+// Copies the parameters of a network into an array without the padding, or
+// back from it.
+template <typename T>
+void copy_parameters(const BasicNetwork<T> *network, T *packed,
+                     bool unpack) {
+  for (size_t l = 0; l < network->count; l++) {
+    const BasicDense<T> *layer = &network->layers[l];
+    for (size_t i = 0; i <= layer->inputs; i++) {
+      T *row = i < layer->inputs ? custom_math::matrix_row(&layer->weights, i)
+                                 : layer->bias;
+      if (unpack)
+        custom_math::simd_copy(row, packed, layer->outputs);
+      else
+        custom_math::simd_copy(packed, row, layer->outputs);
+      packed += layer->outputs;
+    }
+  }
+}
+
+}  // namespace
+
+template <typename T>
+bool network_save(const BasicNetwork<T> *network, const char *filename) {
+  if (network == nullptr) return false;
+  custom_math::BasicMatrix<T> *parameters = custom_math::matrix_create<T>(
+      1, (int)parameter_count(network));
+  if (parameters == nullptr) return false;
+
+  copy_parameters(network, parameters->elements, false);
+  const bool saved = custom_math::matrix_save(parameters, filename);
+  custom_math::matrix_delete(parameters);
+  return saved;
+}
+
+template <typename T>
+bool network_load(BasicNetwork<T> *network, const char *filename) {
+  if (network == nullptr) return false;
+  custom_math::BasicMatrix<T> *parameters =
+      custom_math::matrix_load<T>(filename);
+  if (parameters == nullptr) return false;
+
+  const bool fits =
+      parameters->rows == 1 && parameters->cols == parameter_count(network);
+  if (fits) copy_parameters(network, parameters->elements, true);
+  custom_math::matrix_delete(parameters);
+  return fits;
+}
+
+#define INSTANTIATE_NETWORK(T)                                               \
+  template BasicNetwork<T> *network_create<T>(                               \
+      const size_t *, size_t, const custom_math::Activation *, uint64_t,     \
+      custom_math::Allocator *);                                             \
+  template void network_delete<T>(BasicNetwork<T> *);                        \
+  template BasicWorkspace<T> *workspace_create<T>(                           \
+      const BasicNetwork<T> *, size_t, custom_math::Allocator *);            \
+  template void workspace_delete<T>(BasicWorkspace<T> *);                    \
+  template const custom_math::BasicMatrix<T> *network_forward<T>(            \
+      const BasicNetwork<T> *, BasicWorkspace<T> *,                          \
+      const custom_math::BasicMatrix<T> *);                                  \
+  template bool network_check_labels<T>(const BasicNetwork<T> *,             \
+                                        const int *, size_t);                \
+  template T network_backward<T>(const BasicNetwork<T> *,                    \
+                                 BasicWorkspace<T> *,                        \
+                                 const custom_math::BasicMatrix<T> *,        \
+                                 const int *, size_t,                        \
+                                 const BackwardHook *);                      \
+  template void network_sgd<T>(BasicNetwork<T> *, const BasicWorkspace<T> *, \
+                               T);                                           \
+  template T network_train_batch<T>(BasicNetwork<T> *, BasicWorkspace<T> *,  \
+                                    const images::BasicBatch<T> *, T);       \
+  template T network_train_batch<T>(BasicNetwork<T> *, BasicWorkspace<T> *,  \
+                                    const images::BasicBatch<T> *,           \
+                                    BasicOptimizer<T> *);                    \
+  template double network_accuracy<T>(const BasicNetwork<T> *,               \
+                                      BasicWorkspace<T> *,                   \
+                                      const images::BasicDataset<T> *);  \
+  template bool network_save<T>(const BasicNetwork<T> *, const char *);      \
+  template bool network_load<T>(BasicNetwork<T> *, const char *);
+
+INSTANTIATE_NETWORK(float)
+INSTANTIATE_NETWORK(double)
+
+#undef INSTANTIATE_NETWORK
+
+}  // namespace neural
@@ -0,0 +1,277 @@
+/**
+ * @file optimizer.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the optimizers declared in
+ *        optimizer.hpp.
+ * @version 1.0
+ * @date 2023-08-13
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "optimizer.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#endif
+
+namespace neural {
+
+namespace {
+
+inline size_t align(size_t offset) {
+  return (offset + ALLOCATOR_ALIGNMENT - 1) &
+         ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+// The scalars of a step, computed once.
+template <typename T>
+struct Update {
+  OptimizerType type;
+  T learning_rate;
+  T momentum;
+  T beta1;
+  T beta2;
+  T epsilon;
+  T weight_decay;  // Added to the gradients, 0 for AdamW.
+  T shrink;        // 1 - lr * weight_decay for AdamW, 1 otherwise.
+  T step_size;     // lr / (1 - beta1^t) for Adam and AdamW.
+  T correction;    // 1 / sqrt(1 - beta2^t) for Adam and AdamW.
+};
+
+template <typename T>
+struct UpdateKernel {
+  typedef void (*Function)(const Update<T> *update, T *p, const T *g, T *m,
+                           T *v, size_t size);
+};
+
+// The loops are written once and compiled for every instruction set by the
+// wrappers below. Every optimizer reads and writes each array once per step,
+// so that a step costs about as much as streaming them through memory.
+template <typename T>
+inline __attribute__((always_inline)) void update_loop(const Update<T> *u,
+                                                       T *p, const T *g, T *m,
+                                                       T *v, size_t size) {
+  const T lr = u->learning_rate, decay = u->weight_decay;
+
+  switch (u->type) {
+    case OPTIMIZER_SGD:
+      for (size_t i = 0; i < size; i++) p[i] -= lr * (g[i] + decay * p[i]);
+      break;
+    case OPTIMIZER_MOMENTUM:
+      for (size_t i = 0; i < size; i++) {
+        T velocity = u->momentum * m[i] + (g[i] + decay * p[i]);
+        m[i] = velocity;
+        p[i] -= lr * velocity;
+      }
+      break;
+    case OPTIMIZER_NESTEROV:
+      for (size_t i = 0; i < size; i++) {
+        T d = g[i] + decay * p[i];
+        T velocity = u->momentum * m[i] + d;
+        m[i] = velocity;
+        p[i] -= lr * (d + u->momentum * velocity);
+      }
+      break;
+    case OPTIMIZER_ADAM:
+    case OPTIMIZER_ADAMW:
+      for (size_t i = 0; i < size; i++) {
+        T d = g[i] + decay * p[i];
+        T first = u->beta1 * m[i] + (1 - u->beta1) * d;
+        T second = u->beta2 * v[i] + (1 - u->beta2) * d * d;
+        m[i] = first;
+        v[i] = second;
+        p[i] = u->shrink * p[i] -
+               u->step_size * first / (sqrt(second) * u->correction +
+                                       u->epsilon);
+      }
+      break;
+  }
+}
+
+template <typename T>
+void update_generic(const Update<T> *update, T *p, const T *g, T *m, T *v,
+                    size_t size) {
+  update_loop(update, p, g, m, v, size);
+}
+
+#ifdef SIMD_X86
+
+template <typename T>
+__attribute__((target("avx2,fma"))) void update_avx2(const Update<T> *update,
+                                                     T *p, const T *g, T *m,
+                                                     T *v, size_t size) {
+  update_loop(update, p, g, m, v, size);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void update_avx512(const Update<T> *update,
+                                                      T *p, const T *g, T *m,
+                                                      T *v, size_t size) {
+  update_loop(update, p, g, m, v, size);
+}
+
+#endif  // SIMD_X86
+
+template <typename T>
+typename UpdateKernel<T>::Function select_kernel() {
+#ifdef SIMD_X86
+  switch (custom_math::simd_get_isa()) {
+    case custom_math::ISA_AVX512:
+      return update_avx512<T>;
+    case custom_math::ISA_AVX2:
+      return update_avx2<T>;
+    default:
+      break;
+  }
+#endif
+  return update_generic<T>;
+}
+
+// Arrays smaller than this are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = 1 << 14;
+
+inline bool is_adam(OptimizerType type) {
+  return type == OPTIMIZER_ADAM || type == OPTIMIZER_ADAMW;
+}
+
+}  // namespace
+
+OptimizerOptions optimizer_default_options(OptimizerType type) {
+  OptimizerOptions options;
+  options.type = type;
+  options.learning_rate = is_adam(type) ? 0.001 : 0.01;
+  options.momentum = 0.9;
+  options.beta1 = 0.9;
+  options.beta2 = 0.999;
+  options.epsilon = 1e-8;
+  options.weight_decay = type == OPTIMIZER_ADAMW ? 0.01 : 0;
+  return options;
+}
+
+template <typename T>
+BasicOptimizer<T> *optimizer_create(size_t size,
+                                    const OptimizerOptions *options,
+                                    custom_math::Allocator *allocator) {
+  if (options == nullptr || size == 0) return nullptr;
+  if (options->type < OPTIMIZER_SGD || options->type > OPTIMIZER_ADAMW ||
+      !(options->learning_rate >= 0) || !(options->weight_decay >= 0) ||
+      !(options->momentum >= 0 && options->momentum < 1) ||
+      !(options->beta1 >= 0 && options->beta1 < 1) ||
+      !(options->beta2 >= 0 && options->beta2 < 1) ||
+      !(options->epsilon > 0))
+    return nullptr;
+
+  size_t moments = 0;
+  if (options->type != OPTIMIZER_SGD) moments = is_adam(options->type) ? 2 : 1;
+  const size_t header = align(sizeof(BasicOptimizer<T>));
+  const size_t stride = align(size * sizeof(T));
+  const size_t block = header + moments * stride;
+
+  if (allocator == nullptr) allocator = custom_math::allocator_get_default();
+  BasicOptimizer<T> *optimizer =
+      (BasicOptimizer<T> *)custom_math::allocator_allocate(allocator, block);
+  if (optimizer == nullptr) return nullptr;
+
+  optimizer->options = *options;
+  optimizer->size = size;
+  optimizer->steps = 0;
+  optimizer->first = moments > 0 ? (T *)((char *)optimizer + header) : nullptr;
+  optimizer->second =
+      moments > 1 ? (T *)((char *)optimizer + header + stride) : nullptr;
+  optimizer->allocator = allocator;
+  optimizer->block = block;
+  optimizer_reset(optimizer);
+
+  return optimizer;
+}
+
+template <typename T>
+void optimizer_step(BasicOptimizer<T> *optimizer, T *parameters,
+                    const T *gradients) {
+  const OptimizerOptions *options = &optimizer->options;
+  optimizer->steps++;
+
+  Update<T> update;
+  update.type = options->type;
+  update.learning_rate = (T)options->learning_rate;
+  update.momentum = (T)options->momentum;
+  update.beta1 = (T)options->beta1;
+  update.beta2 = (T)options->beta2;
+  update.epsilon = (T)options->epsilon;
+  update.weight_decay =
+      options->type == OPTIMIZER_ADAMW ? (T)0 : (T)options->weight_decay;
+  update.shrink = options->type == OPTIMIZER_ADAMW
+                      ? (T)(1 - options->learning_rate * options->weight_decay)
+                      : (T)1;
+  const double t = (double)optimizer->steps;
+  update.step_size =
+      (T)(options->learning_rate / (1 - pow(options->beta1, t)));
+  update.correction = (T)(1 / sqrt(1 - pow(options->beta2, t)));
+
+  typename UpdateKernel<T>::Function kernel = select_kernel<T>();
+  const size_t size = optimizer->size;
+  T *first = optimizer->first, *second = optimizer->second;
+
+#ifdef USE_OPENMP
+  if (size >= PARALLEL_THRESHOLD && omp_get_max_threads() > 1 &&
+      !omp_in_parallel()) {
+#pragma omp parallel
+    {
+      // Whole cache lines for every thread.
+      size_t threads = (size_t)omp_get_num_threads();
+      size_t id = (size_t)omp_get_thread_num();
+      size_t chunk = ((size + threads - 1) / threads + 15) & ~(size_t)15;
+      size_t begin = id * chunk < size ? id * chunk : size;
+      size_t end = begin + chunk < size ? begin + chunk : size;
+
+      if (begin < end)
+        kernel(&update, parameters + begin, gradients + begin,
+               first != nullptr ? first + begin : nullptr,
+               second != nullptr ? second + begin : nullptr, end - begin);
+    }
+    return;
+  }
+#endif
+  kernel(&update, parameters, gradients, first, second, size);
+}
+
+template <typename T>
+void optimizer_reset(BasicOptimizer<T> *optimizer) {
+  optimizer->steps = 0;
+  if (optimizer->first != nullptr)
+    memset(optimizer->first, 0, optimizer->size * sizeof(T));
+  if (optimizer->second != nullptr)
+    memset(optimizer->second, 0, optimizer->size * sizeof(T));
+}
+
+template <typename T>
+void optimizer_delete(BasicOptimizer<T> *optimizer) {
+  if (optimizer == nullptr) return;
+  custom_math::allocator_deallocate(optimizer->allocator, optimizer,
+                                    optimizer->block);
+}
+
+#define INSTANTIATE_OPTIMIZER(T)                                           \
+  template BasicOptimizer<T> *optimizer_create<T>(                         \
+      size_t, const OptimizerOptions *, custom_math::Allocator *);         \
+  template void optimizer_step<T>(BasicOptimizer<T> *, T *, const T *);    \
+  template void optimizer_reset<T>(BasicOptimizer<T> *);                   \
+  template void optimizer_delete<T>(BasicOptimizer<T> *);
+
+INSTANTIATE_OPTIMIZER(float)
+INSTANTIATE_OPTIMIZER(double)
+
+#undef INSTANTIATE_OPTIMIZER
+
+}  // namespace neural
@@ -0,0 +1,254 @@
+/**
+ * @file qgemm.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the 8-bit integer matrix
+ *        multiplication declared in qgemm.hpp.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "qgemm.hpp"
+
+#include <string.h>
+
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace custom_math {
+
+namespace {
+
+// The rows of C computed together, the columns of B padded to a multiple of
+// a vector of 16 sums.
+const size_t ROWS = 4;
+const size_t COLUMNS = 16;
+
+inline size_t padded_columns(size_t n) {
+  return (n + COLUMNS - 1) / COLUMNS * COLUMNS;
+}
+
+// The 4 bytes of a row of A multiplied with group g of the packed B, as one
+// 32-bit integer.
+inline int32_t load_group(const uint8_t *row, size_t g) {
+  int32_t value;
+  memcpy(&value, row + 4 * g, sizeof(value));
+  return value;
+}
+
+// The last, partial, group of a row, padded with zeros.
+inline int32_t load_tail(const uint8_t *row, size_t k) {
+  int32_t value = 0;
+  memcpy(&value, row + k / 4 * 4, k % 4);
+  return value;
+}
+
+// Computes up to ROWS rows of C. Every kernel takes the same arguments.
+typedef void (*BlockKernel)(size_t rows, size_t n, size_t k,
+                            const uint8_t *a, size_t lda,
+                            const int8_t *packed, int32_t *c, size_t ldc);
+
+void block_generic(size_t rows, size_t n, size_t k, const uint8_t *a,
+                   size_t lda, const int8_t *packed, int32_t *c,
+                   size_t ldc) {
+  const size_t stride = 4 * padded_columns(n);
+  const size_t groups = (k + 3) / 4;
+
+  for (size_t r = 0; r < rows; r++) {
+    const uint8_t *row = a + r * lda;
+    int32_t *sums = c + r * ldc;
+    memset(sums, 0, n * sizeof(int32_t));
+
+    for (size_t g = 0; g < groups; g++) {
+      const int32_t group =
+          g < k / 4 ? load_group(row, g) : load_tail(row, k);
+      uint8_t bytes[4];
+      memcpy(bytes, &group, sizeof(bytes));
+      const int8_t *b = packed + g * stride;
+      for (size_t j = 0; j < n; j++)
+        sums[j] += bytes[0] * b[4 * j] + bytes[1] * b[4 * j + 1] +
+                   bytes[2] * b[4 * j + 2] + bytes[3] * b[4 * j + 3];
+    }
+  }
+}
+
+#ifdef SIMD_X86
+
+// The rows past the end of the block repeat the first one, so that the
+// kernels are always unrolled over ROWS rows. Their sums are not stored.
+inline void block_rows(size_t rows, size_t k, const uint8_t *a, size_t lda,
+                       const uint8_t **row, int32_t *tail) {
+  for (size_t r = 0; r < ROWS; r++) {
+    row[r] = a + (r < rows ? r : 0) * lda;
+    tail[r] = k % 4 ? load_tail(row[r], k) : 0;
+  }
+}
+
+// vpmaddubsw multiplies the unsigned bytes of A with the signed bytes of B
+// and adds the products two by two into 16 bits, vpmaddwd by 1 adds the
+// pairs into the 32-bit sums of 4 products.
+__attribute__((target("avx2,fma"))) void block_avx2(
+    size_t rows, size_t n, size_t k, const uint8_t *a, size_t lda,
+    const int8_t *packed, int32_t *c, size_t ldc) {
+  const size_t stride = 4 * padded_columns(n);
+  const size_t groups = (k + 3) / 4;
+  const __m256i ones = _mm256_set1_epi16(1);
+  const uint8_t *row[ROWS];
+  int32_t tail[ROWS];
+  block_rows(rows, k, a, lda, row, tail);
+
+  for (size_t j = 0; j < n; j += COLUMNS) {
+    __m256i sums[ROWS][2];
+    for (size_t r = 0; r < ROWS; r++)
+      sums[r][0] = sums[r][1] = _mm256_setzero_si256();
+
+    const int8_t *b = packed + 4 * j;
+    for (size_t g = 0; g < groups; g++, b += stride) {
+      const __m256i b0 = _mm256_loadu_si256((const __m256i *)b);
+      const __m256i b1 = _mm256_loadu_si256((const __m256i *)(b + 32));
+      for (size_t r = 0; r < ROWS; r++) {
+        const __m256i group = _mm256_set1_epi32(
+            g < k / 4 ? load_group(row[r], g) : tail[r]);
+        sums[r][0] = _mm256_add_epi32(
+            sums[r][0],
+            _mm256_madd_epi16(_mm256_maddubs_epi16(group, b0), ones));
+        sums[r][1] = _mm256_add_epi32(
+            sums[r][1],
+            _mm256_madd_epi16(_mm256_maddubs_epi16(group, b1), ones));
+      }
+    }
+
+    const size_t cols = n - j < COLUMNS ? n - j : COLUMNS;
+    for (size_t r = 0; r < rows; r++) {
+      int32_t *destination = c + r * ldc + j;
+      if (cols == COLUMNS) {
+        _mm256_storeu_si256((__m256i *)destination, sums[r][0]);
+        _mm256_storeu_si256((__m256i *)(destination + 8), sums[r][1]);
+      } else {
+        alignas(32) int32_t values[COLUMNS];
+        _mm256_store_si256((__m256i *)values, sums[r][0]);
+        _mm256_store_si256((__m256i *)(values + 8), sums[r][1]);
+        memcpy(destination, values, cols * sizeof(int32_t));
+      }
+    }
+  }
+}
+
+// vpdpbusd multiplies 4 unsigned bytes of A with 4 signed bytes of B and adds
+// the 4 products to a 32-bit sum in one instruction.
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) void block_vnni(
+    size_t rows, size_t n, size_t k, const uint8_t *a, size_t lda,
+    const int8_t *packed, int32_t *c, size_t ldc) {
+  const size_t stride = 4 * padded_columns(n);
+  const size_t groups = (k + 3) / 4;
+  const uint8_t *row[ROWS];
+  int32_t tail[ROWS];
+  block_rows(rows, k, a, lda, row, tail);
+
+  // Two vectors of sums per row while there are more than 16 columns left.
+  for (size_t j = 0; j < n; j += 2 * COLUMNS) {
+    const bool wide = n - j > COLUMNS;
+    __m512i sums[ROWS][2];
+    for (size_t r = 0; r < ROWS; r++)
+      sums[r][0] = sums[r][1] = _mm512_setzero_si512();
+
+    const int8_t *b = packed + 4 * j;
+    for (size_t g = 0; g < groups; g++, b += stride) {
+      const __m512i b0 = _mm512_loadu_si512(b);
+      const __m512i b1 = wide ? _mm512_loadu_si512(b + 64) : b0;
+      for (size_t r = 0; r < ROWS; r++) {
+        const __m512i group = _mm512_set1_epi32(
+            g < k / 4 ? load_group(row[r], g) : tail[r]);
+        sums[r][0] = _mm512_dpbusd_epi32(sums[r][0], group, b0);
+        sums[r][1] = _mm512_dpbusd_epi32(sums[r][1], group, b1);
+      }
+    }
+
+    for (size_t half = 0; half < (wide ? 2u : 1u); half++) {
+      const size_t first = j + half * COLUMNS;
+      const size_t cols = n - first < COLUMNS ? n - first : COLUMNS;
+      const __mmask16 mask = (__mmask16)((1u << cols) - 1);
+      for (size_t r = 0; r < rows; r++)
+        _mm512_mask_storeu_epi32(c + r * ldc + first, mask, sums[r][half]);
+    }
+  }
+}
+
+bool has_vnni() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512vnni") &&
+           __builtin_cpu_supports("avx512bw");
+  }();
+  return supported;
+}
+
+#endif  // SIMD_X86
+
+BlockKernel select_kernel() {
+#ifdef SIMD_X86
+  switch (simd_get_isa()) {
+    case ISA_AVX512:
+      if (has_vnni()) return block_vnni;
+      return block_avx2;
+    case ISA_AVX2:
+      return block_avx2;
+    default:
+      break;
+  }
+#endif
+  return block_generic;
+}
+
+// Products smaller than this are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = (size_t)1 << 20;
+
+}  // namespace
+
+size_t qgemm_packed_size(size_t k, size_t n) {
+  return (k + 3) / 4 * 4 * padded_columns(n);
+}
+
+void qgemm_pack(size_t k, size_t n, const int8_t *b, size_t ldb,
+                int8_t *packed) {
+  const size_t columns = padded_columns(n);
+  memset(packed, 0, qgemm_packed_size(k, n));
+
+  for (size_t i = 0; i < k; i++)
+    for (size_t j = 0; j < n; j++)
+      packed[(i / 4 * columns + j) * 4 + i % 4] = b[i * ldb + j];
+}
+
+void qgemm(size_t m, size_t n, size_t k, const uint8_t *a, size_t lda,
+           const int8_t *packed, int32_t *c, size_t ldc,
+           const GemmEpilogue *epilogue) {
+  if (m == 0 || n == 0) return;
+  const BlockKernel kernel = select_kernel();
+  const long blocks = (long)((m + ROWS - 1) / ROWS);
+  long block;
+
+#ifdef USE_OPENMP
+  const bool parallel = m * n * k >= PARALLEL_THRESHOLD &&
+                        omp_get_max_threads() > 1 && !omp_in_parallel();
+#pragma omp parallel for private(block) schedule(static) if (parallel)
+#endif
+  for (block = 0; block < blocks; block++) {
+    const size_t row = (size_t)block * ROWS;
+    const size_t rows = m - row < ROWS ? m - row : ROWS;
+    kernel(rows, n, k, a + row * lda, lda, packed, c + row * ldc, ldc);
+    if (epilogue != nullptr)
+      epilogue->apply(epilogue->context, row, 0, rows, n);
+  }
+}
+
+}  // namespace custom_math
@@ -0,0 +1,347 @@
+/**
+ * @file quantize.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the quantized networks
+ *        declared in quantize.hpp.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "quantize.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qgemm.hpp"
+#include "softmax.hpp"
+
+namespace neural {
+
+namespace {
+
+inline size_t align(size_t offset) {
+  return (offset + ALLOCATOR_ALIGNMENT - 1) &
+         ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+// The samples of a forward pass of the calibration.
+const size_t CALIBRATION_BATCH = 256;
+
+// The range of the inputs of a layer seen so far.
+typedef struct {
+  float low;
+  float high;
+} Range;
+
+template <typename T>
+void update_range(Range *range, const custom_math::BasicMatrix<T> *values) {
+  for (size_t i = 0; i < values->rows; i++) {
+    const T *row = custom_math::matrix_row(values, i);
+    for (size_t j = 0; j < values->cols; j++) {
+      if (row[j] < range->low) range->low = (float)row[j];
+      if (row[j] > range->high) range->high = (float)row[j];
+    }
+  }
+}
+
+// Quantizes the values of a row, x -> round(x / scale) + zero, clamped.
+template <typename T>
+void quantize_row(uint8_t *dst, const T *src, size_t count, float scale,
+                  int32_t zero) {
+  const float inverse = 1 / scale;
+  for (size_t j = 0; j < count; j++) {
+    long q = lrintf((float)src[j] * inverse) + zero;
+    if (q < 0) q = 0;
+    if (q > QGEMM_MAX_ACTIVATION) q = QGEMM_MAX_ACTIVATION;
+    dst[j] = (uint8_t)q;
+  }
+}
+
+// The bytes a quantized layer takes in the block of its network.
+size_t layer_block(size_t inputs, size_t outputs) {
+  return align(custom_math::qgemm_packed_size(inputs, outputs)) +
+         3 * align(outputs * sizeof(float));
+}
+
+// Quantizes the weights of a layer, one scale per output, and lays out its
+// arrays from next on.
+template <typename T>
+bool quantize_layer(const BasicDense<T> *dense, const Range *range,
+                    QuantizedDense *layer, char *next) {
+  const size_t inputs = dense->inputs, outputs = dense->outputs;
+  int8_t *weights = (int8_t *)malloc(inputs * outputs);
+  if (weights == nullptr) return false;
+
+  layer->inputs = inputs;
+  layer->outputs = outputs;
+  layer->activation = dense->activation;
+  layer->activated = dense->activated;
+  layer->input_scale =
+      range->high > range->low
+          ? (range->high - range->low) / QGEMM_MAX_ACTIVATION
+          : 1;
+  layer->input_zero = (int32_t)lrintf(-range->low / layer->input_scale);
+
+  layer->weights = (int8_t *)next;
+  next += align(custom_math::qgemm_packed_size(inputs, outputs));
+  layer->scales = (float *)next;
+  next += align(outputs * sizeof(float));
+  layer->offsets = (int32_t *)next;
+  next += align(outputs * sizeof(float));
+  layer->bias = (float *)next;
+
+  for (size_t j = 0; j < outputs; j++) {
+    T largest = 0;
+    for (size_t i = 0; i < inputs; i++)
+      largest = fmax(largest,
+                     fabs(custom_math::matrix_row(&dense->weights, i)[j]));
+    const T scale = largest > 0 ? largest / 127 : 1;
+
+    int32_t sum = 0;
+    for (size_t i = 0; i < inputs; i++) {
+      const int8_t w = (int8_t)lrint(
+          custom_math::matrix_row(&dense->weights, i)[j] / scale);
+      weights[i * outputs + j] = w;
+      sum += w;
+    }
+    layer->scales[j] = (float)(layer->input_scale * scale);
+    layer->offsets[j] = layer->input_zero * sum;
+    layer->bias[j] = (float)dense->bias[j];
+  }
+
+  custom_math::qgemm_pack(inputs, outputs, weights, outputs, layer->weights);
+  free(weights);
+  return true;
+}
+
+// Turns a block of the sums of a layer into its outputs, and quantizes them
+// into the inputs of the next layer, if any.
+typedef struct {
+  const QuantizedDense *layer;
+  const int32_t *sums;
+  const custom_math::MatrixF *outputs;
+  const QuantizedDense *next;
+  uint8_t *inputs;  // The inputs of the next layer.
+} QuantizedContext;
+
+void quantized_epilogue(void *context, size_t row, size_t col, size_t rows,
+                        size_t cols) {
+  const QuantizedContext *quantized = (const QuantizedContext *)context;
+  const QuantizedDense *layer = quantized->layer;
+
+  for (size_t i = row; i < row + rows; i++) {
+    const int32_t *sums = quantized->sums + i * layer->outputs + col;
+    float *output = custom_math::matrix_row(quantized->outputs, i) + col;
+    for (size_t j = 0; j < cols; j++)
+      output[j] = layer->scales[col + j] *
+                      (float)(sums[j] - layer->offsets[col + j]) +
+                  layer->bias[col + j];
+
+    if (layer->activated)
+      custom_math::activation_forward(&layer->activation, output, output,
+                                      cols);
+    const QuantizedDense *next = quantized->next;
+    if (next != nullptr)
+      quantize_row(quantized->inputs + i * next->inputs + col, output, cols,
+                   next->input_scale, next->input_zero);
+  }
+}
+
+}  // namespace
+
+template <typename T>
+QuantizedNetwork *quantize_network(const BasicNetwork<T> *network,
+                                   const images::BasicDataset<T> *calibration,
+                                   size_t count) {
+  if (network == nullptr || calibration == nullptr ||
+      calibration->samples.cols != network->layers[0].inputs)
+    return nullptr;
+  if (count == 0 || count > calibration->count) count = calibration->count;
+  if (count == 0) return nullptr;
+
+  // The ranges of the inputs of the layers, 0 included so that it is
+  // represented exactly, e.g. the padding of a ReLU.
+  Range ranges[NETWORK_MAX_LAYERS];
+  for (size_t l = 0; l < network->count; l++) ranges[l] = {0, 0};
+
+  BasicWorkspace<T> *workspace = workspace_create(
+      network, count < CALIBRATION_BATCH ? count : CALIBRATION_BATCH);
+  if (workspace == nullptr) return nullptr;
+
+  for (size_t first = 0; first < count; first += workspace->capacity) {
+    images::BasicBatch<T> batch = images::dataset_batch(
+        calibration, first,
+        count - first < workspace->capacity ? count - first
+                                            : workspace->capacity);
+    network_forward(network, workspace, &batch.samples);
+    update_range(&ranges[0], &batch.samples);
+    for (size_t l = 1; l < network->count; l++)
+      update_range(&ranges[l], &workspace->a[l - 1]);
+  }
+  workspace_delete(workspace);
+
+  size_t block = align(sizeof(QuantizedNetwork));
+  for (size_t l = 0; l < network->count; l++)
+    block += layer_block(network->layers[l].inputs,
+                         network->layers[l].outputs);
+
+  custom_math::Allocator *allocator = custom_math::allocator_get_default();
+  QuantizedNetwork *quantized =
+      (QuantizedNetwork *)custom_math::allocator_allocate(allocator, block);
+  if (quantized == nullptr) return nullptr;
+
+  memset(quantized, 0, sizeof(QuantizedNetwork));
+  quantized->count = network->count;
+  quantized->allocator = allocator;
+  quantized->block = block;
+
+  char *next = (char *)quantized + align(sizeof(QuantizedNetwork));
+  for (size_t l = 0; l < network->count; l++) {
+    const BasicDense<T> *dense = &network->layers[l];
+    if (!quantize_layer(dense, &ranges[l], &quantized->layers[l], next)) {
+      quantized_delete(quantized);
+      return nullptr;
+    }
+    next += layer_block(dense->inputs, dense->outputs);
+  }
+
+  return quantized;
+}
+
+void quantized_delete(QuantizedNetwork *network) {
+  if (network == nullptr) return;
+  custom_math::allocator_deallocate(network->allocator, network,
+                                    network->block);
+}
+
+QuantizedWorkspace *quantized_workspace_create(
+    const QuantizedNetwork *network, size_t capacity) {
+  if (network == nullptr || capacity == 0) return nullptr;
+
+  size_t width = 0;
+  size_t block = align(sizeof(QuantizedWorkspace));
+  for (size_t l = 0; l < network->count; l++) {
+    const QuantizedDense *layer = &network->layers[l];
+    if (layer->outputs > width) width = layer->outputs;
+    block += align(capacity * layer->inputs);
+  }
+  block += 2 * align(capacity * width * sizeof(float));
+
+  custom_math::Allocator *allocator = custom_math::allocator_get_default();
+  QuantizedWorkspace *workspace =
+      (QuantizedWorkspace *)custom_math::allocator_allocate(allocator, block);
+  if (workspace == nullptr) return nullptr;
+
+  memset(workspace, 0, sizeof(QuantizedWorkspace));
+  workspace->capacity = capacity;
+  workspace->allocator = allocator;
+  workspace->block = block;
+
+  char *next = (char *)workspace + align(sizeof(QuantizedWorkspace));
+  for (size_t l = 0; l < network->count; l++) {
+    workspace->inputs[l] = (uint8_t *)next;
+    next += align(capacity * network->layers[l].inputs);
+  }
+  workspace->sums = (int32_t *)next;
+  next += align(capacity * width * sizeof(float));
+  const custom_math::MatrixF outputs = {capacity, width, width, (float *)next,
+                                        nullptr};
+  workspace->outputs = outputs;
+  workspace->logits = outputs;
+
+  return workspace;
+}
+
+void quantized_workspace_delete(QuantizedWorkspace *workspace) {
+  if (workspace == nullptr) return;
+  custom_math::allocator_deallocate(workspace->allocator, workspace,
+                                    workspace->block);
+}
+
+template <typename T>
+const custom_math::MatrixF *quantized_forward(
+    const QuantizedNetwork *network, QuantizedWorkspace *workspace,
+    const custom_math::BasicMatrix<T> *inputs) {
+  if (inputs == nullptr || inputs->rows == 0 ||
+      inputs->rows > workspace->capacity ||
+      inputs->cols != network->layers[0].inputs)
+    return nullptr;
+
+  const size_t rows = inputs->rows;
+  const QuantizedDense *first = &network->layers[0];
+  for (size_t i = 0; i < rows; i++)
+    quantize_row(workspace->inputs[0] + i * first->inputs,
+                 custom_math::matrix_row(inputs, i), first->inputs,
+                 first->input_scale, first->input_zero);
+
+  for (size_t l = 0; l < network->count; l++) {
+    const QuantizedDense *layer = &network->layers[l];
+    const bool last = l + 1 == network->count;
+
+    QuantizedContext context = {
+        layer, workspace->sums, &workspace->outputs,
+        last ? nullptr : &network->layers[l + 1],
+        last ? nullptr : workspace->inputs[l + 1]};
+    custom_math::GemmEpilogue epilogue = {quantized_epilogue, &context};
+    custom_math::qgemm(rows, layer->outputs, layer->inputs,
+                       workspace->inputs[l], layer->inputs, layer->weights,
+                       workspace->sums, layer->outputs, &epilogue);
+  }
+
+  workspace->logits.rows = rows;
+  workspace->logits.cols = network->layers[network->count - 1].outputs;
+  return &workspace->logits;
+}
+
+template <typename T>
+double quantized_accuracy(const QuantizedNetwork *network,
+                          QuantizedWorkspace *workspace,
+                          const images::BasicDataset<T> *dataset) {
+  size_t correct = 0;
+
+  for (size_t first = 0; first < dataset->count;
+       first += workspace->capacity) {
+    images::BasicBatch<T> batch =
+        images::dataset_batch(dataset, first, workspace->capacity);
+    const custom_math::MatrixF *logits =
+        quantized_forward(network, workspace, &batch.samples);
+    if (logits == nullptr) return 0;
+
+    correct +=
+        custom_math::softmax_cross_entropy(logits, batch.labels).correct;
+  }
+
+  return dataset->count > 0 ? (double)correct / (double)dataset->count : 0;
+}
+
+size_t quantized_size(const QuantizedNetwork *network) {
+  size_t size = 0;
+  for (size_t l = 0; l < network->count; l++) {
+    const QuantizedDense *layer = &network->layers[l];
+    size += layer->inputs * layer->outputs +
+            layer->outputs *
+                (sizeof(float) + sizeof(int32_t) + sizeof(float));
+  }
+  return size;
+}
+
+#define INSTANTIATE_QUANTIZE(T)                                             \
+  template QuantizedNetwork *quantize_network<T>(                           \
+      const BasicNetwork<T> *, const images::BasicDataset<T> *, size_t);    \
+  template const custom_math::MatrixF *quantized_forward<T>(                \
+      const QuantizedNetwork *, QuantizedWorkspace *,                       \
+      const custom_math::BasicMatrix<T> *);                                 \
+  template double quantized_accuracy<T>(const QuantizedNetwork *,           \
+                                        QuantizedWorkspace *,               \
+                                        const images::BasicDataset<T> *);
+
+INSTANTIATE_QUANTIZE(float)
+INSTANTIATE_QUANTIZE(double)
+
+#undef INSTANTIATE_QUANTIZE
+
+}  // namespace neural
@@ -0,0 +1,345 @@
+/**
+ * @file server.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the inference server
+ *        declared in server.hpp.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "server.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "simd.hpp"
+
+namespace neural {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  ServerCallback done;
+  void *context;
+  Clock::time_point submitted;
+} Request;
+
+}  // namespace
+
+// The queue is a ring of options.queue slots, each holding the pixels of a
+// request. The requests of the running batch stay queued until they are
+// answered, so that their slots are not reused.
+template <typename T>
+struct BasicServer {
+  const BasicNetwork<T> *network;
+  const QuantizedNetwork *quantized;  // Used instead of network, if any.
+  ServerOptions options;
+  size_t features;  // The number of pixels of a request.
+  BasicWorkspace<T> *workspace;
+  QuantizedWorkspace *quantized_workspace;
+  custom_math::BasicMatrix<T> *batch;
+
+  uint8_t *pixels;
+  Request *requests;
+  size_t head;   // The oldest request queued.
+  size_t count;  // The number of requests queued.
+  size_t submitted;
+  size_t answered;
+  double *times;  // The latencies of the running batch.
+  bool stopped;
+
+  // The statistics of the interval, whose latencies are a ring of the last
+  // SERVER_LATENCY_WINDOW ones.
+  size_t interval_requests;
+  size_t interval_batches;
+  double *latencies;
+  bool started;
+  Clock::time_point start;  // The start of the interval.
+  Clock::time_point last;   // The last answer.
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+};
+
+namespace {
+
+// The index of the largest logit.
+template <typename T>
+int argmax(const T *logits, size_t count) {
+  size_t best = 0;
+  for (size_t j = 1; j < count; j++)
+    if (logits[j] > logits[best]) best = j;
+  return (int)best;
+}
+
+// Runs the forward pass of the requests [head, head + size) of the queue and
+// answers them.
+template <typename T>
+void run_batch(BasicServer<T> *server, size_t head, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    const size_t slot = (head + i) % server->options.queue;
+    custom_math::simd_convert_bytes(
+        custom_math::matrix_row(server->batch, i),
+        server->pixels + slot * server->features, (T)(1 / 255.), (T)0,
+        server->features);
+  }
+
+  const custom_math::BasicMatrix<T> samples =
+      custom_math::matrix_view_rows(server->batch, 0, size);
+  const custom_math::BasicMatrix<T> *logits = nullptr;
+  const custom_math::MatrixF *quantized = nullptr;
+  if (server->quantized != nullptr)
+    quantized = quantized_forward(server->quantized,
+                                  server->quantized_workspace, &samples);
+  else
+    logits = network_forward(server->network, server->workspace, &samples);
+
+  const Clock::time_point now = Clock::now();
+  for (size_t i = 0; i < size; i++) {
+    const Request *request =
+        &server->requests[(head + i) % server->options.queue];
+    request->done(
+        request->context,
+        quantized != nullptr
+            ? argmax(custom_math::matrix_row(quantized, i), quantized->cols)
+            : argmax(custom_math::matrix_row(logits, i), logits->cols));
+    server->times[i] =
+        std::chrono::duration<double>(now - request->submitted).count();
+  }
+}
+
+template <typename T>
+void serve(BasicServer<T> *server) {
+  const Clock::duration delay =
+      std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(server->options.max_delay));
+  std::unique_lock<std::mutex> lock(server->mutex);
+
+  for (;;) {
+    server->changed.wait(
+        lock, [server] { return server->stopped || server->count > 0; });
+    if (server->count == 0) return;
+
+    // A full batch runs at once, a partial one when its oldest request is
+    // due, or when the server stops.
+    const Clock::time_point deadline =
+        server->requests[server->head].submitted + delay;
+    server->changed.wait_until(lock, deadline, [server] {
+      return server->stopped || server->count >= server->options.max_batch;
+    });
+
+    const size_t head = server->head;
+    const size_t size = std::min(server->count, server->options.max_batch);
+    lock.unlock();
+    run_batch(server, head, size);
+    lock.lock();
+
+    for (size_t i = 0; i < size; i++)
+      server->latencies[(server->interval_requests + i) %
+                        SERVER_LATENCY_WINDOW] = server->times[i];
+    server->interval_requests += size;
+    server->interval_batches++;
+    server->head = (head + size) % server->options.queue;
+    server->count -= size;
+    server->answered += size;
+    server->last = Clock::now();
+    server->changed.notify_all();
+  }
+}
+
+// The latency below which a fraction of the sorted latencies are.
+double percentile(const std::vector<double> &sorted, double fraction) {
+  size_t rank = (size_t)ceil(fraction * (double)sorted.size());
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+}  // namespace
+
+ServerOptions server_default_options() {
+  ServerOptions options;
+  options.max_batch = 64;
+  options.max_delay = 0.001;
+  options.queue = 1024;
+  return options;
+}
+
+template <typename T>
+BasicServer<T> *server_create(const BasicNetwork<T> *network,
+                              const ServerOptions *options,
+                              const QuantizedNetwork *quantized) {
+  ServerOptions defaults = server_default_options();
+  if (options == nullptr) options = &defaults;
+  if (network == nullptr || options->max_batch == 0 ||
+      options->queue < options->max_batch || !(options->max_delay >= 0) ||
+      (quantized != nullptr &&
+       quantized->layers[0].inputs != network->layers[0].inputs))
+    return nullptr;
+
+  BasicServer<T> *server = new (std::nothrow) BasicServer<T>();
+  if (server == nullptr) return nullptr;
+
+  server->network = network;
+  server->quantized = quantized;
+  server->options = *options;
+  server->features = network->layers[0].inputs;
+  server->workspace = workspace_create(network, options->max_batch);
+  server->quantized_workspace =
+      quantized != nullptr
+          ? quantized_workspace_create(quantized, options->max_batch)
+          : nullptr;
+  server->batch = custom_math::matrix_create<T>((int)options->max_batch,
+                                                (int)server->features);
+  server->pixels = (uint8_t *)malloc(options->queue * server->features);
+  server->requests = (Request *)malloc(options->queue * sizeof(Request));
+  server->times = (double *)malloc(options->max_batch * sizeof(double));
+  server->head = 0;
+  server->count = 0;
+  server->submitted = 0;
+  server->answered = 0;
+  server->stopped = false;
+  server->interval_requests = 0;
+  server->interval_batches = 0;
+  server->latencies =
+      (double *)malloc(SERVER_LATENCY_WINDOW * sizeof(double));
+  server->started = false;
+
+  if (server->workspace == nullptr || server->batch == nullptr ||
+      server->pixels == nullptr || server->requests == nullptr ||
+      server->times == nullptr || server->latencies == nullptr ||
+      (quantized != nullptr && server->quantized_workspace == nullptr)) {
+    workspace_delete(server->workspace);
+    quantized_workspace_delete(server->quantized_workspace);
+    custom_math::matrix_delete(server->batch);
+    free(server->pixels);
+    free(server->requests);
+    free(server->times);
+    free(server->latencies);
+    delete server;
+    return nullptr;
+  }
+
+  server->thread = std::thread(serve<T>, server);
+  return server;
+}
+
+template <typename T>
+bool server_submit(BasicServer<T> *server, const uint8_t *pixels,
+                   ServerCallback done, void *context) {
+  std::unique_lock<std::mutex> lock(server->mutex);
+  server->changed.wait(lock, [server] {
+    return server->stopped || server->count < server->options.queue;
+  });
+  if (server->stopped) return false;
+
+  const size_t slot = (server->head + server->count) % server->options.queue;
+  memcpy(server->pixels + slot * server->features, pixels, server->features);
+  Request *request = &server->requests[slot];
+  request->done = done;
+  request->context = context;
+  request->submitted = Clock::now();
+  if (!server->started) {
+    server->start = request->submitted;
+    server->started = true;
+  }
+
+  server->count++;
+  server->submitted++;
+  server->changed.notify_all();
+  return true;
+}
+
+template <typename T>
+void server_flush(BasicServer<T> *server) {
+  std::unique_lock<std::mutex> lock(server->mutex);
+  const size_t submitted = server->submitted;
+  server->changed.wait(
+      lock, [server, submitted] { return server->answered >= submitted; });
+}
+
+template <typename T>
+ServerStats server_stats(BasicServer<T> *server, bool reset) {
+  ServerStats stats;
+  memset(&stats, 0, sizeof(stats));
+  std::vector<double> sorted;
+  {
+    std::lock_guard<std::mutex> lock(server->mutex);
+    if (server->interval_requests > 0) {
+      stats.requests = server->interval_requests;
+      stats.batches = server->interval_batches;
+      const double seconds =
+          std::chrono::duration<double>(server->last - server->start)
+              .count();
+      stats.throughput =
+          seconds > 0 ? (double)stats.requests / seconds : 0;
+      sorted.assign(server->latencies,
+                    server->latencies +
+                        std::min(stats.requests,
+                                 (size_t)SERVER_LATENCY_WINDOW));
+    }
+    if (reset) {
+      server->interval_requests = 0;
+      server->interval_batches = 0;
+      server->start = Clock::now();
+      server->started = true;
+    }
+  }
+  if (sorted.empty()) return stats;
+
+  std::sort(sorted.begin(), sorted.end());
+  stats.p50 = percentile(sorted, 0.5);
+  stats.p99 = percentile(sorted, 0.99);
+  return stats;
+}
+
+template <typename T>
+void server_delete(BasicServer<T> *server) {
+  if (server == nullptr) return;
+
+  {
+    std::lock_guard<std::mutex> lock(server->mutex);
+    server->stopped = true;
+    server->changed.notify_all();
+  }
+  server->thread.join();
+
+  workspace_delete(server->workspace);
+  quantized_workspace_delete(server->quantized_workspace);
+  custom_math::matrix_delete(server->batch);
+  free(server->pixels);
+  free(server->requests);
+  free(server->times);
+  free(server->latencies);
+  delete server;
+}
+
+#define INSTANTIATE_SERVER(T)                                                \
+  template BasicServer<T> *server_create<T>(                                 \
+      const BasicNetwork<T> *, const ServerOptions *,                        \
+      const QuantizedNetwork *);                                             \
+  template bool server_submit<T>(BasicServer<T> *, const uint8_t *,          \
+                                 ServerCallback, void *);                    \
+  template void server_flush<T>(BasicServer<T> *);                           \
+  template ServerStats server_stats<T>(BasicServer<T> *, bool);              \
+  template void server_delete<T>(BasicServer<T> *);
+
+INSTANTIATE_SERVER(float)
+INSTANTIATE_SERVER(double)
+
+#undef INSTANTIATE_SERVER
+
+}  // namespace neural
@@ -0,0 +1,958 @@
+/**
+ * @file simd.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the vectorized kernels
+ *        declared in simd.hpp.
+ * @version 1.0
+ * @date 2023-07-22
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace custom_math {
+
+namespace {
+
+template <typename T>
+struct Kernels {
+  void (*add)(T *dst, const T *a, const T *b, size_t size);
+  void (*sub)(T *dst, const T *a, const T *b, size_t size);
+  void (*scale)(T *dst, const T *a, T scalar, size_t size);
+  void (*copy)(T *dst, const T *src, size_t size);
+  void (*fill)(T *dst, T value, size_t size);
+  void (*convert_bytes)(T *dst, const uint8_t *src, T scale, T shift,
+                        size_t size);
+  void (*resample)(T *dst, const T *src, size_t stride, const T *x,
+                   const T *y, size_t size);
+};
+
+// Scalar kernels, these are the portable fallback.
+
+template <typename T>
+void add_scalar(T *dst, const T *a, const T *b, size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = a[i] + b[i];
+}
+
+template <typename T>
+void sub_scalar(T *dst, const T *a, const T *b, size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = a[i] - b[i];
+}
+
+template <typename T>
+void scale_scalar(T *dst, const T *a, T scalar, size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = a[i] * scalar;
+}
+
+template <typename T>
+void copy_scalar(T *dst, const T *src, size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = src[i];
+}
+
+template <typename T>
+void fill_scalar(T *dst, T value, size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = value;
+}
+
+template <typename T>
+void convert_bytes_scalar(T *dst, const uint8_t *src, T scale, T shift,
+                          size_t size) {
+  for (size_t i = 0; i < size; i++) dst[i] = (T)src[i] * scale + shift;
+}
+
+template <typename T>
+void resample_scalar(T *dst, const T *src, size_t stride, const T *x,
+                     const T *y, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    const size_t x0 = (size_t)x[i], y0 = (size_t)y[i];
+    const T fx = x[i] - (T)x0, fy = y[i] - (T)y0;
+    const T *p = src + y0 * stride + x0;
+    const T top = p[0] + (p[1] - p[0]) * fx;
+    const T bottom = p[stride] + (p[stride + 1] - p[stride]) * fx;
+    dst[i] = top + (bottom - top) * fy;
+  }
+}
+
+template <typename T>
+const Kernels<T> *scalar_kernels() {
+  static const Kernels<T> kernels = {add_scalar<T>,   sub_scalar<T>,
+                                     scale_scalar<T>, copy_scalar<T>,
+                                     fill_scalar<T>,  convert_bytes_scalar<T>,
+                                     resample_scalar<T>};
+  return &kernels;
+}
+
+#ifdef SIMD_X86
+
+// SSE2 kernels, 2 doubles per register.
+
+__attribute__((target("sse2"))) void add_sse2(double *dst, const double *a,
+                                               const double *b, size_t size) {
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2)
+    _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  for (; i < size; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("sse2"))) void sub_sse2(double *dst, const double *a,
+                                               const double *b, size_t size) {
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2)
+    _mm_storeu_pd(dst + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  for (; i < size; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("sse2"))) void scale_sse2(double *dst, const double *a,
+                                                 double scalar, size_t size) {
+  const __m128d s = _mm_set1_pd(scalar);
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2)
+    _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), s));
+  for (; i < size; i++) dst[i] = a[i] * scalar;
+}
+
+__attribute__((target("sse2"))) void copy_sse2(double *dst, const double *src,
+                                                size_t size) {
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2) _mm_storeu_pd(dst + i, _mm_loadu_pd(src + i));
+  for (; i < size; i++) dst[i] = src[i];
+}
+
+__attribute__((target("sse2"))) void fill_sse2(double *dst, double value,
+                                                size_t size) {
+  const __m128d v = _mm_set1_pd(value);
+  size_t i = 0;
+  for (; i + 2 <= size; i += 2) _mm_storeu_pd(dst + i, v);
+  for (; i < size; i++) dst[i] = value;
+}
+
+// The bytes are widened with unpacks, SSE2 has no zero-extending moves.
+__attribute__((target("sse2"))) void convert_bytes_sse2(double *dst,
+                                                         const uint8_t *src,
+                                                         double scale,
+                                                         double shift,
+                                                         size_t size) {
+  const __m128d s = _mm_set1_pd(scale);
+  const __m128d t = _mm_set1_pd(shift);
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m128i words = _mm_unpacklo_epi8(
+        _mm_loadl_epi64((const __m128i *)(src + i)), zero);
+    __m128i low = _mm_unpacklo_epi16(words, zero);
+    __m128i high = _mm_unpackhi_epi16(words, zero);
+    _mm_storeu_pd(dst + i, _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(low), s), t));
+    _mm_storeu_pd(dst + i + 2,
+                  _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(
+                                            _mm_unpackhi_epi64(low, low)),
+                                        s),
+                             t));
+    _mm_storeu_pd(dst + i + 4,
+                  _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(high), s), t));
+    _mm_storeu_pd(dst + i + 6,
+                  _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(
+                                            _mm_unpackhi_epi64(high, high)),
+                                        s),
+                             t));
+  }
+  for (; i < size; i++) dst[i] = (double)src[i] * scale + shift;
+}
+
+// SSE2 has no gathers, the resampling is the scalar one.
+const Kernels<double> sse2_kernels = {add_sse2,
+                                      sub_sse2,
+                                      scale_sse2,
+                                      copy_sse2,
+                                      fill_sse2,
+                                      convert_bytes_sse2,
+                                      resample_scalar<double>};
+
+// AVX2 kernels, 4 doubles per register and two registers per iteration.
+
+__attribute__((target("avx2"))) void add_avx2(double *dst, const double *a,
+                                               const double *b, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i),
+                                            _mm256_loadu_pd(b + i)));
+    _mm256_storeu_pd(dst + i + 4, _mm256_add_pd(_mm256_loadu_pd(a + i + 4),
+                                                _mm256_loadu_pd(b + i + 4)));
+  }
+  for (; i < size; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2"))) void sub_avx2(double *dst, const double *a,
+                                               const double *b, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_sub_pd(_mm256_loadu_pd(a + i),
+                                            _mm256_loadu_pd(b + i)));
+    _mm256_storeu_pd(dst + i + 4, _mm256_sub_pd(_mm256_loadu_pd(a + i + 4),
+                                                _mm256_loadu_pd(b + i + 4)));
+  }
+  for (; i < size; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("avx2"))) void scale_avx2(double *dst, const double *a,
+                                                 double scalar, size_t size) {
+  const __m256d s = _mm256_set1_pd(scalar);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), s));
+    _mm256_storeu_pd(dst + i + 4, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), s));
+  }
+  for (; i < size; i++) dst[i] = a[i] * scalar;
+}
+
+__attribute__((target("avx2"))) void copy_avx2(double *dst, const double *src,
+                                                size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_loadu_pd(src + i));
+    _mm256_storeu_pd(dst + i + 4, _mm256_loadu_pd(src + i + 4));
+  }
+  for (; i < size; i++) dst[i] = src[i];
+}
+
+__attribute__((target("avx2"))) void fill_avx2(double *dst, double value,
+                                                size_t size) {
+  const __m256d v = _mm256_set1_pd(value);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) _mm256_storeu_pd(dst + i, v);
+  for (; i < size; i++) dst[i] = value;
+}
+
+__attribute__((target("avx2"))) void convert_bytes_avx2(double *dst,
+                                                         const uint8_t *src,
+                                                         double scale,
+                                                         double shift,
+                                                         size_t size) {
+  const __m256d s = _mm256_set1_pd(scale);
+  const __m256d t = _mm256_set1_pd(shift);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256i ints = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64((const __m128i *)(src + i)));
+    __m256d low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(ints));
+    __m256d high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(ints, 1));
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_mul_pd(low, s), t));
+    _mm256_storeu_pd(dst + i + 4, _mm256_add_pd(_mm256_mul_pd(high, s), t));
+  }
+  for (; i < size; i++) dst[i] = (double)src[i] * scale + shift;
+}
+
+// The four neighbours of every pixel are gathered, the right ones from src + 1
+// with the same indices.
+__attribute__((target("avx2"))) void resample_avx2(double *dst,
+                                                    const double *src,
+                                                    size_t stride,
+                                                    const double *x,
+                                                    const double *y,
+                                                    size_t size) {
+  const __m128i s = _mm_set1_epi32((int)stride);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m256d vx = _mm256_loadu_pd(x + i), vy = _mm256_loadu_pd(y + i);
+    const __m128i x0 = _mm256_cvttpd_epi32(vx), y0 = _mm256_cvttpd_epi32(vy);
+    const __m256d fx = _mm256_sub_pd(vx, _mm256_cvtepi32_pd(x0));
+    const __m256d fy = _mm256_sub_pd(vy, _mm256_cvtepi32_pd(y0));
+    const __m128i index = _mm_add_epi32(_mm_mullo_epi32(y0, s), x0);
+    const __m128i below = _mm_add_epi32(index, s);
+
+    __m256d a = _mm256_i32gather_pd(src, index, 8);
+    __m256d b = _mm256_i32gather_pd(src + 1, index, 8);
+    __m256d c = _mm256_i32gather_pd(src, below, 8);
+    __m256d d = _mm256_i32gather_pd(src + 1, below, 8);
+    __m256d top = _mm256_add_pd(a, _mm256_mul_pd(_mm256_sub_pd(b, a), fx));
+    __m256d bottom = _mm256_add_pd(c, _mm256_mul_pd(_mm256_sub_pd(d, c), fx));
+    _mm256_storeu_pd(
+        dst + i,
+        _mm256_add_pd(top, _mm256_mul_pd(_mm256_sub_pd(bottom, top), fy)));
+  }
+  resample_scalar(dst + i, src, stride, x + i, y + i, size - i);
+}
+
+const Kernels<double> avx2_kernels = {add_avx2,
+                                      sub_avx2,
+                                      scale_avx2,
+                                      copy_avx2,
+                                      fill_avx2,
+                                      convert_bytes_avx2,
+                                      resample_avx2};
+
+// AVX-512 kernels, 8 doubles per register. The tail is handled with a mask
+// instead of a scalar loop.
+
+inline __attribute__((target("avx512f"))) __mmask8 tail_mask(size_t size) {
+  return (__mmask8)((1u << size) - 1);
+}
+
+__attribute__((target("avx512f"))) void add_avx512(double *dst,
+                                                    const double *a,
+                                                    const double *b,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(a + i),
+                                            _mm512_loadu_pd(b + i)));
+  if (i < size) {
+    __mmask8 mask = tail_mask(size - i);
+    _mm512_mask_storeu_pd(dst + i, mask,
+                          _mm512_add_pd(_mm512_maskz_loadu_pd(mask, a + i),
+                                        _mm512_maskz_loadu_pd(mask, b + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void sub_avx512(double *dst,
+                                                    const double *a,
+                                                    const double *b,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_sub_pd(_mm512_loadu_pd(a + i),
+                                            _mm512_loadu_pd(b + i)));
+  if (i < size) {
+    __mmask8 mask = tail_mask(size - i);
+    _mm512_mask_storeu_pd(dst + i, mask,
+                          _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i),
+                                        _mm512_maskz_loadu_pd(mask, b + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void scale_avx512(double *dst,
+                                                      const double *a,
+                                                      double scalar,
+                                                      size_t size) {
+  const __m512d s = _mm512_set1_pd(scalar);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), s));
+  if (i < size) {
+    __mmask8 mask = tail_mask(size - i);
+    _mm512_mask_storeu_pd(dst + i, mask,
+                          _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, a + i), s));
+  }
+}
+
+__attribute__((target("avx512f"))) void copy_avx512(double *dst,
+                                                     const double *src,
+                                                     size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_loadu_pd(src + i));
+  if (i < size) {
+    __mmask8 mask = tail_mask(size - i);
+    _mm512_mask_storeu_pd(dst + i, mask, _mm512_maskz_loadu_pd(mask, src + i));
+  }
+}
+
+__attribute__((target("avx512f"))) void fill_avx512(double *dst, double value,
+                                                     size_t size) {
+  const __m512d v = _mm512_set1_pd(value);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) _mm512_storeu_pd(dst + i, v);
+  if (i < size) _mm512_mask_storeu_pd(dst + i, tail_mask(size - i), v);
+}
+
+// Masked byte loads need AVX-512BW, so the tail is a scalar loop. AVX-512F
+// has fused multiply-adds, which the compiler uses for the tail too.
+__attribute__((target("avx512f"))) void convert_bytes_avx512(
+    double *dst, const uint8_t *src, double scale, double shift, size_t size) {
+  const __m512d s = _mm512_set1_pd(scale);
+  const __m512d t = _mm512_set1_pd(shift);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d x = _mm512_cvtepi32_pd(
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i))));
+    _mm512_storeu_pd(dst + i, _mm512_fmadd_pd(x, s, t));
+  }
+  for (; i < size; i++) dst[i] = (double)src[i] * scale + shift;
+}
+
+// The lanes of the tail read x = y = 0, whose neighbours are in the image.
+__attribute__((target("avx512f"))) void resample_avx512(
+    double *dst, const double *src, size_t stride, const double *x,
+    const double *y, size_t size) {
+  const __m256i s = _mm256_set1_epi32((int)stride);
+  for (size_t i = 0; i < size; i += 8) {
+    const __mmask8 mask = size - i >= 8 ? (__mmask8)0xFF : tail_mask(size - i);
+    const __m512d vx = _mm512_maskz_loadu_pd(mask, x + i);
+    const __m512d vy = _mm512_maskz_loadu_pd(mask, y + i);
+    const __m256i x0 = _mm512_cvttpd_epi32(vx), y0 = _mm512_cvttpd_epi32(vy);
+    const __m512d fx = _mm512_sub_pd(vx, _mm512_cvtepi32_pd(x0));
+    const __m512d fy = _mm512_sub_pd(vy, _mm512_cvtepi32_pd(y0));
+    const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y0, s), x0);
+    const __m256i below = _mm256_add_epi32(index, s);
+
+    __m512d a = _mm512_i32gather_pd(index, src, 8);
+    __m512d b = _mm512_i32gather_pd(index, src + 1, 8);
+    __m512d c = _mm512_i32gather_pd(below, src, 8);
+    __m512d d = _mm512_i32gather_pd(below, src + 1, 8);
+    __m512d top = _mm512_fmadd_pd(_mm512_sub_pd(b, a), fx, a);
+    __m512d bottom = _mm512_fmadd_pd(_mm512_sub_pd(d, c), fx, c);
+    _mm512_mask_storeu_pd(dst + i, mask,
+                          _mm512_fmadd_pd(_mm512_sub_pd(bottom, top), fy, top));
+  }
+}
+
+const Kernels<double> avx512_kernels = {
+    add_avx512,  sub_avx512,           scale_avx512,   copy_avx512,
+    fill_avx512, convert_bytes_avx512, resample_avx512};
+
+// The same kernels for floats.
+
+// SSE2 kernels, 4 floats per register.
+
+__attribute__((target("sse2"))) void add_sse2(float *dst, const float *a,
+                                               const float *b, size_t size) {
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  for (; i < size; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("sse2"))) void sub_sse2(float *dst, const float *a,
+                                               const float *b, size_t size) {
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    _mm_storeu_ps(dst + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  for (; i < size; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("sse2"))) void scale_sse2(float *dst, const float *a,
+                                                 float scalar, size_t size) {
+  const __m128 s = _mm_set1_ps(scalar);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4)
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(a + i), s));
+  for (; i < size; i++) dst[i] = a[i] * scalar;
+}
+
+__attribute__((target("sse2"))) void copy_sse2(float *dst, const float *src,
+                                                size_t size) {
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) _mm_storeu_ps(dst + i, _mm_loadu_ps(src + i));
+  for (; i < size; i++) dst[i] = src[i];
+}
+
+__attribute__((target("sse2"))) void fill_sse2(float *dst, float value,
+                                                size_t size) {
+  const __m128 v = _mm_set1_ps(value);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) _mm_storeu_ps(dst + i, v);
+  for (; i < size; i++) dst[i] = value;
+}
+
+__attribute__((target("sse2"))) void convert_bytes_sse2(float *dst,
+                                                         const uint8_t *src,
+                                                         float scale,
+                                                         float shift,
+                                                         size_t size) {
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 t = _mm_set1_ps(shift);
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    __m128i ints[4] = {
+        _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+        _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)};
+    for (int k = 0; k < 4; k++)
+      _mm_storeu_ps(dst + i + 4 * k,
+                    _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(ints[k]), s), t));
+  }
+  for (; i < size; i++) dst[i] = (float)src[i] * scale + shift;
+}
+
+const Kernels<float> sse2_kernels_f = {add_sse2,
+                                       sub_sse2,
+                                       scale_sse2,
+                                       copy_sse2,
+                                       fill_sse2,
+                                       convert_bytes_sse2,
+                                       resample_scalar<float>};
+
+// AVX2 kernels, 8 floats per register and two registers per iteration.
+
+__attribute__((target("avx2"))) void add_avx2(float *dst, const float *a,
+                                               const float *b, size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(a + i),
+                                            _mm256_loadu_ps(b + i)));
+    _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(a + i + 8),
+                                                _mm256_loadu_ps(b + i + 8)));
+  }
+  for (; i < size; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2"))) void sub_avx2(float *dst, const float *a,
+                                               const float *b, size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                            _mm256_loadu_ps(b + i)));
+    _mm256_storeu_ps(dst + i + 8, _mm256_sub_ps(_mm256_loadu_ps(a + i + 8),
+                                                _mm256_loadu_ps(b + i + 8)));
+  }
+  for (; i < size; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("avx2"))) void scale_avx2(float *dst, const float *a,
+                                                 float scalar, size_t size) {
+  const __m256 s = _mm256_set1_ps(scalar);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), s));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), s));
+  }
+  for (; i < size; i++) dst[i] = a[i] * scalar;
+}
+
+__attribute__((target("avx2"))) void copy_avx2(float *dst, const float *src,
+                                                size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src + i));
+    _mm256_storeu_ps(dst + i + 8, _mm256_loadu_ps(src + i + 8));
+  }
+  for (; i < size; i++) dst[i] = src[i];
+}
+
+__attribute__((target("avx2"))) void fill_avx2(float *dst, float value,
+                                                size_t size) {
+  const __m256 v = _mm256_set1_ps(value);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) _mm256_storeu_ps(dst + i, v);
+  for (; i < size; i++) dst[i] = value;
+}
+
+__attribute__((target("avx2"))) void convert_bytes_avx2(float *dst,
+                                                         const uint8_t *src,
+                                                         float scale,
+                                                         float shift,
+                                                         size_t size) {
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 t = _mm256_set1_ps(shift);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(src + i));
+    __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    __m256 high =
+        _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(low, s), t));
+    _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_mul_ps(high, s), t));
+  }
+  for (; i < size; i++) dst[i] = (float)src[i] * scale + shift;
+}
+
+__attribute__((target("avx2"))) void resample_avx2(float *dst,
+                                                    const float *src,
+                                                    size_t stride,
+                                                    const float *x,
+                                                    const float *y,
+                                                    size_t size) {
+  const __m256i s = _mm256_set1_epi32((int)stride);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i);
+    const __m256i x0 = _mm256_cvttps_epi32(vx), y0 = _mm256_cvttps_epi32(vy);
+    const __m256 fx = _mm256_sub_ps(vx, _mm256_cvtepi32_ps(x0));
+    const __m256 fy = _mm256_sub_ps(vy, _mm256_cvtepi32_ps(y0));
+    const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y0, s), x0);
+    const __m256i below = _mm256_add_epi32(index, s);
+
+    __m256 a = _mm256_i32gather_ps(src, index, 4);
+    __m256 b = _mm256_i32gather_ps(src + 1, index, 4);
+    __m256 c = _mm256_i32gather_ps(src, below, 4);
+    __m256 d = _mm256_i32gather_ps(src + 1, below, 4);
+    __m256 top = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fx));
+    __m256 bottom = _mm256_add_ps(c, _mm256_mul_ps(_mm256_sub_ps(d, c), fx));
+    _mm256_storeu_ps(
+        dst + i,
+        _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy)));
+  }
+  resample_scalar(dst + i, src, stride, x + i, y + i, size - i);
+}
+
+const Kernels<float> avx2_kernels_f = {add_avx2,
+                                       sub_avx2,
+                                       scale_avx2,
+                                       copy_avx2,
+                                       fill_avx2,
+                                       convert_bytes_avx2,
+                                       resample_avx2};
+
+// AVX-512 kernels, 16 floats per register. The tail is handled with a mask
+// instead of a scalar loop.
+
+inline __attribute__((target("avx512f"))) __mmask16 tail_mask16(size_t size) {
+  return (__mmask16)((1u << size) - 1);
+}
+
+__attribute__((target("avx512f"))) void add_avx512(float *dst, const float *a,
+                                                    const float *b,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(a + i),
+                                            _mm512_loadu_ps(b + i)));
+  if (i < size) {
+    __mmask16 mask = tail_mask16(size - i);
+    _mm512_mask_storeu_ps(dst + i, mask,
+                          _mm512_add_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                        _mm512_maskz_loadu_ps(mask, b + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void sub_avx512(float *dst, const float *a,
+                                                    const float *b,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(dst + i, _mm512_sub_ps(_mm512_loadu_ps(a + i),
+                                            _mm512_loadu_ps(b + i)));
+  if (i < size) {
+    __mmask16 mask = tail_mask16(size - i);
+    _mm512_mask_storeu_ps(dst + i, mask,
+                          _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                        _mm512_maskz_loadu_ps(mask, b + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void scale_avx512(float *dst,
+                                                      const float *a,
+                                                      float scalar,
+                                                      size_t size) {
+  const __m512 s = _mm512_set1_ps(scalar);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), s));
+  if (i < size) {
+    __mmask16 mask = tail_mask16(size - i);
+    _mm512_mask_storeu_ps(dst + i, mask,
+                          _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i), s));
+  }
+}
+
+__attribute__((target("avx512f"))) void copy_avx512(float *dst,
+                                                     const float *src,
+                                                     size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(dst + i, _mm512_loadu_ps(src + i));
+  if (i < size) {
+    __mmask16 mask = tail_mask16(size - i);
+    _mm512_mask_storeu_ps(dst + i, mask, _mm512_maskz_loadu_ps(mask, src + i));
+  }
+}
+
+__attribute__((target("avx512f"))) void fill_avx512(float *dst, float value,
+                                                     size_t size) {
+  const __m512 v = _mm512_set1_ps(value);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) _mm512_storeu_ps(dst + i, v);
+  if (i < size) _mm512_mask_storeu_ps(dst + i, tail_mask16(size - i), v);
+}
+
+__attribute__((target("avx512f"))) void convert_bytes_avx512(
+    float *dst, const uint8_t *src, float scale, float shift, size_t size) {
+  const __m512 s = _mm512_set1_ps(scale);
+  const __m512 t = _mm512_set1_ps(shift);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 x = _mm512_cvtepi32_ps(
+        _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(src + i))));
+    _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(x, s, t));
+  }
+  for (; i < size; i++) dst[i] = (float)src[i] * scale + shift;
+}
+
+__attribute__((target("avx512f"))) void resample_avx512(
+    float *dst, const float *src, size_t stride, const float *x,
+    const float *y, size_t size) {
+  const __m512i s = _mm512_set1_epi32((int)stride);
+  for (size_t i = 0; i < size; i += 16) {
+    const __mmask16 mask =
+        size - i >= 16 ? (__mmask16)0xFFFF : tail_mask16(size - i);
+    const __m512 vx = _mm512_maskz_loadu_ps(mask, x + i);
+    const __m512 vy = _mm512_maskz_loadu_ps(mask, y + i);
+    const __m512i x0 = _mm512_cvttps_epi32(vx), y0 = _mm512_cvttps_epi32(vy);
+    const __m512 fx = _mm512_sub_ps(vx, _mm512_cvtepi32_ps(x0));
+    const __m512 fy = _mm512_sub_ps(vy, _mm512_cvtepi32_ps(y0));
+    const __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(y0, s), x0);
+    const __m512i below = _mm512_add_epi32(index, s);
+
+    __m512 a = _mm512_i32gather_ps(index, src, 4);
+    __m512 b = _mm512_i32gather_ps(index, src + 1, 4);
+    __m512 c = _mm512_i32gather_ps(below, src, 4);
+    __m512 d = _mm512_i32gather_ps(below, src + 1, 4);
+    __m512 top = _mm512_fmadd_ps(_mm512_sub_ps(b, a), fx, a);
+    __m512 bottom = _mm512_fmadd_ps(_mm512_sub_ps(d, c), fx, c);
+    _mm512_mask_storeu_ps(dst + i, mask,
+                          _mm512_fmadd_ps(_mm512_sub_ps(bottom, top), fy, top));
+  }
+}
+
+const Kernels<float> avx512_kernels_f = {
+    add_avx512,  sub_avx512,           scale_avx512,   copy_avx512,
+    fill_avx512, convert_bytes_avx512, resample_avx512};
+
+#endif  // SIMD_X86
+
+// The kernel tables of every instruction set, for one element type.
+template <typename T>
+struct KernelTables;
+
+template <>
+struct KernelTables<double> {
+  static const Kernels<double> *for_isa(Isa isa) {
+#ifdef SIMD_X86
+    switch (isa) {
+      case ISA_AVX512:
+        return &avx512_kernels;
+      case ISA_AVX2:
+        return &avx2_kernels;
+      case ISA_SSE2:
+        return &sse2_kernels;
+      default:
+        break;
+    }
+#endif
+    return scalar_kernels<double>();
+  }
+};
+
+template <>
+struct KernelTables<float> {
+  static const Kernels<float> *for_isa(Isa isa) {
+#ifdef SIMD_X86
+    switch (isa) {
+      case ISA_AVX512:
+        return &avx512_kernels_f;
+      case ISA_AVX2:
+        return &avx2_kernels_f;
+      case ISA_SSE2:
+        return &sse2_kernels_f;
+      default:
+        break;
+    }
+#endif
+    return scalar_kernels<float>();
+  }
+};
+
+// The active instruction set and its kernels. They are set the first time a
+// kernel runs, which avoids depending on the static initialization order.
+Isa &active_isa() {
+  static Isa isa = simd_detect();
+  return isa;
+}
+
+template <typename T>
+const Kernels<T> *&active_kernels() {
+  static const Kernels<T> *kernels = KernelTables<T>::for_isa(active_isa());
+  return kernels;
+}
+
+// Arrays smaller than this are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = 1 << 16;
+
+// Splits [0, size) into one contiguous chunk per thread and calls
+// kernel(offset, count) on each of them.
+template <typename Kernel>
+void run_parallel(size_t size, Kernel kernel) {
+#ifdef USE_OPENMP
+  if (size >= PARALLEL_THRESHOLD && omp_get_max_threads() > 1 &&
+      !omp_in_parallel()) {
+#pragma omp parallel
+    {
+      size_t threads = (size_t)omp_get_num_threads();
+      size_t id = (size_t)omp_get_thread_num();
+      // Keep the chunks a multiple of a cache line, for floats and doubles.
+      size_t chunk = ((size + threads - 1) / threads + 15) & ~(size_t)15;
+      size_t begin = id * chunk < size ? id * chunk : size;
+      size_t end = begin + chunk < size ? begin + chunk : size;
+
+      if (begin < end) kernel(begin, end - begin);
+    }
+    return;
+  }
+#endif
+  kernel(0, size);
+}
+
+template <typename T>
+void add(T *dst, const T *a, const T *b, size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->add(dst + offset, a + offset, b + offset, count);
+  });
+}
+
+template <typename T>
+void sub(T *dst, const T *a, const T *b, size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->sub(dst + offset, a + offset, b + offset, count);
+  });
+}
+
+template <typename T>
+void scale(T *dst, const T *a, T scalar, size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->scale(dst + offset, a + offset, scalar, count);
+  });
+}
+
+template <typename T>
+void copy(T *dst, const T *src, size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->copy(dst + offset, src + offset, count);
+  });
+}
+
+template <typename T>
+void fill(T *dst, T value, size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->fill(dst + offset, value, count);
+  });
+}
+
+template <typename T>
+void convert_bytes(T *dst, const uint8_t *src, T scale, T shift,
+                   size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->convert_bytes(dst + offset, src + offset, scale, shift, count);
+  });
+}
+
+template <typename T>
+void resample(T *dst, const T *src, size_t stride, const T *x, const T *y,
+              size_t size) {
+  const Kernels<T> *kernels = active_kernels<T>();
+  run_parallel(size, [=](size_t offset, size_t count) {
+    kernels->resample(dst + offset, src, stride, x + offset, y + offset,
+                      count);
+  });
+}
+
+}  // namespace
+
+Isa simd_detect() {
+  static const Isa detected = []() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2")) return ISA_SSE2;
+#endif
+    return ISA_SCALAR;
+  }();
+
+  return detected;
+}
+
+Isa simd_get_isa() { return active_isa(); }
+
+Isa simd_set_isa(Isa isa) {
+  Isa supported = simd_detect();
+  if (isa > supported) isa = supported;
+
+  active_isa() = isa;
+  active_kernels<double>() = KernelTables<double>::for_isa(isa);
+  active_kernels<float>() = KernelTables<float>::for_isa(isa);
+
+  return isa;
+}
+
+const char *simd_isa_name(Isa isa) {
+  switch (isa) {
+    case ISA_AVX512:
+      return "avx512";
+    case ISA_AVX2:
+      return "avx2";
+    case ISA_SSE2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+void simd_add(double *dst, const double *a, const double *b, size_t size) {
+  add(dst, a, b, size);
+}
+
+void simd_add(float *dst, const float *a, const float *b, size_t size) {
+  add(dst, a, b, size);
+}
+
+void simd_sub(double *dst, const double *a, const double *b, size_t size) {
+  sub(dst, a, b, size);
+}
+
+void simd_sub(float *dst, const float *a, const float *b, size_t size) {
+  sub(dst, a, b, size);
+}
+
+void simd_scale(double *dst, const double *a, double scalar, size_t size) {
+  scale(dst, a, scalar, size);
+}
+
+void simd_scale(float *dst, const float *a, float scalar, size_t size) {
+  scale(dst, a, scalar, size);
+}
+
+void simd_copy(double *dst, const double *src, size_t size) {
+  copy(dst, src, size);
+}
+
+void simd_copy(float *dst, const float *src, size_t size) {
+  copy(dst, src, size);
+}
+
+void simd_fill(double *dst, double value, size_t size) {
+  fill(dst, value, size);
+}
+
+void simd_fill(float *dst, float value, size_t size) { fill(dst, value, size); }
+
+void simd_convert_bytes(double *dst, const uint8_t *src, double scale,
+                        double shift, size_t size) {
+  convert_bytes(dst, src, scale, shift, size);
+}
+
+void simd_convert_bytes(float *dst, const uint8_t *src, float scale,
+                        float shift, size_t size) {
+  convert_bytes(dst, src, scale, shift, size);
+}
+
+void simd_resample(double *dst, const double *src, size_t stride,
+                   const double *x, const double *y, size_t size) {
+  resample(dst, src, stride, x, y, size);
+}
+
+void simd_resample(float *dst, const float *src, size_t stride,
+                   const float *x, const float *y, size_t size) {
+  resample(dst, src, stride, x, y, size);
+}
+
+}  // namespace custom_math
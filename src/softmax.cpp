@@ -0,0 +1,369 @@
+/**
+ * @file softmax.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the softmax kernels
+ *        declared in softmax.hpp.
+ * @version 1.0
+ * @date 2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "softmax.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+#include "activation.hpp"
+#include "expression.hpp"
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#endif
+
+namespace custom_math {
+
+namespace {
+
+// A 64-byte vector of T: the number of rows the narrow kernel processes
+// together, and of the partial results the wide kernel keeps along a row.
+template <typename T>
+struct Lanes {
+  static const size_t COUNT = 64 / sizeof(T);
+};
+
+// Rows of at most this many logits, such as the 10 classes of MNIST, are too
+// short to be vectorized along. They are vectorized across Lanes<T>::COUNT
+// rows at a time instead, transposed into a tile that stays in L1.
+const size_t NARROW_COLS = 64;
+
+typedef enum {
+  MODE_GRADIENT,     // The loss, the accuracy and the gradient.
+  MODE_LOSS,         // The loss and the accuracy.
+  MODE_LOG_SOFTMAX,  // The log-softmax.
+} Mode;
+
+template <typename T>
+struct Rows {
+  const T *logits;
+  size_t logits_stride;
+  const int *labels;
+  T *output;
+  size_t output_stride;
+  size_t cols;
+  T scale;
+};
+
+template <typename T>
+struct SoftmaxKernel {
+  typedef void (*Function)(const Rows<T> *rows, size_t begin, size_t end,
+                           SoftmaxLoss *result);
+};
+
+// Up to Lanes<T>::COUNT rows of at most NARROW_COLS logits.
+template <typename T, Mode MODE>
+inline __attribute__((always_inline)) void narrow_rows(const Rows<T> *rows,
+                                                       size_t first,
+                                                       size_t count,
+                                                       SoftmaxLoss *result) {
+  const size_t L = Lanes<T>::COUNT;
+  const size_t cols = rows->cols;
+  T tile[NARROW_COLS][L];
+  T max[L], sum[L], log_sum[L];
+  int index[L];
+
+  // The missing rows of the last tile are zeros, which are harmless.
+  for (size_t k = 0; k < count; k++) {
+    const T *z = rows->logits + (first + k) * rows->logits_stride;
+    for (size_t j = 0; j < cols; j++) tile[j][k] = z[j];
+  }
+  for (size_t k = count; k < L; k++)
+    for (size_t j = 0; j < cols; j++) tile[j][k] = 0;
+
+  for (size_t k = 0; k < L; k++) max[k] = tile[0][k];
+  for (size_t j = 1; j < cols; j++)
+    for (size_t k = 0; k < L; k++)
+      max[k] = tile[j][k] > max[k] ? tile[j][k] : max[k];
+
+  // The first column holding the maximum, found backwards with selects.
+  if (MODE != MODE_LOG_SOFTMAX) {
+    for (size_t k = 0; k < L; k++) index[k] = 0;
+    for (size_t j = cols; j-- > 0;)
+      for (size_t k = 0; k < L; k++)
+        index[k] = tile[j][k] == max[k] ? (int)j : index[k];
+  }
+
+  for (size_t k = 0; k < L; k++) sum[k] = 0;
+  for (size_t j = 0; j < cols; j++)
+    for (size_t k = 0; k < L; k++) {
+      const T e = activation_exp<T, false>(tile[j][k] - max[k]);
+      if (MODE == MODE_GRADIENT) tile[j][k] = e;
+      sum[k] += e;
+    }
+  for (size_t k = 0; k < L; k++) log_sum[k] = (T)log(sum[k]);
+
+  if (MODE == MODE_LOG_SOFTMAX) {
+    for (size_t k = 0; k < count; k++) {
+      T *out = rows->output + (first + k) * rows->output_stride;
+      for (size_t j = 0; j < cols; j++)
+        out[j] = tile[j][k] - max[k] - log_sum[k];
+    }
+    return;
+  }
+
+  for (size_t k = 0; k < count; k++) {
+    const int label = rows->labels[first + k];
+    const T z = rows->logits[(first + k) * rows->logits_stride + label];
+    result->loss += (double)log_sum[k] - (double)(z - max[k]);
+    result->correct += index[k] == label;
+  }
+
+  if (MODE == MODE_GRADIENT) {
+    T factor[L];
+    for (size_t k = 0; k < L; k++) factor[k] = rows->scale / sum[k];
+    for (size_t j = 0; j < cols; j++)
+      for (size_t k = 0; k < L; k++) tile[j][k] *= factor[k];
+
+    for (size_t k = 0; k < count; k++) {
+      T *out = rows->output + (first + k) * rows->output_stride;
+      for (size_t j = 0; j < cols; j++) out[j] = tile[j][k];
+      out[rows->labels[first + k]] -= rows->scale;
+    }
+  }
+}
+
+// A row of more than NARROW_COLS logits.
+template <typename T, Mode MODE>
+inline __attribute__((always_inline)) void wide_row(const Rows<T> *rows,
+                                                    size_t row,
+                                                    SoftmaxLoss *result) {
+  const size_t L = Lanes<T>::COUNT;
+  const size_t cols = rows->cols;
+  const T *z = rows->logits + row * rows->logits_stride;
+  T *out = rows->output + row * rows->output_stride;
+  T lanes[L];
+  size_t j;
+
+  for (size_t k = 0; k < L; k++) lanes[k] = z[k];
+  for (j = L; j + L <= cols; j += L)
+    for (size_t k = 0; k < L; k++)
+      lanes[k] = z[j + k] > lanes[k] ? z[j + k] : lanes[k];
+  T max = lanes[0];
+  for (size_t k = 1; k < L; k++) max = lanes[k] > max ? lanes[k] : max;
+  for (; j < cols; j++) max = z[j] > max ? z[j] : max;
+
+  // Read before the gradient overwrites the logits, when it is them.
+  int label = 0;
+  T label_logit = 0;
+  size_t index = 0;
+  if (MODE != MODE_LOG_SOFTMAX) {
+    label = rows->labels[row];
+    label_logit = z[label];
+    while (index + 1 < cols && z[index] != max) index++;
+  }
+
+  for (size_t k = 0; k < L; k++) lanes[k] = 0;
+  for (j = 0; j + L <= cols; j += L)
+    for (size_t k = 0; k < L; k++) {
+      const T e = activation_exp<T, false>(z[j + k] - max);
+      if (MODE == MODE_GRADIENT) out[j + k] = e;
+      lanes[k] += e;
+    }
+  T sum = 0;
+  for (size_t k = 0; k < L; k++) sum += lanes[k];
+  for (; j < cols; j++) {
+    const T e = activation_exp<T, false>(z[j] - max);
+    if (MODE == MODE_GRADIENT) out[j] = e;
+    sum += e;
+  }
+  const T log_sum = (T)log(sum);
+
+  if (MODE == MODE_LOG_SOFTMAX) {
+    for (j = 0; j < cols; j++) out[j] = z[j] - max - log_sum;
+    return;
+  }
+
+  result->loss += (double)log_sum - (double)(label_logit - max);
+  result->correct += (int)index == label;
+
+  if (MODE == MODE_GRADIENT) {
+    const T factor = rows->scale / sum;
+    for (j = 0; j < cols; j++) out[j] *= factor;
+    out[label] -= rows->scale;
+  }
+}
+
+// The loops are written once and compiled for every instruction set by the
+// wrappers below, like the activation kernels.
+template <typename T, Mode MODE>
+inline __attribute__((always_inline)) void softmax_loop(const Rows<T> *rows,
+                                                        size_t begin,
+                                                        size_t end,
+                                                        SoftmaxLoss *result) {
+  const size_t L = Lanes<T>::COUNT;
+
+  if (rows->cols <= NARROW_COLS) {
+    for (size_t i = begin; i < end; i += L)
+      narrow_rows<T, MODE>(rows, i, end - i < L ? end - i : L, result);
+  } else {
+    for (size_t i = begin; i < end; i++) wide_row<T, MODE>(rows, i, result);
+  }
+}
+
+template <typename T, Mode MODE>
+void softmax_generic(const Rows<T> *rows, size_t begin, size_t end,
+                     SoftmaxLoss *result) {
+  softmax_loop<T, MODE>(rows, begin, end, result);
+}
+
+#ifdef SIMD_X86
+
+template <typename T, Mode MODE>
+__attribute__((target("avx2,fma"))) void softmax_avx2(const Rows<T> *rows,
+                                                      size_t begin,
+                                                      size_t end,
+                                                      SoftmaxLoss *result) {
+  softmax_loop<T, MODE>(rows, begin, end, result);
+}
+
+template <typename T, Mode MODE>
+__attribute__((target("avx512f"))) void softmax_avx512(const Rows<T> *rows,
+                                                       size_t begin,
+                                                       size_t end,
+                                                       SoftmaxLoss *result) {
+  softmax_loop<T, MODE>(rows, begin, end, result);
+}
+
+#endif  // SIMD_X86
+
+template <typename T, Mode MODE>
+typename SoftmaxKernel<T>::Function select_kernel() {
+#ifdef SIMD_X86
+  switch (simd_get_isa()) {
+    case ISA_AVX512:
+      return softmax_avx512<T, MODE>;
+    case ISA_AVX2:
+      return softmax_avx2<T, MODE>;
+    default:
+      break;
+  }
+#endif
+  return softmax_generic<T, MODE>;
+}
+
+// Matrices smaller than this are not worth waking up the threads.
+const size_t PARALLEL_THRESHOLD = 1 << 14;
+
+template <typename T, Mode MODE>
+SoftmaxLoss run(const Rows<T> *rows, size_t count) {
+  typename SoftmaxKernel<T>::Function kernel = select_kernel<T, MODE>();
+  SoftmaxLoss result = {0, 0};
+
+#ifdef USE_OPENMP
+  if (count * rows->cols >= PARALLEL_THRESHOLD && omp_get_max_threads() > 1 &&
+      !omp_in_parallel()) {
+    // The parts are added in the order of the threads, so that the loss does
+    // not depend on which thread finishes first.
+    const int team = omp_get_max_threads();
+    std::vector<SoftmaxLoss> parts((size_t)team, SoftmaxLoss{0, 0});
+
+#pragma omp parallel num_threads(team)
+    {
+      // Whole tiles of rows for every thread.
+      const size_t L = Lanes<T>::COUNT;
+      size_t threads = (size_t)omp_get_num_threads();
+      size_t id = (size_t)omp_get_thread_num();
+      size_t chunk = ((count + threads - 1) / threads + L - 1) / L * L;
+      size_t begin = id * chunk < count ? id * chunk : count;
+      size_t end = begin + chunk < count ? begin + chunk : count;
+
+      // Summed apart, so that the threads do not share a cache line.
+      SoftmaxLoss part = {0, 0};
+      if (begin < end) kernel(rows, begin, end, &part);
+      parts[id] = part;
+    }
+
+    for (const SoftmaxLoss &part : parts) {
+      result.loss += part.loss;
+      result.correct += part.correct;
+    }
+    return result;
+  }
+#endif
+  kernel(rows, 0, count, &result);
+  return result;
+}
+
+// Whether the output is the input itself or a separate matrix of its shape.
+template <typename T>
+bool valid_output(const BasicMatrix<T> *output, const BasicMatrix<T> *input) {
+  if (output->elements == nullptr || output->rows != input->rows ||
+      output->cols != input->cols)
+    return false;
+  return !detail::overlap(output, input) ||
+         (output->elements == input->elements &&
+          output->stride == input->stride);
+}
+
+}  // namespace
+
+template <typename T>
+SoftmaxLoss softmax_cross_entropy(const BasicMatrix<T> *logits,
+                                  const int *labels,
+                                  BasicMatrix<T> *gradients, T scale) {
+  SoftmaxLoss result = {NAN, 0};
+  if (logits == nullptr || logits->elements == nullptr || labels == nullptr ||
+      logits->cols == 0)
+    return result;
+  if (gradients != nullptr &&
+      !valid_output((const BasicMatrix<T> *)gradients, logits))
+    return result;
+  for (size_t i = 0; i < logits->rows; i++)
+    if (labels[i] < 0 || (size_t)labels[i] >= logits->cols) return result;
+
+  Rows<T> rows = {logits->elements,
+                  logits->stride,
+                  labels,
+                  gradients != nullptr ? gradients->elements : nullptr,
+                  gradients != nullptr ? gradients->stride : 0,
+                  logits->cols,
+                  scale};
+  return gradients != nullptr ? run<T, MODE_GRADIENT>(&rows, logits->rows)
+                              : run<T, MODE_LOSS>(&rows, logits->rows);
+}
+
+template <typename T>
+BasicMatrix<T> *matrix_log_softmax_into(BasicMatrix<T> *destination,
+                                        const BasicMatrix<T> *logits) {
+  if (destination == nullptr || logits == nullptr ||
+      logits->elements == nullptr || logits->cols == 0 ||
+      !valid_output((const BasicMatrix<T> *)destination, logits))
+    return nullptr;
+
+  Rows<T> rows = {logits->elements,     logits->stride,
+                  nullptr,              destination->elements,
+                  destination->stride,  logits->cols,
+                  (T)0};
+  run<T, MODE_LOG_SOFTMAX>(&rows, logits->rows);
+  return destination;
+}
+
+#define INSTANTIATE_SOFTMAX(T)                                              \
+  template SoftmaxLoss softmax_cross_entropy<T>(                            \
+      const BasicMatrix<T> *, const int *, BasicMatrix<T> *, T);            \
+  template BasicMatrix<T> *matrix_log_softmax_into<T>(BasicMatrix<T> *,     \
+                                                      const BasicMatrix<T> *);
+
+INSTANTIATE_SOFTMAX(double)
+INSTANTIATE_SOFTMAX(float)
+
+#undef INSTANTIATE_SOFTMAX
+
+}  // namespace custom_math
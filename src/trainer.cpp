@@ -0,0 +1,235 @@
+/**
+ * @file trainer.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the data-parallel trainer
+ *        declared in trainer.hpp.
+ * @version 1.0
+ * @date 2023-08-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "trainer.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace neural {
+
+namespace {
+
+inline size_t align(size_t offset) {
+  return (offset + ALLOCATOR_ALIGNMENT - 1) &
+         ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+}
+
+// The first row of a shard of a batch.
+inline size_t shard_begin(size_t rows, size_t shards, size_t shard) {
+  return rows * shard / shards;
+}
+
+// The step of gradient descent of a shard with Hogwild, p -= lr * (g +
+// weight_decay * p), as optimizer_step takes it for OPTIMIZER_SGD.
+template <typename T>
+void hogwild_step(BasicNetwork<T> *network, const BasicWorkspace<T> *workspace,
+                  T learning_rate, T weight_decay) {
+  if (weight_decay == 0) {
+    network_sgd(network, workspace, learning_rate);
+    return;
+  }
+
+  T *parameters = network->parameters;
+  const T *gradients = workspace->gradients;
+  for (size_t i = 0; i < network->size; i++)
+    parameters[i] -=
+        learning_rate * (gradients[i] + weight_decay * parameters[i]);
+}
+
+// The forward and backward passes of a shard, and its own step of gradient
+// descent with Hogwild.
+template <typename T>
+void train_shard(BasicTrainer<T> *trainer, BasicNetwork<T> *network,
+                 const images::BasicBatch<T> *batch, size_t shards,
+                 size_t shard, T learning_rate, T weight_decay) {
+  const size_t rows = batch->samples.rows;
+  const size_t begin = shard_begin(rows, shards, shard);
+  const size_t end = shard_begin(rows, shards, shard + 1);
+  BasicWorkspace<T> *workspace = trainer->workspaces[shard];
+
+  custom_math::BasicMatrix<T> samples = batch->samples;
+  samples.rows = end - begin;
+  samples.elements = custom_math::matrix_row(&batch->samples, begin);
+
+  network_forward(network, workspace, &samples);
+
+  // The gradients of the shards of a synchronous step are averaged over the
+  // whole batch, so that they only have to be summed.
+  if (trainer->hogwild) {
+    trainer->losses[shard] =
+        (double)network_backward(network, workspace, &samples,
+                                 batch->labels + begin) *
+        (double)(end - begin) / (double)rows;
+    hogwild_step(network, workspace, learning_rate, weight_decay);
+  } else {
+    trainer->losses[shard] = (double)network_backward(
+        network, workspace, &samples, batch->labels + begin, rows);
+  }
+}
+
+// Sums the gradients of the shards into the ones of the first, for the
+// parameters [begin, end): a tree over the replicas, whose every level adds
+// the replicas two by two.
+template <typename T>
+void reduce_slice(BasicTrainer<T> *trainer, size_t shards, size_t begin,
+                  size_t end) {
+  for (size_t stride = 1; stride < shards; stride *= 2)
+    for (size_t r = 0; r + stride < shards; r += 2 * stride) {
+      T *sum = trainer->workspaces[r]->gradients + begin;
+      custom_math::simd_add(
+          sum, sum, trainer->workspaces[r + stride]->gradients + begin,
+          end - begin);
+    }
+}
+
+}  // namespace
+
+TrainerOptions trainer_default_options() {
+  TrainerOptions options;
+  options.threads = 0;
+  options.hogwild = false;
+  return options;
+}
+
+template <typename T>
+BasicTrainer<T> *trainer_create(const BasicNetwork<T> *network,
+                                size_t capacity,
+                                const TrainerOptions *options,
+                                custom_math::Allocator *allocator) {
+  TrainerOptions defaults = trainer_default_options();
+  if (options == nullptr) options = &defaults;
+  if (network == nullptr || capacity == 0) return nullptr;
+
+  size_t threads = options->threads;
+#ifdef USE_OPENMP
+  if (threads == 0) threads = (size_t)omp_get_max_threads();
+#else
+  if (threads == 0) threads = 1;
+#endif
+  if (threads > capacity) threads = capacity;
+
+  if (allocator == nullptr) allocator = custom_math::allocator_get_default();
+  const size_t header = align(sizeof(BasicTrainer<T>));
+  const size_t pointers = align(threads * sizeof(BasicWorkspace<T> *));
+  const size_t block = header + pointers + align(threads * sizeof(double));
+
+  BasicTrainer<T> *trainer =
+      (BasicTrainer<T> *)custom_math::allocator_allocate(allocator, block);
+  if (trainer == nullptr) return nullptr;
+
+  memset(trainer, 0, block);
+  trainer->threads = threads;
+  trainer->hogwild = options->hogwild;
+  trainer->capacity = capacity;
+  trainer->size = network->size;
+  trainer->workspaces = (BasicWorkspace<T> **)((char *)trainer + header);
+  trainer->losses = (double *)((char *)trainer + header + pointers);
+  trainer->allocator = allocator;
+  trainer->block = block;
+
+  // Enough rows for the largest shard of the largest batch.
+  const size_t rows = (capacity + threads - 1) / threads;
+  for (size_t i = 0; i < threads; i++) {
+    trainer->workspaces[i] = workspace_create(network, rows, allocator);
+    if (trainer->workspaces[i] == nullptr) {
+      trainer_delete(trainer);
+      return nullptr;
+    }
+  }
+
+  return trainer;
+}
+
+template <typename T>
+T trainer_train_batch(BasicTrainer<T> *trainer, BasicNetwork<T> *network,
+                      const images::BasicBatch<T> *batch,
+                      BasicOptimizer<T> *optimizer) {
+  const size_t rows = batch->samples.rows;
+  if (rows == 0 || rows > trainer->capacity ||
+      batch->samples.cols != network->layers[0].inputs ||
+      trainer->size != network->size || optimizer->size != network->size ||
+      !network_check_labels(network, batch->labels, rows))
+    return (T)NAN;
+  if (trainer->hogwild && optimizer->options.type != OPTIMIZER_SGD)
+    return (T)NAN;
+
+  const size_t shards = trainer->threads < rows ? trainer->threads : rows;
+  const T learning_rate = (T)optimizer->options.learning_rate;
+  const T weight_decay = (T)optimizer->options.weight_decay;
+  long shard;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(shard) num_threads(shards) \
+    schedule(static, 1)
+#endif
+  for (shard = 0; shard < (long)shards; shard++)
+    train_shard(trainer, network, batch, shards, (size_t)shard,
+                learning_rate, weight_decay);
+
+  double loss = 0;
+  for (size_t i = 0; i < shards; i++) loss += trainer->losses[i];
+  if (trainer->hogwild) {
+    optimizer->steps += shards;
+    return (T)loss;
+  }
+
+  // Every thread reduces whole cache lines of the parameters.
+  const size_t size = network->size;
+  const size_t slice = ((size + shards - 1) / shards + 15) & ~(size_t)15;
+  long part;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for private(part) num_threads(shards) \
+    schedule(static, 1)
+#endif
+  for (part = 0; part < (long)shards; part++) {
+    size_t begin = (size_t)part * slice < size ? (size_t)part * slice : size;
+    size_t end = begin + slice < size ? begin + slice : size;
+    if (begin < end) reduce_slice(trainer, shards, begin, end);
+  }
+
+  optimizer_step(optimizer, network->parameters,
+                 trainer->workspaces[0]->gradients);
+  return (T)loss;
+}
+
+template <typename T>
+void trainer_delete(BasicTrainer<T> *trainer) {
+  if (trainer == nullptr) return;
+  for (size_t i = 0; i < trainer->threads; i++)
+    workspace_delete(trainer->workspaces[i]);
+  custom_math::allocator_deallocate(trainer->allocator, trainer,
+                                    trainer->block);
+}
+
+#define INSTANTIATE_TRAINER(T)                                               \
+  template BasicTrainer<T> *trainer_create<T>(                               \
+      const BasicNetwork<T> *, size_t, const TrainerOptions *,               \
+      custom_math::Allocator *);                                             \
+  template T trainer_train_batch<T>(BasicTrainer<T> *, BasicNetwork<T> *,    \
+                                    const images::BasicBatch<T> *,           \
+                                    BasicOptimizer<T> *);                    \
+  template void trainer_delete<T>(BasicTrainer<T> *);
+
+INSTANTIATE_TRAINER(float)
+INSTANTIATE_TRAINER(double)
+
+#undef INSTANTIATE_TRAINER
+
+}  // namespace neural
@@ -0,0 +1,408 @@
+/**
+ * @file transport.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the implementation of the transports declared in
+ *        transport.hpp.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "transport.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+namespace neural {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+inline bool expired(Clock::time_point start) {
+  return Clock::now() - start > std::chrono::seconds(TRANSPORT_TIMEOUT_SECONDS);
+}
+
+// Shared memory
+
+// The bytes in flight from a process to the next one. Each side owns one of
+// the counters, which only grow, so that a single writer and a single reader
+// need no lock.
+const size_t CHANNEL_CAPACITY = (size_t)1 << 20;
+
+struct Channel {
+  alignas(64) std::atomic<uint64_t> written;
+  alignas(64) std::atomic<uint64_t> read;
+  alignas(64) unsigned char data[CHANNEL_CAPACITY];
+};
+
+struct Segment {
+  alignas(64) std::atomic<uint64_t> attached;  // The number of processes
+                                               // that mapped the segment.
+  std::atomic<uint64_t> ready;  // Set by rank 0 once they all did and the
+                                // name is removed.
+};
+
+struct ShmTransport {
+  Transport base;
+  void *mapping;
+  size_t bytes;
+  Channel *outgoing;  // To the next process.
+  Channel *incoming;  // From the previous one.
+};
+
+size_t push(Channel *channel, const unsigned char *data, size_t bytes) {
+  const uint64_t written = channel->written.load(std::memory_order_relaxed);
+  const uint64_t read = channel->read.load(std::memory_order_acquire);
+  const size_t free = CHANNEL_CAPACITY - (size_t)(written - read);
+  const size_t count = bytes < free ? bytes : free;
+  if (count == 0) return 0;
+
+  const size_t at = (size_t)(written % CHANNEL_CAPACITY);
+  const size_t first =
+      count < CHANNEL_CAPACITY - at ? count : CHANNEL_CAPACITY - at;
+  memcpy(channel->data + at, data, first);
+  memcpy(channel->data, data + first, count - first);
+  channel->written.store(written + count, std::memory_order_release);
+  return count;
+}
+
+size_t pull(Channel *channel, unsigned char *data, size_t bytes) {
+  const uint64_t written = channel->written.load(std::memory_order_acquire);
+  const uint64_t read = channel->read.load(std::memory_order_relaxed);
+  const size_t available = (size_t)(written - read);
+  const size_t count = bytes < available ? bytes : available;
+  if (count == 0) return 0;
+
+  const size_t at = (size_t)(read % CHANNEL_CAPACITY);
+  const size_t first =
+      count < CHANNEL_CAPACITY - at ? count : CHANNEL_CAPACITY - at;
+  memcpy(data, channel->data + at, first);
+  memcpy(data + first, channel->data, count - first);
+  channel->read.store(read + count, std::memory_order_release);
+  return count;
+}
+
+// The number of idle rounds spent spinning before yielding the core.
+const size_t SPINS = 1024;
+
+bool shm_exchange(Transport *transport, const void *send, size_t send_bytes,
+                  void *receive, size_t receive_bytes) {
+  ShmTransport *shm = (ShmTransport *)transport;
+  const unsigned char *source = (const unsigned char *)send;
+  unsigned char *destination = (unsigned char *)receive;
+  size_t sent = 0, received = 0, idle = 0;
+  Clock::time_point idle_since;
+
+  while (sent < send_bytes || received < receive_bytes) {
+    size_t progress = 0;
+    if (sent < send_bytes) {
+      size_t count = push(shm->outgoing, source + sent, send_bytes - sent);
+      sent += count;
+      progress += count;
+    }
+    if (received < receive_bytes) {
+      size_t count = pull(shm->incoming, destination + received,
+                          receive_bytes - received);
+      received += count;
+      progress += count;
+    }
+
+    if (progress > 0) {
+      idle = 0;
+    } else if (++idle == SPINS) {
+      idle_since = Clock::now();
+    } else if (idle > SPINS) {
+      std::this_thread::yield();
+      if (idle % SPINS == 0 && expired(idle_since)) return false;
+    }
+  }
+
+  return true;
+}
+
+void shm_close(Transport *transport) {
+  ShmTransport *shm = (ShmTransport *)transport;
+  munmap(shm->mapping, shm->bytes);
+  delete shm;
+}
+
+// Unix-domain sockets
+
+struct SocketTransport {
+  Transport base;
+  int next;      // Connected to the next process.
+  int previous;  // Accepted from the previous one.
+};
+
+bool socket_address(struct sockaddr_un *address, const char *path,
+                    size_t rank) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  int length = snprintf(address->sun_path, sizeof(address->sun_path),
+                        "%s.%zu", path, rank);
+  return length > 0 && (size_t)length < sizeof(address->sun_path);
+}
+
+inline bool would_block(ssize_t result) {
+  return result < 0 &&
+         (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+bool socket_exchange(Transport *transport, const void *send,
+                     size_t send_bytes, void *receive, size_t receive_bytes) {
+  SocketTransport *sockets = (SocketTransport *)transport;
+  const char *source = (const char *)send;
+  char *destination = (char *)receive;
+  size_t sent = 0, received = 0;
+
+  while (sent < send_bytes || received < receive_bytes) {
+    struct pollfd fds[2];
+    int count = 0, out = -1, in = -1;
+    if (sent < send_bytes) {
+      fds[count].fd = sockets->next;
+      fds[count].events = POLLOUT;
+      out = count++;
+    }
+    if (received < receive_bytes) {
+      fds[count].fd = sockets->previous;
+      fds[count].events = POLLIN;
+      in = count++;
+    }
+
+    int ready = poll(fds, (nfds_t)count, TRANSPORT_TIMEOUT_SECONDS * 1000);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready <= 0) return false;
+
+    if (out >= 0 && fds[out].revents != 0) {
+      ssize_t result = ::send(sockets->next, source + sent, send_bytes - sent,
+                              MSG_NOSIGNAL);
+      if (result < 0 && !would_block(result)) return false;
+      if (result > 0) sent += (size_t)result;
+    }
+    if (in >= 0 && fds[in].revents != 0) {
+      ssize_t result = recv(sockets->previous, destination + received,
+                            receive_bytes - received, 0);
+      if (result == 0 || (result < 0 && !would_block(result))) return false;
+      if (result > 0) received += (size_t)result;
+    }
+  }
+
+  return true;
+}
+
+void socket_close(Transport *transport) {
+  SocketTransport *sockets = (SocketTransport *)transport;
+  if (sockets->next >= 0) close(sockets->next);
+  if (sockets->previous >= 0) close(sockets->previous);
+  delete sockets;
+}
+
+// Connects to the socket of the next process, which may not be listening
+// yet.
+int connect_next(const struct sockaddr_un *address) {
+  const Clock::time_point start = Clock::now();
+
+  while (!expired(start)) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)address, sizeof(*address)) == 0)
+      return fd;
+    close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return -1;
+}
+
+// Opens the segment of a ring. Rank 0 creates it, after removing the one a
+// crashed run may have left under the name, so that its counters start at 0.
+// The other ranks wait until a segment of the right size exists.
+int open_segment(const char *name, size_t rank, size_t bytes,
+                 Clock::time_point start) {
+  if (rank == 0) {
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)bytes) != 0) {
+      close(fd);
+      shm_unlink(name);
+      return -1;
+    }
+    return fd;
+  }
+
+  while (!expired(start)) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd >= 0) {
+      struct stat status;
+      if (fstat(fd, &status) == 0 && (size_t)status.st_size == bytes)
+        return fd;
+      close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return -1;
+}
+
+// Whether the name now refers to another segment than the one of the given
+// inode: that one was left by a crashed run and rank 0 replaced it.
+bool segment_replaced(const char *name, ino_t inode) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) return false;
+  struct stat status;
+  const bool replaced = fstat(fd, &status) == 0 && status.st_ino != inode;
+  close(fd);
+  return replaced;
+}
+
+}  // namespace
+
+Transport *transport_create_shm(const char *name, size_t rank, size_t size) {
+  if (name == nullptr || size == 0 || rank >= size) return nullptr;
+
+  const size_t bytes = sizeof(Segment) + size * sizeof(Channel);
+  const Clock::time_point start = Clock::now();
+
+  for (;;) {
+    int fd = open_segment(name, rank, bytes, start);
+    if (fd < 0) return nullptr;
+    struct stat status;
+    void *mapping = fstat(fd, &status) == 0
+                        ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      if (rank == 0) shm_unlink(name);
+      return nullptr;
+    }
+
+    ShmTransport *shm = new (std::nothrow) ShmTransport();
+    if (shm == nullptr) {
+      munmap(mapping, bytes);
+      if (rank == 0) shm_unlink(name);
+      return nullptr;
+    }
+
+    Channel *channels = (Channel *)((char *)mapping + sizeof(Segment));
+    shm->base.rank = rank;
+    shm->base.size = size;
+    shm->base.exchange = shm_exchange;
+    shm->base.close = shm_close;
+    shm->mapping = mapping;
+    shm->bytes = bytes;
+    shm->outgoing = &channels[rank];
+    shm->incoming = &channels[(rank + size - 1) % size];
+
+    // Once all the processes are attached, rank 0 removes the name, the
+    // segment lives until they all unmap it. A segment left under the name
+    // by a crashed run is never ready: a rank that mapped it sees rank 0
+    // replace it, and starts again with the new one.
+    Segment *segment = (Segment *)mapping;
+    segment->attached.fetch_add(1);
+    bool replaced = false;
+    while (!replaced) {
+      if (rank == 0 && segment->attached.load() == size) {
+        shm_unlink(name);
+        segment->ready.store(1);
+      }
+      if (segment->ready.load() != 0) return &shm->base;
+      if (expired(start)) {
+        if (rank == 0) shm_unlink(name);
+        shm_close(&shm->base);
+        return nullptr;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      replaced = rank != 0 && segment_replaced(name, status.st_ino);
+    }
+    shm_close(&shm->base);
+  }
+}
+
+Transport *transport_create_socket(const char *path, size_t rank,
+                                   size_t size) {
+  struct sockaddr_un own, next;
+  if (path == nullptr || size == 0 || rank >= size ||
+      !socket_address(&own, path, rank) ||
+      !socket_address(&next, path, (rank + 1) % size))
+    return nullptr;
+
+  SocketTransport *sockets = new (std::nothrow) SocketTransport();
+  if (sockets == nullptr) return nullptr;
+  sockets->base.rank = rank;
+  sockets->base.size = size;
+  sockets->base.exchange = socket_exchange;
+  sockets->base.close = socket_close;
+  sockets->next = -1;
+  sockets->previous = -1;
+
+  // Listen first, so that the previous process can connect while this one
+  // connects to the next.
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(own.sun_path);
+  bool failed =
+      listener < 0 ||
+      bind(listener, (const struct sockaddr *)&own, sizeof(own)) != 0 ||
+      listen(listener, 1) != 0;
+
+  if (!failed) {
+    sockets->next = connect_next(&next);
+    failed = sockets->next < 0;
+  }
+
+  if (!failed) {
+    struct pollfd fd = {listener, POLLIN, 0};
+    failed = poll(&fd, 1, TRANSPORT_TIMEOUT_SECONDS * 1000) != 1;
+  }
+  if (!failed) {
+    sockets->previous = accept(listener, nullptr, nullptr);
+    failed = sockets->previous < 0;
+  }
+
+  if (listener >= 0) close(listener);
+  unlink(own.sun_path);
+
+  // The exchanges poll both sockets, which must never block.
+  failed = failed ||
+           fcntl(sockets->next, F_SETFL, O_NONBLOCK) != 0 ||
+           fcntl(sockets->previous, F_SETFL, O_NONBLOCK) != 0;
+  if (failed) {
+    socket_close(&sockets->base);
+    return nullptr;
+  }
+
+  return &sockets->base;
+}
+
+bool transport_exchange(Transport *transport, const void *send,
+                        size_t send_bytes, void *receive,
+                        size_t receive_bytes) {
+  if (transport == nullptr) return false;
+  return transport->exchange(transport, send, send_bytes, receive,
+                             receive_bytes);
+}
+
+void transport_delete(Transport *transport) {
+  if (transport == nullptr) return;
+  transport->close(transport);
+}
+
+}  // namespace neural
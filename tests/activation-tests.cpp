@@ -0,0 +1,238 @@
+/**
+ * @file activation-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the activation functions. The
+ *        kernels of every instruction set are checked against the standard
+ *        library, within the documented error bounds.
+ * @version 1.0
+ * @date 2023-08-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "activation.hpp"
+#include "expression.hpp"
+#include "simd.hpp"
+
+namespace {
+
+// The exact values, computed with the standard library in long double.
+long double expected(custom_math::ActivationType type, long double x,
+                     bool derivative) {
+  const long double c = sqrtl(2.L / 3.14159265358979323846L);
+
+  switch (type) {
+    case custom_math::ACTIVATION_SIGMOID: {
+      long double s = 1 / (1 + expl(-x));
+      return derivative ? s * (1 - s) : s;
+    }
+    case custom_math::ACTIVATION_TANH: {
+      long double t = tanhl(x);
+      return derivative ? 1 - t * t : t;
+    }
+    case custom_math::ACTIVATION_RELU:
+      if (derivative) return x > 0 ? 1 : 0;
+      return x > 0 ? x : 0;
+    case custom_math::ACTIVATION_LEAKY_RELU:
+      if (derivative) return x > 0 ? 1 : 0.5L;
+      return x > 0 ? x : 0.5L * x;
+    case custom_math::ACTIVATION_GELU: {
+      long double t = tanhl(c * (x + 0.044715L * x * x * x));
+      if (derivative)
+        return 0.5L * (1 + t) +
+               0.5L * x * (1 - t * t) * c * (1 + 3 * 0.044715L * x * x);
+      return 0.5L * x * (1 + t);
+    }
+    default:
+      return expl(x);
+  }
+}
+
+// Checks one activation over [-20, 20] against the bound of activation.hpp.
+template <typename T>
+void check(custom_math::ActivationType type, bool fast, bool derivative,
+           double bound) {
+  // An odd size, so that the tails of the vector loops are exercised.
+  const size_t size = 20001;
+  std::vector<T> input(size), output(size);
+  for (size_t i = 0; i < size; i++)
+    input[i] = (T)(-20. + 40. * (double)i / (double)(size - 1));
+
+  custom_math::Activation activation = {type, 0.5, fast};
+  if (derivative)
+    custom_math::activation_derivative(&activation, output.data(),
+                                       input.data(), size);
+  else
+    custom_math::activation_forward(&activation, output.data(), input.data(),
+                                    size);
+
+  for (size_t i = 0; i < size; i++) {
+    long double value = expected(type, input[i], derivative);
+    long double error = fabsl(output[i] - value);
+    if (type == custom_math::ACTIVATION_EXP) error /= value;
+    ASSERT_LE((double)error, bound)
+        << "type " << type << " fast " << fast << " derivative " << derivative
+        << " at " << input[i];
+  }
+}
+
+class ActivationTests : public ::testing::TestWithParam<custom_math::Isa> {
+ public:
+  virtual void SetUp() override {
+    previous = custom_math::simd_get_isa();
+    if (custom_math::simd_set_isa(GetParam()) != GetParam())
+      GTEST_SKIP() << custom_math::simd_isa_name(GetParam())
+                   << " is not supported on this CPU";
+  }
+  virtual void TearDown() override { custom_math::simd_set_isa(previous); }
+
+ private:
+  custom_math::Isa previous;
+};
+
+}  // namespace
+
+TEST_P(ActivationTests, Double) {
+  for (bool derivative : {false, true}) {
+    check<double>(custom_math::ACTIVATION_EXP, false, derivative, 2e-16);
+    check<double>(custom_math::ACTIVATION_SIGMOID, false, derivative, 2e-16);
+    check<double>(custom_math::ACTIVATION_TANH, false, derivative, 7e-16);
+    check<double>(custom_math::ACTIVATION_GELU, false, derivative, 1e-14);
+    check<double>(custom_math::ACTIVATION_RELU, false, derivative, 0);
+    check<double>(custom_math::ACTIVATION_LEAKY_RELU, false, derivative, 0);
+  }
+}
+
+TEST_P(ActivationTests, DoubleFast) {
+  for (bool derivative : {false, true}) {
+    check<double>(custom_math::ACTIVATION_EXP, true, derivative, 4e-6);
+    check<double>(custom_math::ACTIVATION_SIGMOID, true, derivative, 8e-7);
+    check<double>(custom_math::ACTIVATION_TANH, true, derivative, 2e-6);
+    check<double>(custom_math::ACTIVATION_GELU, true, derivative, 8e-7);
+  }
+}
+
+TEST_P(ActivationTests, Float) {
+  for (bool derivative : {false, true}) {
+    check<float>(custom_math::ACTIVATION_EXP, false, derivative, 1e-7);
+    check<float>(custom_math::ACTIVATION_SIGMOID, false, derivative, 1e-7);
+    check<float>(custom_math::ACTIVATION_TANH, false, derivative, 4e-7);
+    check<float>(custom_math::ACTIVATION_GELU, false, derivative, 2e-6);
+    check<float>(custom_math::ACTIVATION_RELU, false, derivative, 0);
+    check<float>(custom_math::ACTIVATION_LEAKY_RELU, false, derivative, 0);
+  }
+}
+
+TEST_P(ActivationTests, FloatFast) {
+  for (bool derivative : {false, true}) {
+    check<float>(custom_math::ACTIVATION_EXP, true, derivative, 4e-6);
+    check<float>(custom_math::ACTIVATION_SIGMOID, true, derivative, 9e-7);
+    check<float>(custom_math::ACTIVATION_TANH, true, derivative, 2e-6);
+    check<float>(custom_math::ACTIVATION_GELU, true, derivative, 2e-6);
+  }
+}
+
+TEST_P(ActivationTests, OutOfRange) {
+  const double input[] = {-1000., 1000., -INFINITY, INFINITY, NAN};
+  double output[5];
+
+  custom_math::Activation activation = {custom_math::ACTIVATION_EXP, 0,
+                                        false};
+  custom_math::activation_forward(&activation, output, input, 5);
+  EXPECT_EQ(output[0], 0.);
+  EXPECT_EQ(output[1], INFINITY);
+  EXPECT_EQ(output[2], 0.);
+  EXPECT_EQ(output[3], INFINITY);
+  EXPECT_TRUE(isnan(output[4]));
+
+  activation.type = custom_math::ACTIVATION_SIGMOID;
+  custom_math::activation_forward(&activation, output, input, 4);
+  EXPECT_EQ(output[0], 0.);
+  EXPECT_EQ(output[1], 1.);
+
+  activation.type = custom_math::ACTIVATION_TANH;
+  custom_math::activation_forward(&activation, output, input, 4);
+  EXPECT_EQ(output[0], -1.);
+  EXPECT_EQ(output[1], 1.);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllIsas, ActivationTests,
+    ::testing::Values(custom_math::ISA_SCALAR, custom_math::ISA_SSE2,
+                      custom_math::ISA_AVX2, custom_math::ISA_AVX512),
+    [](const ::testing::TestParamInfo<custom_math::Isa> &info) {
+      return std::string(custom_math::simd_isa_name(info.param));
+    });
+
+TEST(ActivationMatrixTests, ActivateView) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(6, 7);
+  for (int i = 0; i < 42; i++) matrix->elements[i] = i / 10. - 2.;
+  custom_math::Activation activation = {custom_math::ACTIVATION_RELU, 0,
+                                        false};
+
+  // A view is not contiguous, so it is computed row by row.
+  custom_math::Matrix view = custom_math::matrix_view(matrix, 1, 2, 4, 3);
+  custom_math::Matrix *result =
+      custom_math::matrix_activate(&view, &activation);
+  ASSERT_NE(result, nullptr);
+  for (size_t i = 0; i < 4; i++)
+    for (size_t j = 0; j < 3; j++) {
+      double x = matrix->elements[(i + 1) * 7 + j + 2];
+      EXPECT_EQ(result->elements[i * 3 + j], x > 0 ? x : 0);
+    }
+
+  // In place, and into a matrix of another shape.
+  custom_math::Matrix *copy = custom_math::matrix_copy(matrix);
+  activation.type = custom_math::ACTIVATION_SIGMOID;
+  ASSERT_EQ(custom_math::matrix_activate_derivative_into(matrix, matrix,
+                                                         &activation),
+            matrix);
+  for (int i = 0; i < 42; i++) {
+    double s = 1. / (1. + exp(-copy->elements[i]));
+    EXPECT_NEAR(matrix->elements[i], s * (1. - s), 1e-15);
+  }
+  EXPECT_EQ(custom_math::matrix_activate_into(result, matrix, &activation),
+            nullptr);
+
+  // Two views of the same matrix that partially overlap.
+  custom_math::Matrix shifted = custom_math::matrix_view(matrix, 1, 1, 4, 3);
+  EXPECT_EQ(custom_math::matrix_activate_into(&shifted, &view, &activation),
+            nullptr);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(copy);
+  custom_math::matrix_delete(result);
+}
+
+TEST(ActivationMatrixTests, Functors) {
+  custom_math::MatrixF *matrix = custom_math::matrix_create<float>(5, 9);
+  for (int i = 0; i < 45; i++) matrix->elements[i] = i / 4.f - 5.f;
+  custom_math::Activation activation = {custom_math::ACTIVATION_GELU, 0,
+                                        false};
+
+  // The functors compute the same values as the kernels.
+  custom_math::MatrixF *mapped = custom_math::matrix_map(
+      matrix, custom_math::ActivationFunction<custom_math::ACTIVATION_GELU>());
+  custom_math::MatrixF *activated =
+      custom_math::matrix_activate(matrix, &activation);
+  ASSERT_NE(mapped, nullptr);
+  ASSERT_NE(activated, nullptr);
+  for (int i = 0; i < 45; i++)
+    EXPECT_NEAR(mapped->elements[i], activated->elements[i], 1e-6);
+
+  custom_math::ActivationDerivative<custom_math::ACTIVATION_LEAKY_RELU>
+      derivative = {0.5};
+  ASSERT_EQ(custom_math::matrix_map_inplace(matrix, derivative), matrix);
+  for (int i = 0; i < 45; i++)
+    EXPECT_EQ(matrix->elements[i], i / 4.f - 5.f > 0 ? 1.f : 0.5f);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(mapped);
+  custom_math::matrix_delete(activated);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file allocator-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the allocators.
+ * @version 1.0
+ * @date 2023-07-25
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include "allocator.hpp"
+#include "math.hpp"
+
+TEST(AllocatorTests, HeapAccounting) {
+  custom_math::Allocator *heap = custom_math::allocator_heap();
+  size_t before = custom_math::allocator_current(heap);
+
+  void *block = custom_math::allocator_allocate(heap, 1000);
+  EXPECT_NE(block, nullptr);
+  EXPECT_EQ((uintptr_t)block % ALLOCATOR_ALIGNMENT, 0u);
+  EXPECT_EQ(custom_math::allocator_current(heap), before + 1000);
+  EXPECT_GE(custom_math::allocator_peak(heap), before + 1000);
+  EXPECT_GE(custom_math::allocator_in_use(heap), 1000u);
+
+  custom_math::allocator_deallocate(heap, block, 1000);
+  EXPECT_EQ(custom_math::allocator_current(heap), before);
+}
+
+TEST(AllocatorTests, ArenaBumpAndReset) {
+  custom_math::Allocator *arena = custom_math::arena_create(1024);
+  ASSERT_NE(arena, nullptr);
+
+  char *first = (char *)custom_math::allocator_allocate(arena, 10);
+  char *second = (char *)custom_math::allocator_allocate(arena, 10);
+  EXPECT_EQ(second - first, ALLOCATOR_ALIGNMENT);
+
+  // Going over the first block chains a new one, and the reset merges them.
+  // The arena holds its blocks, whatever is in use.
+  EXPECT_NE(custom_math::allocator_allocate(arena, 4096), nullptr);
+  EXPECT_EQ(custom_math::arena_capacity(arena), 1024u + 4096u);
+  EXPECT_EQ(custom_math::allocator_in_use(arena), 10u + 10u + 4096u);
+  EXPECT_GT(custom_math::allocator_current(arena), 1024u + 4096u);
+
+  custom_math::arena_reset(arena);
+  EXPECT_EQ(custom_math::allocator_in_use(arena), 0u);
+  size_t capacity = custom_math::arena_capacity(arena);
+  size_t held = custom_math::allocator_current(arena);
+  EXPECT_GT(held, capacity);
+  EXPECT_GE(custom_math::allocator_peak(arena), 2 * capacity);
+  EXPECT_NE(custom_math::allocator_allocate(arena, 4096), nullptr);
+  EXPECT_EQ(custom_math::arena_capacity(arena), capacity);
+  EXPECT_EQ(custom_math::allocator_current(arena), held);
+
+  custom_math::arena_delete(arena);
+}
+
+TEST(AllocatorTests, PoolReusesBlocks) {
+  custom_math::Allocator *pool = custom_math::pool_create();
+  ASSERT_NE(pool, nullptr);
+
+  void *block = custom_math::allocator_allocate(pool, 700);
+  custom_math::allocator_deallocate(pool, block, 700);
+  EXPECT_EQ(custom_math::allocator_allocate(pool, 1000), block);
+  custom_math::allocator_deallocate(pool, block, 1000);
+  EXPECT_EQ(custom_math::allocator_in_use(pool), 0u);
+
+  // The free block of 1024 bytes is held until the pool is trimmed.
+  EXPECT_EQ(custom_math::allocator_current(pool), 1024u);
+  EXPECT_EQ(custom_math::allocator_peak(pool), 1024u);
+  custom_math::pool_trim(pool);
+  EXPECT_EQ(custom_math::allocator_current(pool), 0u);
+
+  custom_math::pool_delete(pool);
+}
+
+TEST(AllocatorTests, Limit) {
+  custom_math::Allocator *pool = custom_math::pool_create();
+  custom_math::allocator_set_limit(pool, 1024);
+
+  // The limit applies to the size classes, not to the requested sizes.
+  void *block = custom_math::allocator_allocate(pool, 1000);
+  EXPECT_NE(block, nullptr);
+  EXPECT_EQ(custom_math::allocator_allocate(pool, 100), nullptr);
+  EXPECT_EQ(custom_math::allocator_current(pool), 1024u);
+  EXPECT_EQ(custom_math::allocator_in_use(pool), 1000u);
+
+  // A free block still counts, until it is reused or trimmed.
+  custom_math::allocator_deallocate(pool, block, 1000);
+  EXPECT_EQ(custom_math::allocator_allocate(pool, 100), nullptr);
+  EXPECT_EQ(custom_math::allocator_allocate(pool, 900), block);
+  custom_math::allocator_deallocate(pool, block, 900);
+  custom_math::pool_trim(pool);
+  block = custom_math::allocator_allocate(pool, 100);
+  EXPECT_NE(block, nullptr);
+
+  custom_math::allocator_deallocate(pool, block, 100);
+  custom_math::pool_delete(pool);
+}
+
+TEST(AllocatorTests, MatricesFromArena) {
+  custom_math::Allocator *arena = custom_math::arena_create(1 << 16);
+
+  custom_math::Matrix *matrix1 = custom_math::matrix_create(4, 4, 1, arena);
+  ASSERT_NE(matrix1, nullptr);
+  EXPECT_EQ(matrix1->allocator, arena);
+  EXPECT_EQ((uintptr_t)matrix1->elements % ALLOCATOR_ALIGNMENT, 0u);
+
+  // Operations that do not take an allocator use the thread default.
+  custom_math::Allocator *previous = custom_math::allocator_set_default(arena);
+  custom_math::Matrix *matrix2 = custom_math::matrix_add(matrix1, matrix1);
+  custom_math::allocator_set_default(previous);
+
+  ASSERT_NE(matrix2, nullptr);
+  EXPECT_EQ(matrix2->allocator, arena);
+  EXPECT_EQ(matrix2->elements[15], 2);
+  EXPECT_GT(custom_math::allocator_in_use(arena), 0u);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  EXPECT_EQ(custom_math::allocator_in_use(arena), 0u);
+
+  custom_math::arena_reset(arena);
+  custom_math::arena_delete(arena);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file augment-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the data augmentation.
+ * @version 1.0
+ * @date 2023-08-10
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "augment.hpp"
+
+namespace {
+
+const size_t ROWS = 7, COLS = 9;
+
+// A 7x9 image with a 3x3 square in the middle.
+std::vector<float> make_image() {
+  std::vector<float> image(ROWS * COLS, 0.f);
+  for (size_t i = 2; i < 5; i++)
+    for (size_t j = 3; j < 6; j++) image[i * COLS + j] = 1.f;
+  return image;
+}
+
+std::vector<float> augmented(const images::AugmentChain &chain,
+                             const std::vector<float> &image, uint64_t seed) {
+  images::AugmenterF *augmenter =
+      images::augmenter_create<float>(&chain, ROWS, COLS);
+  EXPECT_NE(augmenter, nullptr);
+  std::vector<float> result(image.size());
+  images::augment(augmenter, result.data(), image.data(), seed);
+  images::augmenter_delete(augmenter);
+  return result;
+}
+
+}  // namespace
+
+TEST(AugmentTests, Chain) {
+  images::AugmentChain chain = images::augment_chain();
+  EXPECT_EQ(chain.count, 0u);
+  EXPECT_EQ(images::augmenter_create<float>(&chain, ROWS, COLS), nullptr);
+
+  EXPECT_FALSE(images::augment_add(&chain, images::AUGMENT_SHIFT, -1));
+  EXPECT_FALSE(images::augment_add(&chain, images::AUGMENT_ELASTIC, 1, 0));
+  for (size_t i = 0; i < AUGMENT_MAX_STEPS; i++)
+    EXPECT_TRUE(images::augment_add(&chain, images::AUGMENT_NOISE, 0.1));
+  EXPECT_FALSE(images::augment_add(&chain, images::AUGMENT_NOISE, 0.1));
+  EXPECT_EQ(chain.count, (size_t)AUGMENT_MAX_STEPS);
+}
+
+TEST(AugmentTests, Identity) {
+  // Transforms of amount 0 resample the image at its own pixels.
+  images::AugmentChain chain = images::augment_chain();
+  images::augment_add(&chain, images::AUGMENT_SHIFT, 0);
+  images::augment_add(&chain, images::AUGMENT_ROTATION, 0);
+  images::augment_add(&chain, images::AUGMENT_ELASTIC, 0, 3);
+  images::augment_add(&chain, images::AUGMENT_NOISE, 0);
+
+  std::vector<float> image = make_image();
+  std::vector<float> result = augmented(chain, image, 1);
+  for (size_t i = 0; i < image.size(); i++)
+    EXPECT_NEAR(result[i], image[i], 1e-6) << i;
+}
+
+TEST(AugmentTests, Transforms) {
+  std::vector<float> image = make_image();
+
+  // A shift keeps the square whole, up to the interpolation.
+  images::AugmentChain chain = images::augment_chain();
+  images::augment_add(&chain, images::AUGMENT_SHIFT, 1.5);
+  std::vector<float> shifted = augmented(chain, image, 2);
+  double sum = 0;
+  for (float value : shifted) sum += value;
+  EXPECT_NEAR(sum, 9., 1e-4);
+  EXPECT_NE(shifted, image);
+
+  // A rotation keeps the center of the image.
+  chain = images::augment_chain();
+  images::augment_add(&chain, images::AUGMENT_ROTATION, 30);
+  std::vector<float> rotated = augmented(chain, image, 3);
+  EXPECT_NEAR(rotated[3 * COLS + 4], 1.f, 1e-6);
+  EXPECT_NE(rotated, image);
+
+  // Everything, in the same order, with noise keeping the pixels in [0, 1].
+  images::augment_add(&chain, images::AUGMENT_ELASTIC, 1, 3);
+  images::augment_add(&chain, images::AUGMENT_SHIFT, 2);
+  images::augment_add(&chain, images::AUGMENT_NOISE, 0.3);
+  std::vector<float> first = augmented(chain, image, 4);
+  for (float value : first) {
+    EXPECT_GE(value, 0.f);
+    EXPECT_LE(value, 1.f);
+  }
+  EXPECT_EQ(augmented(chain, image, 4), first);
+  EXPECT_NE(augmented(chain, image, 5), first);
+
+  // In place.
+  images::AugmenterF *augmenter =
+      images::augmenter_create<float>(&chain, ROWS, COLS);
+  images::augment(augmenter, image.data(), image.data(), 4);
+  EXPECT_EQ(image, first);
+  images::augmenter_delete(augmenter);
+}
+
+TEST(AugmentTests, Noise) {
+  // The noise is centered, of the requested standard deviation.
+  images::AugmentChain chain = images::augment_chain();
+  images::augment_add(&chain, images::AUGMENT_NOISE, 0.05);
+  images::Augmenter *augmenter =
+      images::augmenter_create<double>(&chain, 100, 100);
+  ASSERT_NE(augmenter, nullptr);
+
+  std::vector<double> image(10000, 0.5), result(10000);
+  images::augment(augmenter, result.data(), image.data(), 6);
+  double mean = 0, variance = 0;
+  for (double value : result) mean += value / 10000;
+  for (double value : result) variance += (value - mean) * (value - mean);
+  EXPECT_NEAR(mean, 0.5, 0.002);
+  EXPECT_NEAR(sqrt(variance / 10000), 0.05, 0.002);
+  images::augmenter_delete(augmenter);
+}
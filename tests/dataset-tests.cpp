@@ -0,0 +1,119 @@
+/**
+ * @file dataset-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the datasets.
+ * @version 1.0
+ * @date 2023-08-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include "dataset.hpp"
+
+namespace {
+
+// Five 3x4 images, image i has the label i and the pixels 10 * i + j.
+images::RawImages make_raw(uint8_t *labels, uint8_t *pixels) {
+  for (int i = 0; i < 5; i++) {
+    labels[i] = (uint8_t)i;
+    for (int j = 0; j < 12; j++) pixels[i * 12 + j] = (uint8_t)(10 * i + j);
+  }
+
+  images::RawImages raw;
+  memset(&raw, 0, sizeof(raw));
+  raw.count = 5;
+  raw.rows = 3;
+  raw.cols = 4;
+  raw.labels = labels;
+  raw.pixels = pixels;
+  return raw;
+}
+
+}  // namespace
+
+TEST(DatasetTests, FromRaw) {
+  uint8_t labels[5], pixels[60];
+  images::RawImages raw = make_raw(labels, pixels);
+
+  custom_math::Allocator *heap = custom_math::allocator_heap();
+  const size_t used = custom_math::allocator_current(heap);
+
+  images::DatasetF *dataset = images::dataset_from_raw<float>(&raw, 0, heap);
+  ASSERT_NE(dataset, nullptr);
+  EXPECT_EQ(dataset->count, 5u);
+  EXPECT_EQ(dataset->samples.rows, 5u);
+  EXPECT_EQ(dataset->samples.cols, 12u);
+  EXPECT_EQ(dataset->samples.stride, 12u);
+  EXPECT_EQ((uintptr_t)dataset->samples.elements % ALLOCATOR_ALIGNMENT, 0u);
+  for (int i = 0; i < 60; i++)
+    EXPECT_EQ(dataset->samples.elements[i], (float)(pixels[i] / 255.0));
+
+  // A sample is a view of its image.
+  custom_math::MatrixF sample = images::dataset_sample(dataset, 2);
+  EXPECT_EQ(sample.rows, 3u);
+  EXPECT_EQ(sample.cols, 4u);
+  EXPECT_EQ(sample.allocator, nullptr);
+  EXPECT_EQ(sample.elements, dataset->samples.elements + 24);
+  EXPECT_EQ(*custom_math::matrix_row(&sample, 1), (float)(24 / 255.0));
+
+  // A batch is a view of consecutive rows, cut at the end of the dataset.
+  images::BatchF batch = images::dataset_batch(dataset, 1, 2);
+  EXPECT_EQ(batch.samples.rows, 2u);
+  EXPECT_EQ(batch.samples.cols, 12u);
+  EXPECT_EQ(batch.samples.elements, dataset->samples.elements + 12);
+  EXPECT_EQ(batch.labels[0], 1);
+  EXPECT_EQ(batch.labels[1], 2);
+  batch = images::dataset_batch(dataset, 3, 4);
+  EXPECT_EQ(batch.samples.rows, 2u);
+  EXPECT_EQ(batch.labels[1], 4);
+
+  // Everything is in one block.
+  EXPECT_EQ(custom_math::allocator_current(heap), used + dataset->size);
+  images::dataset_delete(dataset);
+  EXPECT_EQ(custom_math::allocator_current(heap), used);
+
+  // Some of the images, and more images than there are.
+  images::Dataset *first = images::dataset_from_raw(&raw, 3);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->count, 3u);
+  EXPECT_EQ(first->labels[2], 2);
+  images::dataset_delete(first);
+  EXPECT_EQ(images::dataset_from_raw(&raw, 6), nullptr);
+}
+
+TEST(DatasetTests, Bytes) {
+  uint8_t labels[5], pixels[60];
+  images::RawImages raw = make_raw(labels, pixels);
+
+  // The pixels are kept as they are, in 8 times less memory than doubles.
+  images::ByteDataset *dataset = images::dataset_from_raw<uint8_t>(&raw);
+  ASSERT_NE(dataset, nullptr);
+  EXPECT_EQ(dataset->samples.cols, 12u);
+  EXPECT_EQ(memcmp(dataset->samples.elements, pixels, 60), 0);
+  EXPECT_EQ(dataset->labels[4], 4);
+
+  custom_math::BasicMatrix<uint8_t> sample = images::dataset_sample(dataset, 1);
+  EXPECT_EQ(*custom_math::matrix_row(&sample, 2), 18);
+  images::BasicBatch<uint8_t> batch = images::dataset_batch(dataset, 4, 2);
+  EXPECT_EQ(batch.samples.rows, 1u);
+  EXPECT_EQ(batch.samples.elements[0], 40);
+  images::dataset_delete(dataset);
+}
+
+TEST(DatasetTests, ReadTestDataset) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+  EXPECT_EQ(dataset->count, 10000u);
+  EXPECT_EQ(dataset->rows, 28u);
+  EXPECT_EQ(dataset->cols, 28u);
+
+  for (size_t i = 0; i < dataset->count; i++) {
+    ASSERT_GE(dataset->labels[i], 0);
+    ASSERT_LE(dataset->labels[i], 9);
+  }
+  images::dataset_delete(dataset);
+}
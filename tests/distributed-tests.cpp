@@ -0,0 +1,305 @@
+/**
+ * @file distributed-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the transports and the distributed
+ *        training. The processes of a ring are played by threads.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "distributed.hpp"
+
+namespace {
+
+typedef neural::Transport *(*CreateTransport)(const char *, size_t, size_t);
+
+// A name unique to the test process and to the ring.
+std::string ring_name(const char *prefix) {
+  static int rings = 0;
+  char name[64];
+  snprintf(name, sizeof(name), "%s-%d-%d", prefix, (int)getpid(), rings++);
+  return name;
+}
+
+// Runs every rank of a ring on a thread of its own.
+void run_ring(CreateTransport create, const std::string &name, size_t size,
+              const std::function<void(neural::Transport *)> &rank) {
+  std::vector<std::thread> threads;
+  for (size_t r = 0; r < size; r++)
+    threads.emplace_back([&, r] {
+      neural::Transport *transport = create(name.c_str(), r, size);
+      EXPECT_NE(transport, nullptr);
+      if (transport == nullptr) return;
+      EXPECT_EQ(transport->rank, r);
+      rank(transport);
+      neural::transport_delete(transport);
+    });
+  for (std::thread &thread : threads) thread.join();
+}
+
+// Sums arrays of every count over a ring of three, from fewer elements than
+// ranks to chunks larger than a channel of shared memory.
+void check_allreduce(CreateTransport create, const std::string &name) {
+  const size_t counts[] = {0, 2, 1000, 500000};
+
+  run_ring(create, name, 3, [&counts](neural::Transport *transport) {
+    for (size_t count : counts) {
+      std::vector<double> data(count), scratch(count / 3 + 1);
+      for (size_t i = 0; i < count; i++)
+        data[i] = (double)(transport->rank * count + i);
+
+      ASSERT_TRUE(neural::ring_allreduce(transport, data.data(), count,
+                                         scratch.data()));
+      for (size_t i = 0; i < count; i++)
+        ASSERT_EQ(data[i], (double)(3 * i + 3 * count)) << i;
+    }
+  });
+}
+
+const size_t SIZES[] = {784, 32, 16, 10};
+const custom_math::Activation ACTIVATION = {custom_math::ACTIVATION_TANH, 0,
+                                            false};
+
+}  // namespace
+
+TEST(DistributedTests, SharedMemoryAllreduce) {
+  check_allreduce(neural::transport_create_shm, ring_name("/neural"));
+}
+
+// A segment left under the name by a crashed run, whose counters are not 0,
+// is replaced, even when a rank maps it before rank 0 starts.
+TEST(DistributedTests, StaleSegment) {
+  const std::string name = ring_name("/neural");
+
+  // The size of the segment of a ring of two, seen while rank 0 waits.
+  neural::Transport *first = nullptr;
+  std::thread zero(
+      [&] { first = neural::transport_create_shm(name.c_str(), 0, 2); });
+  struct stat status;
+  status.st_size = 0;
+  while (status.st_size == 0) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd >= 0) {
+      fstat(fd, &status);
+      close(fd);
+    }
+  }
+  neural::Transport *second = neural::transport_create_shm(name.c_str(), 1, 2);
+  zero.join();
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  neural::transport_delete(second);
+  neural::transport_delete(first);
+
+  // The segment of a crashed run, in which one rank attached.
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, status.st_size), 0);
+  const uint64_t attached = 1;
+  ASSERT_EQ(pwrite(fd, &attached, sizeof(attached), 0),
+            (ssize_t)sizeof(attached));
+  close(fd);
+
+  std::thread one([&] {
+    second = neural::transport_create_shm(name.c_str(), 1, 2);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  first = neural::transport_create_shm(name.c_str(), 0, 2);
+  one.join();
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+
+  int sent[2] = {1, 2}, received[2] = {0, 0};
+  std::thread exchange([&] {
+    EXPECT_TRUE(neural::transport_exchange(second, &sent[1], sizeof(int),
+                                           &received[1], sizeof(int)));
+  });
+  EXPECT_TRUE(neural::transport_exchange(first, &sent[0], sizeof(int),
+                                         &received[0], sizeof(int)));
+  exchange.join();
+  EXPECT_EQ(received[0], 2);
+  EXPECT_EQ(received[1], 1);
+
+  neural::transport_delete(second);
+  neural::transport_delete(first);
+}
+
+TEST(DistributedTests, SocketAllreduce) {
+  check_allreduce(neural::transport_create_socket, ring_name("/tmp/neural"));
+}
+
+TEST(DistributedTests, SingleProcess) {
+  run_ring(neural::transport_create_socket, ring_name("/tmp/neural"), 1,
+           [](neural::Transport *transport) {
+             float data[3] = {1, 2, 3}, scratch[4];
+             EXPECT_TRUE(
+                 neural::ring_allreduce(transport, data, 3, scratch));
+             EXPECT_EQ(data[2], 3.f);
+           });
+}
+
+TEST(DistributedTests, Invalid) {
+  EXPECT_EQ(neural::transport_create_shm(nullptr, 0, 1), nullptr);
+  EXPECT_EQ(neural::transport_create_shm("/neural", 2, 2), nullptr);
+  EXPECT_EQ(neural::transport_create_socket("/tmp/neural", 0, 0), nullptr);
+
+  // Longer than the path of a Unix-domain socket.
+  std::string path = "/tmp/" + std::string(200, 'n');
+  EXPECT_EQ(neural::transport_create_socket(path.c_str(), 0, 1), nullptr);
+}
+
+TEST(DistributedTests, ClosedPeer) {
+  run_ring(neural::transport_create_socket, ring_name("/tmp/neural"), 2,
+           [](neural::Transport *transport) {
+             if (transport->rank == 1) return;
+             char byte = 0;
+             EXPECT_FALSE(neural::transport_exchange(transport, &byte, 1,
+                                                     &byte, 1));
+           });
+}
+
+// Two processes, each training on half of every batch, take the same steps
+// as a single one training on the whole batches.
+TEST(DistributedTests, TrainShards) {
+  images::Dataset *dataset = images::read_test_dataset<double>();
+  ASSERT_NE(dataset, nullptr);
+  const neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_MOMENTUM);
+
+  neural::Network *single = neural::network_create<double>(SIZES, 4,
+                                                           &ACTIVATION, 3);
+  neural::Workspace *workspace = neural::workspace_create(single, 50);
+  neural::Optimizer *optimizer =
+      neural::optimizer_create<double>(single->size, &options);
+  std::vector<double> losses;
+  for (size_t i = 0; i < 10; i++) {
+    images::Batch batch = images::dataset_batch(dataset, i * 50, 50);
+    losses.push_back(
+        neural::network_train_batch(single, workspace, &batch, optimizer));
+  }
+
+  for (CreateTransport create :
+       {neural::transport_create_shm, neural::transport_create_socket}) {
+    std::string name = ring_name(create == neural::transport_create_shm
+                                     ? "/neural"
+                                     : "/tmp/neural");
+    run_ring(create, name, 2, [&](neural::Transport *transport) {
+      neural::Network *network =
+          neural::network_create<double>(SIZES, 4, &ACTIVATION, 3);
+      neural::Optimizer *replica =
+          neural::optimizer_create<double>(network->size, &options);
+      neural::Distributed *distributed =
+          neural::distributed_create(network, 25, transport);
+      ASSERT_NE(distributed, nullptr);
+
+      for (size_t i = 0; i < 10; i++) {
+        images::Batch batch =
+            images::dataset_batch(dataset, i * 50 + transport->rank * 25, 25);
+        double loss = neural::distributed_train_batch(distributed, network,
+                                                      &batch, replica);
+        EXPECT_FALSE(isnan(loss));
+        EXPECT_LT(fabs(loss - losses[i]), 0.5);
+      }
+
+      double difference = 0;
+      for (size_t i = 0; i < network->size; i++)
+        difference = fmax(difference, fabs(network->parameters[i] -
+                                           single->parameters[i]));
+      EXPECT_LT(difference, 1e-12);
+
+      neural::distributed_delete(distributed);
+      neural::optimizer_delete(replica);
+      neural::network_delete(network);
+    });
+  }
+
+  neural::optimizer_delete(optimizer);
+  neural::workspace_delete(workspace);
+  neural::network_delete(single);
+  images::dataset_delete(dataset);
+}
+
+// A process with an invalid label adds no gradients, but its peers do not wait
+// for it and the replicas stay the same.
+TEST(DistributedTests, TrainInvalidLabels) {
+  images::Dataset *dataset = images::read_test_dataset<double>();
+  ASSERT_NE(dataset, nullptr);
+  const neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  std::vector<double> parameters[2];
+  std::vector<int> labels(dataset->labels + 25, dataset->labels + 50);
+  labels[3] = 10;
+
+  run_ring(neural::transport_create_shm, ring_name("/neural"), 2,
+           [&](neural::Transport *transport) {
+             neural::Network *network =
+                 neural::network_create<double>(SIZES, 4, &ACTIVATION, 3);
+             neural::Optimizer *optimizer =
+                 neural::optimizer_create<double>(network->size, &options);
+             neural::Distributed *distributed =
+                 neural::distributed_create(network, 25, transport);
+             ASSERT_NE(distributed, nullptr);
+
+             images::Batch batch =
+                 images::dataset_batch(dataset, transport->rank * 25, 25);
+             if (transport->rank == 1) batch.labels = labels.data();
+             const double loss = neural::distributed_train_batch(
+                 distributed, network, &batch, optimizer);
+             EXPECT_EQ(isnan(loss), transport->rank == 1);
+             parameters[transport->rank].assign(
+                 network->parameters, network->parameters + network->size);
+
+             neural::distributed_delete(distributed);
+             neural::optimizer_delete(optimizer);
+             neural::network_delete(network);
+           });
+
+  EXPECT_EQ(parameters[0], parameters[1]);
+  images::dataset_delete(dataset);
+}
+
+// Once a process is gone, the others fail instead of waiting forever.
+TEST(DistributedTests, TrainClosedPeer) {
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  images::DatasetF *dataset = images::dataset_create<float>(8, 28, 28);
+
+  run_ring(neural::transport_create_socket, ring_name("/tmp/neural"), 2,
+           [&](neural::Transport *transport) {
+             if (transport->rank == 1) return;
+             neural::NetworkF *replica =
+                 neural::network_create<float>(SIZES, 4, &ACTIVATION);
+             neural::OptimizerF *optimizer =
+                 neural::optimizer_create<float>(replica->size, &options);
+             neural::DistributedF *distributed =
+                 neural::distributed_create(replica, 8, transport);
+             images::BatchF batch = images::dataset_batch(dataset, 0, 8);
+
+             EXPECT_TRUE(isnan(neural::distributed_train_batch(
+                 distributed, replica, &batch, optimizer)));
+             EXPECT_TRUE(isnan(neural::distributed_train_batch(
+                 distributed, replica, &batch, optimizer)));
+
+             neural::distributed_delete(distributed);
+             neural::optimizer_delete(optimizer);
+             neural::network_delete(replica);
+           });
+
+  images::dataset_delete(dataset);
+}
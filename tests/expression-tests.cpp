@@ -0,0 +1,168 @@
+/**
+ * @file expression-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the lazy matrix expressions.
+ * @version 1.0
+ * @date 2023-07-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include "expression.hpp"
+#include "math.hpp"
+
+namespace {
+
+double sigmoid(double x) { return 1. / (1. + exp(-x)); }
+
+custom_math::Matrix *random_matrix(int rows, int cols, unsigned int seed) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(rows, cols);
+  srand(seed);
+  for (int i = 0; i < rows * cols; i++)
+    matrix->elements[i] = rand() / (double)RAND_MAX - 0.5;
+  return matrix;
+}
+
+}  // namespace
+
+TEST(ExpressionTests, ElementWiseChain) {
+  custom_math::Matrix *a = random_matrix(7, 9, 1);
+  custom_math::Matrix *b = random_matrix(7, 9, 2);
+  custom_math::Matrix *c = random_matrix(7, 9, 3);
+
+  // (a + b) * 2 - c, then the square of every element.
+  custom_math::Matrix *result =
+      custom_math::matrix_eval(custom_math::lazy_apply(
+          custom_math::lazy_sub(
+              custom_math::lazy_scale(custom_math::lazy_add(a, b), 2.), c),
+          [](double x) { return x * x; }));
+
+  ASSERT_NE(result, nullptr);
+  EXPECT_EQ(result->rows, 7u);
+  EXPECT_EQ(result->cols, 9u);
+  for (int i = 0; i < 63; i++) {
+    double expected = (a->elements[i] + b->elements[i]) * 2. - c->elements[i];
+    EXPECT_DOUBLE_EQ(result->elements[i], expected * expected);
+  }
+
+  custom_math::matrix_delete(a);
+  custom_math::matrix_delete(b);
+  custom_math::matrix_delete(c);
+  custom_math::matrix_delete(result);
+}
+
+TEST(ExpressionTests, Broadcast) {
+  custom_math::Matrix *a = random_matrix(4, 5, 4);
+  custom_math::Matrix *row = random_matrix(1, 5, 5);
+  custom_math::Matrix *col = random_matrix(4, 1, 6);
+  custom_math::Matrix *result = custom_math::matrix_create(4, 5);
+
+  ASSERT_NE(custom_math::matrix_eval_into(
+                result, custom_math::lazy_add(
+                            custom_math::lazy_add(
+                                a, custom_math::lazy_broadcast(row)),
+                            custom_math::lazy_broadcast(col))),
+            nullptr);
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 5; j++)
+      EXPECT_DOUBLE_EQ(result->elements[i * 5 + j],
+                       a->elements[i * 5 + j] + row->elements[j] +
+                           col->elements[i]);
+
+  // The destination cannot be broadcast, since it is being written.
+  EXPECT_EQ(custom_math::matrix_eval_into(
+                result, custom_math::lazy_add(
+                            a, custom_math::lazy_broadcast(result))),
+            nullptr);
+
+  // A matrix that is not a vector of the right size does not fit.
+  custom_math::Matrix *other = random_matrix(5, 4, 7);
+  EXPECT_EQ(custom_math::matrix_eval_into(
+                result, custom_math::lazy_add(
+                            a, custom_math::lazy_broadcast(other))),
+            nullptr);
+
+  custom_math::matrix_delete(a);
+  custom_math::matrix_delete(row);
+  custom_math::matrix_delete(col);
+  custom_math::matrix_delete(result);
+  custom_math::matrix_delete(other);
+}
+
+TEST(ExpressionTests, InPlace) {
+  custom_math::Matrix *a = random_matrix(3, 3, 8);
+  custom_math::Matrix *copy = custom_math::matrix_copy(a);
+
+  EXPECT_EQ(custom_math::matrix_eval_into(
+                a, custom_math::lazy_scale(custom_math::lazy_add(a, a), 0.25)),
+            a);
+  for (int i = 0; i < 9; i++)
+    EXPECT_DOUBLE_EQ(a->elements[i], copy->elements[i] * 0.5);
+
+  // Reading the destination at other positions is not allowed.
+  custom_math::Matrix view = custom_math::matrix_view(a, 0, 1, 3, 2);
+  custom_math::Matrix destination = custom_math::matrix_view(a, 0, 0, 3, 2);
+  EXPECT_EQ(custom_math::matrix_eval_into(&destination,
+                                          custom_math::lazy(&view)),
+            nullptr);
+
+  custom_math::matrix_delete(a);
+  custom_math::matrix_delete(copy);
+}
+
+TEST(ExpressionTests, DotEpilogue) {
+  const int rows = 37, inner = 300, cols = 70;
+  custom_math::Matrix *weights = random_matrix(rows, inner, 9);
+  custom_math::Matrix *input = random_matrix(inner, cols, 10);
+  custom_math::Matrix *bias = random_matrix(rows, 1, 11);
+  custom_math::Matrix *output = custom_math::matrix_create(rows, cols);
+
+  ASSERT_EQ(custom_math::matrix_dot_eval_into(
+                output, weights, input,
+                custom_math::lazy_apply(
+                    custom_math::lazy_add(custom_math::lazy_product<double>(),
+                                          custom_math::lazy_broadcast(bias)),
+                    sigmoid)),
+            output);
+
+  // The same layer with temporary matrices.
+  custom_math::Matrix *product = custom_math::matrix_dot(weights, input);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      EXPECT_NEAR(output->elements[i * cols + j],
+                  sigmoid(product->elements[i * cols + j] + bias->elements[i]),
+                  1e-12);
+
+  EXPECT_EQ(custom_math::matrix_dot_eval_into(
+                output, weights, input,
+                custom_math::lazy_add(custom_math::lazy_product<double>(),
+                                      output)),
+            nullptr);
+  EXPECT_EQ(custom_math::matrix_dot_eval_into(
+                output, input, weights, custom_math::lazy_product<double>()),
+            nullptr);
+
+  custom_math::matrix_delete(weights);
+  custom_math::matrix_delete(input);
+  custom_math::matrix_delete(bias);
+  custom_math::matrix_delete(output);
+  custom_math::matrix_delete(product);
+}
+
+TEST(ExpressionTests, Float) {
+  custom_math::MatrixF *a = custom_math::matrix_create<float>(2, 3, 1.5);
+  custom_math::MatrixF *b = custom_math::matrix_create<float>(1, 3, 0.5);
+
+  custom_math::MatrixF *result = custom_math::matrix_eval(
+      custom_math::lazy_sub(a, custom_math::lazy_broadcast(b)));
+  ASSERT_NE(result, nullptr);
+  for (int i = 0; i < 6; i++) EXPECT_EQ(result->elements[i], 1.f);
+
+  custom_math::matrix_delete(a);
+  custom_math::matrix_delete(b);
+  custom_math::matrix_delete(result);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file gemm-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the GEMM engine.
+ * @version 1.0
+ * @date 2023-07-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "gemm.hpp"
+
+namespace {
+
+std::vector<double> random_values(size_t size, unsigned int seed) {
+  std::vector<double> values(size);
+  srand(seed);
+  for (size_t i = 0; i < size; i++) values[i] = rand() / (double)RAND_MAX - 0.5;
+  return values;
+}
+
+// Straightforward C = alpha * op(A) * op(B) + beta * C used as a reference.
+void reference_gemm(custom_math::Transpose trans_a,
+                    custom_math::Transpose trans_b, size_t m, size_t n,
+                    size_t k, double alpha, const double *a, size_t lda,
+                    const double *b, size_t ldb, double beta, double *c,
+                    size_t ldc) {
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++) {
+      double sum = 0.;
+      for (size_t p = 0; p < k; p++) {
+        double x = trans_a == custom_math::TRANS ? a[p * lda + i]
+                                                 : a[i * lda + p];
+        double y = trans_b == custom_math::TRANS ? b[j * ldb + p]
+                                                 : b[p * ldb + j];
+        sum += x * y;
+      }
+      c[i * ldc + j] = alpha * sum + beta * c[i * ldc + j];
+    }
+}
+
+void check_gemm(custom_math::Transpose trans_a,
+                custom_math::Transpose trans_b, size_t m, size_t n, size_t k,
+                double alpha, double beta) {
+  size_t lda = trans_a == custom_math::TRANS ? m : k;
+  size_t ldb = trans_b == custom_math::TRANS ? k : n;
+
+  std::vector<double> a = random_values(m * k, 1);
+  std::vector<double> b = random_values(k * n, 2);
+  std::vector<double> c = random_values(m * n, 3);
+  std::vector<double> expected = c;
+
+  custom_math::gemm(trans_a, trans_b, m, n, k, alpha, a.data(), lda, b.data(),
+                    ldb, beta, c.data(), n);
+  reference_gemm(trans_a, trans_b, m, n, k, alpha, a.data(), lda, b.data(),
+                 ldb, beta, expected.data(), n);
+
+  for (size_t i = 0; i < m * n; i++)
+    ASSERT_NEAR(c[i], expected[i], 1e-9 * (k + 1)) << "at index " << i;
+}
+
+}  // namespace
+
+TEST(GemmTests, SmallProduct) {
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 3, 5, 7, 1., 0.);
+}
+
+TEST(GemmTests, EdgeTiles) {
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 13, 17, 19, 1., 0.);
+}
+
+TEST(GemmTests, LayerShapes) {
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 64, 128, 784, 1.,
+             0.);
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 64, 10, 128, 1.,
+             0.);
+}
+
+TEST(GemmTests, MultipleBlocks) {
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 211, 2100, 300, 1.,
+             0.);
+}
+
+TEST(GemmTests, AlphaBeta) {
+  check_gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 31, 29, 600, -0.5,
+             2.);
+}
+
+TEST(GemmTests, Transposed) {
+  check_gemm(custom_math::TRANS, custom_math::NO_TRANS, 37, 41, 43, 1., 1.);
+  check_gemm(custom_math::NO_TRANS, custom_math::TRANS, 37, 41, 43, 1., 1.);
+  check_gemm(custom_math::TRANS, custom_math::TRANS, 37, 41, 43, 1., 1.);
+}
+
+TEST(GemmTests, EmptyInnerDimension) {
+  std::vector<double> c(4, 3.);
+  custom_math::gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, 2, 2, 0, 1.,
+                    nullptr, 0, nullptr, 2, 2., c.data(), 2);
+
+  for (size_t i = 0; i < 4; i++) EXPECT_EQ(c[i], 6.);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file gzip-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the streaming decompression of the
+ *        gzip files.
+ * @version 1.0
+ * @date 2023-08-07
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "gzip.hpp"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+// Lines of many lengths, one of them longer than a block.
+std::string make_text() {
+  std::string text;
+  srand(4);
+  for (int i = 0; i < 3000; i++) {
+    size_t length = i == 1000 ? 3 * GZIP_BLOCK_SIZE / 2 : rand() % 3000;
+    for (size_t j = 0; j < length; j++) text += (char)('a' + (i + j) % 26);
+    text += i % 3 ? "\n" : "\r\n";
+  }
+  // The last line does not end with a newline.
+  text += "end";
+  return text;
+}
+
+#ifdef USE_ZLIB
+// Compresses the text in two members, like two concatenated gzip files.
+std::string compress(const std::string &text, const char *filename) {
+  const size_t half = text.size() / 2;
+  gzFile file = gzopen(filename, "wb");
+  gzwrite(file, text.data(), (unsigned)half);
+  gzclose(file);
+  file = gzopen(filename, "ab");
+  gzwrite(file, text.data() + half, (unsigned)(text.size() - half));
+  gzclose(file);
+
+  std::string content;
+  FILE *input = fopen(filename, "rb");
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    content.append(buffer, size);
+  fclose(input);
+  remove(filename);
+  return content;
+}
+#endif
+
+}  // namespace
+
+TEST(GzipTests, Blocks) {
+#ifndef USE_ZLIB
+  GTEST_SKIP() << "built without zlib";
+#else
+  const std::string text = make_text();
+  const std::string content = compress(text, "gzip-tests.gz");
+  ASSERT_TRUE(images::gzip_is_compressed(content.data(), content.size()));
+  EXPECT_FALSE(images::gzip_is_compressed(text.data(), text.size()));
+
+  images::GzipReader *reader =
+      images::gzip_open(content.data(), content.size());
+  ASSERT_NE(reader, nullptr);
+
+  // The blocks put together are the text, and only the last one does not end
+  // with a newline.
+  std::string result;
+  const char *begin, *end;
+  int blocks = 0;
+  while (images::gzip_next_lines(reader, &begin, &end)) {
+    EXPECT_TRUE(result.empty() || result.back() == '\n');
+    result.append(begin, end);
+    blocks++;
+  }
+  EXPECT_TRUE(images::gzip_close(reader));
+  EXPECT_GT(blocks, 3);
+  EXPECT_EQ(result.size(), text.size());
+  EXPECT_TRUE(result == text);
+#endif
+}
+
+TEST(GzipTests, Corrupted) {
+#ifndef USE_ZLIB
+  GTEST_SKIP() << "built without zlib";
+#else
+  const std::string text = make_text();
+  const std::string content = compress(text, "gzip-tests.gz");
+
+  auto read_all = [](const std::string &data) {
+    images::GzipReader *reader = images::gzip_open(data.data(), data.size());
+    EXPECT_NE(reader, nullptr);
+    const char *begin, *end;
+    while (images::gzip_next_lines(reader, &begin, &end)) {
+    }
+    return images::gzip_close(reader);
+  };
+
+  // One bit of the compressed data, then a file that ends early.
+  std::string corrupted = content;
+  corrupted[corrupted.size() / 3] ^= 1;
+  EXPECT_FALSE(read_all(corrupted));
+  EXPECT_FALSE(read_all(content.substr(0, content.size() - 100)));
+
+  // A reader can be stopped before the end.
+  images::GzipReader *reader =
+      images::gzip_open(content.data(), content.size());
+  ASSERT_NE(reader, nullptr);
+  const char *begin, *end;
+  ASSERT_TRUE(images::gzip_next_lines(reader, &begin, &end));
+  EXPECT_TRUE(images::gzip_close(reader));
+
+  EXPECT_EQ(images::gzip_open(text.data(), text.size()), nullptr);
+#endif
+}
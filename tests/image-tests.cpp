@@ -10,9 +10,16 @@
  */
 
 #include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <vector>
 
 #include "image.hpp"
 
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
 class ImageTests : public ::testing::Test {
  public:
   ImageTests() {}
@@ -54,4 +61,294 @@ TEST(ImageTests, ReadTrainFile) {
     EXPECT_EQ(images[i]->pixels->rows, 28);
     EXPECT_EQ(images[i]->pixels->cols, 28);
   }
-}
\ No newline at end of file
+}
+namespace {
+
+// Writes a CSV file of images, with a header. Image i has the label i and
+// all its pixels set to 10 * i, except for the last one which is 255.
+void write_images(const char *filename, int count, const char *extra) {
+  FILE *file = fopen(filename, "w");
+  ASSERT_NE(file, nullptr);
+
+  fprintf(file, "label");
+  for (int j = 0; j < IMAGE_ROWS * IMAGE_COLS; j++) fprintf(file, ",p%d", j);
+  fprintf(file, "\n");
+
+  for (int i = 0; i < count; i++) {
+    fprintf(file, "%d", i);
+    for (int j = 0; j < IMAGE_ROWS * IMAGE_COLS - 1; j++)
+      fprintf(file, ",%d", 10 * i);
+    // Windows line endings are accepted too.
+    fprintf(file, ",255%s", i % 2 ? "\r\n" : "\n");
+  }
+  fprintf(file, "%s", extra);
+
+  fclose(file);
+}
+
+}  // namespace
+
+TEST(ImageTests, ParseFile) {
+  const char *filename = "image-tests.csv";
+  write_images(filename, 25, "\n");
+
+  int count = 20;
+  images::ReadReport report;
+  images::ImageF **images =
+      images::read_images<float>(filename, &count, &report);
+
+  ASSERT_NE(images, nullptr);
+  EXPECT_EQ(report.rows, 25u);
+  EXPECT_EQ(report.malformed, 0u);
+  for (int i = 0; i < count; i++) {
+    EXPECT_EQ(images[i]->label, i);
+    EXPECT_EQ(images[i]->pixels->elements[0], (float)(10 * i / 255.0));
+    EXPECT_EQ(images[i]->pixels->elements[IMAGE_ROWS * IMAGE_COLS - 2],
+              (float)(10 * i / 255.0));
+    EXPECT_EQ(images[i]->pixels->elements[IMAGE_ROWS * IMAGE_COLS - 1], 1.f);
+  }
+  images::delete_images(images, count);
+
+  // More images than the file holds.
+  count = 26;
+  EXPECT_EQ(images::read_images<float>(filename, &count), nullptr);
+
+  remove(filename);
+}
+
+TEST(ImageTests, CompressedFile) {
+#ifndef USE_ZLIB
+  GTEST_SKIP() << "built without zlib";
+#else
+  const char *filename = "image-tests.csv";
+  const char *compressed = "image-tests.csv.gz";
+  write_images(filename, 25, "");
+
+  FILE *input = fopen(filename, "rb");
+  ASSERT_NE(input, nullptr);
+  gzFile output = gzopen(compressed, "wb");
+  ASSERT_NE(output, nullptr);
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    gzwrite(output, buffer, (unsigned)size);
+  fclose(input);
+  gzclose(output);
+
+  // The images are the same as the ones of the CSV file.
+  int count = 25;
+  images::Image **expected = images::read_images(filename, &count);
+  images::Image **images = images::read_images(compressed, &count);
+  ASSERT_NE(expected, nullptr);
+  ASSERT_NE(images, nullptr);
+  for (int i = 0; i < count; i++) {
+    EXPECT_EQ(images[i]->label, expected[i]->label);
+    for (int j = 0; j < IMAGE_ROWS * IMAGE_COLS; j++)
+      ASSERT_EQ(images[i]->pixels->elements[j],
+                expected[i]->pixels->elements[j]);
+  }
+  images::delete_images(expected, count);
+  images::delete_images(images, count);
+
+  // All the images, and more than the file holds.
+  images::RawImages *raw = images::read_raw_images(compressed, 0);
+  ASSERT_NE(raw, nullptr);
+  EXPECT_EQ(raw->count, 25u);
+  images::delete_raw_images(raw);
+  count = 26;
+  EXPECT_EQ(images::read_images(compressed, &count), nullptr);
+
+  remove(filename);
+  remove(compressed);
+#endif
+}
+
+TEST(ImageTests, MalformedRows) {
+  const char *filename = "image-tests.csv";
+  int count = 4;
+  images::ReadReport report;
+
+  // A row that is too short, on line 5 after the header and 3 images.
+  write_images(filename, 3, "3,1,2\n");
+  EXPECT_EQ(images::read_images(filename, &count, &report), nullptr);
+  EXPECT_EQ(report.malformed, 1u);
+  EXPECT_EQ(report.first_malformed_line, 5u);
+
+  // A pixel that is out of range or not a number.
+  for (const char *pixel : {"256", "-1", "1.5", "x", ""}) {
+    std::string row = "3";
+    for (int j = 0; j < IMAGE_ROWS * IMAGE_COLS; j++)
+      row += j == 100 ? std::string(",") + pixel : std::string(",0");
+    write_images(filename, 3, row.c_str());
+
+    EXPECT_EQ(images::read_images(filename, &count, &report), nullptr)
+        << pixel;
+    EXPECT_EQ(report.malformed, 1u) << pixel;
+  }
+
+  remove(filename);
+}
+
+TEST(ImageTests, Cache) {
+  const char *filename = "image-tests-cache.csv";
+  const char *cache = "image-tests-cache.csv.cache";
+  remove(cache);
+  write_images(filename, 5, "");
+
+  // The first load parses the file and writes the cache.
+  images::RawImages *raw = images::load_image_cache(filename);
+  ASSERT_NE(raw, nullptr);
+  EXPECT_EQ(raw->mapping, nullptr);
+  EXPECT_EQ(raw->count, 5u);
+  images::delete_raw_images(raw);
+
+  // The next ones map the cache.
+  raw = images::load_image_cache(filename);
+  ASSERT_NE(raw, nullptr);
+  EXPECT_NE(raw->mapping, nullptr);
+  ASSERT_EQ(raw->count, 5u);
+  for (size_t i = 0; i < 5; i++) {
+    EXPECT_EQ(raw->labels[i], i);
+    EXPECT_EQ(raw->pixels[i * IMAGE_ROWS * IMAGE_COLS], 10 * i);
+  }
+  images::delete_raw_images(raw);
+
+  int count = 5;
+  images::Image **images = images::read_cached_images(filename, &count);
+  ASSERT_NE(images, nullptr);
+  EXPECT_EQ(images[4]->label, 4);
+  EXPECT_EQ(images[4]->pixels->elements[0], 40 / 255.0);
+  images::delete_images(images, count);
+
+  // A change of the file makes the cache stale.
+  write_images(filename, 7, "");
+  raw = images::load_image_cache(filename);
+  ASSERT_NE(raw, nullptr);
+  EXPECT_EQ(raw->mapping, nullptr);
+  EXPECT_EQ(raw->count, 7u);
+  images::delete_raw_images(raw);
+
+  // An empty or truncated cache is rebuilt.
+  for (long size : {0L, 16L, 200L}) {
+    FILE *file = fopen(cache, "r+b");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(ftruncate(fileno(file), size), 0);
+    fclose(file);
+    raw = images::load_image_cache(filename);
+    ASSERT_NE(raw, nullptr) << size;
+    EXPECT_EQ(raw->mapping, nullptr);
+    EXPECT_EQ(raw->count, 7u);
+    images::delete_raw_images(raw);
+  }
+
+  remove(filename);
+  remove(cache);
+}
+
+namespace {
+
+// Writes an IDX file with the given sizes. Byte i of the elements is i % 251,
+// and there are none if elements is false.
+void write_idx(const char *filename, uint8_t type,
+               std::vector<uint32_t> sizes, bool elements = true) {
+  FILE *file = fopen(filename, "wb");
+  ASSERT_NE(file, nullptr);
+
+  const unsigned char magic[4] = {0, 0, type, (unsigned char)sizes.size()};
+  fwrite(magic, 1, 4, file);
+  size_t count = 1;
+  for (uint32_t size : sizes) {
+    const unsigned char bytes[4] = {
+        (unsigned char)(size >> 24), (unsigned char)(size >> 16),
+        (unsigned char)(size >> 8), (unsigned char)size};
+    fwrite(bytes, 1, 4, file);
+    count *= size;
+  }
+  count *= images::idx_type_size((images::IdxType)type);
+  if (!elements) count = 0;
+  for (size_t i = 0; i < count; i++) fputc((int)(i % 251), file);
+  fclose(file);
+}
+
+}  // namespace
+
+TEST(ImageTests, Idx) {
+  const char *images_filename = "image-tests-images-idx3-ubyte";
+  const char *labels_filename = "image-tests-labels-idx1-ubyte";
+  write_idx(images_filename, images::IDX_UINT8, {6, 5, 4});
+  write_idx(labels_filename, images::IDX_UINT8, {6});
+
+  // The header gives the shape and the type of the elements.
+  images::IdxFile *file = images::idx_open(images_filename);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(file->type, images::IDX_UINT8);
+  ASSERT_EQ(file->dimensions, 3u);
+  EXPECT_EQ(file->sizes[0], 6u);
+  EXPECT_EQ(file->sizes[1], 5u);
+  EXPECT_EQ(file->sizes[2], 4u);
+  EXPECT_EQ(file->count, 120u);
+  EXPECT_EQ(file->data, file->content + 16);
+  images::idx_close(file);
+
+  // The images are views of the mapped files.
+  images::RawImages *raw =
+      images::load_idx_images(images_filename, labels_filename);
+  ASSERT_NE(raw, nullptr);
+  EXPECT_EQ(raw->count, 6u);
+  EXPECT_EQ(raw->rows, 5u);
+  EXPECT_EQ(raw->cols, 4u);
+  EXPECT_NE(raw->mapping, nullptr);
+  EXPECT_EQ((char *)raw->pixels, (char *)raw->mapping + 16);
+  EXPECT_EQ((char *)raw->labels, (char *)raw->labels_mapping + 8);
+  for (size_t i = 0; i < 6; i++) EXPECT_EQ(raw->labels[i], i);
+  for (size_t i = 0; i < 120; i++) EXPECT_EQ(raw->pixels[i], i);
+  images::delete_raw_images(raw);
+
+  int count = 4;
+  images::ImageF **images =
+      images::read_idx_images<float>(images_filename, labels_filename, &count);
+  ASSERT_NE(images, nullptr);
+  EXPECT_EQ(images[3]->label, 3);
+  EXPECT_EQ(images[3]->pixels->rows, 5u);
+  EXPECT_EQ(images[3]->pixels->cols, 4u);
+  EXPECT_EQ(images[3]->pixels->elements[1], (float)(61 / 255.0));
+  images::delete_images(images, count);
+
+  count = 7;
+  EXPECT_EQ(images::read_idx_images(images_filename, labels_filename, &count),
+            nullptr);
+
+  // Labels that do not match the images.
+  write_idx(labels_filename, images::IDX_UINT8, {5});
+  EXPECT_EQ(images::load_idx_images(images_filename, labels_filename),
+            nullptr);
+  write_idx(labels_filename, images::IDX_INT16, {6});
+  EXPECT_EQ(images::load_idx_images(images_filename, labels_filename),
+            nullptr);
+
+  // Other types are read, but are not images.
+  file = images::idx_open(labels_filename);
+  ASSERT_NE(file, nullptr);
+  EXPECT_EQ(file->type, images::IDX_INT16);
+  EXPECT_EQ(file->count, 6u);
+  images::idx_close(file);
+
+  // Files that are truncated, too long or not IDX files.
+  write_idx(images_filename, images::IDX_UINT8, {6, 5, 4});
+  FILE *extra = fopen(images_filename, "ab");
+  ASSERT_NE(extra, nullptr);
+  fputc(0, extra);
+  fclose(extra);
+  EXPECT_EQ(images::idx_open(images_filename), nullptr);
+  write_idx(images_filename, images::IDX_UINT8, {6, 5, 4}, false);
+  EXPECT_EQ(images::idx_open(images_filename), nullptr);
+  write_idx(images_filename, 0x07, {6, 5, 4});
+  EXPECT_EQ(images::idx_open(images_filename), nullptr);
+  write_idx(images_filename, images::IDX_UINT8, {0xFFFFFFFF, 0xFFFFFFFF, 2},
+            false);
+  EXPECT_EQ(images::idx_open(images_filename), nullptr);
+  EXPECT_EQ(images::idx_open("missing-idx1-ubyte"), nullptr);
+
+  remove(images_filename);
+  remove(labels_filename);
+}
@@ -0,0 +1,239 @@
+/**
+ * @file loader-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the mini-batch loader.
+ * @version 1.0
+ * @date 2023-08-09
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "loader.hpp"
+#include "random.hpp"
+
+namespace {
+
+// A dataset of 2x3 images where every pixel of sample i is i.
+images::DatasetF *make_dataset(size_t count) {
+  images::DatasetF *dataset = images::dataset_create<float>(count, 2, 3);
+  for (size_t i = 0; i < count; i++) {
+    dataset->labels[i] = (int)i;
+    float *sample = custom_math::matrix_row(&dataset->samples, i);
+    for (size_t j = 0; j < 6; j++) sample[j] = (float)i;
+  }
+  return dataset;
+}
+
+// Reads one epoch, checking that every batch holds the samples of its
+// labels, and returns the labels in the order they came.
+std::vector<int> read_epoch(images::LoaderF *loader,
+                            std::vector<size_t> *sizes = nullptr) {
+  std::vector<int> labels;
+  images::BatchF batch;
+  while (images::loader_next(loader, &batch)) {
+    EXPECT_EQ(batch.samples.allocator, nullptr);
+    EXPECT_EQ(batch.samples.cols, 6u);
+    for (size_t i = 0; i < batch.samples.rows; i++) {
+      labels.push_back(batch.labels[i]);
+      const float *sample = custom_math::matrix_row(&batch.samples, i);
+      for (size_t j = 0; j < 6; j++)
+        EXPECT_EQ(sample[j], (float)batch.labels[i]);
+    }
+    if (sizes != nullptr) sizes->push_back(batch.samples.rows);
+  }
+  return labels;
+}
+
+}  // namespace
+
+TEST(LoaderTests, Epochs) {
+  images::DatasetF *dataset = make_dataset(10);
+  images::LoaderOptions options = images::loader_default_options();
+  options.batch_size = 4;
+  options.prefetch = 3;
+  options.workers = 2;
+  options.seed = 7;
+
+  images::LoaderF *loader = images::loader_create(dataset, &options);
+  ASSERT_NE(loader, nullptr);
+  EXPECT_EQ(images::loader_batches(loader), 3u);
+
+  // Every sample once per epoch, in batches of 4, 4 and 2.
+  std::vector<size_t> sizes;
+  std::vector<int> first = read_epoch(loader, &sizes);
+  EXPECT_EQ(sizes, std::vector<size_t>({4, 4, 2}));
+  std::vector<int> sorted = first;
+  std::sort(sorted.begin(), sorted.end());
+  for (int i = 0; i < 10; i++) EXPECT_EQ(sorted[i], i);
+
+  // Another order at the next epoch.
+  std::vector<int> second = read_epoch(loader);
+  EXPECT_EQ(second.size(), 10u);
+  EXPECT_NE(first, second);
+  images::loader_delete(loader);
+
+  // The same orders with the same seed, whatever the number of threads.
+  options.workers = 1;
+  options.prefetch = 2;
+  loader = images::loader_create(dataset, &options);
+  ASSERT_NE(loader, nullptr);
+  EXPECT_EQ(read_epoch(loader), first);
+  EXPECT_EQ(read_epoch(loader), second);
+  images::loader_delete(loader);
+
+  // Without shuffling, and without the last batch.
+  options.shuffle = false;
+  options.drop_last = true;
+  loader = images::loader_create(dataset, &options);
+  ASSERT_NE(loader, nullptr);
+  std::vector<int> ordered = read_epoch(loader);
+  ASSERT_EQ(ordered.size(), 8u);
+  for (int i = 0; i < 8; i++) EXPECT_EQ(ordered[i], i);
+  images::loader_delete(loader);
+
+  // A loader can be deleted in the middle of an epoch.
+  loader = images::loader_create(dataset, &options);
+  images::BatchF batch;
+  ASSERT_TRUE(images::loader_next(loader, &batch));
+  images::loader_delete(loader);
+
+  // Batches larger than the dataset.
+  options.batch_size = 11;
+  EXPECT_EQ(images::loader_create(dataset, &options), nullptr);
+
+  images::dataset_delete(dataset);
+}
+
+TEST(LoaderTests, Normalization) {
+  images::DatasetF *dataset = make_dataset(5);
+  images::LoaderOptions options = images::loader_default_options();
+  options.batch_size = 5;
+  options.shuffle = false;
+  options.mean = 2;
+  options.std = 0.5;
+
+  images::LoaderF *loader = images::loader_create(dataset, &options);
+  ASSERT_NE(loader, nullptr);
+  images::BatchF batch;
+  ASSERT_TRUE(images::loader_next(loader, &batch));
+  for (size_t i = 0; i < 5; i++)
+    EXPECT_EQ(custom_math::matrix_row(&batch.samples, i)[5],
+              (float)(((double)i - 2) / 0.5));
+  images::loader_delete(loader);
+
+  options.std = 0;
+  EXPECT_EQ(images::loader_create(dataset, &options), nullptr);
+
+  images::dataset_delete(dataset);
+}
+
+TEST(LoaderTests, Bytes) {
+  // Sample i of both datasets is made of the pixels 50 * i + j.
+  images::ByteDataset *bytes = images::dataset_create<uint8_t>(5, 2, 3);
+  images::DatasetF *dataset = images::dataset_create<float>(5, 2, 3);
+  for (size_t i = 0; i < 30; i++) {
+    bytes->samples.elements[i] = (uint8_t)(i / 6 * 50 + i % 6);
+    dataset->samples.elements[i] = (float)(bytes->samples.elements[i] / 255.);
+  }
+  for (int i = 0; i < 5; i++) bytes->labels[i] = dataset->labels[i] = i;
+
+  images::LoaderOptions options = images::loader_default_options();
+  options.batch_size = 2;
+  options.seed = 3;
+  options.mean = 0.1307;
+  options.std = 0.3081;
+
+  // The same batches as from the pixels scaled to [0, 1], in the same order.
+  images::LoaderF *from_bytes = images::loader_create<float>(bytes, &options);
+  images::LoaderF *from_floats = images::loader_create(dataset, &options);
+  ASSERT_NE(from_bytes, nullptr);
+  ASSERT_NE(from_floats, nullptr);
+  images::BatchF a, b;
+  for (int epoch = 0; epoch < 2; epoch++) {
+    while (images::loader_next(from_bytes, &a)) {
+      ASSERT_TRUE(images::loader_next(from_floats, &b));
+      ASSERT_EQ(a.samples.rows, b.samples.rows);
+      for (size_t i = 0; i < a.samples.rows; i++) {
+        ASSERT_EQ(a.labels[i], b.labels[i]);
+        for (size_t j = 0; j < 6; j++)
+          EXPECT_NEAR(custom_math::matrix_row(&a.samples, i)[j],
+                      custom_math::matrix_row(&b.samples, i)[j], 1e-5);
+      }
+    }
+    EXPECT_FALSE(images::loader_next(from_floats, &b));
+  }
+  images::loader_delete(from_bytes);
+  images::loader_delete(from_floats);
+
+  images::dataset_delete(bytes);
+  images::dataset_delete(dataset);
+}
+
+TEST(LoaderTests, Augmentation) {
+  images::ByteDataset *dataset = images::dataset_create<uint8_t>(6, 5, 5);
+  for (size_t i = 0; i < 6 * 25; i++)
+    dataset->samples.elements[i] = (uint8_t)(i * 41);
+  for (int i = 0; i < 6; i++) dataset->labels[i] = i;
+
+  images::LoaderOptions options = images::loader_default_options();
+  options.batch_size = 4;
+  options.seed = 11;
+  images::augment_add(&options.augment, images::AUGMENT_ROTATION, 20);
+  images::augment_add(&options.augment, images::AUGMENT_NOISE, 0.1);
+
+  // The same samples whatever the number of threads, but not twice the same
+  // for a sample.
+  std::vector<std::vector<float>> runs;
+  for (size_t workers = 1; workers <= 3; workers += 2) {
+    options.workers = workers;
+    images::LoaderF *loader = images::loader_create<float>(dataset, &options);
+    ASSERT_NE(loader, nullptr);
+    std::vector<float> values;
+    images::BatchF batch;
+    for (int epoch = 0; epoch < 2; epoch++)
+      while (images::loader_next(loader, &batch))
+        for (size_t i = 0; i < batch.samples.rows; i++) {
+          const float *sample = custom_math::matrix_row(&batch.samples, i);
+          values.push_back((float)batch.labels[i]);
+          values.insert(values.end(), sample, sample + 25);
+        }
+    images::loader_delete(loader);
+    runs.push_back(values);
+  }
+  ASSERT_EQ(runs[0].size(), 2 * 6 * 26u);
+  EXPECT_EQ(runs[0], runs[1]);
+
+  for (size_t i = 0; i < 6; i++) {
+    const float *sample = &runs[0][i * 26];
+    for (size_t j = 0; j < 6; j++) {
+      if (runs[0][(6 + j) * 26] == sample[0]) {
+        EXPECT_NE(std::vector<float>(sample, sample + 26),
+                  std::vector<float>(&runs[0][(6 + j) * 26],
+                                     &runs[0][(7 + j) * 26]));
+      }
+    }
+  }
+
+  images::dataset_delete(dataset);
+}
+
+TEST(LoaderTests, Random) {
+  custom_math::Random a, b;
+  custom_math::random_seed(&a, 42);
+  custom_math::random_seed(&b, 42);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(custom_math::random_next(&a), custom_math::random_next(&b));
+    double x = custom_math::random_uniform(&a);
+    EXPECT_GE(x, 0.);
+    EXPECT_LT(x, 1.);
+    EXPECT_LT(custom_math::random_below(&a, 7), 7u);
+    custom_math::random_uniform(&b);
+    custom_math::random_below(&b, 7);
+  }
+}
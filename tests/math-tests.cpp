@@ -328,3 +328,341 @@ TEST(MathTests, ApplyFunctionToMatrix) {
   custom_math::matrix_delete(matrix);
   custom_math::matrix_delete(matrix2);
 }
+
+TEST(MathTests, DotMatrixFractional) {
+  custom_math::Matrix *matrix1 = custom_math::matrix_create(1, 2);
+  matrix1->elements[0] = 0.5;
+  matrix1->elements[1] = 0.25;
+
+  custom_math::Matrix *matrix2 = custom_math::matrix_create(2, 1);
+  matrix2->elements[0] = 0.5;
+  matrix2->elements[1] = 1.5;
+
+  custom_math::Matrix *matrix3 = custom_math::matrix_dot(matrix1, matrix2);
+  EXPECT_DOUBLE_EQ(matrix3->elements[0], 0.625);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  custom_math::matrix_delete(matrix3);
+}
+
+TEST(MathTests, AddMatrixInto) {
+  custom_math::Matrix *matrix1 = custom_math::matrix_create(2, 2, 1);
+  custom_math::Matrix *matrix2 = custom_math::matrix_create(2, 2, 2);
+  custom_math::Matrix *destination = custom_math::matrix_create(2, 2);
+
+  EXPECT_EQ(custom_math::matrix_add_into(destination, matrix1, matrix2),
+            destination);
+  for (int i = 0; i < 4; i++) EXPECT_EQ(destination->elements[i], 3);
+
+  EXPECT_EQ(custom_math::matrix_sub_into(destination, destination, matrix1),
+            destination);
+  for (int i = 0; i < 4; i++) EXPECT_EQ(destination->elements[i], 2);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  custom_math::matrix_delete(destination);
+}
+
+TEST(MathTests, AddMatrixIntoIncorrect) {
+  custom_math::Matrix *matrix1 = custom_math::matrix_create(2, 2, 1);
+  custom_math::Matrix *matrix2 = custom_math::matrix_create(2, 2, 2);
+  custom_math::Matrix *destination = custom_math::matrix_create(2, 3);
+
+  EXPECT_EQ(custom_math::matrix_add_into(destination, matrix1, matrix2),
+            nullptr);
+
+  // A destination that only partially overlaps an operand is rejected.
+  custom_math::Matrix shifted = *matrix1;
+  shifted.elements = matrix1->elements + 1;
+  shifted.rows = 1;
+  custom_math::Matrix head = *matrix1;
+  head.rows = 1;
+  EXPECT_EQ(custom_math::matrix_add_into(&shifted, &head, &head), nullptr);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  custom_math::matrix_delete(destination);
+}
+
+TEST(MathTests, DotMatrixInto) {
+  custom_math::Matrix *matrix1 = custom_math::matrix_create(2, 3, 1);
+  custom_math::Matrix *matrix2 = custom_math::matrix_create(3, 2, 2);
+  custom_math::Matrix *destination = custom_math::matrix_create(2, 2, 1);
+
+  EXPECT_EQ(custom_math::matrix_dot_into(destination, matrix1, matrix2, true),
+            destination);
+  for (int i = 0; i < 4; i++) EXPECT_EQ(destination->elements[i], 7);
+
+  EXPECT_EQ(custom_math::matrix_dot_into(destination, matrix1, matrix2),
+            destination);
+  for (int i = 0; i < 4; i++) EXPECT_EQ(destination->elements[i], 6);
+
+  // The product cannot be written over one of its operands.
+  custom_math::Matrix *square = custom_math::matrix_create(2, 2, 1);
+  EXPECT_EQ(custom_math::matrix_dot_into(square, square, square), nullptr);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  custom_math::matrix_delete(destination);
+  custom_math::matrix_delete(square);
+}
+
+TEST(MathTests, TransposeMatrixInto) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(40, 70);
+  for (int i = 0; i < 40 * 70; i++) matrix->elements[i] = i;
+
+  custom_math::Matrix *destination = custom_math::matrix_create(70, 40);
+  EXPECT_EQ(custom_math::matrix_transpose_into(destination, matrix),
+            destination);
+  for (int i = 0; i < 40; i++)
+    for (int j = 0; j < 70; j++)
+      EXPECT_EQ(destination->elements[j * 40 + i], i * 70 + j);
+
+  EXPECT_EQ(custom_math::matrix_transpose_into(matrix, matrix), nullptr);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(destination);
+}
+
+TEST(MathTests, InPlaceOperations) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(2, 2);
+  matrix->elements[0] = 7;
+  matrix->elements[1] = 8;
+  matrix->elements[2] = 9;
+  matrix->elements[3] = 0;
+  custom_math::Matrix *other = custom_math::matrix_create(2, 2, 1);
+
+  custom_math::matrix_add_inplace(matrix, other);
+  custom_math::matrix_mul_scalar_inplace(matrix, 2);
+  custom_math::matrix_sub_inplace(matrix, other);
+  custom_math::matrix_transpose_inplace(matrix);
+  custom_math::matrix_apply_inplace(matrix, [](double x) { return -x; });
+
+  EXPECT_EQ(matrix->elements[0], -15);
+  EXPECT_EQ(matrix->elements[1], -19);
+  EXPECT_EQ(matrix->elements[2], -17);
+  EXPECT_EQ(matrix->elements[3], -1);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(other);
+}
+
+TEST(MathTests, AlignedMatrix) {
+  custom_math::Matrix *matrix = custom_math::matrix_create_aligned(3, 5, 1);
+
+  EXPECT_EQ(matrix->stride, 8);
+  for (size_t i = 0; i < 3; i++)
+    EXPECT_EQ((uintptr_t)custom_math::matrix_row(matrix, i) % 64, 0u);
+
+  custom_math::Matrix *dense = custom_math::matrix_create(3, 5, 2);
+  custom_math::Matrix *sum = custom_math::matrix_add(matrix, dense);
+  EXPECT_EQ(sum->stride, 5);
+  for (int i = 0; i < 15; i++) EXPECT_EQ(sum->elements[i], 3);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(dense);
+  custom_math::matrix_delete(sum);
+}
+
+TEST(MathTests, ViewsShareElements) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(4, 4);
+  for (int i = 0; i < 16; i++) matrix->elements[i] = i;
+
+  custom_math::Matrix rows = custom_math::matrix_view_rows(matrix, 1, 2);
+  EXPECT_EQ(rows.rows, 2);
+  EXPECT_EQ(rows.elements, matrix->elements + 4);
+
+  custom_math::Matrix block = custom_math::matrix_view(matrix, 1, 1, 2, 2);
+  custom_math::matrix_mul_scalar_inplace(&block, 10);
+  EXPECT_EQ(matrix->elements[5], 50);
+  EXPECT_EQ(matrix->elements[6], 60);
+  EXPECT_EQ(matrix->elements[7], 7);
+  EXPECT_EQ(matrix->elements[9], 90);
+  EXPECT_EQ(matrix->elements[10], 100);
+
+  custom_math::Matrix *copy = custom_math::matrix_copy(&block);
+  EXPECT_EQ(copy->stride, 2);
+  EXPECT_EQ(copy->elements[3], 100);
+
+  // Deleting a view does nothing.
+  custom_math::matrix_delete(&block);
+  EXPECT_EQ(block.elements, matrix->elements + 5);
+
+  custom_math::matrix_delete(copy);
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, ViewsInOperations) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(3, 4);
+  for (int i = 0; i < 12; i++) matrix->elements[i] = i;
+
+  // The first two columns times the last two columns transposed.
+  custom_math::Matrix left = custom_math::matrix_view_cols(matrix, 0, 2);
+  custom_math::Matrix right = custom_math::matrix_view_cols(matrix, 2, 2);
+  custom_math::Matrix *right_t = custom_math::matrix_transpose(&right);
+  custom_math::Matrix *product = custom_math::matrix_dot(&left, right_t);
+
+  EXPECT_EQ(product->elements[0], 0 * 2 + 1 * 3);
+  EXPECT_EQ(product->elements[4], 4 * 6 + 5 * 7);
+  EXPECT_EQ(product->elements[8], 8 * 10 + 9 * 11);
+
+  custom_math::Matrix flat = custom_math::matrix_reshape(matrix, 1, 12);
+  EXPECT_EQ(flat.cols, 12);
+  custom_math::Matrix invalid = custom_math::matrix_reshape(&left, 1, 6);
+  EXPECT_EQ(invalid.elements, nullptr);
+  EXPECT_EQ(custom_math::matrix_copy(&invalid), nullptr);
+
+  custom_math::Matrix outside = custom_math::matrix_view_rows(matrix, 2, 2);
+  EXPECT_EQ(outside.elements, nullptr);
+
+  custom_math::matrix_delete(right_t);
+  custom_math::matrix_delete(product);
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, DeterminantSingularMatrix) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(3, 3, 1);
+
+  EXPECT_EQ(custom_math::matrix_determinant(matrix), 0);
+
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, DeterminantLargeMatrix) {
+  // A lower triangular matrix with 2s on the diagonal, with its rows
+  // reversed: the determinant is +-2^n and needs pivoting.
+  const int n = 150;
+  custom_math::Matrix *matrix = custom_math::matrix_create(n, n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j <= i; j++)
+      matrix->elements[(n - 1 - i) * n + j] = i == j ? 2 : 1;
+
+  // Reversing 150 rows takes 75 swaps.
+  double expected = -1;
+  for (int i = 0; i < n; i++) expected *= 2;
+  EXPECT_DOUBLE_EQ(custom_math::matrix_determinant(matrix), expected);
+
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, SolveAndInverse) {
+  const int n = 200;
+  custom_math::Matrix *matrix = custom_math::matrix_create(n, n);
+  srand(3);
+  for (int i = 0; i < n * n; i++) matrix->elements[i] = rand() % 10 - 4.5;
+
+  custom_math::Matrix *x = custom_math::matrix_create(n, 2);
+  for (int i = 0; i < 2 * n; i++) x->elements[i] = i % 7;
+  custom_math::Matrix *b = custom_math::matrix_dot(matrix, x);
+
+  custom_math::Matrix *solution = custom_math::matrix_solve(matrix, b);
+  ASSERT_NE(solution, nullptr);
+  for (int i = 0; i < 2 * n; i++)
+    EXPECT_NEAR(solution->elements[i], x->elements[i], 1e-8);
+
+  custom_math::Matrix *inverse = custom_math::matrix_inverse(matrix);
+  ASSERT_NE(inverse, nullptr);
+  custom_math::Matrix *identity = custom_math::matrix_dot(matrix, inverse);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      EXPECT_NEAR(identity->elements[i * n + j], i == j ? 1 : 0, 1e-9);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(x);
+  custom_math::matrix_delete(b);
+  custom_math::matrix_delete(solution);
+  custom_math::matrix_delete(inverse);
+  custom_math::matrix_delete(identity);
+}
+
+TEST(MathTests, InverseSingularMatrix) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(2, 2, 1);
+
+  EXPECT_EQ(custom_math::matrix_inverse(matrix), nullptr);
+
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, FloatMatrix) {
+  custom_math::MatrixF *matrix1 = custom_math::matrix_create<float>(3, 5, 2);
+  custom_math::MatrixF *matrix2 = custom_math::matrix_I<float>(5);
+  ASSERT_NE(matrix1, nullptr);
+
+  custom_math::MatrixF *sum = custom_math::matrix_add(matrix1, matrix1);
+  custom_math::MatrixF *product = custom_math::matrix_dot(sum, matrix2);
+  custom_math::MatrixF *scaled = custom_math::matrix_mul_scalar(product, 0.5);
+  custom_math::MatrixF *transposed = custom_math::matrix_transpose(scaled);
+
+  ASSERT_NE(transposed, nullptr);
+  EXPECT_EQ(transposed->rows, 5u);
+  EXPECT_EQ(transposed->cols, 3u);
+  for (int i = 0; i < 15; i++) EXPECT_EQ(transposed->elements[i], 2.f);
+
+  custom_math::matrix_delete(matrix1);
+  custom_math::matrix_delete(matrix2);
+  custom_math::matrix_delete(sum);
+  custom_math::matrix_delete(product);
+  custom_math::matrix_delete(scaled);
+  custom_math::matrix_delete(transposed);
+}
+
+TEST(MathTests, FloatAlignedMatrix) {
+  custom_math::MatrixF *matrix =
+      custom_math::matrix_create_aligned<float>(3, 17, 1);
+
+  ASSERT_NE(matrix, nullptr);
+  EXPECT_EQ(matrix->stride, 32u);
+  EXPECT_EQ((uintptr_t)custom_math::matrix_row(matrix, 2) % 64, 0u);
+
+  custom_math::matrix_delete(matrix);
+}
+
+TEST(MathTests, FloatSolveAndDeterminant) {
+  const int n = 100;
+  custom_math::MatrixF *matrix = custom_math::matrix_create<float>(n, n);
+  srand(4);
+  for (int i = 0; i < n * n; i++) matrix->elements[i] = rand() % 10 - 4.5f;
+  for (int i = 0; i < n; i++) matrix->elements[i * n + i] += 50;
+
+  custom_math::MatrixF *x = custom_math::matrix_create<float>(n, 1);
+  for (int i = 0; i < n; i++) x->elements[i] = i % 5;
+  custom_math::MatrixF *b = custom_math::matrix_dot(matrix, x);
+
+  custom_math::MatrixF *solution = custom_math::matrix_solve(matrix, b);
+  ASSERT_NE(solution, nullptr);
+  for (int i = 0; i < n; i++)
+    EXPECT_NEAR(solution->elements[i], x->elements[i], 1e-4);
+
+  // A larger determinant would not fit in a float.
+  custom_math::MatrixF block = custom_math::matrix_view(matrix, 0, 0, 12, 12);
+  custom_math::Matrix *matrix_double =
+      custom_math::matrix_convert<double>(&block);
+  float determinant = custom_math::matrix_determinant(&block);
+  double expected = custom_math::matrix_determinant(matrix_double);
+  EXPECT_NEAR(determinant / expected, 1., 1e-3);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(x);
+  custom_math::matrix_delete(b);
+  custom_math::matrix_delete(solution);
+  custom_math::matrix_delete(matrix_double);
+}
+
+TEST(MathTests, ConvertMatrix) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(4, 4);
+  for (int i = 0; i < 16; i++) matrix->elements[i] = i / 3.;
+  custom_math::Matrix view = custom_math::matrix_view(matrix, 1, 1, 2, 3);
+
+  custom_math::MatrixF *converted = custom_math::matrix_convert<float>(&view);
+  ASSERT_NE(converted, nullptr);
+  EXPECT_EQ(converted->rows, 2u);
+  EXPECT_EQ(converted->cols, 3u);
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 3; j++)
+      EXPECT_EQ(converted->elements[i * 3 + j],
+                (float)matrix->elements[(i + 1) * 4 + j + 1]);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(converted);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file matrix-file-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for saving, loading and mapping
+ *        matrices.
+ * @version 1.0
+ * @date 2023-08-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include "math.hpp"
+#include "matrix_file.hpp"
+
+namespace {
+
+const char *BINARY_FILE = "matrix-file-tests.bin";
+const char *TEXT_FILE = "matrix-file-tests.txt";
+
+custom_math::Matrix *random_matrix(int rows, int cols, unsigned int seed) {
+  custom_math::Matrix *matrix = custom_math::matrix_create(rows, cols);
+  srand(seed);
+  for (int i = 0; i < rows * cols; i++)
+    matrix->elements[i] = rand() / (double)RAND_MAX - 0.5;
+  return matrix;
+}
+
+// Overwrites one byte of a file.
+void corrupt(const char *filename, long position) {
+  FILE *file = fopen(filename, "r+b");
+  ASSERT_NE(file, nullptr);
+  fseek(file, position, SEEK_SET);
+  int byte = fgetc(file);
+  fseek(file, position, SEEK_SET);
+  fputc(byte ^ 1, file);
+  fclose(file);
+}
+
+}  // namespace
+
+TEST(MatrixFileTests, SaveLoad) {
+  custom_math::Matrix *matrix = random_matrix(13, 21, 1);
+
+  // A view, so that the padding of the rows is not saved.
+  custom_math::Matrix view = custom_math::matrix_view(matrix, 2, 3, 9, 17);
+  ASSERT_TRUE(custom_math::matrix_save(&view, BINARY_FILE));
+
+  custom_math::Matrix *loaded = custom_math::matrix_load(BINARY_FILE);
+  ASSERT_NE(loaded, nullptr);
+  ASSERT_EQ(loaded->rows, 9u);
+  ASSERT_EQ(loaded->cols, 17u);
+  for (size_t i = 0; i < 9; i++)
+    for (size_t j = 0; j < 17; j++)
+      EXPECT_EQ(loaded->elements[i * loaded->stride + j],
+                matrix->elements[(i + 2) * 21 + j + 3]);
+
+  // A file of doubles can be loaded as floats.
+  custom_math::MatrixF *converted =
+      custom_math::matrix_load<float>(BINARY_FILE);
+  ASSERT_NE(converted, nullptr);
+  for (size_t i = 0; i < 9 * 17; i++)
+    EXPECT_EQ(converted->elements[i], (float)loaded->elements[i]);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(loaded);
+  custom_math::matrix_delete(converted);
+  remove(BINARY_FILE);
+}
+
+TEST(MatrixFileTests, Map) {
+  custom_math::MatrixF *matrix = custom_math::matrix_create<float>(5, 7, 0);
+  for (int i = 0; i < 35; i++) matrix->elements[i] = i * 0.25f;
+  ASSERT_TRUE(custom_math::matrix_save(matrix, BINARY_FILE));
+
+  custom_math::MappedMatrixF *mapped =
+      custom_math::matrix_map_file<float>(BINARY_FILE, true);
+  ASSERT_NE(mapped, nullptr);
+  EXPECT_EQ(mapped->matrix.rows, 5u);
+  EXPECT_EQ(mapped->matrix.cols, 7u);
+  EXPECT_EQ((uintptr_t)mapped->matrix.elements % MATRIX_FILE_ALIGNMENT, 0u);
+  for (int i = 0; i < 35; i++)
+    EXPECT_EQ(mapped->matrix.elements[i], matrix->elements[i]);
+
+  // The mapped matrix can be read like any other.
+  custom_math::MatrixF *copy = custom_math::matrix_copy(&mapped->matrix);
+  ASSERT_NE(copy, nullptr);
+  EXPECT_EQ(copy->elements[34], 8.5f);
+  custom_math::matrix_unmap(mapped);
+
+  // A file of floats is not mapped as doubles.
+  EXPECT_EQ(custom_math::matrix_map_file<double>(BINARY_FILE), nullptr);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(copy);
+  remove(BINARY_FILE);
+}
+
+TEST(MatrixFileTests, Corrupted) {
+  custom_math::Matrix *matrix = random_matrix(4, 4, 2);
+  ASSERT_TRUE(custom_math::matrix_save(matrix, BINARY_FILE));
+
+  // One bit of an element.
+  corrupt(BINARY_FILE, sizeof(custom_math::MatrixFileHeader) + 37);
+  EXPECT_EQ(custom_math::matrix_load(BINARY_FILE), nullptr);
+  EXPECT_EQ(custom_math::matrix_map_file(BINARY_FILE, true), nullptr);
+
+  // Without the checksum, only the header is checked.
+  custom_math::MappedMatrix *mapped = custom_math::matrix_map_file(BINARY_FILE);
+  EXPECT_NE(mapped, nullptr);
+  custom_math::matrix_unmap(mapped);
+
+  // One bit of the number of rows, which no longer fit in the file.
+  corrupt(BINARY_FILE, 16);
+  EXPECT_EQ(custom_math::matrix_load(BINARY_FILE), nullptr);
+  EXPECT_EQ(custom_math::matrix_map_file(BINARY_FILE), nullptr);
+
+  // Files that are not matrix files.
+  ASSERT_TRUE(custom_math::matrix_save_text(matrix, TEXT_FILE));
+  EXPECT_EQ(custom_math::matrix_load(TEXT_FILE), nullptr);
+  EXPECT_EQ(custom_math::matrix_map_file(TEXT_FILE), nullptr);
+  EXPECT_EQ(custom_math::matrix_load("missing.bin"), nullptr);
+
+  custom_math::matrix_delete(matrix);
+  remove(BINARY_FILE);
+  remove(TEXT_FILE);
+}
+
+TEST(MatrixFileTests, Text) {
+  custom_math::Matrix *matrix = random_matrix(6, 3, 3);
+  ASSERT_TRUE(custom_math::matrix_save_text(matrix, TEXT_FILE));
+
+  // Enough digits are written to get the same doubles back.
+  custom_math::Matrix *loaded = custom_math::matrix_load_text(TEXT_FILE);
+  ASSERT_NE(loaded, nullptr);
+  ASSERT_EQ(loaded->rows, 6u);
+  ASSERT_EQ(loaded->cols, 3u);
+  for (int i = 0; i < 18; i++)
+    EXPECT_EQ(loaded->elements[i], matrix->elements[i]);
+
+  // A file that ends early.
+  FILE *file = fopen(TEXT_FILE, "w");
+  ASSERT_NE(file, nullptr);
+  fprintf(file, "2 2\n1 2\n3\n");
+  fclose(file);
+  EXPECT_EQ(custom_math::matrix_load_text(TEXT_FILE), nullptr);
+
+  custom_math::matrix_delete(matrix);
+  custom_math::matrix_delete(loaded);
+  remove(TEXT_FILE);
+}
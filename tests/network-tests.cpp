@@ -0,0 +1,344 @@
+/**
+ * @file network-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the dense-layer networks.
+ * @version 1.0
+ * @date 2023-08-11
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "loader.hpp"
+#include "network.hpp"
+#include "random.hpp"
+
+namespace {
+
+// Fills a matrix with values drawn uniformly in [-1, 1].
+void fill(custom_math::Matrix *matrix, uint64_t seed) {
+  custom_math::Random random;
+  custom_math::random_seed(&random, seed);
+  for (size_t i = 0; i < matrix->rows; i++)
+    for (size_t j = 0; j < matrix->cols; j++)
+      custom_math::matrix_row(matrix, i)[j] =
+          2 * custom_math::random_uniform(&random) - 1;
+}
+
+// Checks the gradients of a network against central differences.
+void check_gradients(custom_math::ActivationType type) {
+  const size_t sizes[] = {5, 7, 6, 4};
+  const custom_math::Activation activation = {type, 0.1, false};
+  neural::Network *network =
+      neural::network_create<double>(sizes, 4, &activation, 3);
+  ASSERT_NE(network, nullptr);
+  neural::Workspace *workspace = neural::workspace_create(network, 8);
+  ASSERT_NE(workspace, nullptr);
+
+  custom_math::Matrix *inputs = custom_math::matrix_create<double>(8, 5);
+  fill(inputs, 11);
+  const int labels[] = {0, 1, 2, 3, 3, 2, 1, 0};
+
+  // The biases are 0 at first, give them some values to check them too.
+  for (size_t l = 0; l < network->count; l++)
+    for (size_t j = 0; j < network->layers[l].outputs; j++)
+      network->layers[l].bias[j] = 0.1 * (double)j - 0.2;
+
+  ASSERT_NE(neural::network_forward(network, workspace, inputs), nullptr);
+  neural::network_backward(network, workspace, inputs, labels);
+  std::vector<double> gradients(workspace->gradients,
+                                workspace->gradients + workspace->size);
+
+  const double h = 1e-6;
+  for (size_t l = 0; l < network->count; l++) {
+    const neural::BasicDense<double> *layer = &network->layers[l];
+    std::vector<double *> parameters;
+    for (size_t i = 0; i < layer->inputs * layer->outputs; i++)
+      parameters.push_back(layer->weights.elements + i);
+    for (size_t j = 0; j < layer->outputs; j++)
+      parameters.push_back(layer->bias + j);
+
+    for (double *parameter : parameters) {
+      const double value = *parameter;
+      *parameter = value + h;
+      neural::network_forward(network, workspace, inputs);
+      const double plus =
+          neural::network_backward(network, workspace, inputs, labels);
+      *parameter = value - h;
+      neural::network_forward(network, workspace, inputs);
+      const double minus =
+          neural::network_backward(network, workspace, inputs, labels);
+      *parameter = value;
+
+      const double expected = (plus - minus) / (2 * h);
+      EXPECT_NEAR(gradients[parameter - network->parameters], expected, 1e-6)
+          << "layer " << l;
+    }
+  }
+
+  custom_math::matrix_delete(inputs);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+}
+
+}  // namespace
+
+TEST(NetworkTests, Create) {
+  const size_t sizes[] = {784, 30, 10};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_RELU, 0,
+                                              false};
+  neural::NetworkF *network =
+      neural::network_create<float>(sizes, 3, &activation);
+  ASSERT_NE(network, nullptr);
+  EXPECT_EQ(network->count, 2u);
+
+  const neural::BasicDense<float> *hidden = &network->layers[0];
+  const neural::BasicDense<float> *output = &network->layers[1];
+  EXPECT_EQ(hidden->inputs, 784u);
+  EXPECT_EQ(hidden->outputs, 30u);
+  EXPECT_TRUE(hidden->activated);
+  EXPECT_FALSE(output->activated);
+  EXPECT_EQ(hidden->offset, 0u);
+  EXPECT_EQ(output->offset % 16, 0u);
+  EXPECT_GE(output->offset, 784u * 30 + 30);
+  EXPECT_GE(network->size, output->offset + 30 * 10 + 10);
+
+  // He initialization for the ReLUs, in +-sqrt(6 / 784).
+  const float limit = sqrtf(6.f / 784);
+  for (size_t i = 0; i < 784 * 30; i++)
+    ASSERT_LE(fabsf(hidden->weights.elements[i]), limit);
+  for (size_t j = 0; j < 30; j++) EXPECT_EQ(hidden->bias[j], 0.f);
+
+  EXPECT_EQ(neural::network_create<float>(sizes, 1, &activation), nullptr);
+  const size_t empty[] = {784, 0, 10};
+  EXPECT_EQ(neural::network_create<float>(empty, 3, &activation), nullptr);
+
+  neural::network_delete(network);
+}
+
+TEST(NetworkTests, SaveLoad) {
+  const char *filename = "network-tests.mat";
+  const size_t sizes[] = {12, 5, 3};
+  const size_t other[] = {12, 6, 3};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_TANH, 0,
+                                              false};
+  neural::Network *network =
+      neural::network_create<double>(sizes, 3, &activation, 1);
+  neural::NetworkF *loaded =
+      neural::network_create<float>(sizes, 3, &activation, 2);
+  neural::NetworkF *larger =
+      neural::network_create<float>(other, 3, &activation, 2);
+
+  ASSERT_TRUE(neural::network_save(network, filename));
+  ASSERT_TRUE(neural::network_load(loaded, filename));
+  // The padding of the layers of floats and doubles differs.
+  for (size_t l = 0; l < 2; l++) {
+    const neural::BasicDense<double> *layer = &network->layers[l];
+    const neural::BasicDense<float> *copy = &loaded->layers[l];
+    for (size_t i = 0; i < layer->inputs; i++)
+      for (size_t j = 0; j < layer->outputs; j++)
+        ASSERT_EQ(custom_math::matrix_row(&copy->weights, i)[j],
+                  (float)custom_math::matrix_row(&layer->weights, i)[j]);
+    for (size_t j = 0; j < layer->outputs; j++)
+      EXPECT_EQ(copy->bias[j], (float)layer->bias[j]);
+  }
+
+  const float first = larger->parameters[0];
+  EXPECT_FALSE(neural::network_load(larger, filename));
+  EXPECT_EQ(larger->parameters[0], first);
+  EXPECT_FALSE(neural::network_load(loaded, "missing-network.mat"));
+
+  remove(filename);
+  neural::network_delete(larger);
+  neural::network_delete(loaded);
+  neural::network_delete(network);
+}
+
+TEST(NetworkTests, Forward) {
+  const size_t sizes[] = {6, 4, 3};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_TANH, 0,
+                                              false};
+  neural::Network *network =
+      neural::network_create<double>(sizes, 3, &activation, 5);
+  neural::Workspace *workspace = neural::workspace_create(network, 4);
+
+  custom_math::Matrix *inputs = custom_math::matrix_create<double>(3, 6);
+  fill(inputs, 7);
+  for (size_t j = 0; j < 4; j++) network->layers[0].bias[j] = 0.25 * j;
+
+  const custom_math::Matrix *logits =
+      neural::network_forward(network, workspace, inputs);
+  ASSERT_NE(logits, nullptr);
+  EXPECT_EQ(logits->rows, 3u);
+  EXPECT_EQ(logits->cols, 3u);
+
+  // The same computation, one sample at a time.
+  for (size_t i = 0; i < 3; i++) {
+    const double *x = custom_math::matrix_row(inputs, i);
+    double hidden[4], output[3];
+    for (size_t j = 0; j < 4; j++) {
+      hidden[j] = network->layers[0].bias[j];
+      for (size_t k = 0; k < 6; k++)
+        hidden[j] += x[k] * network->layers[0].weights.elements[k * 4 + j];
+      hidden[j] = tanh(hidden[j]);
+    }
+    for (size_t j = 0; j < 3; j++) {
+      output[j] = network->layers[1].bias[j];
+      for (size_t k = 0; k < 4; k++)
+        output[j] += hidden[k] * network->layers[1].weights.elements[k * 3 + j];
+      EXPECT_NEAR(custom_math::matrix_row(logits, i)[j], output[j], 1e-12);
+    }
+  }
+
+  // More samples than the capacity, or samples of the wrong size.
+  custom_math::Matrix *large = custom_math::matrix_create<double>(5, 6);
+  custom_math::Matrix *wide = custom_math::matrix_create<double>(2, 7);
+  EXPECT_EQ(neural::network_forward(network, workspace, large), nullptr);
+  EXPECT_EQ(neural::network_forward(network, workspace, wide), nullptr);
+
+  custom_math::matrix_delete(wide);
+  custom_math::matrix_delete(large);
+  custom_math::matrix_delete(inputs);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+}
+
+// Counts the layers whose gradients are final.
+void count_layer(void *context, size_t) { (*(size_t *)context)++; }
+
+TEST(NetworkTests, InvalidLabels) {
+  const size_t sizes[] = {6, 4, 3};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_TANH, 0,
+                                              false};
+  neural::Network *network =
+      neural::network_create<double>(sizes, 3, &activation, 5);
+  neural::Workspace *workspace = neural::workspace_create(network, 4);
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  neural::Optimizer *optimizer =
+      neural::optimizer_create<double>(network->size, &options);
+
+  custom_math::Matrix *inputs = custom_math::matrix_create<double>(2, 6);
+  fill(inputs, 3);
+  const int valid[] = {0, 2}, invalid[] = {1, 7}, negative[] = {-1, 0};
+  images::Batch batch = {*inputs, valid};
+
+  // A first step leaves gradients in the workspace.
+  ASSERT_FALSE(
+      isnan(neural::network_train_batch(network, workspace, &batch, 0.1)));
+  const std::vector<double> parameters(network->parameters,
+                                       network->parameters + network->size);
+
+  // Batches with a label out of the classes take no step.
+  for (const int *labels : {invalid, negative}) {
+    batch.labels = labels;
+    EXPECT_TRUE(
+        isnan(neural::network_train_batch(network, workspace, &batch, 0.1)));
+    EXPECT_TRUE(isnan(
+        neural::network_train_batch(network, workspace, &batch, optimizer)));
+  }
+  for (size_t i = 0; i < network->size; i++)
+    ASSERT_EQ(network->parameters[i], parameters[i]);
+
+  // The backward pass leaves gradients of 0, and still reports every layer.
+  size_t layers = 0;
+  const neural::BackwardHook hook = {count_layer, &layers};
+  neural::network_forward(network, workspace, inputs);
+  EXPECT_TRUE(isnan(neural::network_backward(network, workspace, inputs,
+                                             invalid, 0, &hook)));
+  EXPECT_EQ(layers, 2u);
+  for (size_t i = 0; i < workspace->size; i++)
+    ASSERT_EQ(workspace->gradients[i], 0.);
+
+  custom_math::matrix_delete(inputs);
+  neural::optimizer_delete(optimizer);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+}
+
+TEST(NetworkTests, GradientsSigmoid) {
+  check_gradients(custom_math::ACTIVATION_SIGMOID);
+}
+
+TEST(NetworkTests, GradientsTanh) {
+  check_gradients(custom_math::ACTIVATION_TANH);
+}
+
+TEST(NetworkTests, GradientsGelu) {
+  check_gradients(custom_math::ACTIVATION_GELU);
+}
+
+TEST(NetworkTests, TrainTestDataset) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+
+  const size_t sizes[] = {784, 64, 10};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_RELU, 0,
+                                              false};
+  neural::NetworkF *network =
+      neural::network_create<float>(sizes, 3, &activation, 1);
+  neural::WorkspaceF *workspace = neural::workspace_create(network, 64);
+
+  images::LoaderOptions options = images::loader_default_options();
+  options.batch_size = 64;
+  images::LoaderF *loader = images::loader_create(dataset, &options);
+  ASSERT_NE(loader, nullptr);
+
+  images::BatchF batch;
+  float first = 0, last = 0;
+  for (size_t epoch = 0; epoch < 2; epoch++) {
+    while (images::loader_next(loader, &batch)) {
+      last = neural::network_train_batch(network, workspace, &batch, 0.1f);
+      ASSERT_FALSE(isnan(last));
+      if (first == 0) first = last;
+    }
+  }
+  EXPECT_LT(last, first);
+  EXPECT_GT(neural::network_accuracy(network, workspace, dataset), 0.9);
+
+  images::loader_delete(loader);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
+
+TEST(NetworkTests, TrainAdam) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+
+  const size_t sizes[] = {784, 64, 10};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_RELU, 0,
+                                              false};
+  neural::NetworkF *network =
+      neural::network_create<float>(sizes, 3, &activation, 1);
+  neural::WorkspaceF *workspace = neural::workspace_create(network, 64);
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+  neural::OptimizerF *optimizer =
+      neural::optimizer_create<float>(network->size, &options);
+  ASSERT_NE(optimizer, nullptr);
+
+  for (size_t first = 0; first < dataset->count; first += 64) {
+    images::BatchF batch = images::dataset_batch(dataset, first, 64);
+    ASSERT_FALSE(isnan(
+        neural::network_train_batch(network, workspace, &batch, optimizer)));
+  }
+  EXPECT_GT(neural::network_accuracy(network, workspace, dataset), 0.85);
+
+  // An optimizer of another size does not fit.
+  neural::OptimizerF *other = neural::optimizer_create<float>(10, &options);
+  images::BatchF batch = images::dataset_batch(dataset, 0, 64);
+  EXPECT_TRUE(
+      isnan(neural::network_train_batch(network, workspace, &batch, other)));
+
+  neural::optimizer_delete(other);
+  neural::optimizer_delete(optimizer);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
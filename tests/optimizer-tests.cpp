@@ -0,0 +1,160 @@
+/**
+ * @file optimizer-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the optimizers.
+ * @version 1.0
+ * @date 2023-08-13
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "optimizer.hpp"
+#include "random.hpp"
+
+namespace {
+
+// The updates as they are usually written, one parameter at a time.
+void reference_step(const neural::OptimizerOptions *o, size_t t,
+                    std::vector<double> *p, const std::vector<double> &g,
+                    std::vector<double> *m, std::vector<double> *v) {
+  for (size_t i = 0; i < p->size(); i++) {
+    double &x = (*p)[i];
+    double d = g[i];
+    if (o->type != neural::OPTIMIZER_ADAMW) d += o->weight_decay * x;
+
+    switch (o->type) {
+      case neural::OPTIMIZER_SGD:
+        x -= o->learning_rate * d;
+        break;
+      case neural::OPTIMIZER_MOMENTUM:
+        (*m)[i] = o->momentum * (*m)[i] + d;
+        x -= o->learning_rate * (*m)[i];
+        break;
+      case neural::OPTIMIZER_NESTEROV:
+        (*m)[i] = o->momentum * (*m)[i] + d;
+        x -= o->learning_rate * (d + o->momentum * (*m)[i]);
+        break;
+      case neural::OPTIMIZER_ADAM:
+      case neural::OPTIMIZER_ADAMW: {
+        (*m)[i] = o->beta1 * (*m)[i] + (1 - o->beta1) * d;
+        (*v)[i] = o->beta2 * (*v)[i] + (1 - o->beta2) * d * d;
+        double m_hat = (*m)[i] / (1 - pow(o->beta1, (double)t));
+        double v_hat = (*v)[i] / (1 - pow(o->beta2, (double)t));
+        if (o->type == neural::OPTIMIZER_ADAMW)
+          x -= o->learning_rate * o->weight_decay * x;
+        x -= o->learning_rate * m_hat / (sqrt(v_hat) + o->epsilon);
+        break;
+      }
+    }
+  }
+}
+
+template <typename T>
+void check(neural::OptimizerType type, double weight_decay, double tolerance) {
+  const size_t size = 37;
+  neural::OptimizerOptions options = neural::optimizer_default_options(type);
+  options.learning_rate = 0.1;
+  options.weight_decay = weight_decay;
+  neural::BasicOptimizer<T> *optimizer =
+      neural::optimizer_create<T>(size, &options);
+  ASSERT_NE(optimizer, nullptr);
+
+  custom_math::Random random;
+  custom_math::random_seed(&random, (uint64_t)type);
+  std::vector<double> p(size), g(size), m(size, 0), v(size, 0);
+  std::vector<T> parameters(size), gradients(size);
+  for (size_t i = 0; i < size; i++)
+    parameters[i] = (T)(p[i] = custom_math::random_uniform(&random) - 0.5);
+
+  for (size_t t = 1; t <= 5; t++) {
+    for (size_t i = 0; i < size; i++)
+      gradients[i] = (T)(g[i] = custom_math::random_uniform(&random) - 0.5);
+    neural::optimizer_step(optimizer, parameters.data(), gradients.data());
+    reference_step(&options, t, &p, g, &m, &v);
+
+    for (size_t i = 0; i < size; i++)
+      ASSERT_NEAR(parameters[i], p[i], tolerance)
+          << "step " << t << ", parameter " << i;
+  }
+  EXPECT_EQ(optimizer->steps, 5u);
+
+  neural::optimizer_delete(optimizer);
+}
+
+}  // namespace
+
+TEST(OptimizerTests, Sgd) {
+  check<double>(neural::OPTIMIZER_SGD, 0, 1e-14);
+  check<float>(neural::OPTIMIZER_SGD, 0.01, 1e-6);
+}
+
+TEST(OptimizerTests, Momentum) {
+  check<double>(neural::OPTIMIZER_MOMENTUM, 0, 1e-14);
+  check<float>(neural::OPTIMIZER_MOMENTUM, 0.01, 1e-6);
+}
+
+TEST(OptimizerTests, Nesterov) {
+  check<double>(neural::OPTIMIZER_NESTEROV, 0, 1e-14);
+  check<float>(neural::OPTIMIZER_NESTEROV, 0.01, 1e-6);
+}
+
+TEST(OptimizerTests, Adam) {
+  check<double>(neural::OPTIMIZER_ADAM, 0, 1e-12);
+  check<float>(neural::OPTIMIZER_ADAM, 0.01, 1e-5);
+}
+
+TEST(OptimizerTests, AdamW) {
+  check<double>(neural::OPTIMIZER_ADAMW, 0.01, 1e-12);
+  check<float>(neural::OPTIMIZER_ADAMW, 0.1, 1e-5);
+}
+
+TEST(OptimizerTests, State) {
+  neural::OptimizerOptions sgd =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  neural::OptimizerOptions adam =
+      neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+
+  neural::Optimizer *plain = neural::optimizer_create<double>(10, &sgd);
+  EXPECT_EQ(plain->first, nullptr);
+  EXPECT_EQ(plain->second, nullptr);
+
+  // The moments are one block, each on a cache line of its own.
+  neural::OptimizerF *moments = neural::optimizer_create<float>(10, &adam);
+  ASSERT_NE(moments->first, nullptr);
+  EXPECT_EQ((uintptr_t)moments->first % 64, 0u);
+  EXPECT_EQ((char *)moments->second - (char *)moments->first, 64);
+
+  float parameters[10] = {0}, gradients[10] = {1};
+  neural::optimizer_step(moments, parameters, gradients);
+  EXPECT_NE(moments->first[0], 0.f);
+  neural::optimizer_reset(moments);
+  EXPECT_EQ(moments->steps, 0u);
+  EXPECT_EQ(moments->first[0], 0.f);
+  EXPECT_EQ(moments->second[0], 0.f);
+
+  neural::optimizer_delete(moments);
+  neural::optimizer_delete(plain);
+}
+
+TEST(OptimizerTests, Invalid) {
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_MOMENTUM);
+  EXPECT_EQ(neural::optimizer_create<float>(0, &options), nullptr);
+  EXPECT_EQ(neural::optimizer_create<float>(10, nullptr), nullptr);
+
+  options.momentum = 1;
+  EXPECT_EQ(neural::optimizer_create<float>(10, &options), nullptr);
+
+  options = neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+  options.epsilon = 0;
+  EXPECT_EQ(neural::optimizer_create<float>(10, &options), nullptr);
+  options.epsilon = 1e-8;
+  options.beta2 = 1;
+  EXPECT_EQ(neural::optimizer_create<float>(10, &options), nullptr);
+}
@@ -0,0 +1,137 @@
+/**
+ * @file qgemm-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the 8-bit integer GEMM, with every
+ *        instruction set.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "qgemm.hpp"
+#include "simd.hpp"
+
+namespace {
+
+class QgemmTests : public ::testing::TestWithParam<custom_math::Isa> {
+ public:
+  virtual void SetUp() override {
+    previous = custom_math::simd_get_isa();
+    if (custom_math::simd_set_isa(GetParam()) != GetParam())
+      GTEST_SKIP() << custom_math::simd_isa_name(GetParam())
+                   << " is not supported on this CPU";
+  }
+  virtual void TearDown() override { custom_math::simd_set_isa(previous); }
+
+ private:
+  custom_math::Isa previous;
+};
+
+// Checks C = A * B against the sums computed one by one, which must be equal:
+// the kernels do not round. The extremes of both ranges are drawn often.
+void check_qgemm(size_t m, size_t n, size_t k, unsigned int seed) {
+  const size_t lda = k + 3, ldb = n + 1, ldc = n + 2;
+  std::vector<uint8_t> a(m * lda);
+  std::vector<int8_t> b(k * ldb);
+  srand(seed);
+  for (uint8_t &x : a)
+    x = rand() % 4 == 0 ? QGEMM_MAX_ACTIVATION
+                        : (uint8_t)(rand() % (QGEMM_MAX_ACTIVATION + 1));
+  for (int8_t &x : b) x = rand() % 4 == 0 ? -128 : (int8_t)(rand() % 256);
+
+  std::vector<int8_t> packed(custom_math::qgemm_packed_size(k, n));
+  custom_math::qgemm_pack(k, n, b.data(), ldb, packed.data());
+  std::vector<int32_t> c(m * ldc, -1);
+  custom_math::qgemm(m, n, k, a.data(), lda, packed.data(), c.data(), ldc);
+
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) {
+      int32_t expected = 0;
+      for (size_t p = 0; p < k; p++)
+        expected += a[i * lda + p] * b[p * ldb + j];
+      ASSERT_EQ(c[i * ldc + j], expected)
+          << m << "x" << n << "x" << k << " at " << i << ", " << j;
+    }
+    // The padding of the rows of C is left alone.
+    for (size_t j = n; j < ldc; j++) ASSERT_EQ(c[i * ldc + j], -1);
+  }
+}
+
+// Counts the elements of C the epilogue is called on.
+void count(void *context, size_t row, size_t col, size_t rows, size_t cols) {
+  std::vector<int> *calls = (std::vector<int> *)context;
+  for (size_t i = row; i < row + rows; i++)
+    for (size_t j = col; j < col + cols; j++) (*calls)[i * 10 + j]++;
+}
+
+}  // namespace
+
+TEST_P(QgemmTests, Sizes) {
+  const size_t sizes[][3] = {{1, 1, 1},    {3, 5, 2},     {4, 16, 4},
+                             {5, 17, 7},   {7, 31, 13},   {8, 32, 64},
+                             {13, 33, 30}, {17, 48, 129}, {64, 128, 784},
+                             {33, 10, 128}};
+  unsigned int seed = 1;
+  for (const auto &size : sizes) check_qgemm(size[0], size[1], size[2], seed++);
+}
+
+TEST_P(QgemmTests, Empty) {
+  // Without any column of A, C is 0.
+  std::vector<uint8_t> a(3);
+  std::vector<int8_t> packed(custom_math::qgemm_packed_size(0, 5));
+  std::vector<int32_t> c(15, -1);
+  custom_math::qgemm(3, 5, 0, a.data(), 1, packed.data(), c.data(), 5);
+  for (int32_t x : c) EXPECT_EQ(x, 0);
+
+  custom_math::qgemm(0, 5, 4, a.data(), 4, packed.data(), c.data(), 5);
+}
+
+TEST_P(QgemmTests, Epilogue) {
+  const size_t m = 11, n = 10, k = 9;
+  std::vector<uint8_t> a(m * k, 1);
+  std::vector<int8_t> b(k * n, 2);
+  std::vector<int8_t> packed(custom_math::qgemm_packed_size(k, n));
+  custom_math::qgemm_pack(k, n, b.data(), n, packed.data());
+
+  std::vector<int> calls(m * n, 0);
+  const custom_math::GemmEpilogue epilogue = {count, &calls};
+  std::vector<int32_t> c(m * n);
+  custom_math::qgemm(m, n, k, a.data(), k, packed.data(), c.data(), n,
+                     &epilogue);
+
+  for (size_t i = 0; i < m * n; i++) {
+    EXPECT_EQ(calls[i], 1) << i;
+    EXPECT_EQ(c[i], 18);
+  }
+}
+
+TEST(QgemmPackTests, Layout) {
+  // 5 rows, grouped by 4, and 3 columns, padded to 16.
+  const int8_t b[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  ASSERT_EQ(custom_math::qgemm_packed_size(5, 3), 2u * 16 * 4);
+  std::vector<int8_t> packed(custom_math::qgemm_packed_size(5, 3), -1);
+  custom_math::qgemm_pack(5, 3, b, 3, packed.data());
+
+  const int8_t column[] = {1, 4, 7, 10};
+  for (size_t t = 0; t < 4; t++) EXPECT_EQ(packed[t], column[t]);
+  EXPECT_EQ(packed[4 + 1], 5);
+  EXPECT_EQ(packed[64], 13);
+  EXPECT_EQ(packed[64 + 1], 0);
+  EXPECT_EQ(packed[64 + 4 * 2], 15);
+  EXPECT_EQ(packed[4 * 3], 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllIsas, QgemmTests,
+    ::testing::Values(custom_math::ISA_SCALAR, custom_math::ISA_SSE2,
+                      custom_math::ISA_AVX2, custom_math::ISA_AVX512),
+    [](const ::testing::TestParamInfo<custom_math::Isa> &info) {
+      return std::string(custom_math::simd_isa_name(info.param));
+    });
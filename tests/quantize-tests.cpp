@@ -0,0 +1,146 @@
+/**
+ * @file quantize-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the quantized networks.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include "quantize.hpp"
+#include "random.hpp"
+
+namespace {
+
+// A dataset of samples drawn uniformly in [-1, 1], whose labels are unused.
+images::Dataset *uniform_dataset(size_t count, size_t features) {
+  images::Dataset *dataset = images::dataset_create<double>(count, 1, features);
+  custom_math::Random random;
+  custom_math::random_seed(&random, 3);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < features; j++)
+      custom_math::matrix_row(&dataset->samples, i)[j] =
+          2 * custom_math::random_uniform(&random) - 1;
+    dataset->labels[i] = 0;
+  }
+  return dataset;
+}
+
+}  // namespace
+
+TEST(QuantizeTests, Logits) {
+  const size_t sizes[] = {12, 24, 20, 5};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_TANH, 0,
+                                              false};
+  neural::Network *network =
+      neural::network_create<double>(sizes, 4, &activation, 7);
+  for (size_t l = 0; l < network->count; l++)
+    for (size_t j = 0; j < network->layers[l].outputs; j++)
+      network->layers[l].bias[j] = 0.05 * (double)j - 0.3;
+  images::Dataset *dataset = uniform_dataset(100, 12);
+
+  neural::QuantizedNetwork *quantized =
+      neural::quantize_network(network, dataset);
+  ASSERT_NE(quantized, nullptr);
+  ASSERT_EQ(quantized->count, 3u);
+  // The inputs and the outputs of tanh are centered on 0.
+  for (size_t l = 0; l < quantized->count; l++) {
+    EXPECT_GT(quantized->layers[l].input_zero, 50) << l;
+    EXPECT_LT(quantized->layers[l].input_zero, 77) << l;
+  }
+  EXPECT_EQ(neural::quantized_size(quantized),
+            12u * 24 + 24 * 20 + 20 * 5 + 12 * (24 + 20 + 5));
+
+  neural::Workspace *workspace = neural::workspace_create(network, 100);
+  neural::QuantizedWorkspace *quantized_workspace =
+      neural::quantized_workspace_create(quantized, 100);
+  ASSERT_NE(quantized_workspace, nullptr);
+
+  const custom_math::Matrix *expected =
+      neural::network_forward(network, workspace, &dataset->samples);
+  const custom_math::MatrixF *logits = neural::quantized_forward(
+      quantized, quantized_workspace, &dataset->samples);
+  ASSERT_NE(logits, nullptr);
+  ASSERT_EQ(logits->rows, 100u);
+  ASSERT_EQ(logits->cols, 5u);
+
+  // Every quantization step is within half a step of 1 / 127 of the range.
+  double largest = 0;
+  for (size_t i = 0; i < 100; i++)
+    for (size_t j = 0; j < 5; j++)
+      largest = fmax(largest,
+                     fabs(custom_math::matrix_row(logits, i)[j] -
+                          custom_math::matrix_row(expected, i)[j]));
+  EXPECT_LT(largest, 0.05);
+  EXPECT_GT(largest, 0.);
+
+  // More samples than the capacity, or samples of the wrong size.
+  images::Dataset *large = uniform_dataset(101, 12);
+  images::Dataset *wide = uniform_dataset(2, 13);
+  EXPECT_EQ(neural::quantized_forward(quantized, quantized_workspace,
+                                      &large->samples),
+            nullptr);
+  EXPECT_EQ(neural::quantized_forward(quantized, quantized_workspace,
+                                      &wide->samples),
+            nullptr);
+  EXPECT_EQ(neural::quantize_network(network, wide), nullptr);
+  EXPECT_EQ(neural::quantize_network<double>(nullptr, dataset), nullptr);
+
+  images::dataset_delete(wide);
+  images::dataset_delete(large);
+  neural::quantized_workspace_delete(quantized_workspace);
+  neural::workspace_delete(workspace);
+  neural::quantized_delete(quantized);
+  images::dataset_delete(dataset);
+  neural::network_delete(network);
+}
+
+TEST(QuantizeTests, Accuracy) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+
+  const size_t sizes[] = {784, 64, 10};
+  const custom_math::Activation activation = {custom_math::ACTIVATION_RELU, 0,
+                                              false};
+  neural::NetworkF *network =
+      neural::network_create<float>(sizes, 3, &activation, 1);
+  neural::WorkspaceF *workspace = neural::workspace_create(network, 64);
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+  neural::OptimizerF *optimizer =
+      neural::optimizer_create<float>(network->size, &options);
+  for (size_t first = 0; first < dataset->count; first += 64) {
+    images::BatchF batch = images::dataset_batch(dataset, first, 64);
+    neural::network_train_batch(network, workspace, &batch, optimizer);
+  }
+
+  // Calibrated on a tenth of the samples.
+  neural::QuantizedNetwork *quantized =
+      neural::quantize_network(network, dataset, 1000);
+  ASSERT_NE(quantized, nullptr);
+  neural::QuantizedWorkspace *quantized_workspace =
+      neural::quantized_workspace_create(quantized, 64);
+
+  const double expected =
+      neural::network_accuracy(network, workspace, dataset);
+  const double accuracy =
+      neural::quantized_accuracy(quantized, quantized_workspace, dataset);
+  EXPECT_GT(expected, 0.85);
+  EXPECT_NEAR(accuracy, expected, 0.01);
+
+  // The weights take a byte instead of 4.
+  EXPECT_LT(neural::quantized_size(quantized),
+            (784 * 64 + 64 * 10) * sizeof(float) / 3);
+
+  neural::quantized_workspace_delete(quantized_workspace);
+  neural::quantized_delete(quantized);
+  neural::optimizer_delete(optimizer);
+  neural::workspace_delete(workspace);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
@@ -0,0 +1,241 @@
+/**
+ * @file server-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the inference server.
+ * @version 1.0
+ * @date 2023-08-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "server.hpp"
+
+namespace {
+
+const size_t SIZES[] = {784, 32, 10};
+const custom_math::Activation ACTIVATION = {custom_math::ACTIVATION_TANH, 0,
+                                            false};
+
+// Records the labels of the answers, in their order.
+void record(void *context, int label) {
+  ((std::vector<int> *)context)->push_back(label);
+}
+
+// A sample whose pixels all have the same value.
+std::vector<uint8_t> uniform(uint8_t value) {
+  return std::vector<uint8_t>(784, value);
+}
+
+}  // namespace
+
+TEST(ServerTests, Predictions) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::ServerF *server = neural::server_create(network);
+  ASSERT_NE(server, nullptr);
+
+  // The pixels of the samples, and the labels of a forward pass over all of
+  // them at once.
+  const size_t count = 300;
+  std::vector<uint8_t> pixels(count * 784);
+  for (size_t i = 0; i < count * 784; i++)
+    pixels[i] = (uint8_t)lrintf(
+        custom_math::matrix_row(&dataset->samples, i / 784)[i % 784] * 255);
+
+  neural::WorkspaceF *workspace = neural::workspace_create(network, count);
+  images::BatchF batch = images::dataset_batch(dataset, 0, count);
+  const custom_math::MatrixF *logits =
+      neural::network_forward(network, workspace, &batch.samples);
+
+  std::vector<int> labels;
+  for (size_t i = 0; i < count; i++)
+    ASSERT_TRUE(
+        neural::server_submit(server, &pixels[i * 784], record, &labels));
+  neural::server_flush(server);
+
+  ASSERT_EQ(labels.size(), count);
+  // The pixels are scaled in another order, which may swap two labels whose
+  // logits are within a rounding error.
+  for (size_t i = 0; i < count; i++) {
+    const float *row = custom_math::matrix_row(logits, i);
+    EXPECT_NEAR(row[labels[i]], *std::max_element(row, row + 10), 1e-4) << i;
+  }
+
+  neural::ServerStats stats = neural::server_stats(server);
+  EXPECT_EQ(stats.requests, count);
+  EXPECT_GE(stats.batches, count / 64);
+  EXPECT_LE(stats.p50, stats.p99);
+  EXPECT_GT(stats.throughput, 0);
+
+  neural::workspace_delete(workspace);
+  neural::server_delete(server);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
+
+TEST(ServerTests, Quantized) {
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::QuantizedNetwork *quantized =
+      neural::quantize_network(network, dataset, 500);
+  neural::ServerF *server = neural::server_create(network, nullptr, quantized);
+  ASSERT_NE(server, nullptr);
+
+  // The quantized network answers, from the pixels scaled by the server.
+  const size_t count = 100;
+  std::vector<uint8_t> pixels(count * 784);
+  custom_math::MatrixF *samples = custom_math::matrix_create<float>(count, 784);
+  for (size_t i = 0; i < count * 784; i++) {
+    pixels[i] = (uint8_t)lrintf(
+        custom_math::matrix_row(&dataset->samples, i / 784)[i % 784] * 255);
+    custom_math::matrix_row(samples, i / 784)[i % 784] =
+        (float)pixels[i] * (float)(1 / 255.);
+  }
+  neural::QuantizedWorkspace *workspace =
+      neural::quantized_workspace_create(quantized, count);
+  const custom_math::MatrixF *logits =
+      neural::quantized_forward(quantized, workspace, samples);
+
+  std::vector<int> labels;
+  for (size_t i = 0; i < count; i++)
+    ASSERT_TRUE(
+        neural::server_submit(server, &pixels[i * 784], record, &labels));
+  neural::server_flush(server);
+
+  ASSERT_EQ(labels.size(), count);
+  for (size_t i = 0; i < count; i++) {
+    const float *row = custom_math::matrix_row(logits, i);
+    EXPECT_EQ(row[labels[i]], *std::max_element(row, row + 10)) << i;
+  }
+
+  // A quantized network of another size does not fit.
+  const size_t other[] = {100, 32, 10};
+  neural::NetworkF *small =
+      neural::network_create<float>(other, 3, &ACTIVATION, 4);
+  EXPECT_EQ(neural::server_create(small, nullptr, quantized), nullptr);
+
+  neural::network_delete(small);
+  neural::quantized_workspace_delete(workspace);
+  custom_math::matrix_delete(samples);
+  neural::server_delete(server);
+  neural::quantized_delete(quantized);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
+
+TEST(ServerTests, FullBatches) {
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::ServerOptions options = neural::server_default_options();
+  options.max_batch = 4;
+  options.max_delay = 60;
+  neural::ServerF *server = neural::server_create(network, &options);
+
+  // Full batches do not wait for the delay.
+  std::vector<int> labels;
+  std::vector<uint8_t> pixels = uniform(100);
+  for (size_t i = 0; i < 8; i++)
+    ASSERT_TRUE(neural::server_submit(server, pixels.data(), record, &labels));
+  neural::server_flush(server);
+
+  neural::ServerStats stats = neural::server_stats(server);
+  EXPECT_EQ(stats.requests, 8u);
+  EXPECT_EQ(stats.batches, 2u);
+  EXPECT_LT(stats.p99, 30.);
+  for (int label : labels) EXPECT_EQ(label, labels[0]);
+
+  // The requests queued when the server is deleted are answered.
+  for (size_t i = 0; i < 3; i++)
+    ASSERT_TRUE(neural::server_submit(server, pixels.data(), record, &labels));
+  neural::server_delete(server);
+  EXPECT_EQ(labels.size(), 11u);
+
+  neural::network_delete(network);
+}
+
+TEST(ServerTests, Delay) {
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::ServerOptions options = neural::server_default_options();
+  options.max_delay = 0.02;
+  neural::ServerF *server = neural::server_create(network, &options);
+
+  // A lone request waits for others until its deadline.
+  std::vector<int> labels;
+  std::vector<uint8_t> pixels = uniform(0);
+  EXPECT_EQ(neural::server_stats(server).requests, 0u);
+  ASSERT_TRUE(neural::server_submit(server, pixels.data(), record, &labels));
+  neural::server_flush(server);
+
+  neural::ServerStats stats = neural::server_stats(server);
+  EXPECT_EQ(stats.batches, 1u);
+  EXPECT_GE(stats.p50, 0.02);
+  EXPECT_EQ(stats.p50, stats.p99);
+
+  neural::server_delete(server);
+  neural::network_delete(network);
+}
+
+TEST(ServerTests, Interval) {
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::ServerOptions options = neural::server_default_options();
+  options.max_delay = 0;
+  neural::ServerF *server = neural::server_create(network, &options);
+
+  // More requests than the window of latencies.
+  std::vector<int> labels;
+  std::vector<uint8_t> pixels = uniform(50);
+  const size_t count = SERVER_LATENCY_WINDOW + 100;
+  for (size_t i = 0; i < count; i++)
+    ASSERT_TRUE(neural::server_submit(server, pixels.data(), record, &labels));
+  neural::server_flush(server);
+
+  neural::ServerStats stats = neural::server_stats(server, true);
+  EXPECT_EQ(stats.requests, count);
+  EXPECT_GT(stats.p50, 0);
+  EXPECT_LE(stats.p50, stats.p99);
+  EXPECT_GT(stats.throughput, 0);
+
+  // A reset starts a new interval.
+  EXPECT_EQ(neural::server_stats(server).requests, 0u);
+  for (size_t i = 0; i < 3; i++)
+    ASSERT_TRUE(neural::server_submit(server, pixels.data(), record, &labels));
+  neural::server_flush(server);
+  stats = neural::server_stats(server);
+  EXPECT_EQ(stats.requests, 3u);
+  EXPECT_GE(stats.batches, 1u);
+  EXPECT_EQ(neural::server_stats(server).requests, 3u);
+
+  neural::server_delete(server);
+  neural::network_delete(network);
+}
+
+TEST(ServerTests, Invalid) {
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 3, &ACTIVATION, 4);
+  neural::ServerOptions options = neural::server_default_options();
+
+  options.max_batch = 0;
+  EXPECT_EQ(neural::server_create(network, &options), nullptr);
+  options = neural::server_default_options();
+  options.queue = options.max_batch - 1;
+  EXPECT_EQ(neural::server_create(network, &options), nullptr);
+  options = neural::server_default_options();
+  options.max_delay = NAN;
+  EXPECT_EQ(neural::server_create(network, &options), nullptr);
+  EXPECT_EQ(neural::server_create<float>(nullptr), nullptr);
+
+  neural::network_delete(network);
+}
@@ -0,0 +1,254 @@
+/**
+ * @file simd-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the vectorized kernels. Every
+ *        instruction set supported by the machine is checked against the
+ *        scalar results.
+ * @version 1.0
+ * @date 2023-07-22
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "gemm.hpp"
+#include "simd.hpp"
+
+namespace {
+
+// Sizes around the vector widths and the threading threshold, so that both
+// the main loops and the tails are exercised.
+const size_t SIZES[] = {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 1000, 70001};
+
+std::vector<double> random_values(size_t size, unsigned int seed) {
+  std::vector<double> values(size);
+  srand(seed);
+  for (size_t i = 0; i < size; i++) values[i] = rand() / (double)RAND_MAX - 0.5;
+  return values;
+}
+
+class SimdTests : public ::testing::TestWithParam<custom_math::Isa> {
+ public:
+  virtual void SetUp() override {
+    previous = custom_math::simd_get_isa();
+    if (custom_math::simd_set_isa(GetParam()) != GetParam())
+      GTEST_SKIP() << custom_math::simd_isa_name(GetParam())
+                   << " is not supported on this CPU";
+  }
+  virtual void TearDown() override { custom_math::simd_set_isa(previous); }
+
+ private:
+  custom_math::Isa previous;
+};
+
+}  // namespace
+
+TEST_P(SimdTests, Add) {
+  for (size_t size : SIZES) {
+    // Start one element in, so the arrays are not aligned.
+    std::vector<double> a = random_values(size + 1, 1);
+    std::vector<double> b = random_values(size + 1, 2);
+    std::vector<double> dst(size + 2, -1.);
+
+    custom_math::simd_add(dst.data() + 1, a.data() + 1, b.data() + 1, size);
+
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i + 1], a[i + 1] + b[i + 1]) << "size " << size;
+    EXPECT_EQ(dst[0], -1.);
+    EXPECT_EQ(dst[size + 1], -1.);
+  }
+}
+
+TEST_P(SimdTests, Sub) {
+  for (size_t size : SIZES) {
+    std::vector<double> a = random_values(size, 3);
+    std::vector<double> b = random_values(size, 4);
+    std::vector<double> dst(size + 1, -1.);
+
+    custom_math::simd_sub(dst.data(), a.data(), b.data(), size);
+
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i], a[i] - b[i]) << "size " << size;
+    EXPECT_EQ(dst[size], -1.);
+  }
+}
+
+TEST_P(SimdTests, SubInPlace) {
+  std::vector<double> a = random_values(1001, 5);
+  std::vector<double> b = random_values(1001, 6);
+  std::vector<double> expected(a.size());
+  for (size_t i = 0; i < a.size(); i++) expected[i] = a[i] - b[i];
+
+  custom_math::simd_sub(a.data(), a.data(), b.data(), a.size());
+
+  for (size_t i = 0; i < a.size(); i++) ASSERT_EQ(a[i], expected[i]);
+}
+
+TEST_P(SimdTests, Scale) {
+  for (size_t size : SIZES) {
+    std::vector<double> a = random_values(size, 7);
+    std::vector<double> dst(size + 1, -1.);
+
+    custom_math::simd_scale(dst.data(), a.data(), -2.5, size);
+
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i], a[i] * -2.5) << "size " << size;
+    EXPECT_EQ(dst[size], -1.);
+  }
+}
+
+TEST_P(SimdTests, CopyAndFill) {
+  for (size_t size : SIZES) {
+    std::vector<double> a = random_values(size, 8);
+    std::vector<double> dst(size + 1, -1.);
+
+    custom_math::simd_copy(dst.data(), a.data(), size);
+    for (size_t i = 0; i < size; i++) ASSERT_EQ(dst[i], a[i]);
+    EXPECT_EQ(dst[size], -1.);
+
+    custom_math::simd_fill(dst.data(), 3., size);
+    for (size_t i = 0; i < size; i++) ASSERT_EQ(dst[i], 3.);
+    EXPECT_EQ(dst[size], -1.);
+  }
+}
+
+TEST_P(SimdTests, Gemm) {
+  const size_t m = 29, n = 31, k = 300;
+  std::vector<double> a = random_values(m * k, 9);
+  std::vector<double> b = random_values(k * n, 10);
+  std::vector<double> c(m * n);
+
+  custom_math::gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, m, n, k, 1.,
+                    a.data(), k, b.data(), n, 0., c.data(), n);
+
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++) {
+      double expected = 0.;
+      for (size_t p = 0; p < k; p++) expected += a[i * k + p] * b[p * n + j];
+      ASSERT_NEAR(c[i * n + j], expected, 1e-10);
+    }
+}
+
+TEST_P(SimdTests, Float) {
+  for (size_t size : SIZES) {
+    std::vector<double> values_a = random_values(size + 1, 11);
+    std::vector<double> values_b = random_values(size + 1, 12);
+    std::vector<float> a(values_a.begin(), values_a.end());
+    std::vector<float> b(values_b.begin(), values_b.end());
+    std::vector<float> dst(size + 2, -1.f);
+
+    custom_math::simd_add(dst.data() + 1, a.data() + 1, b.data() + 1, size);
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i + 1], a[i + 1] + b[i + 1]) << "size " << size;
+
+    custom_math::simd_sub(dst.data() + 1, a.data() + 1, b.data() + 1, size);
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i + 1], a[i + 1] - b[i + 1]) << "size " << size;
+
+    custom_math::simd_scale(dst.data() + 1, a.data() + 1, -2.5f, size);
+    for (size_t i = 0; i < size; i++)
+      ASSERT_EQ(dst[i + 1], a[i + 1] * -2.5f) << "size " << size;
+
+    custom_math::simd_copy(dst.data() + 1, b.data() + 1, size);
+    for (size_t i = 0; i < size; i++) ASSERT_EQ(dst[i + 1], b[i + 1]);
+
+    custom_math::simd_fill(dst.data() + 1, 3.f, size);
+    for (size_t i = 0; i < size; i++) ASSERT_EQ(dst[i + 1], 3.f);
+
+    EXPECT_EQ(dst[0], -1.f);
+    EXPECT_EQ(dst[size + 1], -1.f);
+  }
+}
+
+TEST_P(SimdTests, GemmFloat) {
+  const size_t m = 29, n = 37, k = 300;
+  std::vector<double> values_a = random_values(m * k, 13);
+  std::vector<double> values_b = random_values(k * n, 14);
+  std::vector<float> a(values_a.begin(), values_a.end());
+  std::vector<float> b(values_b.begin(), values_b.end());
+  std::vector<float> c(m * n, 1.f);
+
+  custom_math::gemm(custom_math::NO_TRANS, custom_math::NO_TRANS, m, n, k, 2.f,
+                    a.data(), k, b.data(), n, 0.5f, c.data(), n);
+
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++) {
+      double expected = 0.;
+      for (size_t p = 0; p < k; p++)
+        expected += (double)a[i * k + p] * b[p * n + j];
+      ASSERT_NEAR(c[i * n + j], 2. * expected + 0.5, 1e-4);
+    }
+}
+
+TEST_P(SimdTests, ConvertBytes) {
+  for (size_t size : SIZES) {
+    std::vector<uint8_t> src(size + 1);
+    for (size_t i = 0; i < src.size(); i++) src[i] = (uint8_t)(i * 37 + 11);
+    std::vector<float> dst(size + 2, -1.f);
+    std::vector<double> dst_double(size + 2, -1.);
+
+    // The product and the sum may be fused, so the last bit may differ.
+    const float scale = 1.f / (255.f * 0.3081f), shift = -0.1307f / 0.3081f;
+    custom_math::simd_convert_bytes(dst.data() + 1, src.data() + 1, scale,
+                                    shift, size);
+    custom_math::simd_convert_bytes(dst_double.data() + 1, src.data() + 1,
+                                    1 / 255., 0., size);
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_NEAR(dst[i + 1], src[i + 1] * scale + shift, 1e-6)
+          << "size " << size;
+      ASSERT_EQ(dst_double[i + 1], src[i + 1] * (1 / 255.)) << "size " << size;
+    }
+
+    EXPECT_EQ(dst[0], -1.f);
+    EXPECT_EQ(dst[size + 1], -1.f);
+    EXPECT_EQ(dst_double[size + 1], -1.);
+  }
+}
+
+TEST_P(SimdTests, Resample) {
+  // A 5x6 image, sampled in all of its cells, at integer coordinates too.
+  const size_t stride = 6;
+  std::vector<double> values = random_values(5 * stride, 15);
+  std::vector<float> image(values.begin(), values.end());
+
+  for (size_t size : {0, 1, 7, 8, 9, 15, 16, 17, 1000}) {
+    std::vector<float> x(size), y(size);
+    for (size_t i = 0; i < size; i++) {
+      x[i] = (float)(i * 7 % 40) / 8.f;  // In [0, 5).
+      y[i] = (float)(i * 3 % 32) / 8.f;  // In [0, 4).
+    }
+    std::vector<float> dst(size + 1, -1.f);
+    custom_math::simd_resample(dst.data(), image.data(), stride, x.data(),
+                               y.data(), size);
+
+    for (size_t i = 0; i < size; i++) {
+      const size_t x0 = (size_t)x[i], y0 = (size_t)y[i];
+      const double fx = x[i] - x0, fy = y[i] - y0;
+      const float *p = image.data() + y0 * stride + x0;
+      const double expected =
+          p[0] * (1 - fx) * (1 - fy) + p[1] * fx * (1 - fy) +
+          p[stride] * (1 - fx) * fy + p[stride + 1] * fx * fy;
+      ASSERT_NEAR(dst[i], expected, 1e-6) << "size " << size << ", i " << i;
+    }
+    EXPECT_EQ(dst[size], -1.f);
+  }
+
+  // Doubles, at the pixels themselves.
+  std::vector<double> x = {0, 1, 4, 2}, y = {0, 3, 2, 1}, dst(4);
+  custom_math::simd_resample(dst.data(), values.data(), stride, x.data(),
+                             y.data(), 4);
+  for (size_t i = 0; i < 4; i++)
+    EXPECT_EQ(dst[i], values[(size_t)y[i] * stride + (size_t)x[i]]);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllIsas, SimdTests,
+    ::testing::Values(custom_math::ISA_SCALAR, custom_math::ISA_SSE2,
+                      custom_math::ISA_AVX2, custom_math::ISA_AVX512),
+    [](const ::testing::TestParamInfo<custom_math::Isa> &info) {
+      return std::string(custom_math::simd_isa_name(info.param));
+    });
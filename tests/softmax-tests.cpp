@@ -0,0 +1,171 @@
+/**
+ * @file softmax-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the softmax kernels.
+ * @version 1.0
+ * @date 2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "random.hpp"
+#include "softmax.hpp"
+
+namespace {
+
+// Logits drawn uniformly in [-range, range], and labels in [0, cols).
+template <typename T>
+custom_math::BasicMatrix<T> *make_logits(size_t rows, size_t cols,
+                                         double range, std::vector<int> *labels,
+                                         uint64_t seed) {
+  custom_math::Random random;
+  custom_math::random_seed(&random, seed);
+  custom_math::BasicMatrix<T> *logits =
+      custom_math::matrix_create<T>((int)rows, (int)cols);
+  labels->resize(rows);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++)
+      custom_math::matrix_row(logits, i)[j] =
+          (T)((2 * custom_math::random_uniform(&random) - 1) * range);
+    (*labels)[i] = (int)custom_math::random_below(&random, cols);
+  }
+  return logits;
+}
+
+// Checks the kernel against the definitions, computed in long double.
+template <typename T>
+void check(size_t rows, size_t cols, double range, double tolerance) {
+  std::vector<int> labels;
+  custom_math::BasicMatrix<T> *logits =
+      make_logits<T>(rows, cols, range, &labels, rows * 31 + cols);
+  custom_math::BasicMatrix<T> *gradients =
+      custom_math::matrix_create<T>((int)rows, (int)cols);
+  custom_math::BasicMatrix<T> *log_softmax =
+      custom_math::matrix_create<T>((int)rows, (int)cols);
+  const T scale = (T)0.5;
+
+  custom_math::SoftmaxLoss result = custom_math::softmax_cross_entropy(
+      logits, labels.data(), gradients, scale);
+  ASSERT_EQ(custom_math::matrix_log_softmax_into(log_softmax, logits),
+            log_softmax);
+
+  long double loss = 0;
+  size_t correct = 0;
+  for (size_t i = 0; i < rows; i++) {
+    const T *z = custom_math::matrix_row(logits, i);
+    size_t best = 0;
+    for (size_t j = 1; j < cols; j++)
+      if (z[j] > z[best]) best = j;
+    long double sum = 0;
+    for (size_t j = 0; j < cols; j++)
+      sum += expl((long double)(z[j] - z[best]));
+
+    for (size_t j = 0; j < cols; j++) {
+      long double log_p = (long double)(z[j] - z[best]) - logl(sum);
+      long double g = scale * (expl(log_p) - (j == (size_t)labels[i]));
+      EXPECT_NEAR(custom_math::matrix_row(log_softmax, i)[j], log_p,
+                  tolerance * (1 + fabsl(log_p)));
+      EXPECT_NEAR(custom_math::matrix_row(gradients, i)[j], g, tolerance);
+    }
+    loss -= (long double)(z[labels[i]] - z[best]) - logl(sum);
+    correct += best == (size_t)labels[i];
+  }
+
+  EXPECT_NEAR(result.loss, (double)loss, tolerance * (double)loss);
+  EXPECT_EQ(result.correct, correct);
+
+  // The loss and the accuracy alone.
+  custom_math::SoftmaxLoss alone =
+      custom_math::softmax_cross_entropy(logits, labels.data());
+  EXPECT_EQ(alone.loss, result.loss);
+  EXPECT_EQ(alone.correct, result.correct);
+
+  custom_math::matrix_delete(log_softmax);
+  custom_math::matrix_delete(gradients);
+  custom_math::matrix_delete(logits);
+}
+
+}  // namespace
+
+TEST(SoftmaxTests, NarrowRows) {
+  check<double>(37, 10, 5, 1e-13);
+  check<float>(37, 10, 5, 1e-6);
+  check<float>(5, 1, 5, 1e-6);
+}
+
+TEST(SoftmaxTests, WideRows) {
+  check<double>(9, 100, 5, 1e-13);
+  check<float>(9, 333, 5, 1e-6);
+}
+
+TEST(SoftmaxTests, ManyRows) {
+  check<double>(4099, 10, 5, 1e-13);
+  check<float>(4099, 10, 5, 1e-6);
+}
+
+TEST(SoftmaxTests, LargeLogits) {
+  // e^1000 overflows even in double, the shifted logits do not.
+  check<double>(20, 10, 1000, 1e-13);
+  check<float>(20, 10, 80, 1e-6);
+  check<float>(20, 100, 80, 1e-6);
+}
+
+TEST(SoftmaxTests, InPlace) {
+  std::vector<int> labels;
+  custom_math::MatrixF *logits = make_logits<float>(19, 10, 3, &labels, 1);
+  custom_math::MatrixF *gradients = custom_math::matrix_create<float>(19, 10);
+
+  custom_math::SoftmaxLoss expected = custom_math::softmax_cross_entropy(
+      logits, labels.data(), gradients, 1.f);
+  custom_math::SoftmaxLoss result =
+      custom_math::softmax_cross_entropy(logits, labels.data(), logits, 1.f);
+  EXPECT_EQ(result.loss, expected.loss);
+  EXPECT_EQ(result.correct, expected.correct);
+  for (size_t i = 0; i < 19; i++)
+    for (size_t j = 0; j < 10; j++)
+      EXPECT_EQ(custom_math::matrix_row(logits, i)[j],
+                custom_math::matrix_row(gradients, i)[j]);
+
+  custom_math::matrix_delete(gradients);
+  custom_math::matrix_delete(logits);
+}
+
+TEST(SoftmaxTests, Ties) {
+  // The first of the largest logits is the prediction.
+  custom_math::Matrix *logits = custom_math::matrix_create<double>(2, 3);
+  double values[] = {1, 2, 2, 0, 0, 0};
+  for (size_t i = 0; i < 6; i++) logits->elements[i] = values[i];
+
+  const int first[] = {1, 0};
+  const int second[] = {2, 1};
+  EXPECT_EQ(custom_math::softmax_cross_entropy(logits, first).correct, 2u);
+  EXPECT_EQ(custom_math::softmax_cross_entropy(logits, second).correct, 0u);
+  EXPECT_NEAR(custom_math::softmax_cross_entropy(logits, first).loss,
+              log(2 + exp(-1.)) + log(3.), 1e-14);
+
+  custom_math::matrix_delete(logits);
+}
+
+TEST(SoftmaxTests, Invalid) {
+  custom_math::Matrix *logits = custom_math::matrix_create<double>(2, 3);
+  custom_math::Matrix *wrong = custom_math::matrix_create<double>(3, 2);
+  for (size_t i = 0; i < 6; i++) logits->elements[i] = 0;
+  const int labels[] = {0, 2};
+  const int outside[] = {0, 3};
+
+  EXPECT_TRUE(isnan(custom_math::softmax_cross_entropy(logits, outside).loss));
+  EXPECT_TRUE(isnan(
+      custom_math::softmax_cross_entropy(logits, labels, wrong, 1.).loss));
+  EXPECT_EQ(custom_math::matrix_log_softmax_into(wrong, logits), nullptr);
+  EXPECT_NEAR(custom_math::softmax_cross_entropy(logits, labels).loss,
+              2 * log(3.), 1e-15);
+
+  custom_math::matrix_delete(wrong);
+  custom_math::matrix_delete(logits);
+}
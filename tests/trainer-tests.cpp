@@ -0,0 +1,200 @@
+/**
+ * @file trainer-tests.cpp
+ * @author Bogdan Ciurea (ciureabogdanalexandru@gmail.com)
+ * @brief This file contains the tests for the data-parallel trainer.
+ * @version 1.0
+ * @date 2023-08-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include "trainer.hpp"
+
+namespace {
+
+const size_t SIZES[] = {784, 32, 16, 10};
+const custom_math::Activation ACTIVATION = {custom_math::ACTIVATION_TANH, 0,
+                                            false};
+
+// Trains two copies of a network on the same batches, one with
+// network_train_batch and one with a trainer, and returns the largest
+// difference between their parameters.
+template <typename T>
+double compare(images::BasicDataset<T> *dataset, size_t threads,
+               neural::OptimizerType type, bool hogwild = false,
+               double weight_decay = 0) {
+  neural::BasicNetwork<T> *single =
+      neural::network_create<T>(SIZES, 4, &ACTIVATION, 2);
+  neural::BasicNetwork<T> *parallel =
+      neural::network_create<T>(SIZES, 4, &ACTIVATION, 2);
+  neural::BasicWorkspace<T> *workspace = neural::workspace_create(single, 50);
+  neural::OptimizerOptions options = neural::optimizer_default_options(type);
+  options.weight_decay = weight_decay;
+  neural::BasicOptimizer<T> *first =
+      neural::optimizer_create<T>(single->size, &options);
+  neural::BasicOptimizer<T> *second =
+      neural::optimizer_create<T>(single->size, &options);
+
+  neural::TrainerOptions trainer_options = neural::trainer_default_options();
+  trainer_options.threads = threads;
+  trainer_options.hogwild = hogwild;
+  neural::BasicTrainer<T> *trainer =
+      neural::trainer_create(parallel, 50, &trainer_options);
+  EXPECT_EQ(trainer->threads, threads);
+
+  for (size_t i = 0; i < 10; i++) {
+    // Batches of 50 and of 47 samples, not a multiple of the threads.
+    images::BasicBatch<T> batch =
+        images::dataset_batch(dataset, i * 50, i % 2 ? 47 : 50);
+    T expected = neural::network_train_batch(single, workspace, &batch, first);
+    T loss = neural::trainer_train_batch(trainer, parallel, &batch, second);
+    EXPECT_NEAR(loss, expected, 1e-5 * expected);
+  }
+  EXPECT_EQ(second->steps, first->steps * (hogwild ? threads : 1));
+
+  double difference = 0;
+  for (size_t i = 0; i < single->size; i++)
+    difference = fmax(difference, fabs((double)single->parameters[i] -
+                                       (double)parallel->parameters[i]));
+
+  neural::trainer_delete(trainer);
+  neural::optimizer_delete(second);
+  neural::optimizer_delete(first);
+  neural::workspace_delete(workspace);
+  neural::network_delete(parallel);
+  neural::network_delete(single);
+  return difference;
+}
+
+}  // namespace
+
+TEST(TrainerTests, OneThread) {
+  images::Dataset *dataset = images::read_test_dataset<double>();
+  ASSERT_NE(dataset, nullptr);
+  EXPECT_EQ(compare(dataset, 1, neural::OPTIMIZER_MOMENTUM), 0.);
+  images::dataset_delete(dataset);
+}
+
+TEST(TrainerTests, Shards) {
+  images::Dataset *dataset = images::read_test_dataset<double>();
+  ASSERT_NE(dataset, nullptr);
+  EXPECT_LT(compare(dataset, 3, neural::OPTIMIZER_SGD), 1e-13);
+  EXPECT_LT(compare(dataset, 4, neural::OPTIMIZER_ADAM), 1e-12);
+  EXPECT_LT(compare(dataset, 7, neural::OPTIMIZER_NESTEROV), 1e-13);
+  images::dataset_delete(dataset);
+}
+
+TEST(TrainerTests, Hogwild) {
+  // With a single thread, Hogwild is a step of gradient descent per batch,
+  // the weight decay included.
+  images::Dataset *doubles = images::read_test_dataset<double>();
+  ASSERT_NE(doubles, nullptr);
+  EXPECT_LT(compare(doubles, 1, neural::OPTIMIZER_SGD, true, 1e-3), 1e-13);
+  images::dataset_delete(doubles);
+
+  images::DatasetF *dataset = images::read_test_dataset<float>();
+  ASSERT_NE(dataset, nullptr);
+
+  const size_t sizes[] = {784, 64, 10};
+  const custom_math::Activation relu = {custom_math::ACTIVATION_RELU, 0,
+                                        false};
+  neural::NetworkF *network =
+      neural::network_create<float>(sizes, 3, &relu, 1);
+  neural::NetworkF *synchronous =
+      neural::network_create<float>(sizes, 3, &relu, 1);
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  options.learning_rate = 0.1;
+  neural::OptimizerF *optimizer =
+      neural::optimizer_create<float>(network->size, &options);
+  neural::OptimizerF *reference =
+      neural::optimizer_create<float>(network->size, &options);
+
+  neural::TrainerOptions trainer_options = neural::trainer_default_options();
+  trainer_options.threads = 4;
+  neural::TrainerF *steps =
+      neural::trainer_create(synchronous, 128, &trainer_options);
+  trainer_options.hogwild = true;
+  neural::TrainerF *trainer =
+      neural::trainer_create(network, 128, &trainer_options);
+  ASSERT_NE(trainer, nullptr);
+
+  double loss = 0, expected = 0;
+  for (size_t epoch = 0; epoch < 2; epoch++)
+    for (size_t first = 0; first < dataset->count; first += 128) {
+      images::BatchF batch = images::dataset_batch(dataset, first, 128);
+      float hogwild =
+          neural::trainer_train_batch(trainer, network, &batch, optimizer);
+      ASSERT_FALSE(isnan(hogwild));
+      float step =
+          neural::trainer_train_batch(steps, synchronous, &batch, reference);
+      if (epoch == 1) {
+        loss += hogwild;
+        expected += step;
+      }
+    }
+  // Four steps on the shards of every batch go further than one on the whole
+  // batch: the races cost Hogwild some of its updates, but not that many.
+  EXPECT_LT(loss, expected);
+  EXPECT_EQ(optimizer->steps, 4 * reference->steps);
+
+  // Hogwild only takes steps of gradient descent.
+  neural::OptimizerOptions adam =
+      neural::optimizer_default_options(neural::OPTIMIZER_ADAM);
+  neural::OptimizerF *other =
+      neural::optimizer_create<float>(network->size, &adam);
+  images::BatchF batch = images::dataset_batch(dataset, 0, 128);
+  EXPECT_TRUE(
+      isnan(neural::trainer_train_batch(trainer, network, &batch, other)));
+
+  neural::optimizer_delete(other);
+  neural::trainer_delete(trainer);
+  neural::trainer_delete(steps);
+  neural::optimizer_delete(reference);
+  neural::optimizer_delete(optimizer);
+  neural::network_delete(synchronous);
+  neural::network_delete(network);
+  images::dataset_delete(dataset);
+}
+
+TEST(TrainerTests, Invalid) {
+  neural::NetworkF *network =
+      neural::network_create<float>(SIZES, 4, &ACTIVATION);
+  neural::OptimizerOptions options =
+      neural::optimizer_default_options(neural::OPTIMIZER_SGD);
+  neural::OptimizerF *optimizer =
+      neural::optimizer_create<float>(network->size, &options);
+  neural::TrainerOptions trainer_options = neural::trainer_default_options();
+  trainer_options.threads = 8;
+
+  // No more threads than samples.
+  neural::TrainerF *trainer =
+      neural::trainer_create(network, 4, &trainer_options);
+  ASSERT_NE(trainer, nullptr);
+  EXPECT_EQ(trainer->threads, 4u);
+  EXPECT_EQ(neural::trainer_create(network, 0, &trainer_options), nullptr);
+
+  images::DatasetF *dataset = images::dataset_create<float>(5, 28, 28);
+  images::BatchF batch = images::dataset_batch(dataset, 0, 5);
+  EXPECT_TRUE(
+      isnan(neural::trainer_train_batch(trainer, network, &batch, optimizer)));
+
+  // A label out of the classes takes no step.
+  for (size_t i = 0; i < 5; i++) dataset->labels[i] = (int)i;
+  dataset->labels[3] = 10;
+  for (size_t i = 0; i < 4 * 784; i++) dataset->samples.elements[i] = 0.5f;
+  const float first = network->parameters[0];
+  batch = images::dataset_batch(dataset, 0, 4);
+  EXPECT_TRUE(
+      isnan(neural::trainer_train_batch(trainer, network, &batch, optimizer)));
+  EXPECT_EQ(network->parameters[0], first);
+
+  images::dataset_delete(dataset);
+  neural::trainer_delete(trainer);
+  neural::optimizer_delete(optimizer);
+  neural::network_delete(network);
+}